@@ -1,6 +1,7 @@
 #include <csignal>
 #include <vector>
 #include <functional>
+#include <string>
 
 #include "cracen2/sockets/AsioStreaming.hpp"
 #include "cracen2/sockets/BoostMpi.hpp"
@@ -19,9 +20,18 @@ void signalHandler(int) {
 	exit(0);
 }
 
-int main(int, char**) {
+int main(int argc, char** argv) {
 	// Reading config
 
+	if(argc > 1 && std::string(argv[1]) == "rma") {
+		// Takes part in the collective creation of the rma rings. Must match the clients, see TotalBandwidthMpi.
+		sockets::detail::MpiEngine::Configuration configuration;
+		configuration.duplicateCommunicator = false;
+		configuration.rmaSlots = 40;
+		configuration.rmaSlotSize = 574 * 1024;
+		sockets::detail::MpiEngine::setDefaultConfiguration(configuration);
+	}
+
 	// Adding signal handlers for clean up before termination
 
 	std::signal(SIGINT, signalHandler);
@@ -0,0 +1,50 @@
+#include "cracen2/network/Message.hpp"
+
+#include <array>
+#include <chrono>
+#include <iostream>
+
+using namespace cracen2::network;
+
+// Dispatch overhead per message of the static and the std::function visitor
+int main() {
+
+	constexpr int runs = 10000000;
+
+	using TL = std::tuple<int, char, float>;
+	using MyMessage = Message<TL>;
+
+	int i = 42;
+	char c = 'x';
+	float f = 3.1415;
+	std::array<MyMessage, 3> messages {{ MyMessage(i), MyMessage(c), MyMessage(f) }};
+
+	const auto measure = [&](auto& visitor) {
+		long sum = 0;
+		const auto begin = std::chrono::high_resolution_clock::now();
+		for(int run = 0; run < runs; run++) {
+			sum += messages[run % messages.size()].visit(visitor);
+		}
+		const auto end = std::chrono::high_resolution_clock::now();
+		// Keeps the loop from being optimised away
+		if(sum != long(runs / 3) * (42 + 'x' + 3) + (runs % 3 > 0 ? 42 : 0)) {
+			std::cerr << "Wrong dispatch sum " << sum << std::endl;
+		}
+		return std::chrono::duration<double, std::nano>(end - begin).count() / runs;
+	};
+
+	auto staticVisitor = MyMessage::make_visitor_helper<>::make_visitor(
+		[](int value) -> int { return value; },
+		[](char value) -> int { return value; },
+		[](float value) -> int { return static_cast<int>(value); }
+	);
+	std::cout << "Static visitor: " << measure(staticVisitor) << " ns per message" << std::endl;
+
+	MyMessage::Visitor<int> functionVisitor;
+	functionVisitor.add([](int value) -> int { return value; });
+	functionVisitor.add([](char value) -> int { return value; });
+	functionVisitor.add([](float value) -> int { return static_cast<int>(value); });
+	std::cout << "std::function visitor: " << measure(functionVisitor) << " ns per message" << std::endl;
+
+	return 0;
+}
@@ -182,9 +182,17 @@ struct TotalBandwidth {
 
 int main(int argc, char* argv[]) {
 	if(argc < 2) {
-		std::cout << "Add role as arg. ./TotalBandwidth <0..2>" << std::endl;
+		std::cout << "Add role as arg. ./TotalBandwidth <0..2> [rma]" << std::endl;
 		std::exit(1);
 	}
+	if(argc > 2 && std::string(argv[2]) == "rma") {
+		// The CracenServer must be started with rma as well, because the ring is created collectively
+		sockets::detail::MpiEngine::Configuration configuration;
+		configuration.duplicateCommunicator = false;
+		configuration.rmaSlots = 2 * queueSize;
+		configuration.rmaSlotSize = frameSize + 64 * KiB;
+		sockets::detail::MpiEngine::setDefaultConfiguration(configuration);
+	}
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 // 	TotalBandwidth<AsioDatagramSocket> run;
 // 	TotalBandwidth<AsioStreamingSocket> run;
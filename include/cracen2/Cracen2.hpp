@@ -3,10 +3,17 @@
 #include "util/AtomicQueue.hpp"
 #include "util/Thread.hpp"
 #include "CracenClient.hpp"
+#include "network/View.hpp"
 
+#include <condition_variable>
+#include <deque>
+#include <future>
 #include <initializer_list>
+#include <iostream>
+#include <mutex>
 #include <numeric>
 
+#include <boost/optional.hpp>
 #include <boost/variant.hpp>
 
 namespace cracen2 {
@@ -29,7 +36,8 @@ class Cracen2<SocketImplementation, Role, std::tuple<MessageTypeList...>> {
 public:
 
 	using TagList = std::tuple<backend::CracenClose, MessageTypeList...>;
-	using QueueType = std::tuple<util::AtomicQueue<MessageTypeList>...>;
+	// Received messages are queued as views of their receive buffers, so that the body is copied at most once
+	using QueueType = std::tuple<util::AtomicQueue<network::View<MessageTypeList>>...>;
 	using ClientType = CracenClient<SocketImplementation, TagList>;
 	using CracenType = Cracen2<SocketImplementation, Role, std::tuple<MessageTypeList...>>;
 	using RoleEndpointMap = typename ClientType::RoleEndpointMap::value_type;
@@ -47,9 +55,53 @@ private:
 		>
 	> pendingSends;
 
+	struct PooledSend;
+
+	// Completion of the send of a PooledSend to one endpoint
+	struct EndpointCompletion : network::SendCompletion {
+		PooledSend* pooled;
+
+		void complete(std::exception_ptr error) override {
+			if(error) {
+				try {
+					std::rethrow_exception(error);
+				} catch(const std::exception& e) {
+					std::cerr << "Cracen2: send failed: " << e.what() << std::endl;
+				}
+			}
+			if(--pooled->outstanding == 0) {
+				pooled->cracen->release(*pooled);
+			}
+		}
+	};
+
+	// A message on the allocation-free send path. It is recycled, once the sends to all endpoints completed.
+	struct PooledSend {
+		CracenType* cracen;
+		std::tuple<boost::optional<MessageTypeList>...> values;
+		// Grows to the largest number of endpoints, that one message was sent to
+		std::deque<EndpointCompletion> completions;
+		std::size_t used = 0;
+		// One per send in flight, plus one held by send, until all sends are started
+		std::atomic<std::size_t> outstanding;
+	};
+
+	// Same bound as for the pending futures
+	static constexpr std::size_t maxPooledSends = 200;
+
+	std::mutex sendPoolMutex;
+	std::condition_variable sendReleased;
+	std::deque<PooledSend> sendPool;
+	std::vector<PooledSend*> freeSends;
+	std::size_t pooledSendsInFlight;
+
+	// Fulfilled by the receiver, when the loopback CracenClose of release arrives
+	std::promise<void> closeReceived;
+
 	util::JoiningThread inputThread;
 	util::JoiningThread outputThread;
 
+	// Declared after the send pool, so that the sockets complete their sends before the pool is destroyed
 	ClientType client;
 
 	//input and output fifo;
@@ -57,11 +109,11 @@ private:
 	backend::RoleId roleId;
 
 	template <class T>
-	std::function<void(T, typename ClientType::Endpoint)> createVisitorLambda() {
-		return [this](T element, Endpoint) {
-			constexpr size_t id = util::tuple_index<util::AtomicQueue<T>, QueueType>::value;
+	std::function<void(network::View<T>, typename ClientType::Endpoint)> createVisitorLambda() {
+		return [this](network::View<T> element, Endpoint) {
+			constexpr size_t id = util::tuple_index<util::AtomicQueue<network::View<T>>, QueueType>::value;
 			auto& queue = std::get<id>(inputQueues);
-			queue.push(element);
+			queue.push(std::move(element));
 		};
 	}
 
@@ -74,8 +126,9 @@ private:
 		std::queue<std::future<void>> pendingReceives;
 
 		auto visitor = ClientType::make_visitor(
-			[&running](backend::CracenClose, Endpoint){
+			[this, &running](backend::CracenClose, Endpoint){
 				running = false;
+				closeReceived.set_value();
 			},
 			createVisitorLambda<MessageTypeList>()...
 		);
@@ -86,12 +139,84 @@ private:
 		}
 
 		while(client.isRunning() && running) {
-			pendingReceives.front().get();
+			try {
+				pendingReceives.front().get();
+			} catch(const std::exception&) {
+				// release closed the sockets without the CracenClose having arrived
+				if(!client.isRunning()) break;
+				throw;
+			}
 			pendingReceives.pop();
 			pendingReceives.push(client.asyncReceive(visitor));
 		}
 	}
 
+	void release(PooledSend& pooled) {
+		pooled.values = decltype(pooled.values)();
+		pooled.used = 0;
+		std::unique_lock<std::mutex> lock(sendPoolMutex);
+		freeSends.push_back(&pooled);
+		pooledSendsInFlight--;
+		sendReleased.notify_one();
+	}
+
+	// Sockets with completions send from a pooled copy of the value, without allocating once the pool is warm
+	template <class T, class SendPolicy>
+	void sendValue(T&& value, SendPolicy&& sendPolicy, std::true_type) {
+		using Type = std::remove_cv_t<std::remove_reference_t<T>>;
+		PooledSend* pooled;
+		{
+			std::unique_lock<std::mutex> lock(sendPoolMutex);
+			sendReleased.wait(lock, [this](){ return pooledSendsInFlight < maxPooledSends; });
+			if(freeSends.empty()) {
+				sendPool.emplace_back();
+				sendPool.back().cracen = this;
+				freeSends.push_back(&sendPool.back());
+			}
+			pooled = freeSends.back();
+			freeSends.pop_back();
+			pooledSendsInFlight++;
+		}
+
+		auto& stored = std::get<boost::optional<Type>>(pooled->values);
+		stored = std::forward<T>(value);
+		pooled->outstanding = 1;
+		try {
+			client.asyncSend(*stored, std::forward<SendPolicy>(sendPolicy), [pooled]() -> network::SendCompletion& {
+				if(pooled->used == pooled->completions.size()) {
+					pooled->completions.emplace_back();
+					pooled->completions.back().pooled = pooled;
+				}
+				pooled->outstanding++;
+				return pooled->completions[pooled->used++];
+			});
+		} catch(...) {
+			if(--pooled->outstanding == 0) release(*pooled);
+			throw;
+		}
+		if(--pooled->outstanding == 0) {
+			release(*pooled);
+		}
+	}
+
+	template <class T, class SendPolicy>
+	void sendValue(T&& value, SendPolicy&& sendPolicy, std::false_type) {
+
+		while(pendingSends.size() > 20) {};
+
+		auto buffer = std::make_shared<std::remove_reference_t<T>>(std::forward<T>(value));
+		auto futures = client.asyncSend(*buffer, std::forward<SendPolicy>(sendPolicy));
+
+		for(auto& f : futures) {
+			pendingSends.push(
+				std::make_pair(
+					std::move(f),
+					boost::variant<std::shared_ptr<MessageTypeList>...>(buffer)
+				)
+			);
+		}
+	}
+
 	void sender() {
 
 		while(client.isRunning()) {
@@ -114,11 +239,29 @@ public:
 	 * @param cracenServerEndpoint endpoint of the managment server. Upon creation, cracen2 will establish
 	 * a connection to the server in order to get information about participants, that enter or leave the context.
 	 * @param role The object, that maps this instance to a logical node in the communication graph.
+	 * @param features backend::Features requested for the context, e.g. the extended header.
+	 */
+	Cracen2(Endpoint cracenServerEndpoint, Role role, std::uint32_t features = backend::Features::none) :
+		inputQueues{Role::template InputQueueSize<MessageTypeList>::value...},
+		pendingSends(200),
+		pooledSendsInFlight(0),
+		client(cracenServerEndpoint, role.roleId, role.roleConnectionGraph, features),
+		roleId(role.roleId)
+	{
+		inputThread = { "Cracen2::ionputThread", &CracenType::receiver, this };
+		outputThread = { "Cracen2::outputThread", &Cracen2::sender, this };
+	}
+
+	/* @brief Cracen2 constructor with sockets constructed from configuration
+	 * @param configuration e.g. a BoostMpiSocket::Configuration, that selects the engine of this instance. Instances
+	 * on separate engines do not share any progress state.
 	 */
-	Cracen2(Endpoint cracenServerEndpoint, Role role) :
+	template <class SocketConfiguration>
+	Cracen2(Endpoint cracenServerEndpoint, Role role, std::uint32_t features, const SocketConfiguration& configuration) :
 		inputQueues{Role::template InputQueueSize<MessageTypeList>::value...},
 		pendingSends(200),
-		client(cracenServerEndpoint, role.roleId, role.roleConnectionGraph),
+		pooledSendsInFlight(0),
+		client(cracenServerEndpoint, role.roleId, role.roleConnectionGraph, features, configuration),
 		roleId(role.roleId)
 	{
 		inputThread = { "Cracen2::ionputThread", &CracenType::receiver, this };
@@ -129,7 +272,7 @@ public:
 	{
 		std::vector<int>{
 			std::get<
-				util::tuple_index<util::AtomicQueue<MessageTypeList>, QueueType>::value
+				util::tuple_index<util::AtomicQueue<network::View<MessageTypeList>>, QueueType>::value
 			>(inputQueues).destroy()...
 		};
 	}
@@ -163,24 +306,17 @@ public:
 	/*
 	 * @param value, value to be send
 	 * @param sendPolicy functor, that picks all endpoints, to which the value shall be sendet. Cracen comes with the following
-	 * send_policies implemented: round_robin, broadcast, and single.
+	 * send_policies implemented: round_robin, broadcast, and single. If the socket supports completions, the
+	 * send does not allocate for messages, that are not composites.
 	 */
 	template <class T, class SendPolicy>
 	void send(T&& value, SendPolicy&& sendPolicy) {
-
-		while(pendingSends.size() > 20) {};
-
-		auto buffer = std::make_shared<std::remove_reference_t<T>>(std::forward<T>(value));
-		auto futures = client.asyncSend(*buffer, std::forward<SendPolicy>(sendPolicy));
-
-		for(auto& f : futures) {
-			pendingSends.push(
-				std::make_pair(
-					std::move(f),
-					boost::variant<std::shared_ptr<MessageTypeList>...>(buffer)
-				)
-			);
-		}
+		using Type = std::remove_cv_t<std::remove_reference_t<T>>;
+		sendValue(
+			std::forward<T>(value),
+			std::forward<SendPolicy>(sendPolicy),
+			std::integral_constant<bool, network::supports_completion<SocketImplementation>::value && !network::is_composite<Type>::value>()
+		);
 	}
 
 
@@ -189,18 +325,20 @@ public:
 	 */
 	template <class T>
 	std::size_t count() {
-		constexpr size_t id = util::tuple_index<util::AtomicQueue<T>, QueueType>::value;
+		constexpr size_t id = util::tuple_index<util::AtomicQueue<network::View<T>>, QueueType>::value;
 		return std::get<id>(inputQueues).size();
 	}
 
 	/*
 	 * @brief blocking receive operation
-	 * @result returns a value of type T, that has been received on an edge.
+	 * @result returns a value of type T, that has been received on an edge. T may be a network::View of a
+	 * message type, which aliases the receive buffer instead of copying the message.
 	 */
 	template <class T>
 	T receive() {
-		constexpr size_t id = util::tuple_index<util::AtomicQueue<T>, QueueType>::value;
-		return std::get<id>(inputQueues).pop();
+		using Type = typename network::MessageArgument<T>::Type;
+		constexpr size_t id = util::tuple_index<util::AtomicQueue<network::View<Type>>, QueueType>::value;
+		return network::MessageArgument<T>::from(std::get<id>(inputQueues).pop());
 	}
 
 // 	template <class Visitor>
@@ -230,17 +368,32 @@ public:
 		client.printStatus();
 	}
 
+	/*
+	 * @brief loss, reordering and one-way latency of the messages received from remote, if the context uses the extended header.
+	 */
+	auto getEdgeStatistics(const Endpoint& remote) const {
+		return client.getEdgeStatistics(remote);
+	}
+
 	/*
 	 *  @brief release the cracen. Finalize the context and safely close all connections.
 	 */
 	void release() {
+		auto closed = closeReceived.get_future();
 		client.loopback(backend::CracenClose());
+		// A completed send does not mean, that the loopback message has been delivered yet. Give the receiver
+		// some time to process it, before the sockets are closed. A lost CracenClose must not block the release.
+		closed.wait_for(std::chrono::seconds(1));
 		client.stop();
 		while(client.isRunning()) {
 			std::this_thread::sleep_for(std::chrono::milliseconds(1));
 		}
+		inputThread = util::JoiningThread();
 	}
 
 }; // End of class cracen2
 
+template<class SocketImplementation, class Role, class... MessageTypeList>
+constexpr std::size_t Cracen2<SocketImplementation, Role, std::tuple<MessageTypeList...>>::maxPooledSends;
+
 } // End of namespace cracen2
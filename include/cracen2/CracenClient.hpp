@@ -52,6 +52,10 @@ private:
 
 	void alive();
 
+	// Binds the communicators and registers with the server, until the context is ready
+	template <class RoleGraphContainerType>
+	void join(const RoleGraphContainerType& roleGraph, std::uint32_t features);
+
 public:
 
 	/*
@@ -60,9 +64,17 @@ public:
 	 * participants that enter or leave the context.
 	 * @param roleId The logical id of this node
 	 * @param roleGraph the communication graph.
+	 * @param features backend::Features requested for the context. The participant, that creates the context, decides for all.
 	 */
 	template <class RoleGraphContainerType>
-	CracenClient(Endpoint serverEndpoint, backend::RoleId roleId, const RoleGraphContainerType& roleGraph);
+	CracenClient(Endpoint serverEndpoint, backend::RoleId roleId, const RoleGraphContainerType& roleGraph, std::uint32_t features = backend::Features::none);
+
+	/*
+	 * Same as above, but the sockets of the client are constructed from configuration, e.g. a
+	 * BoostMpiSocket::Configuration, that selects the engine of the client.
+	 */
+	template <class RoleGraphContainerType, class SocketConfiguration>
+	CracenClient(Endpoint serverEndpoint, backend::RoleId roleId, const RoleGraphContainerType& roleGraph, std::uint32_t features, const SocketConfiguration& configuration);
 
 	/*
 	 * @brief helper function to make a valid visitor object from lambda functions.
@@ -91,6 +103,15 @@ public:
 	template <class T, class SendPolicy>
 	std::vector<std::future<void>> asyncSend(const T& message, SendPolicy sendPolicy);
 
+	/*
+	 * Allocation-free version of asyncSend, if the socket supports completions (see network::supports_completion).
+	 * @param acquire is called once per picked endpoint and returns the network::SendCompletion of that send.
+	 * message must stay valid, until all of them have been completed. The send policy has to offer forEach.
+	 * @result number of sends
+	 */
+	template <class T, class SendPolicy, class Acquire>
+	std::size_t asyncSend(const T& message, SendPolicy sendPolicy, Acquire&& acquire);
+
 	/*
 	 * blocking receive. Since there are no message queses, the type of the message has to be guessed right. If the type of the received message does not equal T, a exception will be thrown. This exception can be cought, but the message will be lost. If the type of the received message is not known, this function should not be called.
 	 */
@@ -155,6 +176,11 @@ public:
 	 */
 	void printStatus() const;
 
+	/*
+	 * @brief loss, reordering and latency of the messages received from remote. Requires the extended header feature.
+	 */
+	typename DataCommunicator::EdgeStatistics getEdgeStatistics(const Endpoint& remote) const;
+
 }; // End of class CracenClient
 
 template <class SocketImplementation, class DataTagList>
@@ -188,6 +214,8 @@ void CracenClient<SocketImplementation, DataTagList>::alive() {
 				auto roleCommunicatorView = roleEndpointMap.getView();
 				auto& map = roleCommunicatorView->get();
 				map[embody.roleId].push_back(embody.endpoint);
+				// Warm up the connection, so that the first frames to the new participant are not delayed
+				dataCommunicator.connect(embody.endpoint);
 			} catch(const std::exception& e) {
 				std::cerr << "Could not connect to " << embody.endpoint << ". Ignoring embody(" << embody.roleId << ")"<< std::endl;
 			}
@@ -200,6 +228,7 @@ void CracenClient<SocketImplementation, DataTagList>::alive() {
 				auto roleCommunicatorView = roleEndpointMap.getView();
 				auto& map = roleCommunicatorView->get();
 				map[announce.roleId].push_back(announce.endpoint);
+				dataCommunicator.connect(announce.endpoint);
 			} catch(const std::exception& e) {
 				std::cerr << "Could not connect to " << announce.endpoint << ". Ignoring embody(" << announce.roleId << ")"<< std::endl;
 			}
@@ -213,21 +242,39 @@ void CracenClient<SocketImplementation, DataTagList>::alive() {
 
 template <class SocketImplementation, class DataTagList>
 template <class RoleGraphContainerType>
-CracenClient<SocketImplementation, DataTagList>::CracenClient(Endpoint serverEndpoint, backend::RoleId roleId, const RoleGraphContainerType& roleGraph) :
+CracenClient<SocketImplementation, DataTagList>::CracenClient(Endpoint serverEndpoint, backend::RoleId roleId, const RoleGraphContainerType& roleGraph, std::uint32_t features) :
 	roleId(roleId),
 	serverEndpoint(serverEndpoint),
 	running(true)
 {
+	join(roleGraph, features);
+}
+
+template <class SocketImplementation, class DataTagList>
+template <class RoleGraphContainerType, class SocketConfiguration>
+CracenClient<SocketImplementation, DataTagList>::CracenClient(Endpoint serverEndpoint, backend::RoleId roleId, const RoleGraphContainerType& roleGraph, std::uint32_t features, const SocketConfiguration& configuration) :
+	roleId(roleId),
+	serverEndpoint(serverEndpoint),
+	serverCommunicator(SocketImplementation(configuration)),
+	dataCommunicator(SocketImplementation(configuration)),
+	running(true)
+{
+	join(roleGraph, features);
+}
+
+template <class SocketImplementation, class DataTagList>
+template <class RoleGraphContainerType>
+void CracenClient<SocketImplementation, DataTagList>::join(const RoleGraphContainerType& roleGraph, std::uint32_t features) {
 	dataCommunicator.bind();
 	serverCommunicator.bind();
 	std::cout << "send register to " << serverEndpoint << std::endl;
-	serverCommunicator.sendTo(backend::Register(), serverEndpoint);
+	serverCommunicator.sendTo(backend::Register { features }, serverEndpoint);
 
 	bool contextReady = false;
 	unsigned int edges = 0;
 
 	auto contextCreationVisitor = ServerCommunicator::make_visitor(
-		[this, &roleGraph, serverEndpoint](backend::RoleGraphRequest, Endpoint){
+		[this, &roleGraph](backend::RoleGraphRequest, Endpoint){
 			// Request from server to send role graph
 			for(const auto edge : roleGraph) {
 				// send connections one by one
@@ -236,7 +283,11 @@ CracenClient<SocketImplementation, DataTagList>::CracenClient(Endpoint serverEnd
 			serverCommunicator.sendTo(backend::RolesComplete(), serverEndpoint);
 		},
 		[&edges](backend::AddRoleConnection, Endpoint){ ++edges; },
-		[&contextReady](backend::RolesComplete, Endpoint){
+		[this, &contextReady](backend::RolesComplete rolesComplete, Endpoint){
+			// The data communicator has not sent anything yet
+			if(rolesComplete.features & backend::Features::extendedHeader) {
+				dataCommunicator.enableExtendedHeader();
+			}
 			contextReady = true;
 		}
 	);
@@ -282,6 +333,19 @@ std::vector<std::future<void>> CracenClient<SocketImplementation, DataTagList>::
 	return result;
 }
 
+template <class SocketImplementation, class DataTagList>
+template <class T, class SendPolicy, class Acquire>
+std::size_t CracenClient<SocketImplementation, DataTagList>::asyncSend(const T& message, SendPolicy sendPolicy, Acquire&& acquire) {
+	return roleEndpointMap.read([&](const auto& map) {
+		std::size_t sends = 0;
+		sendPolicy.forEach(map, [&](const Endpoint& ep) {
+			dataCommunicator.asyncSendTo(message, ep, acquire());
+			sends++;
+		});
+		return sends;
+	});
+}
+
 template <class SocketImplementation, class DataTagList>
 template<class T>
 T CracenClient<SocketImplementation, DataTagList>::receive() {
@@ -359,4 +423,9 @@ void CracenClient<SocketImplementation, DataTagList>::printStatus() const {
 	std::cout << status.rdbuf();
 }
 
+template <class SocketImplementation, class DataTagList>
+typename CracenClient<SocketImplementation, DataTagList>::DataCommunicator::EdgeStatistics CracenClient<SocketImplementation, DataTagList>::getEdgeStatistics(const Endpoint& remote) const {
+	return dataCommunicator.getEdgeStatistics(remote);
+}
+
 } // End of namespace cracen2
@@ -58,6 +58,8 @@ public:
 private:
 
 	State state;
+	// Taken from the participant, that initialises the context
+	std::uint32_t features;
 	GraphConnectionType roleGraphConnections;
 	ParticipantMapType participants;
 
@@ -84,6 +86,13 @@ public:
 	 */
 	CracenServer(Endpoint endpoint = Endpoint());
 
+	/*
+	 * Same as above, but the socket of the server is constructed from configuration, e.g. a
+	 * BoostMpiSocket::Configuration, that selects the engine of the server.
+	 */
+	template <class SocketConfiguration>
+	CracenServer(Endpoint endpoint, const SocketConfiguration& configuration);
+
 	/*
 	 * stop the server. Destruct context and close all connections.
 	 */
@@ -103,7 +112,19 @@ public:
 
 template <class SocketImplementation>
 CracenServer<SocketImplementation>::CracenServer(CracenServer::Endpoint endpoint) :
-	state(State::ContextUninitialised)
+	state(State::ContextUninitialised),
+	features(backend::Features::none)
+{
+	communicator.bind(endpoint);
+	serverThread = util::JoiningThread("CracenServer::serverThread", &CracenServer::serverFunction, this);
+}
+
+template <class SocketImplementation>
+template <class SocketConfiguration>
+CracenServer<SocketImplementation>::CracenServer(CracenServer::Endpoint endpoint, const SocketConfiguration& configuration) :
+	state(State::ContextUninitialised),
+	features(backend::Features::none),
+	communicator(SocketImplementation(configuration))
 {
 	communicator.bind(endpoint);
 	serverThread = util::JoiningThread("CracenServer::serverThread", &CracenServer::serverFunction, this);
@@ -139,13 +160,14 @@ void CracenServer<SocketImplementation>::serverFunction() {
 	std::vector<Endpoint> registerQueue;
 	bool running = true;
 	auto visitor = Communicator::make_visitor(
-		[this, &registerQueue](backend::Register, Endpoint from){
+		[this, &registerQueue](backend::Register reg, Endpoint from){
  			std::cout << "Server: Received register, server state = " << static_cast<unsigned int>(state) << std::endl;
 			switch(state) {
 				case State::ContextUninitialised:
 					// First client is connecting
 // 					std::cout << "Server: First client connected. Initialising Context..." << std::endl;
 					state = State::ContextInizialising;
+					features = reg.features;
 					communicator.sendTo(backend::RoleGraphRequest(), from);
 					registerQueue.push_back(from);
 					break;
@@ -155,7 +177,7 @@ void CracenServer<SocketImplementation>::serverFunction() {
 				case State::ContextInitialised:
 // 					std::cout << "Server: send roles complete" << std::endl;
 					// Package was delayed. Send to endpoint from reg package
-					communicator.sendTo(backend::RolesComplete(), from);
+					communicator.sendTo(backend::RolesComplete { features }, from);
 					break;
 			}
 		},
@@ -170,6 +192,7 @@ void CracenServer<SocketImplementation>::serverFunction() {
 				std::cout << "Server: 	" << edge.first << "->" << edge.second << std::endl;
 			}
 			state = State::ContextInitialised;
+			rolesComplete.features = features;
 // 			std::cout << "Server: send roles complete" << std::endl;
 			for(const Endpoint& ep : registerQueue) {
  				std::cout << "Server: send roles complete" << std::endl;
@@ -7,7 +7,10 @@ namespace cracen2 {
 
 namespace backend {
 
-struct Register {};
+struct Register {
+	// Features requested for the context
+	std::uint32_t features = Features::none;
+};
 
 struct RoleGraphRequest{};
 
@@ -16,7 +19,10 @@ struct AddRoleConnection{
 	RoleId to;
 };
 
-struct RolesComplete{};
+struct RolesComplete{
+	// Features of the context
+	std::uint32_t features = Features::none;
+};
 
 template <class Endpoint>
 struct Embody {
@@ -11,6 +11,14 @@ namespace backend {
 using RoleId = std::uint32_t;
 using ParticipantId = std::uint32_t;
 
+// Optional protocol features of a context as a bit mask. The participant, that creates the context, decides.
+struct Features {
+	enum : std::uint32_t {
+		none = 0,
+		extendedHeader = 1 << 0
+	};
+};
+
 } // End of namespace backend
 
 } // End of namespace cracen2
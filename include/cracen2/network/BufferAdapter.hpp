@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <type_traits>
 #include <vector>
 #include <array>
@@ -50,11 +51,8 @@ struct BufferAdapter<
 
 	Type cast() const {
 		Type result;
-		memcpy(
-			&result,
-			data,
-			std::min(size, sizeof(result))
-		);
+		// Through void*, Type may be a class type without a trivial copy assignment
+		memcpy(static_cast<void*>(&result), data, std::min(size, sizeof(result)));
 		return result;
 	}
 
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+namespace cracen2 {
+
+namespace network {
+
+/*
+ * Owner of memory, that a Buffer borrows instead of taking it from the BufferPool, e.g. the ring of a
+ * socket. release may be called from any thread.
+ */
+class BufferOwner {
+public:
+	virtual void release(std::uint8_t* data) = 0;
+
+protected:
+	~BufferOwner() = default;
+};
+
+/*
+ * Deleter for memory handed out by the BufferPool. Memory, that is not part of a size class
+ * (sizeClass < 0), is released with delete[]. Borrowed memory goes back to its owner.
+ */
+struct BufferDeleter {
+	int sizeClass = -1;
+	BufferOwner* owner = nullptr;
+
+	BufferDeleter() = default;
+	BufferDeleter(int sizeClass) : sizeClass(sizeClass) {}
+	explicit BufferDeleter(BufferOwner* owner) : owner(owner) {}
+
+	void operator()(std::uint8_t* data) const;
+};
+
+/*
+ * Process wide slab pool for network buffers. Requests are rounded up to a power of two size class.
+ * Released blocks go back into a small thread local cache first and into a shared free list, if the
+ * cache is full. Recycling the blocks avoids the allocator and the page faults on freshly mapped
+ * memory for every received frame. Requests larger than the biggest size class are not pooled.
+ * The idle memory of the shared free lists is bounded by a high-water mark over all size classes,
+ * blocks released above it are freed.
+ */
+class BufferPool {
+public:
+
+	using Pointer = std::unique_ptr<std::uint8_t[], BufferDeleter>;
+
+	static constexpr std::size_t minSizeClassLog2 = 8; // 256 Byte
+	static constexpr std::size_t maxSizeClassLog2 = 24; // 16 MiB
+	static constexpr std::size_t sizeClasses = maxSizeClassLog2 - minSizeClassLog2 + 1;
+
+	struct Statistics {
+		// Allocations served from a cache or free list
+		std::uint64_t hits;
+		// Allocations of a size class, that required fresh memory
+		std::uint64_t misses;
+		// Allocations bigger than the biggest size class
+		std::uint64_t unpooled;
+		// Bytes kept in the shared free lists
+		std::uint64_t idleBytes;
+	};
+
+	static constexpr std::size_t defaultIdleLimit = 256*1024*1024;
+
+	static Pointer allocate(std::size_t size);
+	static void deallocate(std::uint8_t* data, int sizeClass);
+
+	// Returns -1 if size is not served by a size class
+	static int sizeClass(std::size_t size);
+	static std::size_t sizeClassCapacity(int sizeClass);
+
+	// High-water mark of the shared free lists. Lowering it does not free blocks, see trim.
+	static void setIdleLimit(std::size_t bytes);
+	// Frees the blocks of the shared free lists and of the cache of the calling thread
+	static void trim();
+
+	// Sums the counters of all threads
+	static Statistics statistics();
+	static void resetStatistics();
+
+}; // End of class BufferPool
+
+} // End of namespace network
+
+} // End of namespace cracen2
@@ -1,8 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <future>
+#include <map>
+#include <memory>
+#include <mutex>
 
 #include "Message.hpp"
+#include "Completion.hpp"
 #include "cracen2/util/Demangle.hpp"
 #include "cracen2/util/Tuple.hpp"
 
@@ -10,6 +17,56 @@ namespace cracen2 {
 
 namespace network {
 
+namespace detail {
+
+// Sockets without connection setup, have nothing to prepare
+template <class Socket, class Endpoint>
+auto connect(Socket& socket, const Endpoint& remote, int) -> decltype(socket.connect(remote)) {
+	return socket.connect(remote);
+}
+
+template <class Socket, class Endpoint>
+void connect(Socket&, const Endpoint&, long) {}
+
+// Sockets with gather writes send the pieces of a composite as they are, all others get one packed copy
+template <class Socket, class Type, class Endpoint>
+auto sendPieces(Socket& socket, const Serialized<Type>& body, Buffer&, const Endpoint& remote, const ImmutableBuffer& header, int)
+	-> decltype(socket.asyncSendTo(body.pieces(), remote, header))
+{
+	return socket.asyncSendTo(body.pieces(), remote, header);
+}
+
+// Sockets, that take over Buffers, get the packed copy moved in instead of copying it again. The header
+// stays borrowed, the socket copies it like for any other send.
+template <class Socket, class Endpoint>
+auto sendPacked(Socket& socket, Buffer& packed, const Endpoint& remote, const ImmutableBuffer& header, int)
+	-> decltype(socket.asyncSendTo(std::move(packed), remote, header))
+{
+	return socket.asyncSendTo(std::move(packed), remote, header);
+}
+
+template <class Socket, class Endpoint>
+std::future<void> sendPacked(Socket& socket, Buffer& packed, const Endpoint& remote, const ImmutableBuffer& header, long) {
+	return socket.asyncSendTo(ImmutableBuffer(packed.data(), packed.size()), remote, header);
+}
+
+template <class Socket, class Type, class Endpoint>
+std::future<void> sendPieces(Socket& socket, const Serialized<Type>& body, Buffer& packed, const Endpoint& remote, const ImmutableBuffer& header, long) {
+	packed = body.pack();
+	return sendPacked(socket, packed, remote, header, 0);
+}
+
+} // End of namespace detail
+
+/*
+ * Completion of an allocation-free Communicator send. It stores the header of the message, so that it
+ * stays valid while the send is queued. Usually derived and recycled by a CompletionPool.
+ */
+struct SendCompletion : Completion {
+	// Only the leading Header is sent, if the extended header is disabled
+	ExtendedHeader header;
+};
+
 /*
  * The Communicator combines the abstraction of the network::Socket and network::Message
  */
@@ -22,6 +79,22 @@ public:
 
 	using typename Socket::Endpoint;
 
+	/*
+	 * What the extended headers of one remote revealed so far. Messages, that arrive after a later one,
+	 * count as reordered and no longer as lost. Only the last 64 sequence numbers are tracked, so messages,
+	 * that arrive later than that, stay lost. Messages, that arrive again, count as duplicated. Messages,
+	 * whose body does not have the length it was sent with, count as truncated.
+	 */
+	struct EdgeStatistics {
+		std::uint64_t received = 0;
+		std::uint64_t lost = 0;
+		std::uint64_t reordered = 0;
+		std::uint64_t duplicated = 0;
+		std::uint64_t truncated = 0;
+		// One-way latency of the last message
+		std::chrono::nanoseconds latency = std::chrono::nanoseconds(0);
+	};
+
 	template <class... Functors>
 	static auto make_visitor(Functors&&... functors);
 
@@ -41,13 +114,39 @@ public:
 	Communicator(const Communicator& other) = delete;
 	Communicator& operator=(const Communicator& other) = delete;
 
+	/*
+	 * Send the ExtendedHeader instead of the minimal Header from now on. Should be called before the first
+	 * send, usually as negotiated by the context. Received extended headers are always evaluated.
+	 */
+	void enableExtendedHeader();
+	bool hasExtendedHeader() const;
+
+	EdgeStatistics getEdgeStatistics(const Endpoint& remote) const;
+
+	/*
+	 * Prepare the connection to remote ahead of the first send, if the socket backend is connection based.
+	 */
+	void connect(const Endpoint& remote);
+
 	template <class T>
 	void sendTo(const T& data, const Endpoint remote);
 
+	/*
+	 * Composite types (see Members) are sent as their pieces. data must stay valid, until the future is
+	 * ready.
+	 */
 	template <class T>
 	std::future<void> asyncSendTo(const T& data, const Endpoint remote);
 
+	/*
+	 * Sends without allocating, if the socket supports completions. data must stay valid, until completion
+	 * is called. Composite types are not supported.
+	 */
+	template <class T>
+	void asyncSendTo(const T& data, const Endpoint remote, SendCompletion& completion);
+
 	// This has to be used with extreme caution. Guessing the wrong type will cause packages to be droped and exception to be thrown
+	// T may be a View<U> of a type U of the TagList, which takes over the receive buffer instead of copying the body.
 	template <class T>
 	std::pair<T, Endpoint> receiveFrom();
 
@@ -67,6 +166,36 @@ public:
 	template <class Visitor>
 	std::future<typename std::remove_reference_t<Visitor>::Result> asyncReceive(Visitor&& visitor);
 
+private:
+
+	struct EdgeState {
+		std::uint32_t expected = 0;
+		// Bit k is set, while the sequence number expected - 1 - k is counted as lost
+		std::uint64_t missing = 0;
+		EdgeStatistics statistics;
+	};
+
+	// Kept on the heap, so that pending receives do not depend on the address of the Communicator
+	struct HeaderState {
+		std::atomic<bool> extended;
+		mutable std::mutex mutex;
+		std::map<Endpoint, std::uint32_t> sequences;
+		std::map<Endpoint, EdgeState> edges;
+
+		HeaderState() : extended(false) {}
+	};
+
+	std::unique_ptr<HeaderState> headerState = std::make_unique<HeaderState>();
+
+	ExtendedHeader makeExtendedHeader(const Header& header, const ImmutableBuffer& body, const Endpoint& remote);
+
+	template <class T>
+	std::future<void> sendMessage(const T& data, const Endpoint& remote, std::false_type);
+	template <class T>
+	std::future<void> sendMessage(const T& data, const Endpoint& remote, std::true_type);
+
+	static Header receiveHeader(HeaderState& state, const Buffer& header, std::size_t bodySize, const Endpoint& remote);
+
 }; // End of class Communicator
 
 template <class Socket, class TagList>
@@ -75,6 +204,83 @@ auto Communicator<Socket, TagList>::make_visitor(Functors&&... functors) {
 	return Message::template make_visitor_helper<Endpoint>::make_visitor(std::forward<Functors>(functors)...);
 };
 
+template <class Socket, class TagList>
+void Communicator<Socket, TagList>::connect(const Endpoint& remote) {
+	detail::connect(static_cast<Socket&>(*this), remote, 0);
+}
+
+template <class Socket, class TagList>
+void Communicator<Socket, TagList>::enableExtendedHeader() {
+	headerState->extended = true;
+}
+
+template <class Socket, class TagList>
+bool Communicator<Socket, TagList>::hasExtendedHeader() const {
+	return headerState->extended;
+}
+
+template <class Socket, class TagList>
+typename Communicator<Socket, TagList>::EdgeStatistics Communicator<Socket, TagList>::getEdgeStatistics(const Endpoint& remote) const {
+	std::unique_lock<std::mutex> lock(headerState->mutex);
+	auto it = headerState->edges.find(remote);
+	return it != headerState->edges.end() ? it->second.statistics : EdgeStatistics();
+}
+
+template <class Socket, class TagList>
+ExtendedHeader Communicator<Socket, TagList>::makeExtendedHeader(const Header& header, const ImmutableBuffer& body, const Endpoint& remote) {
+	ExtendedHeader extended;
+	extended.header = header;
+	extended.flags = 0;
+	{
+		std::unique_lock<std::mutex> lock(headerState->mutex);
+		extended.sequence = headerState->sequences[remote]++;
+	}
+	extended.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	extended.length = body.size;
+	return extended;
+}
+
+template <class Socket, class TagList>
+Header Communicator<Socket, TagList>::receiveHeader(HeaderState& state, const Buffer& header, std::size_t bodySize, const Endpoint& remote) {
+	Header result;
+	std::memcpy(&result, header.data(), sizeof(result));
+	if(header.size() != sizeof(ExtendedHeader)) {
+		return result;
+	}
+
+	ExtendedHeader extended;
+	std::memcpy(&extended, header.data(), sizeof(extended));
+	const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+	std::unique_lock<std::mutex> lock(state.mutex);
+	auto& edge = state.edges[remote];
+	auto& statistics = edge.statistics;
+	statistics.received++;
+	statistics.latency = std::chrono::nanoseconds(static_cast<std::int64_t>(now - extended.timestamp));
+	if(extended.length != bodySize) {
+		statistics.truncated++;
+	}
+	// Sequence numbers wrap around, so the distance decides, whether a message is early or late
+	const std::int32_t distance = static_cast<std::int32_t>(extended.sequence - edge.expected);
+	if(distance >= 0) {
+		statistics.lost += distance;
+		edge.expected = extended.sequence + 1;
+		const std::uint64_t skipped = distance >= 63 ? ~std::uint64_t(1) : ((std::uint64_t(1) << distance) - 1) << 1;
+		edge.missing = (distance >= 63 ? 0 : edge.missing << (distance + 1)) | skipped;
+	} else {
+		const std::uint32_t late = static_cast<std::uint32_t>(-(distance + 1));
+		const std::uint64_t bit = late < 64 ? std::uint64_t(1) << late : 0;
+		if(edge.missing & bit) {
+			edge.missing &= ~bit;
+			statistics.reordered++;
+			statistics.lost--;
+		} else if(bit) {
+			statistics.duplicated++;
+		}
+	}
+	return result;
+}
+
 template <class Socket, class TagList>
 template <class T>
 void Communicator<Socket, TagList>::sendTo(const T& data, const Endpoint remote) {
@@ -84,7 +290,24 @@ void Communicator<Socket, TagList>::sendTo(const T& data, const Endpoint remote)
 template <class Socket, class TagList>
 template <class T>
 std::future<void> Communicator<Socket, TagList>::asyncSendTo(const T& data, const Endpoint remote) {
+	return sendMessage(data, remote, is_composite<T>());
+}
+
+template <class Socket, class TagList>
+template <class T>
+std::future<void> Communicator<Socket, TagList>::sendMessage(const T& data, const Endpoint& remote, std::false_type) {
 	auto message = std::make_unique<Message>(data);
+	if(headerState->extended) {
+		auto extended = std::make_unique<ExtendedHeader>(makeExtendedHeader(message->getHeader(), message->getBody(), remote));
+		auto result = Socket::asyncSendTo(message->getBody(), remote, ImmutableBuffer(reinterpret_cast<std::uint8_t*>(extended.get()), sizeof(ExtendedHeader)));
+		return std::async(
+			std::launch::deferred,
+			[result = std::move(result), message = std::move(message), extended = std::move(extended)]() mutable
+			{
+				result.get();
+			}
+		);
+	}
 	auto& header = message->getHeader();
 	auto result = Socket::asyncSendTo(message->getBody(), remote, ImmutableBuffer(reinterpret_cast<std::uint8_t*>(&header), sizeof(header)));
 	return std::async(
@@ -97,6 +320,64 @@ std::future<void> Communicator<Socket, TagList>::asyncSendTo(const T& data, cons
 	);
 }
 
+template <class Socket, class TagList>
+template <class T>
+std::future<void> Communicator<Socket, TagList>::sendMessage(const T& data, const Endpoint& remote, std::true_type) {
+	static_assert(
+		cracen2::util::tuple_contains_type<T, TagList>::value,
+		"TagList must include the the type, that shall be casted into a message."
+	);
+
+	// Everything the socket points into, until the send is done
+	struct Pending {
+		Serialized<T> body;
+		ExtendedHeader header;
+		Buffer packed;
+
+		explicit Pending(const T& data) : body(data) {}
+	};
+
+	auto pending = std::make_unique<Pending>(data);
+	const Header header { cracen2::util::tuple_index<T, TagList>::value };
+	std::size_t headerSize = sizeof(Header);
+	if(headerState->extended) {
+		pending->header = makeExtendedHeader(header, ImmutableBuffer(nullptr, pending->body.size()), remote);
+		headerSize = sizeof(ExtendedHeader);
+	} else {
+		pending->header.header = header;
+	}
+	auto result = detail::sendPieces(
+		static_cast<Socket&>(*this),
+		pending->body,
+		pending->packed,
+		remote,
+		ImmutableBuffer(reinterpret_cast<std::uint8_t*>(&pending->header), headerSize),
+		0
+	);
+	return std::async(
+		std::launch::deferred,
+		[result = std::move(result), pending = std::move(pending)]() mutable
+		{
+			result.get();
+		}
+	);
+}
+
+template <class Socket, class TagList>
+template <class T>
+void Communicator<Socket, TagList>::asyncSendTo(const T& data, const Endpoint remote, SendCompletion& completion) {
+	static_assert(!is_composite<T>::value, "Composite messages are sent with the future based asyncSendTo.");
+	Message message(data);
+	std::size_t headerSize = sizeof(Header);
+	if(headerState->extended) {
+		completion.header = makeExtendedHeader(message.getHeader(), message.getBody(), remote);
+		headerSize = sizeof(ExtendedHeader);
+	} else {
+		completion.header.header = message.getHeader();
+	}
+	Socket::asyncSendTo(message.getBody(), remote, ImmutableBuffer(reinterpret_cast<std::uint8_t*>(&completion.header), headerSize), completion);
+}
+
 template <class Socket, class TagList>
 template <class T>
 std::pair<T, typename Communicator<Socket, TagList>::Endpoint> Communicator<Socket, TagList>::receiveFrom() {
@@ -115,10 +396,10 @@ std::future<std::pair<T, typename Communicator<Socket, TagList>::Endpoint>> Comm
 	auto datagramFuture = Socket::asyncReceiveFrom();
 	return std::async(
 		std::launch::deferred,
-		[datagramFuture = std::move(datagramFuture)]() mutable -> std::pair<T, Endpoint> {
+		[datagramFuture = std::move(datagramFuture), state = headerState.get()]() mutable -> std::pair<T, Endpoint> {
 			auto datagram = datagramFuture.get();
-			Message message(ImmutableBuffer(datagram.body.data(), datagram.body.size()), *reinterpret_cast<Header*>(datagram.header.data()));
-			boost::optional<T> result = message.template cast<T>();
+			Message message(ImmutableBuffer(datagram.body.data(), datagram.body.size()), receiveHeader(*state, datagram.header, datagram.body.size(), datagram.remote));
+			boost::optional<T> result = message.template cast<T>(&datagram.body);
 			if(result) {
 				return std::make_pair(std::move(result.get()), datagram.remote);
 			} else {
@@ -171,13 +452,13 @@ std::future<typename std::remove_reference_t<Vis>::Result> Communicator<Socket,
 
 	return std::async(
 		std::launch::deferred,
-		[datagramFuture = std::move(datagram), visitor = std::forward<Vis>(visitor)]() mutable
+		[datagramFuture = std::move(datagram), visitor = std::forward<Vis>(visitor), state = headerState.get()]() mutable
 			-> typename std::remove_reference_t<Vis>::Result
 		{
 			auto datagram = datagramFuture.get();
-			std::get<Endpoint>(*(visitor.argTuple)) = datagram.remote;
-			Message message(ImmutableBuffer(datagram.body.data(), datagram.body.size()), *reinterpret_cast<Header*>(datagram.header.data()));
-			return message.visit(std::forward<Vis>(visitor));
+			std::get<Endpoint>(visitor.arguments()) = datagram.remote;
+			Message message(ImmutableBuffer(datagram.body.data(), datagram.body.size()), receiveHeader(*state, datagram.header, datagram.body.size(), datagram.remote));
+			return message.visit(visitor, &datagram.body);
 		}
 	);
 
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include "ImmutableBuffer.hpp"
+
+namespace cracen2 {
+
+namespace network {
+
+/*
+ * Completion of an allocation-free send. The caller owns the object, e.g. in a CompletionPool, and keeps it
+ * alive until complete has been called. complete is called exactly once, with nullptr on success, from the
+ * thread that finished the send.
+ */
+class Completion {
+public:
+	virtual void complete(std::exception_ptr error) = 0;
+
+protected:
+	~Completion() = default;
+}; // End of class Completion
+
+/*
+ * Whether Socket has the allocation-free asyncSendTo, that reports to a Completion.
+ */
+template <class Socket, class enable = void>
+struct supports_completion : std::false_type {};
+
+template <class Socket>
+struct supports_completion<
+	Socket,
+	decltype(void(std::declval<Socket&>().asyncSendTo(
+		std::declval<const ImmutableBuffer&>(),
+		std::declval<const typename Socket::Endpoint&>(),
+		std::declval<const ImmutableBuffer&>(),
+		std::declval<Completion&>()
+	)))
+> : std::true_type {};
+
+/*
+ * Completion of a queued send inside a socket. It is either the promise behind the future-based api or a
+ * Completion of the caller, so that the queues of the socket do not care, which api was used.
+ */
+class Completer {
+	boost::optional<std::promise<void>> promise;
+	Completion* completion;
+
+public:
+
+	// Empty placeholder, e.g. in a preallocated slot. It must not be completed.
+	Completer() :
+		completion(nullptr)
+	{}
+
+	explicit Completer(std::promise<void>&& promise) :
+		promise(std::move(promise)),
+		completion(nullptr)
+	{}
+
+	explicit Completer(Completion& completion) :
+		completion(&completion)
+	{}
+
+	Completer(Completer&& other) :
+		promise(std::move(other.promise)),
+		completion(other.completion)
+	{
+		other.completion = nullptr;
+	}
+
+	Completer& operator=(Completer&& other) {
+		promise = std::move(other.promise);
+		completion = other.completion;
+		other.completion = nullptr;
+		return *this;
+	}
+
+	Completer(const Completer&) = delete;
+	Completer& operator=(const Completer&) = delete;
+
+	void set_value() {
+		if(completion) completion->complete(nullptr);
+		else promise->set_value();
+	}
+
+	void set_exception(std::exception_ptr error) {
+		if(completion) completion->complete(std::move(error));
+		else promise->set_exception(std::move(error));
+	}
+
+}; // End of class Completer
+
+/*
+ * Recycles completion objects of type Base (a Completion or derived from it), that report to handler.
+ * acquire only allocates, if all objects are in flight. The pool must outlive the sends.
+ */
+template <class Base, class Handler>
+class CompletionPool {
+
+	struct Node : Base {
+		CompletionPool* pool;
+
+		void complete(std::exception_ptr error) override {
+			pool->handler(std::move(error));
+			pool->release(this);
+		}
+	};
+
+	Handler handler;
+	std::mutex mutex;
+	std::deque<Node> nodes;
+	std::vector<Node*> free;
+
+	void release(Node* node) {
+		std::unique_lock<std::mutex> lock(mutex);
+		free.push_back(node);
+	}
+
+public:
+
+	explicit CompletionPool(Handler handler, std::size_t size = 0) :
+		handler(std::move(handler))
+	{
+		for(std::size_t i = 0; i < size; i++) {
+			nodes.emplace_back();
+			nodes.back().pool = this;
+			free.push_back(&nodes.back());
+		}
+	}
+
+	CompletionPool(const CompletionPool&) = delete;
+	CompletionPool& operator=(const CompletionPool&) = delete;
+
+	Base& acquire() {
+		std::unique_lock<std::mutex> lock(mutex);
+		if(free.empty()) {
+			nodes.emplace_back();
+			nodes.back().pool = this;
+			return nodes.back();
+		}
+		Node* node = free.back();
+		free.pop_back();
+		return *node;
+	}
+
+}; // End of class CompletionPool
+
+} // End of namespace network
+
+} // End of namespace cracen2
@@ -2,6 +2,9 @@
 
 #include <cinttypes>
 #include <memory>
+#include <stdexcept>
+
+#include "cracen2/network/BufferPool.hpp"
 
 namespace cracen2 {
 
@@ -9,15 +12,16 @@ namespace network {
 
 class Buffer {
 
-	std::unique_ptr<std::uint8_t[]> buf;
+	BufferPool::Pointer buf;
 	std::size_t count;
 
 public:
 
 	using value_type = std::uint8_t;
 
+	// The memory is taken from the BufferPool and goes back to it, when the buffer is destroyed.
 	Buffer(std::size_t size) :
-		buf(new std::uint8_t[size]),
+		buf(BufferPool::allocate(size)),
 		count(size)
 	{}
 
@@ -27,7 +31,12 @@ public:
 	Buffer& operator=(Buffer&&) = default;
 	Buffer& operator=(const Buffer&) = delete;
 	Buffer(std::unique_ptr<std::uint8_t[]>&& buf, const std::size_t size) :
-		buf(std::move(buf)),
+		buf(buf.release(), BufferDeleter()),
+		count(size)
+	{}
+	// Borrows size bytes at data, which go back to owner, when the buffer is destroyed
+	Buffer(std::uint8_t* data, const std::size_t size, BufferOwner& owner) :
+		buf(data, BufferDeleter(&owner)),
 		count(size)
 	{}
 
@@ -1,12 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <cstring>
 #include <cstdint>
+#include <stdexcept>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 #include <boost/optional.hpp>
 
 #include "cracen2/network/adapter/All.hpp"
+#include "cracen2/network/View.hpp"
 #include "cracen2/util/Demangle.hpp"
 #include "cracen2/util/Tuple.hpp"
 #include "cracen2/util/Function.hpp"
@@ -24,6 +28,26 @@ struct Header {
 	std::uint16_t typeId;
 };
 
+/*
+ * Optional wire header, that is negotiated per context. It starts with the minimal Header, so receivers
+ * tell both apart by the size of the header. The sequence number counts per edge (sender and receiver).
+ * The timestamp is the send time in nanoseconds of the system clock, which gives the one-way latency
+ * between participants with synchronised clocks. length is the body length as sent.
+ */
+struct ExtendedHeader {
+	enum Flags : std::uint16_t {
+		compressed = 1 << 0,
+		fragmented = 1 << 1,
+		checksummed = 1 << 2
+	};
+
+	Header header;
+	std::uint16_t flags;
+	std::uint32_t sequence;
+	std::uint64_t timestamp;
+	std::uint64_t length;
+};
+
 /*
  * This is the message class. It builds ontop of the BufferAdapter and provides a interface to go
  * from a typed value, to a untyped buffer with runtime type information in it and back again.
@@ -40,6 +64,8 @@ private:
 	Header header;
 	ImmutableBuffer body;
 
+	static std::runtime_error noVisitorError(TypeIdType typeId);
+
 public:
 
 	template <class ReturnType, class... Args>
@@ -54,8 +80,9 @@ public:
 		Visitor& operator=(Visitor&&) = default;
 		Visitor& operator=(const Visitor&) = default;
 
+		// The buffer is the owner of the body, if the caller gives it up, or nullptr
 		std::array<
-			std::function<ReturnType(const ImmutableBuffer&)>,
+			std::function<ReturnType(const ImmutableBuffer&, Buffer*)>,
 			std::tuple_size<TagList>::value
 		> functions;
 
@@ -64,6 +91,104 @@ public:
 		template <class Functor>
 		int add(Functor&& functor);
 
+		std::tuple<Args...>& arguments() {
+			return *argTuple;
+		}
+
+	};
+
+	/*
+	 * Visitor with the functors as part of its type, as built by make_visitor. visit dispatches on the
+	 * type id with one indirect call through a table, that is generated at compile time. Each entry calls
+	 * its functor directly, so the functor can be inlined. Message types without a functor throw.
+	 */
+	template <class ReturnType, class ArgTuple, class... Functors>
+	struct StaticVisitor;
+
+	template <class ReturnType, class... Args, class... Functors>
+	struct StaticVisitor<ReturnType, std::tuple<Args...>, Functors...> {
+
+		using Result = ReturnType;
+
+		std::tuple<Functors...> functors;
+		std::tuple<Args...> argTuple;
+
+		StaticVisitor(Functors... functors) :
+			functors(std::move(functors)...)
+		{}
+
+		std::tuple<Args...>& arguments() {
+			return argTuple;
+		}
+
+		ReturnType visit(TypeIdType typeId, const ImmutableBuffer& body, Buffer* owner) {
+			return dispatch(typeId, body, owner, std::make_index_sequence<std::tuple_size<TagList>::value>());
+		}
+
+	private:
+
+		static constexpr std::size_t none = sizeof...(Functors);
+
+		template <std::size_t functor>
+		using Argument = std::decay_t<
+			typename std::tuple_element<
+				0,
+				typename cracen2::util::FunctionInfo<typename std::tuple_element<functor, std::tuple<Functors...>>::type>::ParamList
+			>::type
+		>;
+
+		template <std::size_t functor>
+		static constexpr std::size_t typeIdOf() {
+			return cracen2::util::tuple_index<typename MessageArgument<Argument<functor>>::Type, TagList>::value;
+		}
+
+		// Index of the functor for messages with the type id, or none
+		template <std::size_t... Fs>
+		static constexpr std::size_t functorFor(std::size_t typeId, std::index_sequence<Fs...>) {
+			const std::size_t typeIds[] = { typeIdOf<Fs>()..., 0 };
+			for(std::size_t i = 0; i < sizeof...(Fs); i++) {
+				if(typeIds[i] == typeId) return i;
+			}
+			return none;
+		}
+
+		using Entry = ReturnType(*)(StaticVisitor&, TypeIdType, const ImmutableBuffer&, Buffer*);
+
+		template <std::size_t typeId, std::size_t functor>
+		struct Dispatch {
+			static_assert(
+				std::is_same<ReturnType, typename cracen2::util::FunctionInfo<typename std::tuple_element<functor, std::tuple<Functors...>>::type>::Result>::value,
+				"Supplied functors must have the same return type."
+			);
+
+			static ReturnType call(StaticVisitor& visitor, TypeIdType, const ImmutableBuffer& body, Buffer* owner) {
+				return std::get<functor>(visitor.functors)(MessageArgument<Argument<functor>>::make(body, owner), std::get<Args>(visitor.argTuple)...);
+			}
+		};
+
+		template <std::size_t typeId>
+		struct Dispatch<typeId, none> {
+			static ReturnType call(StaticVisitor&, TypeIdType, const ImmutableBuffer&, Buffer*) {
+				throw noVisitorError(typeId);
+			}
+		};
+
+		// Invalid type ids share the last entry, which keeps the error path out of the dispatch
+		struct Invalid {
+			static ReturnType call(StaticVisitor&, TypeIdType typeId, const ImmutableBuffer&, Buffer*) {
+				throw noVisitorError(typeId);
+			}
+		};
+
+		template <std::size_t... Ts>
+		ReturnType dispatch(TypeIdType typeId, const ImmutableBuffer& body, Buffer* owner, std::index_sequence<Ts...>) {
+			static constexpr Entry table[] = {
+				&Dispatch<Ts, functorFor(Ts, std::index_sequence_for<Functors...>())>::call...,
+				&Invalid::call
+			};
+			return table[std::min<std::size_t>(typeId, sizeof...(Ts))](*this, typeId, body, owner);
+		}
+
 	};
 
 	template <class... Args>
@@ -86,11 +211,15 @@ public:
 	Message(const Message&) = default;
 	Message& operator=(const Message&) = default;
 
+	// Type may be a View of a type of the TagList. owner is the buffer behind the body, that the View may take over.
 	template <class Type>
-	boost::optional<Type> cast();
+	boost::optional<Type> cast(Buffer* owner = nullptr);
 
 	template <class ReturnType, class... Args>
-	ReturnType visit(Visitor<ReturnType, Args...>& visitor);
+	ReturnType visit(Visitor<ReturnType, Args...>& visitor, Buffer* owner = nullptr);
+
+	template <class ReturnType, class ArgTuple, class... Functors>
+	ReturnType visit(StaticVisitor<ReturnType, ArgTuple, Functors...>& visitor, Buffer* owner = nullptr);
 
 	ImmutableBuffer& getBody();
 	Header& getHeader();
@@ -124,9 +253,9 @@ int Message<TagList>::Visitor<ReturnType, Args...>::add(Functor&& functor) {
 			ArgumentList
 		>::type;
 
-	TypeIdType id = cracen2::util::tuple_index<Argument, TagList>::value;
-	functions[id] = [argTuple = this->argTuple, functor = std::forward<Functor>(functor)](const ImmutableBuffer& buffer) -> ReturnType {
-		return functor(BufferAdapter<Argument>(buffer).cast(), std::get<Args>(*argTuple)...);
+	TypeIdType id = cracen2::util::tuple_index<typename MessageArgument<Argument>::Type, TagList>::value;
+	functions[id] = [argTuple = this->argTuple, functor = std::forward<Functor>(functor)](const ImmutableBuffer& buffer, Buffer* owner) -> ReturnType {
+		return functor(MessageArgument<Argument>::make(buffer, owner), std::get<Args>(*argTuple)...);
 	};
 	return 0;
 }
@@ -136,10 +265,12 @@ template <class... Args>
 template <class Functor, class... Rest>
 auto Message<TagList>::make_visitor_helper<Args...>::make_visitor(Functor&& f1, Rest&&... functor) {
 
-	Visitor<typename util::FunctionInfo<Functor>::Result, Args...> visitor;
-	std::vector<int> temp { visitor.add(std::forward<Functor>(f1)), visitor.add(std::forward<Rest>(functor))... };
-
-	return visitor;
+	return StaticVisitor<
+		typename util::FunctionInfo<std::remove_reference_t<Functor>>::Result,
+		std::tuple<Args...>,
+		std::decay_t<Functor>,
+		std::decay_t<Rest>...
+	>(std::forward<Functor>(f1), std::forward<Rest>(functor)...);
 }
 
 template <class TagList>
@@ -163,43 +294,50 @@ Message<TagList>::Message(const Type& body) :
 
 template <class TagList>
 template <class Type>
-boost::optional<Type> Message<TagList>::cast() {
-	if(header.typeId == cracen2::util::tuple_index<Type, TagList>::value) {
-		const BufferAdapter<Type> adapter(
+boost::optional<Type> Message<TagList>::cast(Buffer* owner) {
+	if(header.typeId == cracen2::util::tuple_index<typename MessageArgument<Type>::Type, TagList>::value) {
+		return MessageArgument<Type>::make(
 			ImmutableBuffer(
 				body.data,
 				body.size
-			)
+			),
+			owner
 		);
-		return adapter.cast();
 	}
 	return boost::none;
 }
 
 template <class TagList>
 template <class ReturnType, class... Args>
-ReturnType Message<TagList>::visit(Visitor<ReturnType, Args...>& visitor) {
+ReturnType Message<TagList>::visit(Visitor<ReturnType, Args...>& visitor, Buffer* owner) {
 	if(visitor.functions[header.typeId]) {
 		return visitor.functions[header.typeId](
 			ImmutableBuffer(
 				body.data,
 				body.size
-			)
+			),
+			owner
 		);
 	} else {
-		const auto names = util::tuple_get_type_names<TagList>::value();
-		std::string message("No visitor function for message of type \"");
-		if(header.typeId < names.size()) message += util::demangle(names[header.typeId]) + "\" defined.";
-		else  message += std::to_string(header.typeId) + "\" defined.";
-		throw std::runtime_error(
-			message
-		);
-		throw std::runtime_error(
-			"No valid message received."
-		);
+		throw noVisitorError(header.typeId);
 	}
 }
 
+template <class TagList>
+template <class ReturnType, class ArgTuple, class... Functors>
+ReturnType Message<TagList>::visit(StaticVisitor<ReturnType, ArgTuple, Functors...>& visitor, Buffer* owner) {
+	return visitor.visit(header.typeId, body, owner);
+}
+
+template <class TagList>
+std::runtime_error Message<TagList>::noVisitorError(TypeIdType typeId) {
+	const auto names = util::tuple_get_type_names<TagList>::value();
+	std::string message("No visitor function for message of type \"");
+	if(typeId < names.size()) message += util::demangle(names[typeId]) + "\" defined.";
+	else  message += std::to_string(typeId) + "\" defined.";
+	return std::runtime_error(message);
+}
+
 template <class TagList>
 ImmutableBuffer& Message<TagList>::getBody() {
 	return body;
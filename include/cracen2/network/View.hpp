@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "cracen2/network/BufferAdapter.hpp"
+#include "cracen2/network/ImmutableBuffer.hpp"
+
+namespace cracen2 {
+
+namespace network {
+
+namespace detail {
+
+// Element type of the body of a message of type Type, and how to copy a body back into a Type. Types
+// without a linear body (e.g. composites or user BufferAdapters) have no element type.
+template <class Type, class enable = void>
+struct view_element {};
+
+template <class Type>
+struct view_element<Type, typename std::enable_if<linear_memory_check<Type>::value>::type> {
+	using type = Type;
+	static Type copy(const type* begin, const type*) { return *begin; }
+};
+
+template <class T>
+struct view_element<std::vector<T>, typename std::enable_if<linear_memory_check<T>::value>::type> {
+	using type = T;
+	static std::vector<T> copy(const type* begin, const type* end) { return std::vector<T>(begin, end); }
+};
+
+template <>
+struct view_element<std::string> {
+	using type = char;
+	static std::string copy(const type* begin, const type* end) { return std::string(begin, end); }
+};
+
+template <class Type, class enable = void>
+struct has_view : std::false_type {};
+
+template <class Type>
+struct has_view<Type, decltype(void(std::declval<typename view_element<Type>::type>()))> : std::true_type {};
+
+} // End of namespace detail
+
+/*
+ * Read only view of the body of a received message of type Type (e.g. std::vector<float>). The view owns
+ * the receive buffer, so the body is not copied into a new Type. The body is a contiguous range of
+ * elements. The body of a trivially destructible Type is a single element, that operator* returns.
+ */
+template <class Type, class enable = void>
+class View {
+public:
+
+	using value_type = typename detail::view_element<Type>::type;
+
+private:
+
+	Buffer buffer;
+	std::size_t count;
+
+public:
+
+	View() :
+		count(0)
+	{}
+
+	// Takes over the receive buffer. It must hold exactly the body of the message.
+	explicit View(Buffer&& body) :
+		buffer(std::move(body)),
+		count(buffer.size() / sizeof(value_type))
+	{
+		// Buffers of the BufferPool are aligned for any element. Anything else is copied once.
+		if(reinterpret_cast<std::uintptr_t>(buffer.data()) % alignof(value_type) != 0) {
+			Buffer aligned(buffer.size());
+			std::memcpy(aligned.data(), buffer.data(), buffer.size());
+			buffer = std::move(aligned);
+		}
+	}
+
+	// Copies the body, if nobody hands over the buffer behind it
+	explicit View(const ImmutableBuffer& body) :
+		buffer(body.size),
+		count(body.size / sizeof(value_type))
+	{
+		if(body.size > 0) std::memcpy(buffer.data(), body.data, body.size);
+	}
+
+	View(View&&) = default;
+	View& operator=(View&&) = default;
+	View(const View&) = delete;
+	View& operator=(const View&) = delete;
+
+	const value_type* data() const {
+		return reinterpret_cast<const value_type*>(buffer.data());
+	}
+
+	std::size_t size() const {
+		return count;
+	}
+
+	bool empty() const {
+		return count == 0;
+	}
+
+	const value_type* begin() const {
+		return data();
+	}
+
+	const value_type* end() const {
+		return data() + count;
+	}
+
+	const value_type& operator[](std::size_t index) const {
+		return data()[index];
+	}
+
+	const value_type& operator*() const {
+		return *data();
+	}
+
+	const value_type* operator->() const {
+		return data();
+	}
+
+	// Copies the body into a Type, for code, that needs to own or modify the message
+	Type copy() const {
+		return detail::view_element<Type>::copy(begin(), end());
+	}
+
+}; // End of class View
+
+/*
+ * View of a message type without a linear body. The body is decoded once into the value, that the view
+ * owns, so that code handling views (e.g. the queues of Cracen2) works for every message type.
+ */
+template <class Type>
+class View<Type, typename std::enable_if<!detail::has_view<Type>::value>::type> {
+public:
+
+	using value_type = Type;
+
+private:
+
+	std::unique_ptr<Type> value;
+
+public:
+
+	View() = default;
+
+	explicit View(Buffer&& body) :
+		value(std::make_unique<Type>(BufferAdapter<Type>(ImmutableBuffer(body.data(), body.size())).cast()))
+	{}
+
+	explicit View(const ImmutableBuffer& body) :
+		value(std::make_unique<Type>(BufferAdapter<Type>(body).cast()))
+	{}
+
+	View(View&&) = default;
+	View& operator=(View&&) = default;
+	View(const View&) = delete;
+	View& operator=(const View&) = delete;
+
+	const value_type* data() const {
+		return value.get();
+	}
+
+	std::size_t size() const {
+		return value ? 1 : 0;
+	}
+
+	bool empty() const {
+		return !value;
+	}
+
+	const value_type* begin() const {
+		return data();
+	}
+
+	const value_type* end() const {
+		return data() + size();
+	}
+
+	const value_type& operator[](std::size_t index) const {
+		return data()[index];
+	}
+
+	const value_type& operator*() const {
+		return *value;
+	}
+
+	const value_type* operator->() const {
+		return data();
+	}
+
+	Type copy() const & {
+		return *value;
+	}
+
+	// The decoded value is handed out without another copy
+	Type copy() && {
+		return std::move(*value);
+	}
+
+}; // End of class View
+
+/*
+ * Turns the body of a message into the argument type T of a receive or visitor. T is either a type of the
+ * TagList, which is copied out of the body, or a View of it. owner is the buffer holding exactly the body,
+ * if the caller gives it up, so that a View can take it over. Type is the type of the TagList.
+ */
+template <class T>
+struct MessageArgument {
+	using Type = T;
+
+	static T make(const ImmutableBuffer& body, Buffer*) {
+		return BufferAdapter<T>(body).cast();
+	}
+
+	static T from(View<T>&& view) {
+		return std::move(view).copy();
+	}
+};
+
+template <class T>
+struct MessageArgument<View<T>> {
+	using Type = T;
+
+	static View<T> make(const ImmutableBuffer& body, Buffer* owner) {
+		if(owner != nullptr) return View<T>(std::move(*owner));
+		return View<T>(body);
+	}
+
+	static View<T> from(View<T>&& view) {
+		return std::move(view);
+	}
+};
+
+} // End of namespace network
+
+} // End of namespace cracen2
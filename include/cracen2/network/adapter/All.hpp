@@ -4,3 +4,4 @@
 #include "Vector.hpp"
 #include "Deque.hpp"
 #include "String.hpp"
+#include "Composite.hpp"
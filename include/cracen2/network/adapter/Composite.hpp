@@ -0,0 +1,302 @@
+#pragma once
+
+#include "../BufferAdapter.hpp"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace cracen2 {
+
+namespace network {
+
+/*
+ * Member registration of a composite message type. Specialise it for a struct, that is not trivially
+ * destructible, with a tie function over its members in wire order:
+ *
+ * template <>
+ * struct Members<Frame> {
+ * 	template <class Self>
+ * 	static auto tie(Self& frame) -> decltype(std::tie(frame.id, frame.samples)) {
+ * 		return std::tie(frame.id, frame.samples);
+ * 	}
+ * };
+ *
+ * Members may be trivially destructible types, std::vector and std::deque of those, std::string and other
+ * composites. A composite must be default constructible. It can be a message type of a Communicator or of
+ * Cracen2, which queues it decoded (see View).
+ */
+template <class Type>
+struct Members {};
+
+template <class Type, class enable = void>
+struct is_composite : std::false_type {};
+
+template <class Type>
+struct is_composite<
+	Type,
+	typename std::enable_if<
+		!linear_memory_check<Type>::value &&
+		std::is_same<decltype(void(Members<Type>::tie(std::declval<Type&>()))), void>::value
+	>::type
+> : std::true_type {};
+
+namespace detail {
+
+// Collects the pieces of a composite without copying the members
+struct PieceWriter {
+	std::uint64_t* lengths;
+	std::vector<ImmutableBuffer>& pieces;
+	std::size_t size;
+
+	void add(const void* data, std::size_t bytes) {
+		if(bytes == 0) return;
+		pieces.emplace_back(static_cast<const std::uint8_t*>(data), bytes);
+		size += bytes;
+	}
+
+	void addLength(std::uint64_t bytes) {
+		*lengths++ = bytes;
+	}
+};
+
+// Reads the members of a composite back from one contiguous body
+struct PieceReader {
+	const std::uint8_t* lengths;
+	const std::uint8_t* position;
+	const std::uint8_t* end;
+
+	std::uint64_t nextLength(std::size_t elementSize) {
+		std::uint64_t bytes;
+		std::memcpy(&bytes, lengths, sizeof(bytes));
+		lengths += sizeof(bytes);
+		if(bytes > static_cast<std::uint64_t>(end - position)) throw std::runtime_error("Composite message is truncated.");
+		if(bytes % elementSize != 0) throw std::runtime_error("Composite member length is not a multiple of its element size.");
+		return bytes;
+	}
+
+	void read(void* target, std::size_t bytes) {
+		if(bytes > static_cast<std::size_t>(end - position)) throw std::runtime_error("Composite message is truncated.");
+		if(bytes > 0) std::memcpy(target, position, bytes);
+		position += bytes;
+	}
+};
+
+/*
+ * Wire layout of one member. variables is the number of length slots it needs, pieces the number of pieces
+ * it emits at most (except for deques, which emit one piece per block).
+ */
+template <class Field, class enable = void>
+struct Piece;
+
+template <class Field>
+struct Piece<Field, typename std::enable_if<linear_memory_check<Field>::value>::type> {
+	static constexpr std::size_t variables = 0;
+	static constexpr std::size_t pieces = 1;
+
+	static void gather(const Field& field, PieceWriter& writer) {
+		writer.add(&field, sizeof(field));
+	}
+
+	static void scatter(Field& field, PieceReader& reader) {
+		reader.read(&field, sizeof(field));
+	}
+};
+
+template <class T>
+struct Piece<std::vector<T>, typename std::enable_if<linear_memory_check<T>::value>::type> {
+	static constexpr std::size_t variables = 1;
+	static constexpr std::size_t pieces = 1;
+
+	static void gather(const std::vector<T>& field, PieceWriter& writer) {
+		writer.addLength(field.size() * sizeof(T));
+		writer.add(field.data(), field.size() * sizeof(T));
+	}
+
+	static void scatter(std::vector<T>& field, PieceReader& reader) {
+		const auto bytes = reader.nextLength(sizeof(T));
+		field.resize(bytes / sizeof(T));
+		reader.read(field.data(), bytes);
+	}
+};
+
+template <>
+struct Piece<std::string> {
+	static constexpr std::size_t variables = 1;
+	static constexpr std::size_t pieces = 1;
+
+	static void gather(const std::string& field, PieceWriter& writer) {
+		writer.addLength(field.size());
+		writer.add(field.data(), field.size());
+	}
+
+	static void scatter(std::string& field, PieceReader& reader) {
+		field.resize(reader.nextLength(sizeof(char)));
+		reader.read(&field[0], field.size());
+	}
+};
+
+// A deque is sent block by block
+template <class T>
+struct Piece<std::deque<T>, typename std::enable_if<linear_memory_check<T>::value>::type> {
+	static constexpr std::size_t variables = 1;
+	static constexpr std::size_t pieces = 1;
+
+	static void gather(const std::deque<T>& field, PieceWriter& writer) {
+		writer.addLength(field.size() * sizeof(T));
+		std::size_t begin = 0;
+		for(std::size_t i = 1; i <= field.size(); i++) {
+			if(i == field.size() || &field[i] != &field[i-1] + 1) {
+				writer.add(&field[begin], (i - begin) * sizeof(T));
+				begin = i;
+			}
+		}
+	}
+
+	static void scatter(std::deque<T>& field, PieceReader& reader) {
+		const auto bytes = reader.nextLength(sizeof(T));
+		field.resize(bytes / sizeof(T));
+		for(auto& element : field) {
+			reader.read(&element, sizeof(T));
+		}
+	}
+};
+
+template <class Tuple>
+struct TupleLayout;
+
+template <>
+struct TupleLayout<std::tuple<>> {
+	static constexpr std::size_t variables = 0;
+	static constexpr std::size_t pieces = 0;
+};
+
+template <class Head, class... Tail>
+struct TupleLayout<std::tuple<Head&, Tail&...>> {
+	using Next = TupleLayout<std::tuple<Tail&...>>;
+	static constexpr std::size_t variables = Piece<typename std::remove_const<Head>::type>::variables + Next::variables;
+	static constexpr std::size_t pieces = Piece<typename std::remove_const<Head>::type>::pieces + Next::pieces;
+};
+
+template <class Field>
+struct Piece<Field, typename std::enable_if<is_composite<Field>::value>::type> {
+	using Layout = TupleLayout<decltype(Members<Field>::tie(std::declval<Field&>()))>;
+	static constexpr std::size_t variables = Layout::variables;
+	static constexpr std::size_t pieces = Layout::pieces;
+
+	template <class Tuple, std::size_t... indices>
+	static void gatherAll(const Tuple& members, PieceWriter& writer, std::index_sequence<indices...>) {
+		int expand[] = { 0, (Piece<typename std::decay<typename std::tuple_element<indices, Tuple>::type>::type>::gather(std::get<indices>(members), writer), 0)... };
+		(void) expand;
+	}
+
+	template <class Tuple, std::size_t... indices>
+	static void scatterAll(const Tuple& members, PieceReader& reader, std::index_sequence<indices...>) {
+		int expand[] = { 0, (Piece<typename std::decay<typename std::tuple_element<indices, Tuple>::type>::type>::scatter(std::get<indices>(members), reader), 0)... };
+		(void) expand;
+	}
+
+	static void gather(const Field& field, PieceWriter& writer) {
+		const auto members = Members<Field>::tie(field);
+		gatherAll(members, writer, std::make_index_sequence<std::tuple_size<decltype(members)>::value>());
+	}
+
+	static void scatter(Field& field, PieceReader& reader) {
+		const auto members = Members<Field>::tie(field);
+		scatterAll(members, reader, std::make_index_sequence<std::tuple_size<decltype(members)>::value>());
+	}
+};
+
+} // End of namespace detail
+
+/*
+ * Sender side of a composite message. The body is a block with the byte length of every variable sized
+ * member, followed by the bytes of all members in registration order. pieces() points into the lengths block
+ * and into the members of value, so that a socket can send them with one gather write. value must outlive
+ * the send, the Serialized object must stay where it is.
+ */
+template <class Type>
+class Serialized {
+
+	static_assert(is_composite<Type>::value, "Type has no Members registration.");
+
+	using Layout = detail::Piece<Type>;
+
+	std::array<std::uint64_t, Layout::variables> lengths;
+	std::vector<ImmutableBuffer> bodyPieces;
+	std::size_t bodySize;
+
+public:
+
+	explicit Serialized(const Type& value) {
+		bodyPieces.reserve(Layout::pieces + 1);
+		detail::PieceWriter writer { lengths.data(), bodyPieces, 0 };
+		writer.add(lengths.data(), Layout::variables * sizeof(std::uint64_t));
+		Layout::gather(value, writer);
+		bodySize = writer.size;
+	}
+
+	Serialized(const Serialized&) = delete;
+	Serialized& operator=(const Serialized&) = delete;
+
+	const std::vector<ImmutableBuffer>& pieces() const {
+		return bodyPieces;
+	}
+
+	std::size_t size() const {
+		return bodySize;
+	}
+
+	// Copies the pieces into one buffer, for sockets without gather writes
+	Buffer pack() const {
+		Buffer result(bodySize);
+		std::size_t offset = 0;
+		for(const auto& piece : bodyPieces) {
+			std::memcpy(result.data() + offset, piece.data, piece.size);
+			offset += piece.size;
+		}
+		return result;
+	}
+
+}; // End of class Serialized
+
+template <class Type>
+Type deserialize(const ImmutableBuffer& body) {
+	constexpr std::size_t lengthBytes = detail::Piece<Type>::variables * sizeof(std::uint64_t);
+	if(body.size < lengthBytes) throw std::runtime_error("Composite message is truncated.");
+	detail::PieceReader reader { body.data, body.data + lengthBytes, body.data + body.size };
+	Type result;
+	detail::Piece<Type>::scatter(result, reader);
+	return result;
+}
+
+// Receive side of a composite. Composites are sent through Serialized, not as one ImmutableBuffer.
+template <class Type>
+struct BufferAdapter<
+	Type,
+	typename std::enable_if<
+		is_composite<Type>::value
+	>::type
+> :
+	public ImmutableBuffer
+{
+	BufferAdapter(const ImmutableBuffer& other) :
+		ImmutableBuffer(other)
+	{};
+
+	BufferAdapter(const Type& input) = delete;
+
+	Type cast() const {
+		return deserialize<Type>(*this);
+	}
+
+}; // End of struct BufferAdapter
+
+} // End of namespace network
+
+} // End of namespace cracen2
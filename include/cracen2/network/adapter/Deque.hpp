@@ -2,6 +2,7 @@
 
 #include "../BufferAdapter.hpp"
 #include <deque>
+#include <stdexcept>
 
 namespace cracen2 {
 
@@ -20,12 +21,17 @@ struct BufferAdapter<
 {
 	using ImmutableBuffer::ImmutableBuffer;
 
+	// Only a deque within one block is contiguous. Larger deques are sent as a member of a composite.
 	BufferAdapter(const std::deque<Type>& input) :
 		ImmutableBuffer(
-			reinterpret_cast<decltype(ImmutableBuffer::data)>(&input[0]),
+			reinterpret_cast<decltype(ImmutableBuffer::data)>(input.empty() ? nullptr : &input[0]),
 			input.size()*sizeof(Type)
 		)
-	{};
+	{
+		if(!input.empty() && &input.back() != &input.front() + (input.size() - 1)) {
+			throw std::runtime_error("The deque is not contiguous. Send it as a member of a composite.");
+		}
+	};
 
 	BufferAdapter(const ImmutableBuffer& other) :
 		ImmutableBuffer(other)
@@ -34,12 +40,14 @@ struct BufferAdapter<
 	BufferAdapter(std::deque<Type>&& other) = delete;
 
 	std::deque<Type> cast() const {
+		// The blocks of a deque are not contiguous, so it is filled element by element
 		std::deque<Type> destination(size / sizeof(Type));
-		memcpy(
-			&destination[0],
-			data,
-			size
-		);
+		auto position = data;
+		for(auto& element : destination) {
+			memcpy(&element, position, sizeof(Type));
+			position += sizeof(Type);
+		}
+		return destination;
 	}
 
 }; // End of struct BufferAdapter
@@ -8,16 +8,21 @@ namespace send_policies {
 
 struct broadcast_any {
 
-	template <class RoleEndpointMap>
-	auto run(RoleEndpointMap& roleEndpointMap) {
-		using Endpoint = typename RoleEndpointMap::value_type::second_type::value_type;
-		std::vector<Endpoint> sendToList;
+	// Calls function for each picked endpoint, without building a list
+	template <class RoleEndpointMap, class Function>
+	void forEach(RoleEndpointMap& roleEndpointMap, Function&& function) {
 		for(auto& roleEndpointVectorPair : roleEndpointMap) {
 			for(auto& ep : roleEndpointVectorPair.second) {
-				sendToList.emplace_back(ep);
+				function(ep);
 			}
 		}
+	}
 
+	template <class RoleEndpointMap>
+	auto run(RoleEndpointMap& roleEndpointMap) {
+		using Endpoint = typename RoleEndpointMap::value_type::second_type::value_type;
+		std::vector<Endpoint> sendToList;
+		forEach(roleEndpointMap, [&sendToList](const Endpoint& ep){ sendToList.emplace_back(ep); });
 		return sendToList;
 	}
 
@@ -31,18 +36,22 @@ struct broadcast_role {
 		roleId(roleId)
 	{}
 
+	// Calls function for each picked endpoint, without building a list
+	template <class RoleEndpointMap, class Function>
+	void forEach(RoleEndpointMap& roleEndpointMap, Function&& function) {
+		auto epVec = roleEndpointMap.find(roleId);
+		if(epVec != roleEndpointMap.end()) {
+			for(const auto& ep : epVec->second) {
+				function(ep);
+			}
+		}
+	}
+
 	template <class RoleEndpointMap>
 	auto run(RoleEndpointMap& roleEndpointMap) {
 		using Endpoint = typename RoleEndpointMap::value_type::second_type::value_type;
 		std::vector<Endpoint> sendToList;
-		try {
-			auto& epVec = roleEndpointMap.at(roleId);
-
-			for(const auto& ep : epVec) {
-				sendToList.push_back(ep);
-			}
-		} catch(const std::out_of_range&) {
-		}
+		forEach(roleEndpointMap, [&sendToList](const Endpoint& ep){ sendToList.push_back(ep); });
 		return sendToList;
 	}
 
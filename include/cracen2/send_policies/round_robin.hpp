@@ -16,19 +16,22 @@ struct round_robin {
 		counter(0)
 	{}
 
+	// Calls function for each picked endpoint, without building a list
+	template <class RoleEndpointMap, class Function>
+	void forEach(RoleEndpointMap& roleEndpointMap, Function&& function) {
+		auto epVec = roleEndpointMap.find(roleId);
+		if(epVec != roleEndpointMap.end() && epVec->second.size() > 0) {
+			counter = counter % epVec->second.size();
+			function(epVec->second[counter]);
+		}
+		counter++;
+	}
+
 	template <class RoleEndpointMap>
 	auto run(RoleEndpointMap& roleEndpointMap) {
 		using Endpoint = typename RoleEndpointMap::value_type::second_type::value_type;
 		std::vector<Endpoint> sendToList;
-		try {
-			auto& epVec = roleEndpointMap.at(roleId);
-			if(epVec.size() > 0) {
-				counter = counter % epVec.size();
-				sendToList.push_back(epVec.at(counter));
-			}
-		} catch(const std::out_of_range&) {
-		}
-		counter++;
+		forEach(roleEndpointMap, [&sendToList](const Endpoint& ep){ sendToList.push_back(ep); });
 		return sendToList;
 	}
 
@@ -1,12 +1,24 @@
 #pragma once
 
 #include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
 #include <memory>
 #include <future>
 #include <limits>
 #include <cstdint>
+#include <mutex>
+#include <queue>
+#include <vector>
+#include <sys/socket.h>
 
 #include "cracen2/network/ImmutableBuffer.hpp"
+#include "cracen2/network/Completion.hpp"
+#include "cracen2/sockets/AsioExecutor.hpp"
+#include "cracen2/sockets/RateController.hpp"
 #include "cracen2/util/Debug.hpp"
 #include "cracen2/util/Thread.hpp"
 
@@ -20,18 +32,42 @@ private:
 	using Socket = udp::socket;
 	using ImmutableBuffer = network::ImmutableBuffer;
 
-	boost::asio::io_service io_service;
-	util::JoiningThread serviceThread;
-	boost::asio::io_service::work work;
-
-	Socket socket;
+	std::shared_ptr<AsioExecutor> executor;
+	boost::asio::io_service& io_service;
+	// All handlers of the socket run on this strand, so the executor may run several threads.
+	boost::asio::io_service::strand strand;
+	HandlerTracker handlers;
 
 public:
 
-	struct MaxMessageSize {
-		static constexpr std::size_t total = std::numeric_limits<std::uint16_t>::max() - sizeof(ImmutableBuffer::size);
-		static constexpr std::size_t body = total;
-		static constexpr std::size_t header = total;
+	struct Configuration {
+		// Maximum number of datagrams, that are drained from the socket with a single recvmmsg call.
+		std::size_t receiveBatchSize = 32;
+		// Outgoing datagrams are collected until sendBatchSize datagrams are queued or the oldest
+		// queued datagram waited for sendWindow. The collected datagrams are sent with a single sendmmsg call.
+		std::size_t sendBatchSize = 1;
+		std::chrono::microseconds sendWindow = std::chrono::microseconds(0);
+		// Messages, that do not fit into a datagram of fragmentSize bytes, are split into fragments of that
+		// size and reassembled by the receiver. Use the path MTU minus 28 to avoid ip fragmentation.
+		// Received fragments bigger than fragmentSize are dropped, so it must not be smaller than the sender's.
+		std::size_t fragmentSize = 65507;
+		// Fragments of one message are handed to the kernel as one UDP_SEGMENT (GSO) send, if several fit.
+		bool segmentationOffload = true;
+		// Incomplete messages are discarded, when none of their fragments arrived for reassemblyTimeout, or
+		// when more than maxReassemblies messages are incomplete at the same time (least recently active first).
+		std::chrono::milliseconds reassemblyTimeout = std::chrono::milliseconds(200);
+		std::size_t maxReassemblies = 64;
+		// Fragmented messages with a bigger body are dropped. Reassembly holds at most
+		// maxReassemblies * maxReassembledSize bytes.
+		std::size_t maxReassembledSize = 64*1024*1024;
+		// Sends to each destination are paced by a token bucket, that admits pacingBurst bytes at once.
+		// The rate starts at rateControl.initialRate and follows the feedback of a layer above.
+		bool pacing = false;
+		std::size_t pacingBurst = 64*1024;
+		// Sends, that wait for the bucket of their destination, are queued per destination. Sends to a destination,
+		// for which maxPacedSends sends wait already, fail.
+		std::size_t maxPacedSends = 4096;
+		RateController::Configuration rateControl;
 	};
 
 	using Endpoint = udp::endpoint;
@@ -41,7 +77,145 @@ public:
 		Endpoint remote;
 	};
 
+private:
+
+	// Every slot receives into a pooled buffer, that can be handed out with the datagram
+	struct ReceiveRing {
+		std::size_t slotSize;
+		std::vector<network::Buffer> buffers;
+		std::vector<mmsghdr> messages;
+		std::vector<iovec> iovecs;
+		std::vector<sockaddr_storage> addresses;
+
+		ReceiveRing(std::size_t slots, std::size_t slotSize);
+		std::uint8_t* slot(std::size_t index);
+		// Hands the buffer of the slot out and gives the slot a fresh one
+		network::Buffer take(std::size_t index);
+	};
+
+	const Configuration configuration;
+	std::mutex receiveMutex;
+	std::queue<std::promise<Datagram>> pendingReceives;
+	std::queue<Datagram> receivedDatagrams;
+	bool receiveArmed;
+	ReceiveRing receiveRing;
+
+	using size_type = std::remove_const<decltype(ImmutableBuffer::size)>::type;
+
+	// Set in the header size of a datagram, that carries one fragment of a bigger message
+	static constexpr size_type fragmentFlag = size_type(1) << (8 * sizeof(size_type) - 1);
+
+	// Precedes the header size of a fragment: [piece][header][FragmentInfo][headerSize | fragmentFlag]
+	struct FragmentInfo {
+		std::uint32_t message;
+		std::uint32_t index;
+		std::uint32_t count;
+		std::uint32_t offset;
+		std::uint32_t total;
+	};
+
+	// Body of a fragmented message, allocated when its first fragment arrives
+	struct Reassembly {
+		network::Buffer header;
+		network::Buffer body;
+		std::vector<bool> received;
+		std::uint32_t missing;
+		// Body bytes in every fragment but the last
+		std::uint32_t pieceSize;
+		// Arrival of the last fragment
+		std::chrono::steady_clock::time_point updated;
+	};
+
+	std::map<std::pair<Endpoint, std::uint32_t>, Reassembly> reassemblies;
+	std::atomic<std::uint32_t> nextMessage;
+	bool segmentationOffload;
+
+	struct PendingSend {
+		const std::uint8_t* data;
+		std::size_t dataSize;
+		const std::uint8_t* header;
+		size_type headerSize;
+		Endpoint remote;
+		network::Completer completion;
+		// Fragments are numbered per socket. The wire header size carries the fragment flag.
+		std::vector<FragmentInfo> fragments;
+		size_type fragmentHeaderSize;
+		// Admitted by the pacer, so that it is not charged again, when it is queued again
+		bool paced;
+	};
+
+	std::mutex sendMutex;
+	std::vector<PendingSend> sendQueue;
+	bool flushScheduled;
+	// Senders start the posted flush and the coalescing window, at most one of each is in flight
+	HandlerMemory flushMemory;
+	HandlerMemory windowMemory;
+	// Set while the socket buffer is full and the queue waits for the socket to become writable
+	bool writeBlocked;
+
+	struct SegmentControl {
+		alignas(cmsghdr) std::uint8_t data[CMSG_SPACE(sizeof(std::uint16_t))];
+	};
+
+	// Only used by flush. Kept between flushes, so that their capacity is reused.
+	std::vector<PendingSend> flushBatch;
+	std::vector<iovec> flushIovecs;
+	std::vector<mmsghdr> flushMessages;
+	std::vector<SegmentControl> flushControls;
+	std::vector<std::size_t> flushOwners;
+	std::vector<std::exception_ptr> flushErrors;
+
+	struct Pacer {
+		RateController controller;
+		double tokens;
+		std::chrono::steady_clock::time_point refilled;
+		// Sends, that wait for tokens, in order. Only the pacing timer drains them.
+		std::deque<PendingSend> deferred;
+	};
+
+	std::mutex pacingMutex;
+	std::map<Endpoint, Pacer> pacers;
+	// The pacing timer is only armed and handled on the strand
+	bool pacingScheduled;
+	std::chrono::steady_clock::time_point pacingWakeup;
+	// Sends, that found the deferred queue of their destination full. Only used by pace.
+	std::vector<PendingSend> paceRejected;
+
+	Socket socket;
+	boost::asio::steady_timer sendTimer;
+	boost::asio::steady_timer pacingTimer;
+	boost::asio::steady_timer retryTimer;
+
+	void armReceive();
+	void handle_receive(const boost::system::error_code& error);
+	void deliver(Datagram&& datagram);
+	void reassemble(const std::uint8_t* frame, std::size_t frameSize, size_type headerSize, const Endpoint& remote);
+
+	void enqueue(const ImmutableBuffer& data, const Endpoint& remote, const ImmutableBuffer& header, network::Completer&& completion);
+	void scheduleFlush();
+	void waitWritable(int error);
+	void flush();
+	void transmit(std::vector<PendingSend>& batch);
+	void pace(std::vector<PendingSend>& batch);
+	void releasePaced();
+	void schedulePacing(std::chrono::steady_clock::time_point wakeup);
+	Pacer& getPacer(const Endpoint& remote);
+	bool admit(Pacer& pacer, const PendingSend& send, std::chrono::steady_clock::time_point now);
+	// When the empty bucket of pacer has tokens again
+	static std::chrono::steady_clock::time_point nextTokens(const Pacer& pacer, std::chrono::steady_clock::time_point now);
+
+public:
+
+	// Bigger messages are fragmented. The fragment info addresses the body with 32 bit offsets.
+	struct MaxMessageSize {
+		static constexpr std::size_t total = std::numeric_limits<std::uint32_t>::max();
+		static constexpr std::size_t body = total;
+		// Every fragment repeats the header, so it has to fit into a fragment with at least one body byte
+		static constexpr std::size_t header = 65507 - sizeof(FragmentInfo) - sizeof(size_type) - 1;
+	};
+
 	AsioDatagramSocket();
+	AsioDatagramSocket(Configuration configuration, std::shared_ptr<AsioExecutor> executor = std::make_shared<AsioExecutor>());
 	~AsioDatagramSocket();
 
 	AsioDatagramSocket(AsioDatagramSocket&& other) = default;
@@ -53,8 +227,19 @@ public:
 	void bind(Endpoint endpoint = Endpoint(boost::asio::ip::address::from_string("0.0.0.0"),0));
 
 	std::future<void> asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header = ImmutableBuffer(nullptr, 0));
+	// Reports to completion instead of a future. Body and header must stay valid until then.
+	void asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header, network::Completion& completion);
 	std::future<Datagram> asyncReceiveFrom();
 
+	/*
+	 * Adapt the pacing rate towards remote. Does nothing, if pacing is off.
+	 */
+	void feedback(const Endpoint& remote, const RateSample& sample);
+
+	// Pacing rate towards remote in bytes per second, 0 if pacing is off
+	double getRate(const Endpoint& remote);
+	std::map<Endpoint, double> getRates();
+
 	bool isOpen() const;
 	Endpoint getLocalEndpoint() const;
 
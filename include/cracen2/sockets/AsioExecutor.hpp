@@ -0,0 +1,219 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+
+#include "cracen2/util/Thread.hpp"
+
+namespace cracen2 {
+
+namespace sockets {
+
+/*
+ * Runs the io_services of the asio socket backends. An executor can be shared between several sockets.
+ *
+ * Policy::shared: One io_service is run by all threads. Handlers of a single connection are serialized
+ * with a strand, so different connections are served in parallel.
+ * Policy::sharded: Every thread runs its own io_service. Connections are distributed round robin over
+ * the io_services.
+ */
+class AsioExecutor {
+public:
+
+	enum class Policy {
+		shared,
+		sharded
+	};
+
+	struct Configuration {
+		Policy policy = Policy::shared;
+		std::size_t threads = 1;
+	};
+
+	AsioExecutor();
+	AsioExecutor(Configuration configuration);
+	~AsioExecutor();
+
+	AsioExecutor(const AsioExecutor& other) = delete;
+	AsioExecutor& operator=(const AsioExecutor& other) = delete;
+
+	/*
+	 * @result io_service for the next connection.
+	 */
+	boost::asio::io_service& next();
+
+	std::size_t threads() const;
+	Policy policy() const;
+
+private:
+
+	struct Context {
+		boost::asio::io_service io_service;
+		std::unique_ptr<boost::asio::io_service::work> work;
+
+		Context();
+	};
+
+	const Configuration configuration;
+	std::vector<std::unique_ptr<Context>> contexts;
+	std::vector<util::JoiningThread> workers;
+	std::atomic<std::size_t> nextContext;
+
+}; // End of class AsioExecutor
+
+/*
+ * Memory for a handler, of which at most one is in flight at a time, e.g. the posted flush of a socket.
+ * Operations of handlers wrapped with it are allocated here instead of on the heap, also when they are
+ * started from a thread outside the executor. Bigger operations and a second one, while the memory is
+ * in use, fall back to the heap.
+ */
+class HandlerMemory {
+	static constexpr std::size_t capacity = 256;
+
+	typename std::aligned_storage<capacity>::type storage;
+	std::atomic<bool> inUse;
+
+public:
+
+	HandlerMemory();
+
+	HandlerMemory(const HandlerMemory& other) = delete;
+	HandlerMemory& operator=(const HandlerMemory& other) = delete;
+
+	void* allocate(std::size_t size);
+	void deallocate(void* pointer);
+
+}; // End of class HandlerMemory
+
+/*
+ * Counts the handlers a socket has handed to a shared executor, so that the socket can wait for
+ * all of them before it is destroyed. A handler counts until its last copy is gone, so handlers,
+ * that are destroyed without running, e.g. by a stopped io_service, are released as well.
+ * Wrapping and releasing a handler only touch an atomic counter, the mutex is taken by wait() and
+ * by the release, that wakes it up.
+ */
+class HandlerTracker {
+	std::atomic<std::size_t> pending;
+	std::mutex mutex;
+	std::condition_variable finished;
+
+	void acquire();
+	void release();
+
+	// One pending handler as long as it lives. Copies count on their own, a moved from count is empty.
+	class Count {
+		HandlerTracker* tracker;
+
+	public:
+
+		explicit Count(HandlerTracker& tracker);
+		Count(const Count& other);
+		Count(Count&& other);
+		~Count();
+
+		Count& operator=(const Count& other) = delete;
+		Count& operator=(Count&& other) = delete;
+	};
+
+	template <class Handler>
+	struct Wrapped {
+		// Declared before the handler, so that it is released after the handler is destroyed
+		Count count;
+		HandlerMemory* memory;
+		Handler handler;
+
+		template <class... Args>
+		void operator()(Args&&... args) {
+			handler(std::forward<Args>(args)...);
+		}
+
+		// Allocation hooks of asio, also reached through strand.wrap
+		friend void* asio_handler_allocate(std::size_t size, Wrapped* wrapped) {
+			if(wrapped->memory) return wrapped->memory->allocate(size);
+			using boost::asio::asio_handler_allocate;
+			return asio_handler_allocate(size, std::addressof(wrapped->handler));
+		}
+
+		friend void asio_handler_deallocate(void* pointer, std::size_t size, Wrapped* wrapped) {
+			if(wrapped->memory) return wrapped->memory->deallocate(pointer);
+			using boost::asio::asio_handler_deallocate;
+			asio_handler_deallocate(pointer, size, std::addressof(wrapped->handler));
+		}
+	};
+
+public:
+
+	HandlerTracker();
+
+	template <class Handler>
+	Wrapped<typename std::decay<Handler>::type> wrap(Handler&& handler);
+	// The operations of the handler use memory, see HandlerMemory
+	template <class Handler>
+	Wrapped<typename std::decay<Handler>::type> wrap(Handler&& handler, HandlerMemory& memory);
+
+	// Blocks until all wrapped handlers have been executed or destroyed
+	void wait();
+
+}; // End of class HandlerTracker
+
+inline void HandlerTracker::acquire() {
+	pending.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void HandlerTracker::release() {
+	// Decremented under the mutex, so that wait() can not return and free the tracker, before the last
+	// release has left it
+	std::lock_guard<std::mutex> lock(mutex);
+	if(--pending == 0) {
+		finished.notify_all();
+	}
+}
+
+inline HandlerTracker::Count::Count(HandlerTracker& tracker) :
+	tracker(&tracker)
+{
+	tracker.acquire();
+}
+
+inline HandlerTracker::Count::Count(const Count& other) :
+	tracker(other.tracker)
+{
+	if(tracker) tracker->acquire();
+}
+
+inline HandlerTracker::Count::Count(Count&& other) :
+	tracker(other.tracker)
+{
+	other.tracker = nullptr;
+}
+
+inline HandlerTracker::Count::~Count() {
+	if(tracker) tracker->release();
+}
+
+template <class Handler>
+HandlerTracker::Wrapped<typename std::decay<Handler>::type> HandlerTracker::wrap(Handler&& handler) {
+	return Wrapped<typename std::decay<Handler>::type> {
+		Count(*this),
+		nullptr,
+		std::forward<Handler>(handler)
+	};
+}
+
+template <class Handler>
+HandlerTracker::Wrapped<typename std::decay<Handler>::type> HandlerTracker::wrap(Handler&& handler, HandlerMemory& memory) {
+	return Wrapped<typename std::decay<Handler>::type> {
+		Count(*this),
+		&memory,
+		std::forward<Handler>(handler)
+	};
+}
+
+} // End of namespace sockets
+
+} // End of namespace cracen2
@@ -1,12 +1,22 @@
 #pragma once
 
 #include <boost/asio.hpp>
+#include <chrono>
 #include <memory>
 #include <future>
 #include <limits>
 #include <cstdint>
+#include <map>
+#include <queue>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <sys/uio.h>
 
 #include "cracen2/network/ImmutableBuffer.hpp"
+#include "cracen2/network/Completion.hpp"
+#include "cracen2/sockets/AsioExecutor.hpp"
 #include "cracen2/util/Debug.hpp"
 #include "cracen2/util/Thread.hpp"
 #include "cracen2/util/CoarseGrainedLocked.hpp"
@@ -37,8 +47,23 @@ public:
 		Datagram(Datagram&&) = default;
 	};
 
+	struct Configuration {
+		// Number of tcp connections per remote endpoint. Bodies of at least stripeThreshold bytes are
+		// split over all connections and reassembled by the receiver. Smaller frames always use the
+		// first connection and keep their order.
+		std::size_t streams = 1;
+		std::size_t stripeThreshold = 256*1024;
+		// Partially received striped messages are dropped, when the connection reading one of their stripes
+		// fails, or when none of their stripes was read for reassemblyTimeout.
+		std::chrono::milliseconds reassemblyTimeout = std::chrono::milliseconds(10000);
+		// Stripes of bigger messages are rejected and their connection is closed
+		std::size_t maxStripedSize = 1024*1024*1024;
+		// Bodies of at least zeroCopyThreshold bytes are sent with MSG_ZEROCOPY, if the kernel supports it.
+		// Their futures are only ready, when the kernel released the memory. 0 disables zero copy sends.
+		std::size_t zeroCopyThreshold = 0;
+	};
+
 	Endpoint local;
-	std::mutex mutex;
 
 private:
 
@@ -47,33 +72,179 @@ private:
 
 	using ImmutableBuffer = network::ImmutableBuffer;
 
-	boost::asio::io_service io_service;
-	util::JoiningThread serviceThread;
-	boost::asio::io_service::work work;
+	std::shared_ptr<AsioExecutor> executor;
+	boost::asio::io_service& io_service;
+	HandlerTracker handlers;
+
+	using buffer_size_t = std::remove_const<decltype(ImmutableBuffer::size)>::type;
+
+	// Set in the header size of a frame, that carries one stripe of a bigger body
+	static constexpr buffer_size_t stripeFlag = buffer_size_t(1) << (8 * sizeof(buffer_size_t) - 1);
+
+	// Follows the header size of a stripe frame
+	struct StripeInfo {
+		std::uint64_t sender;
+		std::uint64_t message;
+		std::uint64_t offset;
+		std::uint64_t total;
+	};
+
+	struct PendingWrite {
+		buffer_size_t headerSize; // As sent on the wire, including the stripe flag
+		const std::uint8_t* header;
+		buffer_size_t bodySize;
+		const std::uint8_t* body;
+		network::Completer completion;
+		StripeInfo stripe;
+		bool zeroCopied = false;
+		// Body of a gather send, which is written piece by piece instead of body
+		const ImmutableBuffer* pieces = nullptr;
+		std::size_t pieceCount = 0;
+	};
+
+	// Body of a striped message, that is filled by several connections
+	struct Reassembly {
+		network::Buffer header;
+		network::Buffer body;
+		std::size_t received;
+		// Byte ranges [begin, end) of the stripes, that are read or being read
+		std::map<std::uint64_t, std::uint64_t> claimed;
+		bool hasHeader;
+		Endpoint remote;
+		// Connections, that are reading a stripe of the message
+		std::size_t readers;
+		std::chrono::steady_clock::time_point updated;
+	};
+
+	/*
+	 * State of a single tcp connection. Incoming bytes are read into a reusable staging buffer and
+	 * split into frames ([headerSize][header][bodySize][body]) without blocking the io_service. A stripe
+	 * frame sets the stripeFlag in headerSize and is followed by its StripeInfo before the header.
+	 * Outgoing frames are submitted under the submit mutex and moved to the write queue by a single
+	 * posted handler per burst. Only one async_write is in flight, which carries all frames queued in
+	 * the meantime as a single gather write.
+	 */
+	struct Connection {
+		enum class ReadState {
+			headerSize,
+			stripeInfo,
+			header,
+			bodySize,
+			body
+		};
+
+		static constexpr std::size_t stagingSize = 64*1024;
+
+		Socket socket;
+		Endpoint remote;
+		std::size_t stream;
+		// Serializes all handlers of this connection, if the executor runs several threads
+		boost::asio::io_service::strand strand;
+
+		ReadState state;
+		std::unique_ptr<std::uint8_t[]> staging;
+		std::size_t begin;
+		std::size_t end;
+
+		buffer_size_t headerSize;
+		buffer_size_t bodySize;
+		std::size_t filled;
+		network::Buffer header;
+		network::Buffer body;
+		std::uint8_t* bodyTarget;
+
+		bool striped;
+		StripeInfo stripe;
+		std::shared_ptr<Reassembly> reassembly;
+
+		static constexpr std::size_t maxCoalescedWrites = 64;
+
+		std::mutex submitMutex;
+		std::vector<PendingWrite> submitted;
+		// A handler is posted, that moves the submitted frames to the write queue
+		bool submitPosted;
+		HandlerMemory submitMemory;
+
+		// Frames are queued until the connection is established
+		bool connected;
+		// First connect, read or write error. Frames, that are sent afterwards, fail with it.
+		boost::system::error_code failure;
+
+		std::deque<PendingWrite> writeQueue;
+		std::vector<PendingWrite> writesInFlight;
+		std::vector<boost::asio::const_buffer> writeBuffers;
+		bool writing;
+
+		/*
+		 * Zero copy sends. Each successful sendmsg with MSG_ZEROCOPY gets the next id from the kernel, which
+		 * reports ranges of released ids on the error queue. A write is complete, when all ids up to its
+		 * last one are released.
+		 */
+		bool zeroCopy;
+		// Per write buffer, the write whose body is sent without a copy, or nullptr
+		std::vector<PendingWrite*> zeroCopyOwners;
+		// Gather list of the current sendmsg, kept between writes to reuse its capacity
+		std::vector<iovec> zeroCopyIovecs;
+		std::size_t writeIndex;
+		std::size_t writeOffset;
+		std::uint64_t zeroCopySent;
+		std::uint64_t zeroCopyCompleted;
+		// Released ranges, that do not follow zeroCopyCompleted yet
+		std::map<std::uint64_t, std::uint64_t> zeroCopyReleased;
+		std::deque<std::pair<std::uint64_t, network::Completer>> zeroCopyPending;
+		bool pollingErrors;
+
+		Connection(Socket&& socket, Endpoint remote, std::size_t stream, boost::asio::io_service& io_service);
+	};
 
 	Acceptor acceptor;
-	std::function<void(const boost::system::error_code&)> handle_accept(std::shared_ptr<Socket> socket);
+	std::function<void(const boost::system::error_code&)> handle_accept(std::shared_ptr<Socket> socket, boost::asio::io_service& service);
+	void accept();
 
+	// Connections are identified by the remote endpoint and the stream index
 	using EndpointSocketMapType = cracen2::util::CoarseGrainedLocked<
 		std::map<
-			tcp::endpoint,
-			Socket
+			std::pair<tcp::endpoint, std::size_t>,
+			std::shared_ptr<Connection>
 		>
 	>;
 
-	using PromiseQueueType = cracen2::util::AtomicQueue<
-		std::promise<Datagram>
-	>;
+	const Configuration configuration;
+	const std::uint64_t senderId;
+	std::atomic<std::uint64_t> nextMessage;
+	std::mutex reassemblyMutex;
+	std::map<std::pair<std::uint64_t, std::uint64_t>, std::shared_ptr<Reassembly>> reassemblies;
 
 	EndpointSocketMapType sockets;
-	PromiseQueueType promiseQueue;
+	// Datagrams are handed out in the order they were read from a connection
+	std::mutex receiveMutex;
+	std::queue<std::promise<Datagram>> pendingReceives;
+	std::queue<Datagram> receivedDatagrams;
 
-	void handle_receive(Socket& socket);
-	void handle_datagram(std::shared_ptr<Datagram> d);
+	void handle_receive(std::shared_ptr<Connection> connection);
+	void read_staging(std::shared_ptr<Connection> connection);
+	void read_payload(std::shared_ptr<Connection> connection, std::uint8_t* target, buffer_size_t size);
+	void handle_datagram(Datagram&& datagram);
+	void handle_stripe(Connection& connection);
+	void drop_reassembly(Connection& connection);
+	void submit(const ImmutableBuffer& data, const Endpoint& remote, const ImmutableBuffer& header, network::Completer&& completion);
+	void enqueue(std::shared_ptr<Connection> connection, PendingWrite&& write);
+	void drain_submitted(std::shared_ptr<Connection> connection);
+	void start_write(std::shared_ptr<Connection> connection);
+	void write_zero_copy(std::shared_ptr<Connection> connection);
+	void finish_write(std::shared_ptr<Connection> connection, const boost::system::error_code& error);
+	void enable_zero_copy(Connection& connection);
+	void poll_error_queue(std::shared_ptr<Connection> connection);
+	void read_error_queue(Connection& connection);
+	std::shared_ptr<Connection> getConnection(const Endpoint& remote, std::size_t stream = 0);
+	void handle_connect(std::shared_ptr<Connection> connection, const boost::system::error_code& error);
+	void fail_connection(std::shared_ptr<Connection> connection, const boost::system::error_code& error);
 
 public:
 
 	AsioStreamingSocket();
+	AsioStreamingSocket(std::shared_ptr<AsioExecutor> executor);
+	AsioStreamingSocket(Configuration configuration, std::shared_ptr<AsioExecutor> executor = std::make_shared<AsioExecutor>());
 	~AsioStreamingSocket();
 
 	AsioStreamingSocket(AsioStreamingSocket&& other) = default;
@@ -84,12 +255,28 @@ public:
 
 	void bind(Endpoint endpoint = Endpoint(boost::asio::ip::address::from_string("0.0.0.0"),0));
 
+	/*
+	 * Establish the connection to remote in the background, so that the first frame sent to remote
+	 * does not wait for the handshake. Does nothing if the connection exists already.
+	 */
+	void connect(const Endpoint& remote);
+
 	std::future<void> asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header = ImmutableBuffer(nullptr, 0));
+	// Reports to completion instead of a future. Striped bodies still allocate their bookkeeping.
+	void asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header, network::Completion& completion);
+	/*
+	 * Sends the pieces as one body with a single gather write, e.g. a network::Serialized composite. The
+	 * vector and the memory behind it must stay valid, until the future is ready. The body is not striped.
+	 */
+	std::future<void> asyncSendTo(const std::vector<ImmutableBuffer>& pieces, const Endpoint remote, const ImmutableBuffer& header = ImmutableBuffer(nullptr, 0));
 	std::future<Datagram> asyncReceiveFrom();
 
 	bool isOpen() const;
 	Endpoint getLocalEndpoint() const;
 
+	// Number of striped messages, that are partially received
+	std::size_t getPendingReassemblies();
+
 	void close();
 
 }; // End of class Asio AsioStreamingSocket
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <set>
+#include <vector>
 #include <future>
 #include <boost/asio/io_service.hpp>
 #include <boost/mpi.hpp>
@@ -32,6 +36,65 @@ private:
 
 }; // End of class EndpointFactory
 
+/*
+ * Progress engine of the mpi backend. An engine owns a communicator and one or more lanes. A lane keeps the
+ * outstanding requests of the sockets assigned to it and is progressed by its own thread, if MPI provides
+ * MPI_THREAD_MULTIPLE. Otherwise all lanes are funneled through the thread, that initialized MPI. MPI is
+ * initialized by the first engine and finalized after the last one is gone.
+ */
+class MpiEngine {
+public:
+
+	struct Configuration {
+		// Lanes with their own progress thread, only used with MPI_THREAD_MULTIPLE
+		std::size_t progressThreads = 1;
+		// Duplicates MPI_COMM_WORLD to separate the traffic of the engine from other engines. Collective over
+		// MPI_COMM_WORLD: all processes must create their duplicating engines in the same order.
+		bool duplicateCommunicator = true;
+		/*
+		 * One sided mode. Every process exposes a ring of rmaSlots slots of rmaSlotSize bytes. Frames of at least
+		 * rmaThreshold bytes are put into a free slot of the receiver and announced by a small message. If no
+		 * slot is free or the frame does not fit, it is sent two sided. Creating the ring is collective over
+		 * the communicator, so it must be enabled on all processes. 0 slots disables the mode.
+		 */
+		std::size_t rmaSlots = 0;
+		std::size_t rmaSlotSize = 1024*1024;
+		std::size_t rmaThreshold = 128*1024;
+	};
+
+	class Lane;
+	struct Environment;
+	struct RmaRing;
+
+	MpiEngine();
+	explicit MpiEngine(Configuration configuration);
+	~MpiEngine();
+
+	MpiEngine(const MpiEngine& other) = delete;
+	MpiEngine& operator=(const MpiEngine& other) = delete;
+
+	// Engine of the sockets, that are not given one. Works on MPI_COMM_WORLD, unless configured otherwise.
+	static std::shared_ptr<MpiEngine> defaultEngine();
+	// Must be called before the default engine is created by the first socket
+	static void setDefaultConfiguration(Configuration configuration);
+
+	int rank() const;
+	bool threadMultiple() const;
+
+	// Lanes are handed out round robin
+	Lane& nextLane();
+
+private:
+
+	std::shared_ptr<Environment> environment;
+	MPI_Comm communicator;
+	bool duplicated;
+	std::unique_ptr<RmaRing> rma;
+	std::vector<std::unique_ptr<Lane>> lanes;
+	std::atomic<std::size_t> nextLaneIndex;
+
+}; // End of class MpiEngine
+
 } // End of namespace detail
 
 class BoostMpiSocket {
@@ -53,6 +116,19 @@ public:
 		static constexpr std::size_t header = total;
 	};
 
+	/*
+	 * Must be the same on all processes of the job, because the sender picks the tag of a message by its size.
+	 * Frames received by the pre-posted receives and probed frames are not kept in order relative to each other.
+	 */
+	struct Configuration {
+		// Receives pre-posted on a bound endpoint, 0 probes for every message
+		std::size_t persistentReceives = 0;
+		// Biggest message, including header and trailer, that is received into a pre-posted receive
+		std::size_t persistentMessageSize = 64*1024;
+		// Engine, that progresses the requests of the socket. nullptr selects the default engine.
+		std::shared_ptr<detail::MpiEngine> engine;
+	};
+
 private:
 
 	using ImmutableBuffer = network::ImmutableBuffer;
@@ -60,10 +136,14 @@ private:
 	detail::EndpointFactory endpointFactory;
 
 	Endpoint local;
+	Configuration configuration;
+	std::shared_ptr<detail::MpiEngine> engine;
+	detail::MpiEngine::Lane* lane;
 
 public:
 
 	BoostMpiSocket();
+	BoostMpiSocket(Configuration configuration);
 	~BoostMpiSocket();
 
 	BoostMpiSocket(BoostMpiSocket&& other) = default;
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <queue>
+#include <memory>
+#include <future>
+#include <limits>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+#include "cracen2/network/ImmutableBuffer.hpp"
+#include "cracen2/network/Completion.hpp"
+
+namespace cracen2 {
+
+namespace sockets {
+
+/*
+ * Socket for participants, that run as threads of the same process. Endpoints are registered in a process
+ * wide registry and frames are handed to the queue of the remote socket without passing the kernel.
+ * Frames sent as Buffers change their owner without being copied, frames sent as ImmutableBuffers are
+ * copied once, because the caller keeps their memory.
+ */
+class InProcessSocket {
+public:
+
+	struct Endpoint {
+		// 0 selects a free id on bind
+		std::uint64_t id;
+
+		Endpoint() : id(0) {}
+		explicit Endpoint(std::uint64_t id) : id(id) {}
+
+		bool operator==(const Endpoint& rhs) const { return id == rhs.id; }
+		bool operator!=(const Endpoint& rhs) const { return id != rhs.id; }
+		bool operator<(const Endpoint& rhs) const { return id < rhs.id; }
+	};
+
+	struct Datagram {
+		network::Buffer header;
+		network::Buffer body;
+		Endpoint remote;
+	};
+
+	struct MaxMessageSize {
+		static constexpr std::size_t total = std::numeric_limits<std::size_t>::max();
+		static constexpr std::size_t body = total;
+		static constexpr std::size_t header = total;
+	};
+
+	// Receive queue of a bound socket. Senders look it up in the registry once and keep it.
+	struct Inbox {
+		std::mutex mutex;
+		std::queue<std::promise<Datagram>> pendingReceives;
+		std::queue<Datagram> receivedDatagrams;
+		bool closed = false;
+
+		// Returns false without taking the datagram, if the inbox has been closed
+		bool deliver(Datagram&& datagram);
+	};
+
+private:
+
+	using ImmutableBuffer = network::ImmutableBuffer;
+
+	Endpoint local;
+	std::shared_ptr<Inbox> inbox;
+	// Set after local, so that a send reads it without the bindMutex
+	std::atomic<bool> bound;
+	std::mutex bindMutex;
+
+	// Inboxes of the remotes, that this socket has sent to
+	std::mutex remotesMutex;
+	std::map<Endpoint, std::shared_ptr<Inbox>> remotes;
+
+	void registerEndpoint(Endpoint endpoint);
+	void bindIfUnbound();
+	std::shared_ptr<Inbox> getRemote(const Endpoint& remote);
+	void forgetRemote(const Endpoint& remote, const std::shared_ptr<Inbox>& closed);
+	void send(network::Buffer&& data, const Endpoint& remote, network::Buffer&& header);
+
+public:
+
+	InProcessSocket();
+	~InProcessSocket();
+
+	InProcessSocket(const InProcessSocket& other) = delete;
+	InProcessSocket& operator=(const InProcessSocket& other) = delete;
+
+	void bind(Endpoint endpoint = Endpoint());
+
+	std::future<void> asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header = ImmutableBuffer(nullptr, 0));
+	// Moves the buffers into the queue of the remote
+	std::future<void> asyncSendTo(network::Buffer&& data, const Endpoint remote, network::Buffer&& header = network::Buffer());
+	// Moves data into the queue of the remote and copies the header
+	std::future<void> asyncSendTo(network::Buffer&& data, const Endpoint remote, const ImmutableBuffer& header);
+	// Reports to completion instead of a future. Completes before returning.
+	void asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header, network::Completion& completion);
+	std::future<Datagram> asyncReceiveFrom();
+
+	bool isOpen() const;
+	Endpoint getLocalEndpoint() const;
+
+	void close();
+
+}; // End of class InProcessSocket
+
+std::ostream& operator<<(std::ostream& lhs, const InProcessSocket::Endpoint& rhs);
+
+} // End of namespace sockets
+
+} // End of namespace cracen2
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <boost/asio/ip/udp.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <future>
+#include <limits>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+#include "cracen2/network/ImmutableBuffer.hpp"
+#include "cracen2/network/Completion.hpp"
+#include "cracen2/util/Thread.hpp"
+
+namespace cracen2 {
+
+namespace sockets {
+
+/*
+ * Udp socket on io_uring. The wire format is the one of the AsioDatagramSocket, so both can talk to each
+ * other. Incoming datagrams are received by a single multishot recvmsg into a ring of buffers, that is
+ * registered with the kernel. Received bodies are handed out in place and their buffer goes back into the ring,
+ * when they are released. Sends are queued as sendmsg submissions, that gather body and header from the
+ * memory of the caller, and are submitted in batches. A completion thread per socket reaps the results, a
+ * second thread submits partial batches after the send window, if sendBatchSize is above one.
+ */
+class IoUringDatagramSocket {
+public:
+
+	struct Configuration {
+		// Submission queue entries, also the number of sends, that may be in flight
+		std::size_t queueDepth = 256;
+		// Buffers registered for the multishot receive, rounded up to a power of two. Up to half of them are
+		// lent out with received bodies, further bodies are copied.
+		std::size_t receiveBuffers = 64;
+		// Sends are submitted with one system call, when sendBatchSize of them are queued or the oldest
+		// queued send waited for sendWindow.
+		std::size_t sendBatchSize = 1;
+		std::chrono::microseconds sendWindow = std::chrono::microseconds(50);
+	};
+
+	using Endpoint = boost::asio::ip::udp::endpoint;
+	struct Datagram {
+		network::Buffer header;
+		network::Buffer body;
+		Endpoint remote;
+	};
+
+	// Largest udp payload over IPv4, minus the header size field
+	struct MaxMessageSize {
+		static constexpr std::size_t total = 65507 - sizeof(network::ImmutableBuffer::size);
+		static constexpr std::size_t body = total;
+		static constexpr std::size_t header = total;
+	};
+
+private:
+
+	using ImmutableBuffer = network::ImmutableBuffer;
+
+	// Mapped queues, registered receive buffers and send slots of the io_uring instance
+	struct Ring;
+
+	const Configuration configuration;
+	int fd;
+	std::unique_ptr<Ring> ring;
+
+	// Guards the submission queue and the send slots
+	std::mutex submitMutex;
+	std::condition_variable slotFreed;
+	// Notified, when the first send of a batch is queued
+	std::condition_variable batchStarted;
+	std::chrono::steady_clock::time_point batchStart;
+	bool reaping;
+	std::thread::id completionThreadId;
+
+	std::mutex receiveMutex;
+	std::queue<std::promise<Datagram>> pendingReceives;
+	std::queue<Datagram> receivedDatagrams;
+	bool receiveArmed;
+
+	std::atomic<bool> stopping;
+	util::JoiningThread completionThread;
+	util::JoiningThread batchThread;
+
+	void submitSend(const ImmutableBuffer& data, const Endpoint& remote, const ImmutableBuffer& header, network::Completer&& completion);
+	void armReceive();
+	void reap();
+	void flushBatches();
+	void handleSend(std::uint64_t slot, int result);
+	void handleReceive(int result, std::uint32_t flags);
+	void deliver(Datagram&& datagram);
+
+public:
+
+	IoUringDatagramSocket();
+	IoUringDatagramSocket(Configuration configuration);
+	~IoUringDatagramSocket();
+
+	IoUringDatagramSocket(const IoUringDatagramSocket& other) = delete;
+	IoUringDatagramSocket& operator=(const IoUringDatagramSocket& other) = delete;
+
+	/*
+	 * False, if the kernel can not set up the io_uring instance of a socket: it has no io_uring (ENOSYS), forbids
+	 * it, e.g. by the seccomp profile of a container (EPERM), or lacks registered buffer rings (EINVAL).
+	 */
+	static bool isSupported();
+
+	void bind(Endpoint endpoint = Endpoint(boost::asio::ip::address::from_string("0.0.0.0"), 0));
+
+	std::future<void> asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header = ImmutableBuffer(nullptr, 0));
+	// Reports to completion instead of a future. It is called from the completion thread. A completion may
+	// send again, but fails instead of waiting, if all send slots are in flight.
+	void asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header, network::Completion& completion);
+	std::future<Datagram> asyncReceiveFrom();
+
+	bool isOpen() const;
+	Endpoint getLocalEndpoint() const;
+
+	void close();
+
+}; // End of class IoUringDatagramSocket
+
+} // End of namespace sockets
+
+} // End of namespace cracen2
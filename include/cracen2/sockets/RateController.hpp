@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+namespace cracen2 {
+
+namespace sockets {
+
+/*
+ * Feedback about the path to one peer, as reported by a layer with acknowledgements (see ReliableSocket).
+ * A zero rtt means, that the sample carries no rtt measurement.
+ */
+struct RateSample {
+	std::chrono::microseconds rtt;
+	std::size_t delivered;
+	std::size_t lost;
+};
+
+/*
+ * Delay based rate control in the style of LEDBAT. The smallest rtt seen within baseDelayWindow is the
+ * delay of the empty path. Queuing delay below targetDelay increases the rate, queuing delay above it
+ * decreases the rate, proportional to the distance from the target and scaled to one step per rtt.
+ * Loss decreases the rate by lossDecrease, at most once per rtt.
+ */
+class RateController {
+public:
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Configuration {
+		// All rates in bytes per second
+		double initialRate = 125e6;
+		double minRate = 1e6;
+		double maxRate = 10e9;
+		std::chrono::microseconds targetDelay = std::chrono::microseconds(1000);
+		// Relative change of the rate per rtt, at zero queuing delay
+		double gain = 0.25;
+		double lossDecrease = 0.7;
+		std::chrono::seconds baseDelayWindow = std::chrono::seconds(10);
+	};
+
+private:
+
+	Configuration configuration;
+	double currentRate;
+	std::chrono::microseconds baseDelay;
+	Clock::time_point baseDelayMeasured;
+	Clock::time_point lastUpdate;
+	Clock::time_point lastDecrease;
+
+public:
+
+	RateController();
+	RateController(Configuration configuration);
+
+	void update(const RateSample& sample, Clock::time_point now = Clock::now());
+
+	double rate() const;
+	std::chrono::microseconds getBaseDelay() const;
+
+}; // End of class RateController
+
+} // End of namespace sockets
+
+} // End of namespace cracen2
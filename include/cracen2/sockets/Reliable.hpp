@@ -0,0 +1,508 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+#include "cracen2/network/ImmutableBuffer.hpp"
+#include "cracen2/network/Message.hpp"
+#include "cracen2/sockets/RateController.hpp"
+#include "cracen2/util/Thread.hpp"
+#include "cracen2/util/Tuple.hpp"
+
+namespace cracen2 {
+
+namespace sockets {
+
+namespace detail {
+
+// Sockets with pacing adapt their rate to the acknowledgements
+template <class Socket, class Endpoint>
+auto feedback(Socket& socket, const Endpoint& remote, const RateSample& sample, int) -> decltype(socket.feedback(remote, sample)) {
+	return socket.feedback(remote, sample);
+}
+
+template <class Socket, class Endpoint>
+void feedback(Socket&, const Endpoint&, const RateSample&, long) {}
+
+} // End of namespace detail
+
+/*
+ * Reliability layer over a datagram socket. Messages, for which the configured predicate holds, get a
+ * per peer sequence number and are kept for retransmission, until the receiver acknowledges them. Acks
+ * carry the lowest missing sequence number and a bitmap of the 64 sequence numbers above it. Holes below
+ * an acknowledged message are negative acknowledgements and are retransmitted without waiting for the
+ * timeout. Duplicates are suppressed. Delivery is not ordered, like the one of the underlying socket.
+ * All other messages pass through best-effort. Both sides have to use the layer.
+ *
+ * The future of a reliable send is ready, when the message was acknowledged, or fails after
+ * maxRetransmissions. The body must stay valid until then. Rtt samples of acknowledged messages and
+ * losses are reported to the socket, if it paces its sends (see AsioDatagramSocket::feedback).
+ */
+template <class Socket>
+class ReliableSocket {
+public:
+
+	using Endpoint = typename Socket::Endpoint;
+	using Datagram = typename Socket::Datagram;
+
+	struct Configuration {
+		// Decides by the message header, if a message is sent reliably. All messages by default.
+		std::function<bool(const network::ImmutableBuffer& header)> reliable;
+		std::chrono::milliseconds retransmissionTimeout = std::chrono::milliseconds(20);
+		std::size_t maxRetransmissions = 50;
+		// Acks are delayed by ackDelay to cover several messages, unless a gap or a duplicate is detected
+		std::chrono::microseconds ackDelay = std::chrono::microseconds(500);
+	};
+
+	struct Statistics {
+		std::size_t retransmissions = 0;
+		std::size_t duplicates = 0;
+		std::size_t failed = 0;
+	};
+
+private:
+
+	using ImmutableBuffer = network::ImmutableBuffer;
+	using Clock = std::chrono::steady_clock;
+
+	// Trails the header of every datagram
+	struct Segment {
+		enum Kind : std::uint64_t {
+			unreliable,
+			data,
+			ack
+		};
+		std::uint64_t kind;
+		std::uint64_t sequence;
+		// Acks: every sequence number below ackBase and the ones set in ackBits (bit i = ackBase + i) arrived
+		std::uint64_t ackBase;
+		std::uint64_t ackBits;
+	};
+
+	static constexpr std::uint64_t window = 64;
+
+	using HeaderStorage = std::shared_ptr<std::vector<std::uint8_t>>;
+
+	struct Outstanding {
+		ImmutableBuffer body;
+		HeaderStorage header;
+		std::promise<void> promise;
+		Clock::time_point lastSent;
+		std::size_t transmissions;
+		// Sends of the underlying socket, that may still read body and header
+		std::vector<std::future<void>> sends;
+		std::exception_ptr error;
+	};
+
+	struct Peer {
+		// Sender state
+		std::uint64_t nextSequence = 0;
+		std::map<std::uint64_t, Outstanding> outstanding;
+		// Messages, that wait for the window to open
+		std::deque<Outstanding> waiting;
+
+		// Receiver state
+		std::uint64_t base = 0;
+		std::uint64_t received = 0;
+		std::size_t unacknowledged = 0;
+		Clock::time_point ackDeadline;
+	};
+
+	Socket socket;
+	const Configuration configuration;
+
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	std::map<Endpoint, Peer> peers;
+	// Acknowledged or failed messages, that wait for their underlying sends
+	std::vector<Outstanding> finished;
+	std::deque<std::pair<std::future<void>, HeaderStorage>> controlSends;
+	Statistics statistics;
+	bool stopping;
+
+	std::mutex receiveMutex;
+	std::queue<std::promise<Datagram>> pendingReceives;
+	std::queue<Datagram> receivedDatagrams;
+	// Set by close, receives that find no datagram fail from then on
+	bool receivesClosed;
+
+	util::JoiningThread receiveThread;
+	util::JoiningThread timerThread;
+
+	static HeaderStorage makeHeader(const ImmutableBuffer& header, const Segment& segment) {
+		auto storage = std::make_shared<std::vector<std::uint8_t>>(header.size + sizeof(Segment));
+		if(header.size > 0) std::memcpy(storage->data(), header.data, header.size);
+		std::memcpy(storage->data() + header.size, &segment, sizeof(Segment));
+		return storage;
+	}
+
+	std::future<void> transmit(const ImmutableBuffer& body, const Endpoint& remote, const HeaderStorage& header) {
+		return socket.asyncSendTo(body, remote, ImmutableBuffer(header->data(), header->size()));
+	}
+
+	// mutex must be held by the caller
+	void sendOutstanding(Peer& peer, const Endpoint& remote, Outstanding&& message) {
+		const std::uint64_t sequence = peer.nextSequence++;
+		Segment segment { Segment::data, sequence, 0, 0 };
+		std::memcpy(message.header->data() + message.header->size() - sizeof(Segment), &segment, sizeof(Segment));
+		message.lastSent = Clock::now();
+		message.transmissions = 1;
+		message.sends.push_back(transmit(message.body, remote, message.header));
+		peer.outstanding.emplace(sequence, std::move(message));
+	}
+
+	// mutex must be held by the caller
+	void retransmit(Outstanding& message, const Endpoint& remote, Clock::time_point now) {
+		statistics.retransmissions++;
+		message.lastSent = now;
+		message.transmissions++;
+		message.sends.push_back(transmit(message.body, remote, message.header));
+	}
+
+	// mutex must be held by the caller
+	void sendAck(Peer& peer, const Endpoint& remote) {
+		const Segment segment { Segment::ack, 0, peer.base, peer.received };
+		auto header = makeHeader(ImmutableBuffer(nullptr, 0), segment);
+		controlSends.emplace_back(transmit(ImmutableBuffer(nullptr, 0), remote, header), header);
+		peer.unacknowledged = 0;
+	}
+
+	// mutex must be held by the caller
+	void handleAck(Peer& peer, const Endpoint& remote, const Segment& segment) {
+		auto& outstanding = peer.outstanding;
+		const auto now = Clock::now();
+		RateSample sample { std::chrono::microseconds(0), 0, 0 };
+		for(auto it = outstanding.begin(); it != outstanding.end();) {
+			const std::uint64_t sequence = it->first;
+			const bool acked =
+				sequence < segment.ackBase ||
+				(sequence - segment.ackBase < window && (segment.ackBits >> (sequence - segment.ackBase)) & 1);
+			if(acked) {
+				// The rtt of retransmitted messages is ambiguous
+				if(it->second.transmissions == 1) {
+					sample.rtt = std::chrono::duration_cast<std::chrono::microseconds>(now - it->second.lastSent);
+				}
+				sample.delivered += it->second.body.size;
+				finished.push_back(std::move(it->second));
+				it = outstanding.erase(it);
+			} else {
+				++it;
+			}
+		}
+
+		// Holes below the highest acknowledged message were lost
+		const std::uint64_t highest = segment.ackBase + (segment.ackBits ? 63 - __builtin_clzll(segment.ackBits) : 0);
+		for(auto it = outstanding.begin(); it != outstanding.end() && it->first < highest; ++it) {
+			if(now - it->second.lastSent >= configuration.retransmissionTimeout / 4) {
+				retransmit(it->second, remote, now);
+				sample.lost++;
+			}
+		}
+		detail::feedback(socket, remote, sample, 0);
+
+		// The window moved
+		while(!peer.waiting.empty() && peer.nextSequence < lowestOutstanding(peer) + window) {
+			sendOutstanding(peer, remote, std::move(peer.waiting.front()));
+			peer.waiting.pop_front();
+		}
+		if(!finished.empty()) {
+			wakeup.notify_one();
+		}
+	}
+
+	// mutex must be held by the caller. Returns, if the message is new.
+	bool handleData(Peer& peer, const Endpoint& remote, const Segment& segment) {
+		const std::uint64_t sequence = segment.sequence;
+		bool fresh = sequence >= peer.base;
+		if(fresh) {
+			std::uint64_t offset = sequence - peer.base;
+			if(offset >= window) {
+				// The sender gave up on the messages below its window
+				const std::uint64_t shift = offset - window + 1;
+				peer.received = shift >= window ? 0 : peer.received >> shift;
+				peer.base += shift;
+				offset = window - 1;
+			}
+			fresh = ((peer.received >> offset) & 1) == 0;
+			peer.received |= std::uint64_t(1) << offset;
+			while(peer.received & 1) {
+				peer.received >>= 1;
+				peer.base++;
+			}
+		}
+
+		const bool gap = peer.received != 0;
+		if(!fresh) {
+			statistics.duplicates++;
+		}
+		if(!fresh || gap) {
+			// The sender missed an ack or a message is missing
+			sendAck(peer, remote);
+		} else if(peer.unacknowledged++ == 0) {
+			peer.ackDeadline = Clock::now() + configuration.ackDelay;
+			wakeup.notify_one();
+		}
+		return fresh;
+	}
+
+	static std::uint64_t lowestOutstanding(const Peer& peer) {
+		return peer.outstanding.empty() ? peer.nextSequence : peer.outstanding.begin()->first;
+	}
+
+	void deliver(Datagram&& datagram) {
+		std::unique_lock<std::mutex> lock(receiveMutex);
+		if(!pendingReceives.empty()) {
+			pendingReceives.front().set_value(std::move(datagram));
+			pendingReceives.pop();
+		} else {
+			receivedDatagrams.push(std::move(datagram));
+		}
+	}
+
+	void receiver() {
+		while(true) {
+			Datagram datagram;
+			try {
+				datagram = socket.asyncReceiveFrom().get();
+			} catch(const std::exception&) {
+				std::unique_lock<std::mutex> lock(mutex);
+				if(stopping) break;
+				continue;
+			}
+			if(datagram.header.size() < sizeof(Segment)) continue;
+
+			Segment segment;
+			const std::size_t headerSize = datagram.header.size() - sizeof(Segment);
+			std::memcpy(&segment, datagram.header.data() + headerSize, sizeof(Segment));
+			datagram.header.shrink(headerSize);
+
+			if(segment.kind == Segment::data) {
+				std::unique_lock<std::mutex> lock(mutex);
+				if(!handleData(peers[datagram.remote], datagram.remote, segment)) continue;
+			} else if(segment.kind == Segment::ack) {
+				std::unique_lock<std::mutex> lock(mutex);
+				handleAck(peers[datagram.remote], datagram.remote, segment);
+				continue;
+			}
+			deliver(std::move(datagram));
+		}
+	}
+
+	void timer() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while(!stopping) {
+			const auto now = Clock::now();
+			auto next = now + configuration.retransmissionTimeout;
+
+			for(auto& endpointPeer : peers) {
+				auto& peer = endpointPeer.second;
+				RateSample sample { std::chrono::microseconds(0), 0, 0 };
+				if(peer.unacknowledged > 0) {
+					if(peer.ackDeadline <= now) {
+						sendAck(peer, endpointPeer.first);
+					} else {
+						next = std::min(next, peer.ackDeadline);
+					}
+				}
+
+				for(auto it = peer.outstanding.begin(); it != peer.outstanding.end();) {
+					auto& message = it->second;
+					const auto deadline = message.lastSent + configuration.retransmissionTimeout;
+					if(deadline > now) {
+						next = std::min(next, deadline);
+						++it;
+					} else if(message.transmissions > configuration.maxRetransmissions) {
+						statistics.failed++;
+						message.error = std::make_exception_ptr(std::runtime_error("ReliableSocket: Message was not acknowledged."));
+						finished.push_back(std::move(message));
+						it = peer.outstanding.erase(it);
+					} else {
+						retransmit(message, endpointPeer.first, now);
+						sample.lost++;
+						next = std::min(next, now + configuration.retransmissionTimeout);
+						++it;
+					}
+				}
+				if(sample.lost > 0) {
+					detail::feedback(socket, endpointPeer.first, sample, 0);
+				}
+				while(!peer.waiting.empty() && peer.nextSequence < lowestOutstanding(peer) + window) {
+					sendOutstanding(peer, endpointPeer.first, std::move(peer.waiting.front()));
+					peer.waiting.pop_front();
+				}
+			}
+
+			while(!controlSends.empty() && controlSends.front().first.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+				controlSends.pop_front();
+			}
+
+			// The underlying sends complete quickly, but must not be waited for with the lock held
+			std::vector<Outstanding> completed;
+			completed.swap(finished);
+			if(!completed.empty()) {
+				lock.unlock();
+				for(auto& message : completed) {
+					for(auto& send : message.sends) {
+						send.wait();
+					}
+					if(message.error) {
+						message.promise.set_exception(message.error);
+					} else {
+						message.promise.set_value();
+					}
+				}
+				lock.lock();
+				continue;
+			}
+
+			wakeup.wait_until(lock, next);
+		}
+	}
+
+public:
+
+	ReliableSocket() :
+		ReliableSocket(Configuration())
+	{}
+
+	template <class... SocketArguments>
+	ReliableSocket(Configuration configuration, SocketArguments&&... socketArguments) :
+		socket(std::forward<SocketArguments>(socketArguments)...),
+		configuration(std::move(configuration)),
+		stopping(false),
+		receivesClosed(false)
+	{
+		timerThread = util::JoiningThread("ReliableSocket::timer", &ReliableSocket::timer, this);
+	}
+
+	~ReliableSocket() {
+		close();
+		// Threads are joined before the socket is destroyed
+		receiveThread = util::JoiningThread();
+		timerThread = util::JoiningThread();
+	}
+
+	ReliableSocket(const ReliableSocket& other) = delete;
+	ReliableSocket& operator=(const ReliableSocket& other) = delete;
+
+	/*
+	 * Acks are received on the bound socket, so it has to be bound before the first reliable send.
+	 */
+	template <class... Arguments>
+	void bind(Arguments&&... arguments) {
+		socket.bind(std::forward<Arguments>(arguments)...);
+		receiveThread = util::JoiningThread("ReliableSocket::receiver", &ReliableSocket::receiver, this);
+	}
+
+	std::future<void> asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header = ImmutableBuffer(nullptr, 0)) {
+		if(configuration.reliable && !configuration.reliable(header)) {
+			auto storage = makeHeader(header, Segment { Segment::unreliable, 0, 0, 0 });
+			auto result = transmit(data, remote, storage);
+			return std::async(std::launch::deferred, [result = std::move(result), storage]() mutable {
+				result.get();
+			});
+		}
+
+		Outstanding message { data, makeHeader(header, Segment()), std::promise<void>(), Clock::time_point(), 0, {}, nullptr };
+		auto future = message.promise.get_future();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		auto& peer = peers[remote];
+		if(peer.waiting.empty() && peer.nextSequence < lowestOutstanding(peer) + window) {
+			const bool idle = peer.outstanding.empty();
+			sendOutstanding(peer, remote, std::move(message));
+			if(idle) wakeup.notify_one();
+		} else {
+			peer.waiting.push_back(std::move(message));
+		}
+		return future;
+	}
+
+	std::future<Datagram> asyncReceiveFrom() {
+		std::promise<Datagram> promise;
+		auto future = promise.get_future();
+		std::unique_lock<std::mutex> lock(receiveMutex);
+		if(!receivedDatagrams.empty()) {
+			promise.set_value(std::move(receivedDatagrams.front()));
+			receivedDatagrams.pop();
+		} else if(receivesClosed) {
+			promise.set_exception(std::make_exception_ptr(std::runtime_error("ReliableSocket: The socket has been closed.")));
+		} else {
+			pendingReceives.push(std::move(promise));
+		}
+		return future;
+	}
+
+	// Pacing rate of the socket towards remote
+	template <class S = Socket>
+	auto getRate(const Endpoint& remote) -> decltype(std::declval<S&>().getRate(remote)) {
+		return socket.getRate(remote);
+	}
+
+	Statistics getStatistics() {
+		std::unique_lock<std::mutex> lock(mutex);
+		return statistics;
+	}
+
+	bool isOpen() const {
+		return socket.isOpen();
+	}
+
+	Endpoint getLocalEndpoint() const {
+		return socket.getLocalEndpoint();
+	}
+
+	void close() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if(stopping) return;
+			stopping = true;
+		}
+		wakeup.notify_all();
+		socket.close();
+		std::unique_lock<std::mutex> lock(receiveMutex);
+		receivesClosed = true;
+		while(!pendingReceives.empty()) {
+			pendingReceives.front().set_exception(std::make_exception_ptr(std::runtime_error("ReliableSocket: The socket has been closed.")));
+			pendingReceives.pop();
+		}
+	}
+
+	struct MaxMessageSize {
+		static constexpr std::size_t total = Socket::MaxMessageSize::total - sizeof(Segment);
+		static constexpr std::size_t body = Socket::MaxMessageSize::body;
+		static constexpr std::size_t header = Socket::MaxMessageSize::header - sizeof(Segment);
+	};
+
+}; // End of class ReliableSocket
+
+template <class Socket>
+constexpr std::uint64_t ReliableSocket<Socket>::window;
+
+/*
+ * Predicate for ReliableSocket::Configuration::reliable, that selects messages of a Communicator by their type.
+ */
+template <class TagList, class... Types>
+std::function<bool(const network::ImmutableBuffer& header)> reliableTypes() {
+	const std::vector<decltype(network::Header::typeId)> typeIds { util::tuple_index<Types, TagList>::value... };
+	return [typeIds](const network::ImmutableBuffer& header) {
+		if(header.size < sizeof(network::Header)) return false;
+		network::Header h;
+		std::memcpy(&h, header.data, sizeof(h));
+		return std::find(typeIds.begin(), typeIds.end(), h.typeId) != typeIds.end();
+	};
+}
+
+} // End of namespace sockets
+
+} // End of namespace cracen2
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <map>
+#include <queue>
+#include <memory>
+#include <future>
+#include <limits>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+#include "cracen2/network/ImmutableBuffer.hpp"
+#include "cracen2/util/Thread.hpp"
+
+namespace cracen2 {
+
+namespace sockets {
+
+/*
+ * Socket for participants on the same host. Every bound socket owns an inbox, which is a ring buffer in a
+ * POSIX shared memory segment (/cracen2.<process>.<id>). Senders map the inbox of the remote and copy their
+ * frames directly into it. Sends, that find the inbox full, are queued and written by a sender thread of the remote.
+ * Large bodies are handed to the receiver in place, smaller ones are copied out. Empty and full rings are
+ * waited for with a futex in the shared segment, so no data passes the kernel network stack.
+ */
+class SharedMemorySocket {
+public:
+
+	struct Endpoint {
+		// Process id of the owner and id of the socket inside that process. 0 selects one on bind.
+		std::int32_t process;
+		std::uint32_t id;
+
+		Endpoint() : process(0), id(0) {}
+		Endpoint(std::int32_t process, std::uint32_t id) : process(process), id(id) {}
+
+		bool operator==(const Endpoint& rhs) const { return process == rhs.process && id == rhs.id; }
+		bool operator!=(const Endpoint& rhs) const { return !(*this == rhs); }
+		bool operator<(const Endpoint& rhs) const { return process < rhs.process || (process == rhs.process && id < rhs.id); }
+	};
+
+	struct Datagram {
+		network::Buffer header;
+		network::Buffer body;
+		Endpoint remote;
+	};
+
+	struct MaxMessageSize {
+		static constexpr std::size_t total = std::numeric_limits<std::size_t>::max();
+		static constexpr std::size_t body = total;
+		static constexpr std::size_t header = total;
+	};
+
+	struct Configuration {
+		// Size of the inbox. Frames bigger than the inbox are streamed through it.
+		std::size_t ringSize = 16*1024*1024;
+		// Received bodies from this size on borrow the memory of the inbox instead of being copied out. A
+		// borrowed body holds back the inbox behind it, until it is destroyed, so it should not be kept for
+		// long. At most half of the inbox is borrowed. The maximum value copies every body.
+		std::size_t borrowThreshold = 16*1024;
+	};
+
+private:
+
+	using ImmutableBuffer = network::ImmutableBuffer;
+
+	class Ring;
+
+	// A send, that waits for space in the inbox of its remote
+	struct PendingSend {
+		ImmutableBuffer data;
+		ImmutableBuffer header;
+		Endpoint remote;
+		std::promise<void> promise;
+	};
+
+	const Configuration configuration;
+	Endpoint local;
+	// Shared with the received bodies, that borrow its memory
+	std::shared_ptr<Ring> inbox;
+
+	// Mapped inboxes of the remotes, that this socket has sent to
+	std::mutex remotesMutex;
+	std::map<Endpoint, std::shared_ptr<Ring>> remotes;
+
+	// Datagrams are handed out in the order they were read from the inbox
+	std::mutex receiveMutex;
+	std::queue<std::promise<Datagram>> pendingReceives;
+	std::queue<Datagram> receivedDatagrams;
+	bool closed;
+
+	util::JoiningThread receiver;
+
+	// Sends to one remote, that wait for space in its inbox. They are written in order by a sender thread, that
+	// runs while sends are queued, and later sends to the remote queue up behind them. Other remotes are not held up.
+	struct RemoteSends {
+		std::queue<PendingSend> pending;
+		bool sending = false;
+		util::JoiningThread sender;
+	};
+
+	std::mutex sendMutex;
+	std::map<Endpoint, RemoteSends> remoteSends;
+
+	void receive();
+	void send(Endpoint remote);
+	void handle_datagram(Datagram&& datagram);
+	std::shared_ptr<Ring> getRemote(const Endpoint& remote);
+
+public:
+
+	SharedMemorySocket();
+	SharedMemorySocket(Configuration configuration);
+	~SharedMemorySocket();
+
+	SharedMemorySocket(const SharedMemorySocket& other) = delete;
+	SharedMemorySocket& operator=(const SharedMemorySocket& other) = delete;
+
+	void bind(Endpoint endpoint = Endpoint());
+
+	// data and header must stay valid, until the future is ready
+	std::future<void> asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header = ImmutableBuffer(nullptr, 0));
+	std::future<Datagram> asyncReceiveFrom();
+
+	bool isOpen() const;
+	Endpoint getLocalEndpoint() const;
+
+	void close();
+
+}; // End of class SharedMemorySocket
+
+std::ostream& operator<<(std::ostream& lhs, const SharedMemorySocket::Endpoint& rhs);
+
+} // End of namespace sockets
+
+} // End of namespace cracen2
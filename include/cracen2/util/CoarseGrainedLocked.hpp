@@ -110,6 +110,16 @@ public:
 		return std::unique_ptr<ReadOnlyView>(new ReadOnlyView(*this));
 	}
 
+	// Calls function with the value under a ReadOnlyView, without allocating the view
+	template <class Function>
+	auto read(Function&& function) const {
+		std::unique_lock<std::mutex> lock(mutex); // Lock mutex for creation
+		modified.wait(lock, [this](){ return writerWaiting == 0; });
+		ReadOnlyView view(*this);
+		lock.unlock();
+		return function(view.get());
+	}
+
 }; // End of class CoarseGrainedLocked
 
 } // End of namespace util
@@ -2,6 +2,8 @@
 
 #include <tuple>
 #include <typeinfo>
+#include <array>
+#include <cstddef>
 
 namespace cracen2 {
 
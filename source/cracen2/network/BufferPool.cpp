@@ -0,0 +1,256 @@
+#include "cracen2/network/BufferPool.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <array>
+
+using namespace cracen2::network;
+
+constexpr std::size_t BufferPool::minSizeClassLog2;
+constexpr std::size_t BufferPool::maxSizeClassLog2;
+constexpr std::size_t BufferPool::sizeClasses;
+constexpr std::size_t BufferPool::defaultIdleLimit;
+
+namespace {
+
+constexpr std::size_t localCacheBytes = 16*1024*1024;
+constexpr std::size_t localCacheEntries = 64;
+
+// Counters of one thread. Only incremented by their thread, so no read modify write is needed.
+struct Counters {
+	std::atomic<std::uint64_t> hits { 0 };
+	std::atomic<std::uint64_t> misses { 0 };
+	std::atomic<std::uint64_t> unpooled { 0 };
+};
+
+void count(std::atomic<std::uint64_t>& counter) {
+	counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+struct SharedFreeList {
+	std::mutex mutex;
+	std::vector<std::uint8_t*> blocks;
+};
+
+struct Shared {
+	std::array<SharedFreeList, BufferPool::sizeClasses> freeLists;
+	std::atomic<std::size_t> idleBytes { 0 };
+	std::atomic<std::size_t> idleLimit { BufferPool::defaultIdleLimit };
+
+	// Counters of the running threads and the sum of the exited ones
+	std::mutex countersMutex;
+	std::vector<Counters*> threads;
+	std::atomic<std::uint64_t> retiredHits { 0 };
+	std::atomic<std::uint64_t> retiredMisses { 0 };
+	std::atomic<std::uint64_t> retiredUnpooled { 0 };
+};
+
+// Never destroyed, since buffers may be released during static destruction
+Shared& shared() {
+	static Shared* instance = new Shared();
+	return *instance;
+}
+
+void releaseShared(std::uint8_t* data, int sizeClass) {
+	auto& pool = shared();
+	auto& freeList = pool.freeLists[sizeClass];
+	const std::size_t capacity = BufferPool::sizeClassCapacity(sizeClass);
+	{
+		std::unique_lock<std::mutex> lock(freeList.mutex);
+		if(pool.idleBytes.load(std::memory_order_relaxed) + capacity <= pool.idleLimit.load(std::memory_order_relaxed)) {
+			pool.idleBytes += capacity;
+			freeList.blocks.push_back(data);
+			return;
+		}
+	}
+	delete[] data;
+}
+
+std::uint8_t* acquireShared(int sizeClass) {
+	auto& pool = shared();
+	auto& freeList = pool.freeLists[sizeClass];
+	std::unique_lock<std::mutex> lock(freeList.mutex);
+	if(freeList.blocks.empty()) return nullptr;
+	std::uint8_t* data = freeList.blocks.back();
+	freeList.blocks.pop_back();
+	pool.idleBytes -= BufferPool::sizeClassCapacity(sizeClass);
+	return data;
+}
+
+thread_local bool localCacheDestroyed = false;
+
+struct LocalCache {
+	std::array<std::vector<std::uint8_t*>, BufferPool::sizeClasses> blocks;
+	// Bytes of all size classes in the cache
+	std::size_t bytes = 0;
+	Counters counters;
+
+	LocalCache() {
+		auto& pool = shared();
+		std::unique_lock<std::mutex> lock(pool.countersMutex);
+		pool.threads.push_back(&counters);
+	}
+
+	~LocalCache() {
+		localCacheDestroyed = true;
+		clear(releaseShared);
+
+		auto& pool = shared();
+		std::unique_lock<std::mutex> lock(pool.countersMutex);
+		pool.threads.erase(std::find(pool.threads.begin(), pool.threads.end(), &counters));
+		pool.retiredHits += counters.hits.load();
+		pool.retiredMisses += counters.misses.load();
+		pool.retiredUnpooled += counters.unpooled.load();
+	}
+
+	bool put(std::uint8_t* data, int sizeClass) {
+		const std::size_t capacity = BufferPool::sizeClassCapacity(sizeClass);
+		auto& cached = blocks[sizeClass];
+		if(cached.size() >= localCacheEntries || bytes + capacity > localCacheBytes) return false;
+		cached.push_back(data);
+		bytes += capacity;
+		return true;
+	}
+
+	std::uint8_t* take(int sizeClass) {
+		auto& cached = blocks[sizeClass];
+		if(cached.empty()) return nullptr;
+		std::uint8_t* data = cached.back();
+		cached.pop_back();
+		bytes -= BufferPool::sizeClassCapacity(sizeClass);
+		return data;
+	}
+
+	template <class Release>
+	void clear(Release release) {
+		for(std::size_t c = 0; c < blocks.size(); c++) {
+			for(auto block : blocks[c]) {
+				release(block, c);
+			}
+			blocks[c].clear();
+		}
+		bytes = 0;
+	}
+};
+
+thread_local LocalCache localCache;
+
+// Counters of the calling thread, the retired ones after its cache is gone
+void countHit() {
+	if(localCacheDestroyed) shared().retiredHits++;
+	else count(localCache.counters.hits);
+}
+
+void countMiss() {
+	if(localCacheDestroyed) shared().retiredMisses++;
+	else count(localCache.counters.misses);
+}
+
+void countUnpooled() {
+	if(localCacheDestroyed) shared().retiredUnpooled++;
+	else count(localCache.counters.unpooled);
+}
+
+} // End of anonymous namespace
+
+void BufferDeleter::operator()(std::uint8_t* data) const {
+	if(owner) {
+		owner->release(data);
+	} else if(sizeClass < 0) {
+		delete[] data;
+	} else {
+		BufferPool::deallocate(data, sizeClass);
+	}
+}
+
+int BufferPool::sizeClass(std::size_t size) {
+	std::size_t log2 = minSizeClassLog2;
+	while((std::size_t(1) << log2) < size) {
+		if(++log2 > maxSizeClassLog2) return -1;
+	}
+	return log2 - minSizeClassLog2;
+}
+
+std::size_t BufferPool::sizeClassCapacity(int sizeClass) {
+	return std::size_t(1) << (sizeClass + minSizeClassLog2);
+}
+
+BufferPool::Pointer BufferPool::allocate(std::size_t size) {
+	const int c = sizeClass(size);
+	if(c < 0) {
+		countUnpooled();
+		return Pointer(new std::uint8_t[size], BufferDeleter());
+	}
+
+	std::uint8_t* data = localCacheDestroyed ? nullptr : localCache.take(c);
+	if(data == nullptr) {
+		data = acquireShared(c);
+	}
+	if(data != nullptr) {
+		countHit();
+		return Pointer(data, BufferDeleter(c));
+	}
+
+	countMiss();
+	return Pointer(new std::uint8_t[sizeClassCapacity(c)], BufferDeleter(c));
+}
+
+void BufferPool::deallocate(std::uint8_t* data, int sizeClass) {
+	if(data == nullptr) return;
+	if(!localCacheDestroyed && localCache.put(data, sizeClass)) return;
+	releaseShared(data, sizeClass);
+}
+
+void BufferPool::setIdleLimit(std::size_t bytes) {
+	shared().idleLimit = bytes;
+}
+
+void BufferPool::trim() {
+	if(!localCacheDestroyed) {
+		localCache.clear([](std::uint8_t* data, int){ delete[] data; });
+	}
+	auto& pool = shared();
+	for(std::size_t c = 0; c < pool.freeLists.size(); c++) {
+		std::vector<std::uint8_t*> blocks;
+		{
+			std::unique_lock<std::mutex> lock(pool.freeLists[c].mutex);
+			blocks.swap(pool.freeLists[c].blocks);
+			pool.idleBytes -= blocks.size() * sizeClassCapacity(c);
+		}
+		for(auto block : blocks) {
+			delete[] block;
+		}
+	}
+}
+
+BufferPool::Statistics BufferPool::statistics() {
+	auto& pool = shared();
+	std::unique_lock<std::mutex> lock(pool.countersMutex);
+	Statistics result {
+		pool.retiredHits.load(),
+		pool.retiredMisses.load(),
+		pool.retiredUnpooled.load(),
+		pool.idleBytes.load()
+	};
+	for(auto counters : pool.threads) {
+		result.hits += counters->hits.load(std::memory_order_relaxed);
+		result.misses += counters->misses.load(std::memory_order_relaxed);
+		result.unpooled += counters->unpooled.load(std::memory_order_relaxed);
+	}
+	return result;
+}
+
+void BufferPool::resetStatistics() {
+	auto& pool = shared();
+	std::unique_lock<std::mutex> lock(pool.countersMutex);
+	pool.retiredHits = 0;
+	pool.retiredMisses = 0;
+	pool.retiredUnpooled = 0;
+	for(auto counters : pool.threads) {
+		counters->hits = 0;
+		counters->misses = 0;
+		counters->unpooled = 0;
+	}
+}
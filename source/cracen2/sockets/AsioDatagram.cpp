@@ -1,14 +1,85 @@
 #include "cracen2/sockets/AsioDatagram.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <system_error>
+
+#include <netinet/udp.h>
+
 using namespace cracen2::sockets;
 using namespace cracen2::network;
 using namespace cracen2::util;
 
+namespace {
+
+constexpr std::size_t maxFrameSize = std::numeric_limits<std::uint16_t>::max();
+
+// Largest udp payload over IPv4, also the limit for all segments of one UDP_SEGMENT send
+constexpr std::size_t maxPayloadSize = 65507;
+constexpr std::size_t maxSegments = 64;
+
+// Sends, that can be queued before the send queue grows
+constexpr std::size_t initialSendCapacity = 64;
+
+} // End of anonymous namespace
+
+constexpr std::size_t AsioDatagramSocket::MaxMessageSize::total;
+constexpr std::size_t AsioDatagramSocket::MaxMessageSize::body;
+constexpr std::size_t AsioDatagramSocket::MaxMessageSize::header;
+constexpr AsioDatagramSocket::size_type AsioDatagramSocket::fragmentFlag;
+
+AsioDatagramSocket::ReceiveRing::ReceiveRing(std::size_t slots, std::size_t slotSize) :
+	slotSize(slotSize),
+	buffers(slots),
+	messages(slots),
+	iovecs(slots),
+	addresses(slots)
+{
+	for(std::size_t i = 0; i < slots; i++) {
+		buffers[i] = Buffer(slotSize);
+		iovecs[i].iov_base = buffers[i].data();
+		iovecs[i].iov_len = slotSize;
+		std::memset(&messages[i], 0, sizeof(mmsghdr));
+		messages[i].msg_hdr.msg_iov = &iovecs[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+		messages[i].msg_hdr.msg_name = &addresses[i];
+	}
+}
+
+std::uint8_t* AsioDatagramSocket::ReceiveRing::slot(std::size_t index) {
+	return reinterpret_cast<std::uint8_t*>(iovecs[index].iov_base);
+}
+
+Buffer AsioDatagramSocket::ReceiveRing::take(std::size_t index) {
+	Buffer result = std::move(buffers[index]);
+	buffers[index] = Buffer(slotSize);
+	iovecs[index].iov_base = buffers[index].data();
+	return result;
+}
+
 AsioDatagramSocket::AsioDatagramSocket() :
-	work(io_service),
-	socket(io_service)
+	AsioDatagramSocket(Configuration())
+{}
+
+AsioDatagramSocket::AsioDatagramSocket(Configuration configuration, std::shared_ptr<AsioExecutor> executor) :
+	executor(std::move(executor)),
+	io_service(this->executor->next()),
+	strand(io_service),
+	configuration(configuration),
+	receiveArmed(false),
+	receiveRing(std::max<std::size_t>(configuration.receiveBatchSize, 1), maxFrameSize),
+	nextMessage(std::random_device()()),
+	segmentationOffload(configuration.segmentationOffload),
+	flushScheduled(false),
+	writeBlocked(false),
+	pacingScheduled(false),
+	socket(io_service),
+	sendTimer(io_service),
+	pacingTimer(io_service),
+	retryTimer(io_service)
 {
-	serviceThread = JoiningThread("AsioDatagramSocket::ServiceThread",[this](){ io_service.run(); });
 	socket.open(udp::v4());
 	boost::asio::socket_base::receive_buffer_size option1(256*1024*1024);
 	boost::asio::socket_base::send_buffer_size option2(256*1024*1024);
@@ -16,13 +87,20 @@ AsioDatagramSocket::AsioDatagramSocket() :
 	socket.set_option(option1);
 	socket.set_option(option2);
 
+	// The queue and the batch swap their storage, so senders only allocate, when more sends are queued than ever before
+	sendQueue.reserve(std::max(initialSendCapacity, configuration.sendBatchSize));
+	flushBatch.reserve(sendQueue.capacity());
 }
 
 AsioDatagramSocket::~AsioDatagramSocket()
 {
-	if(socket.is_open()) {
-		socket.close();
-	}
+	boost::system::error_code ignored;
+	socket.close(ignored);
+	sendTimer.cancel(ignored);
+	pacingTimer.cancel(ignored);
+	retryTimer.cancel(ignored);
+	// The executor may be shared and outlive this socket
+	handlers.wait();
 }
 
 void AsioDatagramSocket::bind(Endpoint local) {
@@ -30,61 +108,584 @@ void AsioDatagramSocket::bind(Endpoint local) {
 }
 
 std::future<void> AsioDatagramSocket::asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header) {
-	auto promise = std::make_shared<std::promise<void>>();
-	std::vector<boost::asio::const_buffer> buffers;
-	buffers.reserve(3);
-	buffers.push_back(boost::asio::buffer(data.data, data.size));
-	buffers.push_back(boost::asio::buffer(header.data, header.size));
-	buffers.push_back(boost::asio::buffer(&header.size, sizeof(header.size)));
-
-// 	Buffer b(data.size + header.size + sizeof(header.size));
-// 	std::memcpy(b.data(), data.data, data.size);
-// 	std::memcpy(b.data() + data.size, header.data, header.size);
-// 	std::memcpy(b.data() + data.size + header.size, &header.size, sizeof(header.size));
-
-	socket.async_send_to(
-		buffers,
-		remote,
-		[promise](const boost::system::error_code& error, std::size_t) {
-			if(error != boost::system::errc::success) throw std::runtime_error(error.message());
-			promise->set_value();
+	std::promise<void> promise;
+	auto future = promise.get_future();
+	enqueue(data, remote, header, network::Completer(std::move(promise)));
+	return future;
+}
+
+void AsioDatagramSocket::asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header, network::Completion& completion) {
+	enqueue(data, remote, header, network::Completer(completion));
+}
+
+void AsioDatagramSocket::enqueue(const ImmutableBuffer& data, const Endpoint& remote, const ImmutableBuffer& header, network::Completer&& completion) {
+	std::vector<FragmentInfo> fragments;
+	if(data.size + header.size + sizeof(size_type) > configuration.fragmentSize) {
+		const std::size_t overhead = header.size + sizeof(FragmentInfo) + sizeof(size_type);
+		if(overhead >= configuration.fragmentSize || configuration.fragmentSize > maxPayloadSize || data.size > MaxMessageSize::body) {
+			completion.set_exception(std::make_exception_ptr(std::invalid_argument("AsioDatagramSocket: Message can not be fragmented.")));
+			return;
+		}
+		const std::size_t pieceSize = configuration.fragmentSize - overhead;
+		const std::uint32_t count = (data.size + pieceSize - 1) / pieceSize;
+		const std::uint32_t message = nextMessage++;
+		fragments.reserve(count);
+		for(std::uint32_t i = 0; i < count; i++) {
+			fragments.push_back(FragmentInfo { message, i, count, static_cast<std::uint32_t>(i * pieceSize), static_cast<std::uint32_t>(data.size) });
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(sendMutex);
+	sendQueue.push_back(
+		PendingSend {
+			data.data,
+			data.size,
+			header.data,
+			header.size,
+			remote,
+			std::move(completion),
+			std::move(fragments),
+			header.size | fragmentFlag,
+			false
 		}
 	);
-	return promise->get_future();
+
+	if(sendQueue.size() >= configuration.sendBatchSize || configuration.sendWindow.count() <= 0) {
+		scheduleFlush();
+	} else if(sendQueue.size() == 1) {
+		// First datagram of a new batch opens the coalescing window
+		sendTimer.expires_from_now(configuration.sendWindow);
+		sendTimer.async_wait(strand.wrap(handlers.wrap([this](const boost::system::error_code& error) {
+			if(error == boost::asio::error::operation_aborted) return;
+			std::unique_lock<std::mutex> lock(sendMutex);
+			scheduleFlush();
+		}, windowMemory)));
+	}
 }
 
-std::future<AsioDatagramSocket::Datagram> AsioDatagramSocket::asyncReceiveFrom() {
-	static constexpr std::size_t maxFrameSize = std::numeric_limits<std::uint16_t>::max();
+void AsioDatagramSocket::scheduleFlush() {
+	// sendMutex must be held by the caller. A blocked socket is flushed, when it is writable again.
+	if(flushScheduled || writeBlocked) return;
+	flushScheduled = true;
+	strand.post(handlers.wrap([this](){ flush(); }, flushMemory));
+}
 
-	// Probe first
-	auto remote = std::make_shared<Endpoint>();
-	auto promise = std::make_shared<std::promise<Datagram>>();
-	auto buffer = std::make_shared<Buffer>(maxFrameSize);
+void AsioDatagramSocket::waitWritable(int error) {
+	// sendMutex must be held by the caller. Errors, e.g. of a closed socket, are reported by the next flush.
+	writeBlocked = true;
+	auto resume = strand.wrap(handlers.wrap([this](const boost::system::error_code&) {
+		std::unique_lock<std::mutex> lock(sendMutex);
+		writeBlocked = false;
+		scheduleFlush();
+	}));
+	if(error == ENOBUFS) {
+		// Not signalled by writability, so try again a little later
+		retryTimer.expires_from_now(std::chrono::milliseconds(1));
+		retryTimer.async_wait(std::move(resume));
+	} else {
+		socket.async_wait(Socket::wait_write, std::move(resume));
+	}
+}
 
-	socket.async_receive_from(
-		boost::asio::buffer(buffer->data(), buffer->size()),
-		*remote,
-		[promise, buffer, remote](const boost::system::error_code& error, std::size_t received) {
+void AsioDatagramSocket::flush() {
+	// Runs on the strand. The queue gets the capacity of the last batch, so steady sending does not allocate.
+	auto& batch = flushBatch;
+	{
+		std::unique_lock<std::mutex> lock(sendMutex);
+		batch.swap(sendQueue);
+		flushScheduled = false;
+	}
+	if(configuration.pacing) {
+		pace(batch);
+	}
+	transmit(batch);
+}
 
-			if(error != boost::system::errc::success) throw std::runtime_error(error.message());
-			buffer->shrink(received);
-			// Message is in buffer
-			Datagram d;
-			d.remote = std::move(*remote);
+void AsioDatagramSocket::transmit(std::vector<PendingSend>& batch) {
+	// Runs on the strand
+	if(batch.empty()) return;
 
-			const auto headerSize = *reinterpret_cast<decltype(ImmutableBuffer::size)*>(buffer->data() + buffer->size() - sizeof(ImmutableBuffer::size));
-			d.header = Buffer(headerSize);
-			std::memcpy(d.header.data(), buffer->data() + buffer->size() - sizeof(headerSize) - headerSize, headerSize);
+	// Full fragments have exactly fragmentSize bytes, so the fragments of one message can be segmented by the kernel
+	const std::size_t segments = segmentationOffload ? std::min(maxSegments, maxPayloadSize / configuration.fragmentSize) : 1;
 
-			const auto bodySize = buffer->size() - headerSize - sizeof(headerSize);
-			buffer->shrink(bodySize);
-			d.body = std::move(*buffer);
+	// The vectors are sized up front, because the messages point into them
+	std::size_t iovecCount = 0;
+	std::size_t messageCount = 0;
+	for(auto& send : batch) {
+		iovecCount += send.fragments.empty() ? 3 : 4 * send.fragments.size();
+		messageCount += send.fragments.empty() ? 1 : (send.fragments.size() + segments - 1) / segments;
+	}
+	auto& iovecs = flushIovecs;
+	auto& messages = flushMessages;
+	auto& controls = flushControls;
+	auto& owners = flushOwners;
+	iovecs.resize(iovecCount);
+	messages.resize(messageCount);
+	controls.resize(messageCount);
+	owners.resize(messageCount);
+
+	iovec* iov = iovecs.data();
+	std::size_t m = 0;
+	for(std::size_t i = 0; i < batch.size(); i++) {
+		auto& send = batch[i];
+		const auto begin = [&](iovec* first) {
+			std::memset(&messages[m], 0, sizeof(mmsghdr));
+			messages[m].msg_hdr.msg_name = send.remote.data();
+			messages[m].msg_hdr.msg_namelen = send.remote.size();
+			messages[m].msg_hdr.msg_iov = first;
+			owners[m] = i;
+		};
+
+		if(send.fragments.empty()) {
+			// Datagram layout: [body][header][headerSize]
+			begin(iov);
+			iov[0] = iovec { const_cast<std::uint8_t*>(send.data), send.dataSize };
+			iov[1] = iovec { const_cast<std::uint8_t*>(send.header), send.headerSize };
+			iov[2] = iovec { &send.headerSize, sizeof(send.headerSize) };
+			messages[m].msg_hdr.msg_iovlen = 3;
+			iov += 3;
+			m++;
+			continue;
+		}
+
+		// Fragment layout: [piece][header][FragmentInfo][headerSize | fragmentFlag]
+		for(std::size_t f = 0; f < send.fragments.size(); f += segments) {
+			const std::size_t last = std::min(f + segments, send.fragments.size());
+			begin(iov);
+			for(std::size_t j = f; j < last; j++) {
+				auto& fragment = send.fragments[j];
+				const std::size_t end = (j + 1 < send.fragments.size()) ? send.fragments[j + 1].offset : send.dataSize;
+				iov[0] = iovec { const_cast<std::uint8_t*>(send.data) + fragment.offset, end - fragment.offset };
+				iov[1] = iovec { const_cast<std::uint8_t*>(send.header), send.headerSize };
+				iov[2] = iovec { &fragment, sizeof(FragmentInfo) };
+				iov[3] = iovec { &send.fragmentHeaderSize, sizeof(send.fragmentHeaderSize) };
+				iov += 4;
+			}
+			messages[m].msg_hdr.msg_iovlen = 4 * (last - f);
+			if(last - f > 1) {
+				auto& hdr = messages[m].msg_hdr;
+				hdr.msg_control = controls[m].data;
+				hdr.msg_controllen = sizeof(controls[m].data);
+				cmsghdr* cm = CMSG_FIRSTHDR(&hdr);
+				cm->cmsg_level = SOL_UDP;
+				cm->cmsg_type = UDP_SEGMENT;
+				cm->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+				const std::uint16_t segmentSize = configuration.fragmentSize;
+				std::memcpy(CMSG_DATA(cm), &segmentSize, sizeof(segmentSize));
+			}
+			m++;
+		}
+	}
+
+	auto& errors = flushErrors;
+	errors.assign(batch.size(), nullptr);
+	std::size_t sent = 0;
+	int blocked = 0;
+	while(sent < messageCount) {
+		// Never block the io thread. A full socket buffer is waited for asynchronously.
+		const int result = ::sendmmsg(socket.native_handle(), messages.data() + sent, messageCount - sent, MSG_DONTWAIT);
+		if(result >= 0) {
+			sent += result;
+			continue;
+		}
+		if(errno == EINTR) continue;
+		if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+			blocked = errno;
+			break;
+		}
+
+		auto& hdr = messages[sent].msg_hdr;
+		if(hdr.msg_controllen > 0 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)) {
+			// No segmentation offload on this kernel or path. The rest is sent again fragment by fragment.
+			segmentationOffload = false;
+			break;
+		}
+		if(!errors[owners[sent]]) {
+			// The datagram at the front of the remaining batch failed. Report it and go on with the rest.
+			errors[owners[sent]] = std::make_exception_ptr(std::system_error(errno, std::system_category(), "sendmmsg"));
+		}
+		sent++;
+	}
+
+	std::size_t finished = batch.size();
+	if(sent < messageCount) {
+		// The sends from the first unsent datagram on go back to the front of the queue without the fragments,
+		// that are sent already
+		finished = owners[sent];
+		auto& partial = batch[finished];
+		if(errors[finished]) {
+			finished++;
+		} else if(!partial.fragments.empty()) {
+			std::size_t first = sent;
+			while(first > 0 && owners[first - 1] == finished) first--;
+			partial.fragments.erase(partial.fragments.begin(), partial.fragments.begin() + (sent - first) * segments);
+		}
+
+		std::unique_lock<std::mutex> lock(sendMutex);
+		sendQueue.insert(sendQueue.begin(), std::make_move_iterator(batch.begin() + finished), std::make_move_iterator(batch.end()));
+		if(blocked) {
+			waitWritable(blocked);
+		} else {
+			scheduleFlush();
+		}
+	}
 
-			promise->set_value(std::move(d));
+	for(std::size_t i = 0; i < finished; i++) {
+		if(errors[i]) {
+			batch[i].completion.set_exception(errors[i]);
+		} else {
+			batch[i].completion.set_value();
 		}
+	}
+	batch.clear();
+	errors.clear();
+}
+
+AsioDatagramSocket::Pacer& AsioDatagramSocket::getPacer(const Endpoint& remote) {
+	// pacingMutex must be held by the caller
+	auto it = pacers.find(remote);
+	if(it == pacers.end()) {
+		it = pacers.emplace(
+			remote,
+			Pacer { RateController(configuration.rateControl), static_cast<double>(configuration.pacingBurst), std::chrono::steady_clock::now(), {} }
+		).first;
+	}
+	return it->second;
+}
+
+bool AsioDatagramSocket::admit(Pacer& pacer, const PendingSend& send, std::chrono::steady_clock::time_point now) {
+	// pacingMutex must be held by the caller. Big messages overdraw the bucket and the debt delays the following ones.
+	const double rate = pacer.controller.rate();
+	pacer.tokens = std::min<double>(
+		configuration.pacingBurst,
+		pacer.tokens + rate * std::chrono::duration<double>(now - pacer.refilled).count()
 	);
+	pacer.refilled = now;
+	if(pacer.tokens <= 0) return false;
+	pacer.tokens -= send.dataSize + send.headerSize + sizeof(size_type);
+	return true;
+}
 
-	return promise->get_future();
+std::chrono::steady_clock::time_point AsioDatagramSocket::nextTokens(const Pacer& pacer, std::chrono::steady_clock::time_point now) {
+	// pacingMutex must be held by the caller. The bucket is empty and was refilled at now.
+	return now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(-pacer.tokens / pacer.controller.rate())
+	);
+}
+
+void AsioDatagramSocket::pace(std::vector<PendingSend>& batch) {
+	// Runs on the strand. A send, that finds the bucket of its destination empty or sends to the destination
+	// waiting, is appended to the deferred queue of the destination. Only the pacing timer drains it, so the
+	// sends to other destinations are not touched again. Admitted sends are compacted to the front of batch,
+	// so that its capacity is kept.
+	const auto now = std::chrono::steady_clock::now();
+	auto& rejected = paceRejected;
+	std::size_t admitted = 0;
+	auto wakeup = std::chrono::steady_clock::time_point::max();
+	{
+		std::unique_lock<std::mutex> lock(pacingMutex);
+		for(auto& send : batch) {
+			// Sends, that come back from a full socket buffer, were admitted already
+			if(!send.paced) {
+				auto& pacer = getPacer(send.remote);
+				if(!pacer.deferred.empty() || !admit(pacer, send, now)) {
+					if(pacer.deferred.size() >= configuration.maxPacedSends) {
+						rejected.push_back(std::move(send));
+						continue;
+					}
+					if(pacer.deferred.empty()) {
+						wakeup = std::min(wakeup, nextTokens(pacer, now));
+					}
+					pacer.deferred.push_back(std::move(send));
+					continue;
+				}
+				send.paced = true;
+			}
+			if(&batch[admitted] != &send) {
+				batch[admitted] = std::move(send);
+			}
+			admitted++;
+		}
+	}
+	batch.erase(batch.begin() + admitted, batch.end());
+	if(wakeup != std::chrono::steady_clock::time_point::max()) {
+		schedulePacing(wakeup);
+	}
+
+	for(auto& send : rejected) {
+		send.completion.set_exception(std::make_exception_ptr(std::runtime_error("AsioDatagramSocket: Too many sends wait for the pacing of their destination.")));
+	}
+	rejected.clear();
+}
+
+void AsioDatagramSocket::releasePaced() {
+	// Runs on the strand. Sends the deferred sends, that the buckets admit now, and waits again for the
+	// destinations, that still have deferred sends.
+	const auto now = std::chrono::steady_clock::now();
+	auto& batch = flushBatch;
+	auto wakeup = std::chrono::steady_clock::time_point::max();
+	{
+		std::unique_lock<std::mutex> lock(pacingMutex);
+		for(auto& endpointPacer : pacers) {
+			auto& pacer = endpointPacer.second;
+			while(!pacer.deferred.empty() && admit(pacer, pacer.deferred.front(), now)) {
+				batch.push_back(std::move(pacer.deferred.front()));
+				batch.back().paced = true;
+				pacer.deferred.pop_front();
+			}
+			if(!pacer.deferred.empty()) {
+				wakeup = std::min(wakeup, nextTokens(pacer, now));
+			}
+		}
+	}
+	if(wakeup != std::chrono::steady_clock::time_point::max()) {
+		schedulePacing(wakeup);
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(sendMutex);
+		if(writeBlocked) {
+			// Sent by the flush, that waits for the socket to become writable. Queued sends are younger.
+			sendQueue.insert(sendQueue.begin(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+			batch.clear();
+			return;
+		}
+	}
+	transmit(batch);
+}
+
+void AsioDatagramSocket::schedulePacing(std::chrono::steady_clock::time_point wakeup) {
+	// Runs on the strand. An earlier wakeup cancels the wait for a later one.
+	if(pacingScheduled && wakeup >= pacingWakeup) return;
+	pacingScheduled = true;
+	pacingWakeup = wakeup;
+	pacingTimer.expires_at(wakeup);
+	pacingTimer.async_wait(strand.wrap(handlers.wrap([this](const boost::system::error_code& error) {
+		if(error == boost::asio::error::operation_aborted) return;
+		pacingScheduled = false;
+		releasePaced();
+	})));
+}
+
+void AsioDatagramSocket::feedback(const Endpoint& remote, const RateSample& sample) {
+	if(!configuration.pacing) return;
+	std::unique_lock<std::mutex> lock(pacingMutex);
+	getPacer(remote).controller.update(sample);
+}
+
+double AsioDatagramSocket::getRate(const Endpoint& remote) {
+	if(!configuration.pacing) return 0;
+	std::unique_lock<std::mutex> lock(pacingMutex);
+	auto it = pacers.find(remote);
+	return it != pacers.end() ? it->second.controller.rate() : configuration.rateControl.initialRate;
+}
+
+std::map<AsioDatagramSocket::Endpoint, double> AsioDatagramSocket::getRates() {
+	std::map<Endpoint, double> rates;
+	std::unique_lock<std::mutex> lock(pacingMutex);
+	for(auto& endpointPacer : pacers) {
+		rates.emplace(endpointPacer.first, endpointPacer.second.controller.rate());
+	}
+	return rates;
+}
+
+std::future<AsioDatagramSocket::Datagram> AsioDatagramSocket::asyncReceiveFrom() {
+	std::promise<Datagram> promise;
+	auto future = promise.get_future();
+
+	std::unique_lock<std::mutex> lock(receiveMutex);
+	if(!receivedDatagrams.empty()) {
+		// Left over from the last batch
+		promise.set_value(std::move(receivedDatagrams.front()));
+		receivedDatagrams.pop();
+		return future;
+	}
+
+	pendingReceives.push(std::move(promise));
+	if(!receiveArmed) {
+		receiveArmed = true;
+		armReceive();
+	}
+
+	return future;
+}
+
+void AsioDatagramSocket::armReceive() {
+	// Wait for readiness only. The datagrams are drained with recvmmsg in handle_receive.
+	socket.async_wait(
+		Socket::wait_read,
+		strand.wrap(handlers.wrap([this](const boost::system::error_code& error) {
+			handle_receive(error);
+		}))
+	);
+}
+
+void AsioDatagramSocket::deliver(Datagram&& datagram) {
+	if(!pendingReceives.empty()) {
+		pendingReceives.front().set_value(std::move(datagram));
+		pendingReceives.pop();
+	} else {
+		receivedDatagrams.push(std::move(datagram));
+	}
+}
+
+void AsioDatagramSocket::handle_receive(const boost::system::error_code& error) {
+	if(error != boost::system::errc::success) {
+		std::unique_lock<std::mutex> lock(receiveMutex);
+		while(!pendingReceives.empty()) {
+			pendingReceives.front().set_exception(std::make_exception_ptr(std::runtime_error(error.message())));
+			pendingReceives.pop();
+		}
+		receiveArmed = false;
+		return;
+	}
+
+	auto& ring = receiveRing;
+	const std::size_t slots = ring.messages.size();
+	for(std::size_t i = 0; i < slots; i++) {
+		ring.messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+	}
+
+	const int received = ::recvmmsg(socket.native_handle(), ring.messages.data(), slots, MSG_DONTWAIT, nullptr);
+
+	std::unique_lock<std::mutex> lock(receiveMutex);
+	if(received < 0) {
+		if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && !pendingReceives.empty()) {
+			pendingReceives.front().set_exception(
+				std::make_exception_ptr(std::system_error(errno, std::system_category(), "recvmmsg"))
+			);
+			pendingReceives.pop();
+		}
+	}
+
+	if(!reassemblies.empty()) {
+		// Messages with lost fragments are never completed. Messages, that still make progress, are kept.
+		const auto now = std::chrono::steady_clock::now();
+		for(auto it = reassemblies.begin(); it != reassemblies.end();) {
+			if(now - it->second.updated > configuration.reassemblyTimeout) {
+				it = reassemblies.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	for(int i = 0; i < received; i++) {
+		// Message is in ring slot i: [body][header][headerSize]
+		const std::uint8_t* frame = ring.slot(i);
+		const std::size_t frameSize = ring.messages[i].msg_len;
+
+		size_type headerSize;
+		if(frameSize < sizeof(headerSize)) continue;
+		std::memcpy(&headerSize, frame + frameSize - sizeof(headerSize), sizeof(headerSize));
+
+		Datagram d;
+		d.remote.resize(ring.messages[i].msg_hdr.msg_namelen);
+		std::memcpy(d.remote.data(), &ring.addresses[i], d.remote.size());
+		if(headerSize & fragmentFlag) {
+			reassemble(frame, frameSize, headerSize & ~fragmentFlag, d.remote);
+			continue;
+		}
+
+		if(headerSize > frameSize - sizeof(headerSize)) continue;
+		const std::size_t bodySize = frameSize - headerSize - sizeof(headerSize);
+
+		d.header = Buffer(headerSize);
+		std::memcpy(d.header.data(), frame + bodySize, headerSize);
+		if(BufferPool::sizeClass(bodySize) == BufferPool::sizeClass(ring.slotSize)) {
+			// An exact size copy would take a block of the same size class, so the body stays where it was received
+			d.body = ring.take(i);
+			d.body.shrink(bodySize);
+		} else {
+			// Small bodies are copied, so they do not hold on to a block of the full datagram size
+			d.body = Buffer(bodySize);
+			std::memcpy(d.body.data(), frame, bodySize);
+		}
+
+		deliver(std::move(d));
+	}
+
+	if(!pendingReceives.empty()) {
+		armReceive();
+	} else {
+		receiveArmed = false;
+	}
+}
+
+void AsioDatagramSocket::reassemble(const std::uint8_t* frame, std::size_t frameSize, size_type headerSize, const Endpoint& remote) {
+	// receiveMutex is held by the caller. Fragment layout: [piece][header][FragmentInfo][headerSize | fragmentFlag]
+	const std::size_t trailer = sizeof(FragmentInfo) + sizeof(size_type);
+	if(frameSize < trailer || frameSize > configuration.fragmentSize || headerSize > frameSize - trailer) return;
+	const std::size_t pieceSize = frameSize - trailer - headerSize;
+
+	FragmentInfo info;
+	std::memcpy(&info, frame + pieceSize + headerSize, sizeof(info));
+	if(info.index >= info.count || info.total == 0 || info.total > configuration.maxReassembledSize) return;
+
+	// All fragments but the last carry the same piece size, so the fragment has to agree with its offset, count and total
+	const bool last = info.index + 1 == info.count;
+	std::uint32_t fullPiece;
+	if(info.index > 0) {
+		if(info.offset % info.index != 0) return;
+		fullPiece = info.offset / info.index;
+	} else {
+		fullPiece = last ? info.total : pieceSize;
+	}
+	if(
+		fullPiece == 0 ||
+		fullPiece > configuration.fragmentSize - trailer - headerSize ||
+		info.count != (info.total - 1) / fullPiece + 1 ||
+		info.offset != std::uint64_t(info.index) * fullPiece ||
+		pieceSize != (last ? info.total - info.offset : fullPiece)
+	) {
+		return;
+	}
+
+	const auto key = std::make_pair(remote, info.message);
+	auto it = reassemblies.find(key);
+	if(it == reassemblies.end()) {
+		if(!reassemblies.empty() && reassemblies.size() >= configuration.maxReassemblies) {
+			reassemblies.erase(std::min_element(
+				reassemblies.begin(),
+				reassemblies.end(),
+				[](const decltype(reassemblies)::value_type& a, const decltype(reassemblies)::value_type& b) {
+					return a.second.updated < b.second.updated;
+				}
+			));
+		}
+		Reassembly reassembly;
+		reassembly.header = Buffer(headerSize);
+		std::memcpy(reassembly.header.data(), frame + pieceSize, headerSize);
+		reassembly.body = Buffer(info.total);
+		reassembly.received.assign(info.count, false);
+		reassembly.missing = info.count;
+		reassembly.pieceSize = fullPiece;
+		it = reassemblies.emplace(key, std::move(reassembly)).first;
+	}
+
+	auto& reassembly = it->second;
+	if(
+		reassembly.received.size() != info.count ||
+		reassembly.body.size() != info.total ||
+		reassembly.pieceSize != fullPiece ||
+		reassembly.received[info.index]
+	) {
+		// Duplicate or from a different message with the same id
+		return;
+	}
+	reassembly.received[info.index] = true;
+	reassembly.missing--;
+	reassembly.updated = std::chrono::steady_clock::now();
+	std::memcpy(reassembly.body.data() + info.offset, frame, pieceSize);
+
+	if(reassembly.missing == 0) {
+		Datagram d;
+		d.header = std::move(reassembly.header);
+		d.body = std::move(reassembly.body);
+		d.remote = remote;
+		reassemblies.erase(it);
+		deliver(std::move(d));
+	}
 }
 
 AsioDatagramSocket::Endpoint AsioDatagramSocket::getLocalEndpoint() const {
@@ -0,0 +1,84 @@
+#include "cracen2/sockets/AsioExecutor.hpp"
+
+#include <algorithm>
+#include <string>
+
+using namespace cracen2::sockets;
+using namespace cracen2::util;
+
+AsioExecutor::Context::Context() :
+	work(new boost::asio::io_service::work(io_service))
+{}
+
+AsioExecutor::AsioExecutor() :
+	AsioExecutor(Configuration())
+{}
+
+AsioExecutor::AsioExecutor(Configuration configuration) :
+	configuration(configuration),
+	nextContext(0)
+{
+	const std::size_t threads = std::max<std::size_t>(configuration.threads, 1);
+	const std::size_t contextCount = (configuration.policy == Policy::sharded) ? threads : 1;
+
+	for(std::size_t i = 0; i < contextCount; i++) {
+		contexts.emplace_back(new Context());
+	}
+
+	for(std::size_t i = 0; i < threads; i++) {
+		auto& context = *contexts[i % contextCount];
+		workers.emplace_back("AsioExecutor::Worker_" + std::to_string(i), [&context](){
+			context.io_service.run();
+		});
+	}
+}
+
+AsioExecutor::~AsioExecutor() {
+	for(auto& context : contexts) {
+		context->work.reset();
+	}
+	// Joining the workers, before the io_services are destroyed
+	workers.clear();
+}
+
+boost::asio::io_service& AsioExecutor::next() {
+	return contexts[nextContext++ % contexts.size()]->io_service;
+}
+
+std::size_t AsioExecutor::threads() const {
+	return workers.size();
+}
+
+AsioExecutor::Policy AsioExecutor::policy() const {
+	return configuration.policy;
+}
+
+constexpr std::size_t HandlerMemory::capacity;
+
+HandlerMemory::HandlerMemory() :
+	inUse(false)
+{}
+
+void* HandlerMemory::allocate(std::size_t size) {
+	if(size <= capacity && !inUse.exchange(true, std::memory_order_acquire)) {
+		return &storage;
+	}
+	return ::operator new(size);
+}
+
+void HandlerMemory::deallocate(void* pointer) {
+	if(pointer == &storage) {
+		inUse.store(false, std::memory_order_release);
+	} else {
+		::operator delete(pointer);
+	}
+}
+
+HandlerTracker::HandlerTracker() :
+	pending(0)
+{}
+
+void HandlerTracker::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this](){ return pending == 0; });
+}
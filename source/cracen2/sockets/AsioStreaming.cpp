@@ -1,5 +1,14 @@
 #include "cracen2/sockets/AsioStreaming.hpp"
 
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <random>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+
 using namespace cracen2;
 using namespace cracen2::util;
 using namespace cracen2::sockets;
@@ -9,149 +18,806 @@ using Endpoint = AsioStreamingSocket::Endpoint;
 using Socket = boost::asio::ip::tcp::socket;
 
 AsioStreamingSocket::AsioStreamingSocket() :
-	io_service(),
-	work(io_service),
+	AsioStreamingSocket(std::make_shared<AsioExecutor>())
+{}
+
+AsioStreamingSocket::AsioStreamingSocket(std::shared_ptr<AsioExecutor> executor) :
+	AsioStreamingSocket(Configuration(), std::move(executor))
+{}
+
+namespace {
+
+std::uint64_t randomSenderId() {
+	std::random_device device;
+	return (static_cast<std::uint64_t>(device()) << 32) ^ device();
+}
+
+} // End of anonymous namespace
+
+AsioStreamingSocket::AsioStreamingSocket(Configuration configuration, std::shared_ptr<AsioExecutor> executor) :
+	executor(std::move(executor)),
+	io_service(this->executor->next()),
 	acceptor(io_service),
-	promiseQueue(200)
+	configuration(configuration),
+	senderId(randomSenderId()),
+	nextMessage(0)
 {
-	if(!serviceThread.joinable()) {
-		serviceThread = JoiningThread("AsioStreamingSocket::ServiceThread", [this](){
-			io_service.run();
-		});
+	if(this->configuration.streams == 0) {
+		throw std::invalid_argument("AsioStreamingSocket needs at least one stream per remote endpoint.");
 	}
 }
 
 AsioStreamingSocket::~AsioStreamingSocket() {
-	io_service.stop();
+	boost::system::error_code ignored;
+	acceptor.close(ignored);
+	close();
+	// The executor may be shared and outlive this socket
+	handlers.wait();
 }
 
-void AsioStreamingSocket::handle_datagram(std::shared_ptr<Datagram> d) {
-	auto promise = promiseQueue.tryPop(std::chrono::milliseconds(0));
-	if(promise) {
-		promise->set_value(std::move(*d));
+void AsioStreamingSocket::handle_datagram(Datagram&& datagram) {
+	std::unique_lock<std::mutex> lock(receiveMutex);
+	if(!pendingReceives.empty()) {
+		pendingReceives.front().set_value(std::move(datagram));
+		pendingReceives.pop();
 	} else {
-		io_service.post([this, d]() {
-			handle_datagram(std::move(d));
-		});
+		receivedDatagrams.push(std::move(datagram));
+	}
+}
+
+constexpr AsioStreamingSocket::buffer_size_t AsioStreamingSocket::stripeFlag;
+constexpr std::size_t AsioStreamingSocket::Connection::stagingSize;
+constexpr std::size_t AsioStreamingSocket::Connection::maxCoalescedWrites;
+
+AsioStreamingSocket::Connection::Connection(Socket&& socket, Endpoint remote, std::size_t stream, boost::asio::io_service& io_service) :
+	socket(std::move(socket)),
+	remote(remote),
+	stream(stream),
+	strand(io_service),
+	state(ReadState::headerSize),
+	staging(new std::uint8_t[stagingSize]),
+	begin(0),
+	end(0),
+	headerSize(0),
+	bodySize(0),
+	filled(0),
+	bodyTarget(nullptr),
+	striped(false),
+	submitPosted(false),
+	connected(false),
+	writing(false),
+	zeroCopy(false),
+	writeIndex(0),
+	writeOffset(0),
+	zeroCopySent(0),
+	zeroCopyCompleted(0),
+	pollingErrors(false)
+{}
+
+void AsioStreamingSocket::read_staging(std::shared_ptr<Connection> connection) {
+	// Move the unparsed rest to the front, to make room for the next read
+	if(connection->begin > 0) {
+		std::memmove(connection->staging.get(), connection->staging.get() + connection->begin, connection->end - connection->begin);
+		connection->end -= connection->begin;
+		connection->begin = 0;
 	}
+	connection->socket.async_read_some(
+		boost::asio::buffer(connection->staging.get() + connection->end, Connection::stagingSize - connection->end),
+		connection->strand.wrap(handlers.wrap([this, connection](const boost::system::error_code& error, std::size_t received) {
+			if(error != boost::system::errc::success) {
+				drop_reassembly(*connection);
+				fail_connection(connection, error);
+				return;
+			}
+			connection->end += received;
+			handle_receive(std::move(connection));
+		}))
+	);
 }
-void cracen2::sockets::AsioStreamingSocket::handle_receive(Socket& socket) {
-	using buffer_size_t = std::remove_const<decltype(ImmutableBuffer::size)>::type;
 
-	auto headerSize = std::make_shared<buffer_size_t>();
-	socket.async_receive(
-		boost::asio::buffer(headerSize.get(), sizeof(buffer_size_t)),
-		[headerSize = headerSize, this, &socket](const boost::system::error_code& error, std::size_t) {
-// 			std::cout << "headerSize = " << *headerSize << std::endl;
+void AsioStreamingSocket::read_payload(std::shared_ptr<Connection> connection, std::uint8_t* target, buffer_size_t size) {
+	const std::size_t missing = size - connection->filled;
+	if(missing < Connection::stagingSize / 2) {
+		// Small rest, read it together with whatever follows
+		read_staging(std::move(connection));
+		return;
+	}
+
+	// Big rest, read it directly into its destination
+	boost::asio::async_read(
+		connection->socket,
+		boost::asio::buffer(target + connection->filled, missing),
+		connection->strand.wrap(handlers.wrap([this, connection, size](const boost::system::error_code& error, std::size_t) {
 			if(error != boost::system::errc::success) {
-// 				std::cout << error << std::endl;
+				drop_reassembly(*connection);
+				fail_connection(connection, error);
+				return;
+			}
+			connection->filled = size;
+			handle_receive(std::move(connection));
+		}))
+	);
+}
+
+void cracen2::sockets::AsioStreamingSocket::handle_receive(std::shared_ptr<Connection> connection) {
+	using ReadState = Connection::ReadState;
+	auto& c = *connection;
+
+	while(true) {
+		const std::size_t available = c.end - c.begin;
+		const std::uint8_t* staged = c.staging.get() + c.begin;
+
+		switch(c.state) {
+		case ReadState::headerSize:
+			if(available < sizeof(buffer_size_t)) {
+				read_staging(std::move(connection));
 				return;
 			}
-			network::Buffer header(*headerSize);
-			if(header.size() > 0) boost::asio::read(socket, boost::asio::buffer(header.data(), header.size()));
-			buffer_size_t bodySize;
-// 			std::cout << "read bodySize" << std::endl;
-			boost::asio::read(socket, boost::asio::buffer(&bodySize, sizeof(buffer_size_t)));
-			network::Buffer body(bodySize);
-// 			std::cout << "bodySize = " << bodySize << std::endl;
-			if(bodySize > 0) boost::asio::read(socket, boost::asio::buffer(body.data(),bodySize));
-
-			auto datagram = std::make_shared<Datagram>();
-			datagram->header = std::move(header);
-			datagram->body = std::move(body);
-			datagram->remote = socket.remote_endpoint();
+			std::memcpy(&c.headerSize, staged, sizeof(buffer_size_t));
+			c.begin += sizeof(buffer_size_t);
+			c.striped = (c.headerSize & stripeFlag) != 0;
+			c.headerSize &= ~stripeFlag;
+			c.header = network::Buffer(c.headerSize);
+			c.filled = 0;
+			c.state = c.striped ? ReadState::stripeInfo : ReadState::header;
+			break;
+		case ReadState::stripeInfo:
+			if(available < sizeof(StripeInfo)) {
+				read_staging(std::move(connection));
+				return;
+			}
+			std::memcpy(&c.stripe, staged, sizeof(StripeInfo));
+			c.begin += sizeof(StripeInfo);
+			c.state = ReadState::header;
+			break;
+		case ReadState::header: {
+			const std::size_t n = std::min<std::size_t>(available, c.headerSize - c.filled);
+			std::memcpy(c.header.data() + c.filled, staged, n);
+			c.filled += n;
+			c.begin += n;
+			if(c.filled < c.headerSize) {
+				read_payload(std::move(connection), c.header.data(), c.headerSize);
+				return;
+			}
+			c.state = ReadState::bodySize;
+			break;
+		}
+		case ReadState::bodySize:
+			if(available < sizeof(buffer_size_t)) {
+				read_staging(std::move(connection));
+				return;
+			}
+			std::memcpy(&c.bodySize, staged, sizeof(buffer_size_t));
+			c.begin += sizeof(buffer_size_t);
+			if(c.striped) {
+				// Stripes are read directly into the body of the reassembled message
+				const char* invalid = nullptr;
+				if(c.bodySize == 0 || c.bodySize > c.stripe.total || c.stripe.offset > c.stripe.total - c.bodySize) {
+					invalid = "Stripe exceeds its message";
+				} else if(c.stripe.total > configuration.maxStripedSize) {
+					invalid = "Striped message exceeds maxStripedSize";
+				} else {
+					std::unique_lock<std::mutex> lock(reassemblyMutex);
+					const auto now = std::chrono::steady_clock::now();
+					const auto key = std::make_pair(c.stripe.sender, c.stripe.message);
+					auto it = reassemblies.find(key);
+					if(it == reassemblies.end()) {
+						// Messages, whose remaining stripes never arrived, are swept, when a new one starts
+						for(auto stale = reassemblies.begin(); stale != reassemblies.end();) {
+							if(stale->second->readers == 0 && now - stale->second->updated > configuration.reassemblyTimeout) {
+								stale = reassemblies.erase(stale);
+							} else {
+								++stale;
+							}
+						}
+						auto reassembly = std::make_shared<Reassembly>();
+						reassembly->body = network::Buffer(c.stripe.total);
+						reassembly->received = 0;
+						reassembly->hasHeader = false;
+						reassembly->readers = 0;
+						it = reassemblies.emplace(key, std::move(reassembly)).first;
+					}
+					auto& reassembly = *it->second;
+					// Stripes of one message agree on its size and cover disjoint ranges, so a message is complete,
+					// when its stripes add up to its size
+					const std::uint64_t stripeEnd = c.stripe.offset + c.bodySize;
+					auto next = reassembly.claimed.lower_bound(stripeEnd);
+					if(reassembly.body.size() != c.stripe.total) {
+						invalid = "Stripe disagrees with the size of its message";
+					} else if(next != reassembly.claimed.begin() && std::prev(next)->second > c.stripe.offset) {
+						invalid = "Stripe overlaps a stripe received before";
+					} else {
+						reassembly.claimed.emplace(c.stripe.offset, stripeEnd);
+						reassembly.readers++;
+						reassembly.updated = now;
+						c.reassembly = it->second;
+					}
+				}
+				if(invalid) {
+					std::cerr << "AsioStreamingSocket: " << invalid << ". Closing connection to " << c.remote << std::endl;
+					boost::system::error_code ignored;
+					c.socket.close(ignored);
+					fail_connection(std::move(connection), boost::asio::error::connection_aborted);
+					return;
+				}
+				c.bodyTarget = c.reassembly->body.data() + c.stripe.offset;
+			} else {
+				c.body = network::Buffer(c.bodySize);
+				c.bodyTarget = c.body.data();
+			}
+			c.filled = 0;
+			c.state = ReadState::body;
+			break;
+		case ReadState::body: {
+			const std::size_t n = std::min<std::size_t>(available, c.bodySize - c.filled);
+			std::memcpy(c.bodyTarget + c.filled, staged, n);
+			c.filled += n;
+			c.begin += n;
+			if(c.filled < c.bodySize) {
+				read_payload(std::move(connection), c.bodyTarget, c.bodySize);
+				return;
+			}
+
+			c.state = ReadState::headerSize;
+			if(c.striped) {
+				handle_stripe(c);
+				break;
+			}
+			Datagram datagram;
+			datagram.header = std::move(c.header);
+			datagram.body = std::move(c.body);
+			datagram.remote = c.remote;
 			handle_datagram(std::move(datagram));
-			handle_receive(socket);
+			break;
 		}
-	);
+		}
+	}
+}
+
+void AsioStreamingSocket::handle_stripe(Connection& connection) {
+	// Runs on the strand of the connection. Stripes of one message arrive on different connections.
+	std::shared_ptr<Reassembly> complete;
+	{
+		std::unique_lock<std::mutex> lock(reassemblyMutex);
+		auto& reassembly = *connection.reassembly;
+		reassembly.received += connection.bodySize;
+		reassembly.readers--;
+		reassembly.updated = std::chrono::steady_clock::now();
+		if(connection.stripe.offset == 0) {
+			// The first stripe carries the header and comes from the primary connection of the peer
+			reassembly.header = std::move(connection.header);
+			reassembly.hasHeader = true;
+			reassembly.remote = connection.remote;
+		}
+		if(reassembly.hasHeader && reassembly.received == connection.stripe.total) {
+			reassemblies.erase(std::make_pair(connection.stripe.sender, connection.stripe.message));
+			complete = std::move(connection.reassembly);
+		}
+	}
+	connection.reassembly.reset();
+
+	if(complete) {
+		Datagram datagram;
+		datagram.header = std::move(complete->header);
+		datagram.body = std::move(complete->body);
+		datagram.remote = complete->remote;
+		handle_datagram(std::move(datagram));
+	}
 }
 
+void AsioStreamingSocket::drop_reassembly(Connection& connection) {
+	// Runs on the strand of a failed connection. The message of the stripe it was reading can not be completed.
+	if(!connection.reassembly) return;
+	std::unique_lock<std::mutex> lock(reassemblyMutex);
+	auto it = reassemblies.find(std::make_pair(connection.stripe.sender, connection.stripe.message));
+	if(it != reassemblies.end() && it->second == connection.reassembly) {
+		reassemblies.erase(it);
+	}
+	connection.reassembly->readers--;
+	connection.reassembly.reset();
+}
 
-std::function<void(const boost::system::error_code&)> AsioStreamingSocket::handle_accept(std::shared_ptr<Socket> socket) {
-	return [socket, this](const boost::system::error_code& error) {
+std::function<void(const boost::system::error_code&)> AsioStreamingSocket::handle_accept(std::shared_ptr<Socket> socket, boost::asio::io_service& service) {
+	return handlers.wrap([socket, &service, this](const boost::system::error_code& error) {
 		if(error == boost::system::errc::operation_canceled) {
 			return;
 		};
-		if(error != boost::system::errc::success) {
-			std::cerr << error << std::endl;
-			throw error;
-		}
-		auto viewPtr = sockets.getView();
-		auto& view = *viewPtr;
-		const auto remote = socket->remote_endpoint();
-		view->insert(std::make_pair(remote, std::move(*socket)));
-		handle_receive(view->at(remote));
-
-		auto s2 = std::make_shared<Socket>(io_service);
-		acceptor.async_accept(
-			*s2,
-			handle_accept(s2)
-		);
-	};
+		boost::system::error_code endpointError;
+		const auto remote = error ? Endpoint() : socket->remote_endpoint(endpointError);
+		if(error || endpointError) {
+			// Throwing here would end a thread of the executor. Keep accepting instead.
+			std::cerr << "AsioStreamingSocket: Accept failed: " << (error ? error : endpointError).message() << std::endl;
+			if(acceptor.is_open()) {
+				accept();
+			}
+			return;
+		}
+		auto connection = std::make_shared<Connection>(std::move(*socket), remote, 0, service);
+		{
+			auto view = sockets.getView();
+			(*view)->insert(std::make_pair(std::make_pair(connection->remote, std::size_t(0)), connection));
+		}
+		// Senders see the connection from now on, so it is only touched on its strand. Frames, that are sent
+		// before, wait in the write queue like on a connecting connection.
+		connection->strand.post(handlers.wrap([this, connection](){
+			handle_connect(connection, boost::system::error_code());
+		}));
+
+		accept();
+	});
+}
+
+void AsioStreamingSocket::accept() {
+	// Accepted connections are distributed over the io_services of the executor
+	auto& service = executor->next();
+	auto socket = std::make_shared<Socket>(service);
+	acceptor.async_accept(
+		*socket,
+		handle_accept(socket, service)
+	);
 }
 
 void AsioStreamingSocket::bind(Endpoint endpoint) {
 	acceptor.open(endpoint.protocol());
 	acceptor.bind(endpoint);
 	acceptor.listen();
-	auto socket = std::make_shared<Socket>(io_service);
-	acceptor.async_accept(
-		*socket,
-		handle_accept(socket)
-	);
+	accept();
 }
 
+namespace {
+
+// Completes the send of a striped body, when the last stripe is written
+struct StripedCompletion final : cracen2::network::Completion {
+	cracen2::network::Completer target;
+	std::atomic<std::size_t> remaining;
+	std::atomic<bool> failed;
+	std::exception_ptr error;
+
+	StripedCompletion(cracen2::network::Completer&& target, std::size_t stripes) :
+		target(std::move(target)),
+		remaining(stripes),
+		failed(false)
+	{}
+
+	void complete(std::exception_ptr e) override {
+		if(e && !failed.exchange(true)) {
+			error = std::move(e);
+		}
+		if(--remaining == 0) {
+			if(error) target.set_exception(error);
+			else target.set_value();
+			delete this;
+		}
+	}
+};
+
+} // End of anonymous namespace
+
 std::future<void> AsioStreamingSocket::asyncSendTo(
 	const ImmutableBuffer& data,
 	const Endpoint remote,
 	const ImmutableBuffer& header
 ) {
-	auto p = std::make_shared<std::promise<void>>();
-	auto future = p->get_future();
-	auto view = sockets.getView();
-	if((*view)->count(remote) == 0) {
-		Socket s(io_service);
-		s.open(local.protocol());
-		s.bind(local);
-		s.connect(remote);
-		(*view)->insert(std::make_pair(remote, std::move(s)));
-		handle_receive((*view)->at(remote));
-	}
-	auto& socket = (*view)->at(remote);
-
-
-	io_service.post([&socket, header, data, this, p](){
-		try {
-			std::vector<boost::asio::const_buffer> buffers {
-				boost::asio::buffer(&header.size, sizeof(header.size)),
-				boost::asio::buffer(header.data, header.size),
-				boost::asio::buffer(&data.size, sizeof(data.size)),
-				boost::asio::buffer(data.data, data.size),
-			};
-
-			mutex.lock();
-			// According to this Post https://stackoverflow.com/questions/7362894/boostasiosocket-thread-safety
-			// multiple async_write_some function can be interleaved against each other, which will break
-			// the integrety of the stream.
-
-			boost::asio::write(
-				socket,
-				buffers
-			);
-			mutex.unlock();
-			p->set_value();
-		} catch(...) {
-			p->set_exception(std::current_exception());
+	std::promise<void> promise;
+	auto future = promise.get_future();
+	submit(data, remote, header, network::Completer(std::move(promise)));
+	return future;
+}
+
+void AsioStreamingSocket::asyncSendTo(
+	const ImmutableBuffer& data,
+	const Endpoint remote,
+	const ImmutableBuffer& header,
+	network::Completion& completion
+) {
+	submit(data, remote, header, network::Completer(completion));
+}
+
+std::future<void> AsioStreamingSocket::asyncSendTo(
+	const std::vector<ImmutableBuffer>& pieces,
+	const Endpoint remote,
+	const ImmutableBuffer& header
+) {
+	std::promise<void> promise;
+	auto future = promise.get_future();
+	std::size_t size = 0;
+	for(const auto& piece : pieces) {
+		size += piece.size;
+	}
+	PendingWrite write { header.size, header.data, size, nullptr, network::Completer(std::move(promise)), StripeInfo() };
+	write.pieces = pieces.data();
+	write.pieceCount = pieces.size();
+	enqueue(getConnection(remote), std::move(write));
+	return future;
+}
+
+void AsioStreamingSocket::submit(const ImmutableBuffer& data, const Endpoint& remote, const ImmutableBuffer& header, network::Completer&& completion) {
+	if(configuration.streams == 1 || data.size < configuration.stripeThreshold) {
+		enqueue(
+			getConnection(remote),
+			PendingWrite { header.size, header.data, data.size, data.data, std::move(completion), StripeInfo() }
+		);
+		return;
+	}
+
+	// Split the body over all streams. Only the first stripe carries the header.
+	const std::uint64_t message = nextMessage++;
+	const std::size_t stripeSize = (data.size + configuration.streams - 1) / configuration.streams;
+	auto striped = new StripedCompletion(std::move(completion), (data.size + stripeSize - 1) / stripeSize);
+	for(std::size_t stream = 0, offset = 0; offset < data.size; stream++, offset += stripeSize) {
+		enqueue(
+			getConnection(remote, stream),
+			PendingWrite {
+				(stream == 0 ? header.size : 0) | stripeFlag,
+				header.data,
+				std::min<std::size_t>(stripeSize, data.size - offset),
+				data.data + offset,
+				network::Completer(*striped),
+				StripeInfo { senderId, message, offset, data.size }
+			}
+		);
+	}
+}
+
+void AsioStreamingSocket::enqueue(std::shared_ptr<Connection> connection, PendingWrite&& write) {
+	{
+		std::unique_lock<std::mutex> lock(connection->submitMutex);
+		connection->submitted.push_back(std::move(write));
+		if(connection->submitPosted) {
+			return;
 		}
+		connection->submitPosted = true;
+	}
+
+	// One handler per burst of sends, instead of one per frame
+	connection->strand.post(handlers.wrap([connection, this]() mutable {
+		drain_submitted(std::move(connection));
+	}, connection->submitMemory));
+}
+
+void AsioStreamingSocket::drain_submitted(std::shared_ptr<Connection> connection) {
+	// Runs on the strand of the connection
+	{
+		std::unique_lock<std::mutex> lock(connection->submitMutex);
+		for(auto& write : connection->submitted) {
+			connection->writeQueue.push_back(std::move(write));
+		}
+		connection->submitted.clear();
+		connection->submitPosted = false;
+	}
+	if(connection->failure) {
+		const auto error = connection->failure;
+		fail_connection(std::move(connection), error);
+	} else if(connection->connected && !connection->writing) {
+		start_write(std::move(connection));
+	}
+}
+
+void AsioStreamingSocket::connect(const Endpoint& remote) {
+	for(std::size_t stream = 0; stream < configuration.streams; stream++) {
+		getConnection(remote, stream);
+	}
+}
+
+std::shared_ptr<AsioStreamingSocket::Connection> AsioStreamingSocket::getConnection(const Endpoint& remote, std::size_t stream) {
+	const auto key = std::make_pair(remote, stream);
+	// Sends to a known remote only read the map, which does not allocate
+	auto known = sockets.read([&key](const auto& map) {
+		auto it = map.find(key);
+		return (it != map.end()) ? it->second : std::shared_ptr<Connection>();
 	});
+	if(known) {
+		return known;
+	}
 
-	return future;
+	auto view = sockets.getView();
+	auto it = (*view)->find(key);
+	if(it != (*view)->end()) {
+		return it->second;
+	}
+
+	auto& service = executor->next();
+	Socket s(service);
+	s.open(local.protocol());
+	// Only the primary connection uses the local port, the other streams get an ephemeral one
+	s.bind(stream == 0 ? local : Endpoint(local.address(), 0));
+	auto connection = std::make_shared<Connection>(std::move(s), remote, stream, service);
+	(*view)->insert(std::make_pair(key, connection));
+	view.reset();
+
+	// The handshake runs in the background. Frames sent in the meantime wait in the write queue.
+	connection->strand.post(handlers.wrap([this, connection](){
+		connection->socket.async_connect(
+			connection->remote,
+			connection->strand.wrap(handlers.wrap([this, connection](const boost::system::error_code& error) {
+				handle_connect(connection, error);
+			}))
+		);
+	}));
+
+	return connection;
+}
+
+void AsioStreamingSocket::handle_connect(std::shared_ptr<Connection> connection, const boost::system::error_code& error) {
+	// Runs on the strand of the connection
+	if(error != boost::system::errc::success) {
+		fail_connection(std::move(connection), error);
+		return;
+	}
+
+	connection->connected = true;
+	enable_zero_copy(*connection);
+	handle_receive(connection);
+	if(!connection->writeQueue.empty() && !connection->writing) {
+		start_write(std::move(connection));
+	}
+}
+
+void AsioStreamingSocket::fail_connection(std::shared_ptr<Connection> connection, const boost::system::error_code& error) {
+	// Runs on the strand of the connection
+	if(!connection->failure) {
+		connection->failure = error;
+		// Forget the broken connection, so that the next send connects again
+		auto view = sockets.getView();
+		auto it = (*view)->find(std::make_pair(connection->remote, connection->stream));
+		if(it != (*view)->end() && it->second == connection) {
+			(*view)->erase(it);
+		}
+	}
+	while(!connection->writeQueue.empty()) {
+		connection->writeQueue.front().completion.set_exception(
+			std::make_exception_ptr(boost::system::system_error(error))
+		);
+		connection->writeQueue.pop_front();
+	}
+}
+
+void AsioStreamingSocket::start_write(std::shared_ptr<Connection> connection) {
+	// Runs on the strand of the connection
+	auto& c = *connection;
+	c.writing = true;
+	c.writesInFlight.clear();
+	c.writeBuffers.clear();
+	c.zeroCopyOwners.clear();
+
+	while(!c.writeQueue.empty() && c.writesInFlight.size() < Connection::maxCoalescedWrites) {
+		c.writesInFlight.push_back(std::move(c.writeQueue.front()));
+		c.writeQueue.pop_front();
+	}
+
+	// The vector is not resized any more, so the size fields are stable during the write
+	bool zeroCopy = false;
+	for(auto& w : c.writesInFlight) {
+		c.writeBuffers.push_back(boost::asio::buffer(&w.headerSize, sizeof(w.headerSize)));
+		if(w.headerSize & stripeFlag) {
+			c.writeBuffers.push_back(boost::asio::buffer(&w.stripe, sizeof(w.stripe)));
+		}
+		c.writeBuffers.push_back(boost::asio::buffer(w.header, w.headerSize & ~stripeFlag));
+		c.writeBuffers.push_back(boost::asio::buffer(&w.bodySize, sizeof(w.bodySize)));
+
+		// Only the body is pinned. The size fields are reused by the next write and are always copied.
+		const auto addBody = [&](const std::uint8_t* data, std::size_t size) {
+			c.writeBuffers.push_back(boost::asio::buffer(data, size));
+			if(c.zeroCopy && size >= configuration.zeroCopyThreshold) {
+				c.zeroCopyOwners.resize(c.writeBuffers.size(), nullptr);
+				c.zeroCopyOwners.back() = &w;
+				zeroCopy = true;
+			}
+		};
+		if(w.pieces != nullptr) {
+			for(std::size_t i = 0; i < w.pieceCount; i++) {
+				addBody(w.pieces[i].data, w.pieces[i].size);
+			}
+		} else {
+			addBody(w.body, w.bodySize);
+		}
+	}
+
+	// Writes without a pinned body, e.g. without a body at all, do not add an owner themselves
+	c.zeroCopyOwners.resize(c.writeBuffers.size(), nullptr);
+
+	if(zeroCopy) {
+		c.writeIndex = 0;
+		c.writeOffset = 0;
+		write_zero_copy(std::move(connection));
+		return;
+	}
+
+	boost::asio::async_write(
+		c.socket,
+		c.writeBuffers,
+		c.strand.wrap(handlers.wrap([this, connection](const boost::system::error_code& error, std::size_t) {
+			finish_write(connection, error);
+		}))
+	);
+}
+
+void AsioStreamingSocket::write_zero_copy(std::shared_ptr<Connection> connection) {
+	// Runs on the strand of the connection. Pinned bodies are sent with one sendmsg each, the buffers
+	// between them are gathered into a copying sendmsg.
+	auto& c = *connection;
+	auto& iov = c.zeroCopyIovecs;
+
+	while(c.writeIndex < c.writeBuffers.size()) {
+		PendingWrite* owner = c.zeroCopyOwners[c.writeIndex];
+		iov.clear();
+		for(std::size_t i = c.writeIndex; i < c.writeBuffers.size(); i++) {
+			if(i > c.writeIndex && (owner || c.zeroCopyOwners[i])) break;
+			const std::size_t skip = (i == c.writeIndex) ? c.writeOffset : 0;
+			iov.push_back(iovec {
+				const_cast<std::uint8_t*>(boost::asio::buffer_cast<const std::uint8_t*>(c.writeBuffers[i])) + skip,
+				boost::asio::buffer_size(c.writeBuffers[i]) - skip
+			});
+		}
+
+		msghdr message {};
+		message.msg_iov = iov.data();
+		message.msg_iovlen = iov.size();
+		const int flags = MSG_DONTWAIT | MSG_NOSIGNAL | (owner ? MSG_ZEROCOPY : 0);
+		ssize_t sent = ::sendmsg(c.socket.native_handle(), &message, flags);
+		if(sent < 0 && errno == ENOBUFS && owner) {
+			// Pinned memory is limited by the optmem and locked memory limits. Copy this part instead.
+			owner = nullptr;
+			sent = ::sendmsg(c.socket.native_handle(), &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+		}
+		if(sent < 0) {
+			if(errno == EAGAIN || errno == EWOULDBLOCK) {
+				c.socket.async_wait(
+					Socket::wait_write,
+					c.strand.wrap(handlers.wrap([this, connection](const boost::system::error_code& error) {
+						if(error != boost::system::errc::success) {
+							finish_write(connection, error);
+						} else {
+							write_zero_copy(connection);
+						}
+					}))
+				);
+				return;
+			}
+			finish_write(std::move(connection), boost::system::error_code(errno, boost::system::system_category()));
+			return;
+		}
+		if(owner) {
+			c.zeroCopySent++;
+			owner->zeroCopied = true;
+		}
+
+		// Advance over the sent bytes
+		std::size_t rest = static_cast<std::size_t>(sent);
+		while(c.writeIndex < c.writeBuffers.size()) {
+			const std::size_t available = boost::asio::buffer_size(c.writeBuffers[c.writeIndex]) - c.writeOffset;
+			if(rest < available) {
+				c.writeOffset += rest;
+				break;
+			}
+			rest -= available;
+			c.writeIndex++;
+			c.writeOffset = 0;
+			if(rest == 0 && (c.writeIndex == c.writeBuffers.size() || boost::asio::buffer_size(c.writeBuffers[c.writeIndex]) != 0)) {
+				break;
+			}
+		}
+	}
+
+	finish_write(std::move(connection), boost::system::error_code());
+}
+
+void AsioStreamingSocket::finish_write(std::shared_ptr<Connection> connection, const boost::system::error_code& error) {
+	// Runs on the strand of the connection
+	auto& c = *connection;
+	for(auto& w : c.writesInFlight) {
+		if(error != boost::system::errc::success) {
+			w.completion.set_exception(std::make_exception_ptr(boost::system::system_error(error)));
+		} else if(w.zeroCopied) {
+			// The body is still referenced by the kernel
+			c.zeroCopyPending.emplace_back(c.zeroCopySent, std::move(w.completion));
+		} else {
+			w.completion.set_value();
+		}
+	}
+	c.writesInFlight.clear();
+	if(!c.zeroCopyPending.empty()) {
+		poll_error_queue(connection);
+	}
+
+	if(error != boost::system::errc::success) {
+		c.writing = false;
+		fail_connection(std::move(connection), error);
+	} else if(!c.writeQueue.empty()) {
+		start_write(std::move(connection));
+	} else {
+		c.writing = false;
+	}
+}
+
+void AsioStreamingSocket::enable_zero_copy(Connection& connection) {
+	if(configuration.zeroCopyThreshold == 0) {
+		return;
+	}
+	const int one = 1;
+	// Kernels without SO_ZEROCOPY reject the option and the connection copies as before
+	connection.zeroCopy = ::setsockopt(connection.socket.native_handle(), SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+}
+
+void AsioStreamingSocket::poll_error_queue(std::shared_ptr<Connection> connection) {
+	// Runs on the strand of the connection
+	auto& c = *connection;
+	if(!c.pollingErrors) {
+		c.pollingErrors = true;
+		c.socket.async_wait(
+			Socket::wait_error,
+			c.strand.wrap(handlers.wrap([this, connection](const boost::system::error_code& error) {
+				connection->pollingErrors = false;
+				if(error != boost::system::errc::success) {
+					// The connection is gone and with it all notifications
+					for(auto& pending : connection->zeroCopyPending) {
+						pending.second.set_exception(std::make_exception_ptr(boost::system::system_error(error)));
+					}
+					connection->zeroCopyPending.clear();
+					return;
+				}
+				if(!connection->zeroCopyPending.empty()) {
+					poll_error_queue(connection);
+				}
+			}))
+		);
+	}
+	// Notifications, that were queued before the wait was armed, do not signal the socket again
+	read_error_queue(c);
+}
+
+void AsioStreamingSocket::read_error_queue(Connection& c) {
+	while(true) {
+		std::uint8_t control[128];
+		msghdr message {};
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+		if(::recvmsg(c.socket.native_handle(), &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+			break;
+		}
+
+		for(cmsghdr* cm = CMSG_FIRSTHDR(&message); cm != nullptr; cm = CMSG_NXTHDR(&message, cm)) {
+			const bool recvErr =
+				(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+				(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+			if(!recvErr) continue;
+			sock_extended_err notification;
+			std::memcpy(&notification, CMSG_DATA(cm), sizeof(notification));
+			if(notification.ee_errno != 0 || notification.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+
+			if(notification.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+				// The kernel copied anyway (e.g. over loopback). Pinning only costs time on this connection.
+				c.zeroCopy = false;
+			}
+
+			// The kernel counts with 32 bit ids, which wrap around
+			const std::uint64_t first = c.zeroCopyCompleted + static_cast<std::uint32_t>(notification.ee_info - static_cast<std::uint32_t>(c.zeroCopyCompleted));
+			const std::uint64_t last = first + static_cast<std::uint32_t>(notification.ee_data - notification.ee_info);
+			c.zeroCopyReleased[first] = std::max(c.zeroCopyReleased[first], last);
+		}
+
+		for(auto it = c.zeroCopyReleased.begin(); it != c.zeroCopyReleased.end() && it->first <= c.zeroCopyCompleted;) {
+			c.zeroCopyCompleted = std::max(c.zeroCopyCompleted, it->second + 1);
+			it = c.zeroCopyReleased.erase(it);
+		}
+	}
+
+	while(!c.zeroCopyPending.empty() && c.zeroCopyPending.front().first <= c.zeroCopyCompleted) {
+		c.zeroCopyPending.front().second.set_value();
+		c.zeroCopyPending.pop_front();
+	}
 }
 
 std::future<AsioStreamingSocket::Datagram> AsioStreamingSocket::asyncReceiveFrom() {
 	std::promise<AsioStreamingSocket::Datagram> promise;
 	auto future = promise.get_future();
-	promiseQueue.push(std::move(promise));
+	std::unique_lock<std::mutex> lock(receiveMutex);
+	if(!receivedDatagrams.empty()) {
+		promise.set_value(std::move(receivedDatagrams.front()));
+		receivedDatagrams.pop();
+	} else {
+		pendingReceives.push(std::move(promise));
+	}
 	return future;
 }
 
@@ -163,7 +829,16 @@ AsioStreamingSocket::Endpoint AsioStreamingSocket::getLocalEndpoint() const {
 	return acceptor.local_endpoint();
 }
 
+std::size_t AsioStreamingSocket::getPendingReassemblies() {
+	std::unique_lock<std::mutex> lock(reassemblyMutex);
+	return reassemblies.size();
+}
+
 void AsioStreamingSocket::close() {
 	auto view = sockets.getView();
+	for(auto& endpointConnection : view->get()) {
+		boost::system::error_code error;
+		endpointConnection.second->socket.close(error);
+	}
 	(*view)->clear();
 }
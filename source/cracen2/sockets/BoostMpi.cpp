@@ -1,11 +1,18 @@
 #include "cracen2/sockets/BoostMpi.hpp"
 #include "cracen2/util/ThreadPool.hpp"
 
+#include <boost/asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <ctime>
+#include <functional>
+#include <iostream>
 #include <limits>
 #include <cstring>
 #include <cstdint>
+#include <vector>
 // #include <boost/serialization/vector.hpp>
 
 using namespace cracen2::util;
@@ -16,231 +23,874 @@ using namespace cracen2::sockets::detail;
 using Datagram = BoostMpiSocket::Datagram;
 using Endpoint = BoostMpiSocket::Endpoint;
 
-std::map<
-	BoostMpiSocket::Endpoint,
-	std::queue<
-		std::promise<Datagram>
-	>
-> pendingProbes;
+namespace {
 
-struct PendingReceive {
-	std::size_t headerSize;
-	boost::mpi::request headerRequest;
-	std::size_t bodySize;
+/*
+ * Header and body of a datagram are sent as one MPI message: [body][header][headerSize][sender tag].
+ * The body is received in place at the front of the buffer, only the trailer is copied out.
+ */
+using trailer_size_t = std::uint64_t;
+using sender_tag_t = decltype(Endpoint::second);
 
-	boost::mpi::request bodyRequest;
+// Set in the header size of a message, that announces a frame put into the rma ring. Its header is an RmaNotice.
+constexpr trailer_size_t rmaFlag = trailer_size_t(1) << 63;
+
+struct RmaNotice {
+	std::uint64_t slot;
+	std::uint64_t size;
+};
+
+struct PendingReceive {
+	Buffer buffer;
+	int source;
 	std::promise<Datagram> promise;
-	std::unique_ptr<std::uint8_t[]> headerBuffer;
-	std::unique_ptr<std::uint8_t[]> bodyBuffer;
 };
 
-std::queue<PendingReceive> pendingReceives;
+struct PendingSend {
+	Buffer trailer;
+	std::promise<void> promise;
+};
 
-std::queue<
-	std::tuple<
-		boost::mpi::request,
-		boost::mpi::request,
-		std::promise<void>,
-		std::shared_ptr<std::uint8_t>
-	>
-> pendingSends;
+/*
+ * Window of persistent receives, that are pre-posted on the tag of a bound endpoint. Messages are matched
+ * in the order the receives are started, so they are delivered in slot order to keep them in sequence.
+ */
+struct ReceiveWindow {
+	struct Slot {
+		Buffer buffer;
+		MPI_Request request;
+		bool complete;
+		int error;
+		int size;
+		int source;
+	};
+
+	Endpoint local;
+	std::size_t messageSize;
+	std::vector<Slot> slots;
+	// Oldest started slot
+	std::size_t next;
+	bool closing;
+};
 
-bool pendingProbeTrackerRunning = false;
-bool pendingReceiveTrackerRunning = false;
-bool pendingSendTrackerRunning = false;
+std::exception_ptr mpiError(int error, const char* function) {
+	return std::make_exception_ptr(boost::mpi::exception(function, error));
+}
 
-std::mutex EndpointFactory::mutex;
-std::set<BoostMpiSocket::Endpoint> EndpointFactory::blockedEndpoints;
+// Splits a received message into a datagram. The body stays in place at the front of the buffer.
+Datagram unpack(Buffer&& buffer, int source, bool& notice) {
+	Endpoint remote;
+	remote.first = source;
+	trailer_size_t headerSize;
+	const std::size_t fixedTrailerSize = sizeof(headerSize) + sizeof(sender_tag_t);
+	if(buffer.size() < fixedTrailerSize) {
+		throw std::runtime_error("BoostMpiSocket: Received a truncated message.");
+	}
+	std::memcpy(&remote.second, buffer.data() + buffer.size() - sizeof(sender_tag_t), sizeof(sender_tag_t));
+	std::memcpy(&headerSize, buffer.data() + buffer.size() - fixedTrailerSize, sizeof(headerSize));
+	notice = (headerSize & rmaFlag) != 0;
+	headerSize &= ~rmaFlag;
+	if(headerSize > buffer.size() - fixedTrailerSize) {
+		throw std::runtime_error("BoostMpiSocket: Received a truncated message.");
+	}
+	const std::size_t bodySize = buffer.size() - fixedTrailerSize - headerSize;
 
-std::unique_ptr<boost::mpi::environment> env;
-std::unique_ptr<boost::mpi::communicator> world;
+	Buffer header(headerSize);
+	std::memcpy(header.data(), buffer.data() + bodySize, headerSize);
+	buffer.shrink(bodySize);
 
-boost::asio::io_service io_service;
+	return Datagram {
+		std::move(header),
+		std::move(buffer),
+		remote
+	};
+}
 
-JoiningThread mpiThread("BoostMpiSocket::MpiThread",[](){
-	std::srand(std::time(0));
+// The progress loop polls while requests complete and backs off exponentially up to maxBackoff, if it is idle
+constexpr std::chrono::microseconds maxBackoff(200);
+constexpr std::chrono::microseconds spinBackoff(16);
+
+} // End of anonymous namespace
+
+/*
+ * Process wide MPI state. MPI is initialized on first use by a thread, that stays alive until MPI is
+ * finalized. Without MPI_THREAD_MULTIPLE all MPI calls are made by this thread.
+ */
+struct MpiEngine::Environment {
+	boost::asio::io_service service;
+	std::unique_ptr<boost::asio::io_service::work> work;
+	JoiningThread thread;
+	std::unique_ptr<boost::mpi::environment> mpi;
+
+	bool multiple;
+	int rank;
+	// Messages bigger than the pre-posted receives are sent on tag + largeTagOffset, 0 if the tag space is too small
+	int largeTagOffset;
+
+	// Serializes the collective creation of communicators
+	std::mutex mutex;
+
+	Environment() :
+		work(std::make_unique<boost::asio::io_service::work>(service)),
+		thread("BoostMpiSocket::MpiThread", [this](){ service.run(); }),
+		multiple(false),
+		rank(0),
+		largeTagOffset(0)
+	{
+		run([this](){
+			std::srand(std::time(0));
+
+			mpi = std::make_unique<boost::mpi::environment>(boost::mpi::threading::multiple);
+			multiple = (boost::mpi::environment::thread_level() == boost::mpi::threading::multiple);
+			MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+			// Endpoint tags are below 2^16, large messages need a second tag range above
+			int* tagUpperBound = nullptr;
+			int found = 0;
+			MPI_Comm_get_attr(MPI_COMM_WORLD, MPI_TAG_UB, &tagUpperBound, &found);
+			if(found && *tagUpperBound >= 2 * (1 << 16) - 1) {
+				largeTagOffset = 1 << 16;
+			}
+		});
+	}
 
-	env = std::make_unique<boost::mpi::environment>(boost::mpi::threading::funneled);
-	world = std::make_unique<boost::mpi::communicator>();
+	~Environment() {
+		run([this](){
+			mpi.reset();
+		});
+		work.reset();
+		thread = JoiningThread();
+	}
 
-	io_service.run();
-});
+	// Runs function on the mpi thread and waits for it
+	template <class Function>
+	void run(Function function) {
+		std::promise<void> promise;
+		service.post([&promise, &function](){
+			try {
+				function();
+				promise.set_value();
+			} catch(...) {
+				promise.set_exception(std::current_exception());
+			}
+		});
+		promise.get_future().get();
+	}
 
-boost::asio::io_service::work work(io_service);
+	static std::shared_ptr<Environment> instance() {
+		// Created on first use, so MPI is not touched during static initialization
+		static std::shared_ptr<Environment> environment = std::make_shared<Environment>();
+		return environment;
+	}
+};
 
+/*
+ * Ring of slots in a window, that every process of the communicator exposes. The ring starts with a flag per
+ * slot, that is set by a sender with compare and swap to claim the slot and cleared by the owner after the
+ * frame has been copied out. The window stays in a passive target epoch for its lifetime.
+ */
+struct MpiEngine::RmaRing {
+	MPI_Win window;
+	std::uint8_t* base;
+	int rank;
+	std::size_t slots;
+	std::size_t slotSize;
+	std::size_t threshold;
+	std::atomic<std::size_t> nextSlot;
+
+	MPI_Aint flagDisplacement(std::size_t slot) const {
+		return slot * sizeof(std::int64_t);
+	}
 
+	MPI_Aint slotDisplacement(std::size_t slot) const {
+		return slots * sizeof(std::int64_t) + slot * slotSize;
+	}
+};
 
-BoostMpiSocket::BoostMpiSocket() {
-	// Thread function must be set after io_service::work object
-	auto rankPromise = std::make_shared<std::promise<int>>();
-	auto rankFuture = rankPromise->get_future();
-	io_service.post([rankPromise = std::move(rankPromise)]() {
-		rankPromise->set_value(world->rank());
-	});
+/*
+ * Outstanding requests and receive state of the sockets assigned to a lane. All members are only used on
+ * the thread, that runs the service of the lane.
+ */
+class MpiEngine::Lane {
+public:
+
+	std::unique_ptr<boost::asio::io_service> ownService;
+	boost::asio::io_service& service;
+	std::unique_ptr<boost::asio::io_service::work> work;
+	JoiningThread thread;
+
+	const MPI_Comm communicator;
+	const int largeTagOffset;
+	RmaRing* const rma;
+
+	std::map<
+		Endpoint,
+		std::queue<
+			std::promise<Datagram>
+		>
+	> pendingProbes;
+
+	/*
+	 * Outstanding MPI requests of the lane. requests[i] belongs to completions[i]. The requests are tested
+	 * with MPI_Testsome, so they complete in any order and a slow request does not hold back the others.
+	 * Each progress step tests a window of at most testWindow requests starting at testCursor. The window
+	 * rotates over all requests, so a burst of sends costs O(testWindow) per step and not O(outstanding).
+	 * Completed requests are swap-removed.
+	 */
+	static constexpr std::size_t testWindow = 256;
+	std::vector<MPI_Request> requests;
+	std::vector<std::function<void(int error, const MPI_Status& status)>> completions;
+	std::size_t testCursor;
+	std::vector<int> completedIndices;
+	std::vector<MPI_Status> completedStatuses;
+	std::vector<std::function<void(int error, const MPI_Status& status)>> completed;
+
+	std::map<Endpoint, std::shared_ptr<ReceiveWindow>> receiveWindows;
+
+	// A datagram or the error of a pre-posted receive, that completed before a receive was requested
+	struct Received {
+		Datagram datagram;
+		std::exception_ptr error;
+	};
+
+	// Received by a window, before a receive was requested
+	std::map<Endpoint, std::queue<Received>> receivedDatagrams;
+
+	boost::asio::steady_timer backoffTimer;
+	std::chrono::microseconds backoff;
+	bool progressPosted;
+	bool stopped;
+
+	// Without a shared service, the lane gets its own progress thread
+	Lane(boost::asio::io_service* sharedService, MPI_Comm communicator, int largeTagOffset, RmaRing* rma) :
+		ownService(sharedService ? nullptr : std::make_unique<boost::asio::io_service>()),
+		service(sharedService ? *sharedService : *ownService),
+		communicator(communicator),
+		largeTagOffset(largeTagOffset),
+		rma(rma),
+		testCursor(0),
+		completedIndices(testWindow),
+		completedStatuses(testWindow),
+		backoffTimer(service),
+		backoff(0),
+		progressPosted(false),
+		stopped(false)
+	{
+		if(ownService) {
+			work = std::make_unique<boost::asio::io_service::work>(service);
+			thread = JoiningThread("BoostMpiSocket::ProgressThread", [this](){ service.run(); });
+		}
+	}
 
-	endpointFactory.rank = rankFuture.get();
-};
+	template <class Function>
+	void post(Function&& function) {
+		service.post(std::forward<Function>(function));
+	}
 
-BoostMpiSocket::~BoostMpiSocket() {
-	close();
-}
+	template <class Function>
+	void run(Function function) {
+		std::promise<void> promise;
+		service.post([&promise, &function](){
+			function();
+			promise.set_value();
+		});
+		promise.get_future().get();
+	}
+
+	// Stops the progress loop and releases the pre-posted receives. Requests in flight are abandoned.
+	void shutdown() {
+		run([this](){
+			stopped = true;
+			backoffTimer.cancel();
+			for(auto& window : receiveWindows) {
+				for(auto& slot : window.second->slots) {
+					if(!slot.complete) {
+						MPI_Cancel(&slot.request);
+					}
+					MPI_Request_free(&slot.request);
+				}
+			}
+			receiveWindows.clear();
+		});
+		// Handlers queued before, like the cancelled wait, must not run after the lane is gone
+		run([](){});
+		if(ownService) {
+			work.reset();
+			service.stop();
+			thread = JoiningThread();
+		}
+	}
+
+	void track(MPI_Request request, std::function<void(int error, const MPI_Status& status)> completion) {
+		requests.push_back(request);
+		completions.push_back(std::move(completion));
+	}
+
+	// Tests the next window of requests. Returns true, if a request completed.
+	bool testRequests() {
+		if(requests.empty()) {
+			return false;
+		}
+		if(testCursor >= requests.size()) {
+			testCursor = 0;
+		}
 
+		const std::size_t first = testCursor;
+		const std::size_t count = std::min(testWindow, requests.size() - first);
+		testCursor += count;
+		int done = 0;
+		const int result = MPI_Testsome(count, requests.data() + first, &done, completedIndices.data(), completedStatuses.data());
+		if(done == MPI_UNDEFINED || done == 0) {
+			return false;
+		}
+
+		// Take the completions out, before they are run, because they may track new requests. Completed
+		// persistent requests are inactive, but not MPI_REQUEST_NULL, so they are removed by index. They are
+		// tracked again, when they are restarted.
+		completed.clear();
+		for(int i = 0; i < done; i++) {
+			completed.push_back(std::move(completions[first + completedIndices[i]]));
+		}
+		// Removing from the back first keeps the indices, that are left, valid
+		std::sort(completedIndices.begin(), completedIndices.begin() + done, std::greater<int>());
+		for(int i = 0; i < done; i++) {
+			const std::size_t index = first + completedIndices[i];
+			requests[index] = requests.back();
+			completions[index] = std::move(completions.back());
+			requests.pop_back();
+			completions.pop_back();
+		}
+
+		for(int i = 0; i < done; i++) {
+			const auto& status = completedStatuses[i];
+			const int error = (result == MPI_ERR_IN_STATUS) ? status.MPI_ERROR : result;
+			completed[i](error, status);
+		}
+		return true;
+	}
+
+	void scheduleProgress() {
+		if(!progressPosted) {
+			progressPosted = true;
+			service.post([this](){ progress(); });
+		}
+	}
+
+	// Called on the lane thread, whenever new work arrives
+	void kickProgress() {
+		backoff = std::chrono::microseconds(0);
+		backoffTimer.cancel();
+		scheduleProgress();
+	}
+
+	void progress() {
+		progressPosted = false;
+		if(stopped) {
+			return;
+		}
+
+		bool progressed = testRequests();
+		if(!pendingProbes.empty()) {
+			progressed = trackAsyncProbe() || progressed;
+		}
+		if(requests.empty() && pendingProbes.empty()) {
+			// Nothing to do, until the next kick
+			backoff = std::chrono::microseconds(0);
+			return;
+		}
 
-void trackAsyncSend() {
-	while(pendingSends.size() > 0) {
-		auto& p = pendingSends.front();
-		try {
-			auto statusHeader = std::get<0>(p).test();
-			auto statusBody = std::get<1>(p).test();
-			if(statusHeader && statusBody) {
-				// Send completed
-				std::get<std::promise<void>>(p).set_value();
-				pendingSends.pop();
+		// The rest of the requests are tested right away, before the lane backs off
+		if(progressed || testCursor < requests.size()) {
+			backoff = std::chrono::microseconds(0);
+		} else {
+			backoff = std::min(maxBackoff, std::max(std::chrono::microseconds(1), backoff * 2));
+		}
+
+		if(backoff < spinBackoff) {
+			scheduleProgress();
+		} else {
+			backoffTimer.expires_from_now(backoff);
+			backoffTimer.async_wait([this](const boost::system::error_code& error) {
+				// A cancelled wait has been replaced by a kick
+				if(error != boost::asio::error::operation_aborted) {
+					scheduleProgress();
+				}
+			});
+		}
+	}
+
+	// Turns a received message into a datagram. Announced frames are copied out of the rma ring.
+	Datagram receiveDatagram(Buffer&& buffer, int source) {
+		bool notice = false;
+		Datagram datagram = unpack(std::move(buffer), source, notice);
+		if(!notice) {
+			return datagram;
+		}
+		if(rma == nullptr || datagram.header.size() != sizeof(RmaNotice)) {
+			throw std::runtime_error("BoostMpiSocket: Received an rma notice without an rma ring.");
+		}
+		RmaNotice rmaNotice;
+		std::memcpy(&rmaNotice, datagram.header.data(), sizeof(rmaNotice));
+		if(rmaNotice.slot >= rma->slots || rmaNotice.size > rma->slotSize) {
+			throw std::runtime_error("BoostMpiSocket: Received an invalid rma notice.");
+		}
+
+		MPI_Win_sync(rma->window);
+		Buffer message(rmaNotice.size);
+		std::memcpy(message.data(), rma->base + rma->slotDisplacement(rmaNotice.slot), rmaNotice.size);
+
+		// Hand the slot back to the senders
+		const std::int64_t free = 0;
+		MPI_Accumulate(&free, 1, MPI_INT64_T, rma->rank, rma->flagDisplacement(rmaNotice.slot), 1, MPI_INT64_T, MPI_REPLACE, rma->window);
+		MPI_Win_flush(rma->rank, rma->window);
+
+		datagram = unpack(std::move(message), source, notice);
+		datagram.remote.first = source;
+		return datagram;
+	}
+
+	// Hands a datagram to the oldest receive on local or keeps it, until a receive is requested
+	void deliver(const Endpoint& local, Datagram&& datagram) {
+		auto it = pendingProbes.find(local);
+		if(it != pendingProbes.end() && !it->second.empty()) {
+			it->second.front().set_value(std::move(datagram));
+			it->second.pop();
+		} else {
+			receivedDatagrams[local].push(Received { std::move(datagram), nullptr });
+		}
+	}
+
+	// Fails the oldest receive on local or keeps the error for the next one, like deliver
+	void fail(const Endpoint& local, std::exception_ptr error) {
+		auto it = pendingProbes.find(local);
+		if(it != pendingProbes.end() && !it->second.empty()) {
+			it->second.front().set_exception(error);
+			it->second.pop();
+		} else {
+			receivedDatagrams[local].push(Received { Datagram(), error });
+		}
+	}
+
+	void handleSlot(std::shared_ptr<ReceiveWindow> window, std::size_t index, int error, const MPI_Status& status) {
+		auto& w = *window;
+		auto& slot = w.slots[index];
+		slot.complete = true;
+		slot.error = error;
+		slot.source = status.MPI_SOURCE;
+		MPI_Get_count(&status, MPI_BYTE, &slot.size);
+
+		if(w.closing) {
+			MPI_Request_free(&slot.request);
+			return;
+		}
+
+		while(w.slots[w.next].complete) {
+			auto& done = w.slots[w.next];
+			if(done.error != MPI_SUCCESS) {
+				fail(w.local, mpiError(done.error, "MPI_Recv_init"));
 			} else {
-				break;
+				Buffer message;
+				if(BufferPool::sizeClass(done.size) == BufferPool::sizeClass(w.messageSize)) {
+					// An exact size copy would take a block of the same size class. Hand the slot buffer over and
+					// bind the slot to a fresh one from the pool instead.
+					message = std::move(done.buffer);
+					message.shrink(done.size);
+					initSlot(w, done);
+				} else {
+					// Small messages are copied, so they do not hold on to a block of the full message size
+					message = Buffer(done.size);
+					std::memcpy(message.data(), done.buffer.data(), done.size);
+				}
+				try {
+					deliver(w.local, receiveDatagram(std::move(message), done.source));
+				} catch(...) {
+					// Reported like a failed probed receive
+					fail(w.local, std::current_exception());
+				}
 			}
-		} catch(...) {
-			std::get<std::promise<void>>(p).set_exception(std::current_exception());
-			pendingSends.pop();
+			startSlot(window, w.next);
+			w.next = (w.next + 1) % w.slots.size();
 		}
 	}
 
-	if(pendingSends.size() == 0) {
-		pendingSendTrackerRunning = false;
-	} else {
-		io_service.post(&trackAsyncSend);
+	// A persistent receive is bound to its buffer, so a slot gets a new request with every new buffer
+	void initSlot(ReceiveWindow& window, ReceiveWindow::Slot& slot) {
+		if(slot.request != MPI_REQUEST_NULL) {
+			MPI_Request_free(&slot.request);
+		}
+		slot.buffer = Buffer(window.messageSize);
+		MPI_Recv_init(slot.buffer.data(), window.messageSize, MPI_BYTE, MPI_ANY_SOURCE, window.local.second, communicator, &slot.request);
 	}
-}
 
-void trackAsyncReceive() {
-
-	while(pendingReceives.size() > 0) {
-		auto& pendingReceive = pendingReceives.front();
-		try {
-			auto headerStatus = pendingReceive.headerRequest.test();
-			auto bodyStatus = pendingReceive.bodyRequest.test();
-
-			if(headerStatus && bodyStatus) {
-
-				Endpoint remote;
-				remote.first = headerStatus->source();
-				remote.second = *reinterpret_cast<decltype(remote.second)*>(pendingReceive.headerBuffer.get());
-
-				//const auto customHeaderSize = headerStatus->count<std::uint8_t>().get() - sizeof(remote.second);
-				const auto& customHeaderSize = pendingReceive.headerSize;
-				//std::cout << "[" << headerStatus->count<std::uint8_t>().get() << "->" << customHeaderSize;
-				Buffer customHeader(customHeaderSize);
-				//std::cout << "]";
-				std::memcpy(customHeader.data(), pendingReceive.headerBuffer.get() + sizeof(remote.second) , customHeaderSize);
-
-				//auto size = bodyStatus->count<std::uint8_t>().get();
-				const auto& size = pendingReceive.bodySize;
-				pendingReceive.promise.set_value(
-					Datagram {
-						std::move(customHeader),
-						Buffer(
-							std::move(pendingReceive.bodyBuffer),
-							size
-						),
-						remote
-					}
-				);
-				pendingReceives.pop();
+	void startSlot(std::shared_ptr<ReceiveWindow> window, std::size_t index) {
+		auto& slot = window->slots[index];
+		slot.complete = false;
+		MPI_Start(&slot.request);
+		track(slot.request, [this, window, index](int error, const MPI_Status& status) {
+			handleSlot(window, index, error, status);
+		});
+	}
+
+	void openWindow(const Endpoint& local, std::size_t slots, std::size_t messageSize) {
+		auto window = std::make_shared<ReceiveWindow>();
+		window->local = local;
+		window->next = 0;
+		window->closing = false;
+		window->messageSize = messageSize;
+		window->slots.resize(slots);
+		for(auto& slot : window->slots) {
+			slot.request = MPI_REQUEST_NULL;
+			initSlot(*window, slot);
+		}
+		for(std::size_t i = 0; i < slots; i++) {
+			startSlot(window, i);
+		}
+		receiveWindows[local] = std::move(window);
+		kickProgress();
+	}
+
+	void closeWindow(const Endpoint& local) {
+		auto it = receiveWindows.find(local);
+		if(it == receiveWindows.end()) {
+			return;
+		}
+		auto window = std::move(it->second);
+		receiveWindows.erase(it);
+
+		// The cancelled receives complete through the progress loop, which frees them
+		window->closing = true;
+		for(auto& slot : window->slots) {
+			if(slot.complete) {
+				MPI_Request_free(&slot.request);
 			} else {
-				break;
+				MPI_Cancel(&slot.request);
 			}
-		} catch(...) {
-			pendingReceive.promise.set_exception(std::current_exception());
-			pendingReceives.pop();
 		}
 	}
 
-	if(pendingReceives.size() == 0) {
-		pendingReceiveTrackerRunning = false;
-	} else {
-		io_service.post(&trackAsyncReceive);
-	}
-}
+	// Probes one tag for a message and starts its receive. Returns false, if there is no message.
+	bool probe(int tag, std::promise<Datagram>& promise) {
+		// A matched probe removes the message from the queue, so concurrent senders can not be mixed up
+		int flag = 0;
+		MPI_Message message;
+		MPI_Status status;
+		const int probeResult = MPI_Improbe(MPI_ANY_SOURCE, tag, communicator, &flag, &message, &status);
+		if(probeResult != MPI_SUCCESS) {
+			std::rethrow_exception(mpiError(probeResult, "MPI_Improbe"));
+		}
+		if(!flag) {
+			return false;
+		}
 
-void trackAsyncProbe() {
+		int size = 0;
+		MPI_Get_count(&status, MPI_BYTE, &size);
 
-	bool rerun = false;
-//	std::cout << "pendingProbes:" << std::endl;
-//	for(auto& p : pendingProbes) {
-//		std::cout << p.first << " count = " << p.second.size() << std::endl;
-//	}
+		auto pendingReceive = std::make_shared<PendingReceive>();
+		pendingReceive->buffer = Buffer(size);
+		pendingReceive->source = status.MPI_SOURCE;
+		pendingReceive->promise = std::move(promise);
 
-	std::vector<Endpoint> emptyQueues;
+		MPI_Request request;
+		const int receiveResult = MPI_Imrecv(pendingReceive->buffer.data(), size, MPI_BYTE, &message, &request);
+		if(receiveResult != MPI_SUCCESS) {
+			pendingReceive->promise.set_exception(mpiError(receiveResult, "MPI_Imrecv"));
+			return true;
+		}
 
-	for(auto& p : pendingProbes) {
-		auto& promiseQueue = p.second;
-		while(promiseQueue.size() > 0) {
+		track(request, [this, pendingReceive](int error, const MPI_Status&) {
+			if(error != MPI_SUCCESS) {
+				pendingReceive->promise.set_exception(mpiError(error, "MPI_Imrecv"));
+				return;
+			}
 			try {
-				const auto& ep = p.first;
-
-//  				std::cout << "probe on " << ep << std::endl;
-				auto headerStatus = world->iprobe(boost::mpi::any_source, ep.second);
-				if(headerStatus) {
-					//Prepare Header Buffer
-					const auto headerSize = headerStatus->count<std::uint8_t>().get();
-					//std::cout << "(" << headerSize;
-					std::unique_ptr<std::uint8_t[]> headerBuffer(new std::uint8_t[headerSize]);
-					auto headerRequest = world->irecv(headerStatus->source(), headerStatus->tag(), headerBuffer.get(), headerSize);
-
-					// Prepare Body Buffer
-					auto bodyStatus = world->probe(headerStatus->source(), ep.second);
-					const auto bodySize = bodyStatus.count<Buffer::value_type>().get();
-					//std::cout << "," << bodySize;
-					std::unique_ptr<std::uint8_t[]> bodyBuffer(new std::uint8_t[bodySize]);
-					//std::cout << ")";
-					auto bodyRequest = world->irecv(bodyStatus.source(), bodyStatus.tag(), bodyBuffer.get(), bodySize);
-
-					pendingReceives.push(
-						PendingReceive {
-							headerSize,
-							std::move(headerRequest),
-							bodySize,
-							std::move(bodyRequest),
-							std::move(promiseQueue.front()),
-							std::move(headerBuffer),
-							std::move(bodyBuffer)
-						}
-					);
-
-					promiseQueue.pop();
+				pendingReceive->promise.set_value(receiveDatagram(std::move(pendingReceive->buffer), pendingReceive->source));
+			} catch(...) {
+				pendingReceive->promise.set_exception(std::current_exception());
+			}
+		});
+		return true;
+	}
 
-					if(!pendingReceiveTrackerRunning) {
-						pendingReceiveTrackerRunning = true;
-						io_service.post(&trackAsyncReceive);
+	// Matches incoming messages with the receives waiting on their endpoint. Returns true, if a message was matched.
+	bool trackAsyncProbe() {
+
+		bool matched = false;
+		std::vector<Endpoint> emptyQueues;
+
+		for(auto& p : pendingProbes) {
+			auto& promiseQueue = p.second;
+			while(promiseQueue.size() > 0) {
+				try {
+					const auto& ep = p.first;
+
+					// Endpoints with a window only probe for messages, that are too big for the pre-posted receives.
+					// Only they get messages on the large tag. A failed probe scans the whole unexpected queue, so
+					// the other endpoints do not probe for it.
+					const bool windowed = receiveWindows.count(ep) > 0;
+					if(windowed && probe(ep.second + largeTagOffset, promiseQueue.front())) {
+						promiseQueue.pop();
+						matched = true;
+					} else if(!windowed && probe(ep.second, promiseQueue.front())) {
+						promiseQueue.pop();
+						matched = true;
+					} else {
+						break;
 					}
-
-				} else {
-					rerun = true;
-					break;
+				} catch(...) {
+					promiseQueue.front().set_exception(std::current_exception());
+					promiseQueue.pop();
 				}
-			} catch(...) {
-				promiseQueue.front().set_exception(std::current_exception());
-				promiseQueue.pop();
+			}
+			if(promiseQueue.size() == 0) {
+				emptyQueues.emplace_back(p.first);
 			}
 		}
-		if(promiseQueue.size() == 0) {
-			emptyQueues.emplace_back(p.first);
+
+		for(auto ep : emptyQueues) {
+			pendingProbes.erase(ep);
 		}
+		return matched;
 	}
 
-	for(auto ep : emptyQueues) {
-		pendingProbes.erase(ep);
+	void send(const ImmutableBuffer& data, const Endpoint& remote, std::shared_ptr<PendingSend> pendingSend, int tag) {
+		const std::size_t messageSize = data.size + pendingSend->trailer.size();
+		if(rma && messageSize >= rma->threshold && messageSize <= rma->slotSize && put(data, remote, pendingSend, tag)) {
+			return;
+		}
+		sendTwoSided(data, remote, std::move(pendingSend), tag);
 	}
 
-	if(rerun) {
-		io_service.post(&trackAsyncProbe);
-	} else {
-		pendingProbeTrackerRunning = false;
+	// Puts the message into a free slot of the remote and announces it. Returns false, if no slot is free.
+	bool put(const ImmutableBuffer& data, const Endpoint& remote, std::shared_ptr<PendingSend>& pendingSend, int tag) {
+		const int target = remote.first;
+		const std::int64_t claimed = 1;
+		const std::int64_t free = 0;
+		std::size_t slot = 0;
+		bool found = false;
+		for(std::size_t attempt = 0; attempt < rma->slots && !found; attempt++) {
+			slot = rma->nextSlot++ % rma->slots;
+			std::int64_t previous = claimed;
+			MPI_Compare_and_swap(&claimed, &free, &previous, MPI_INT64_T, target, rma->flagDisplacement(slot), rma->window);
+			MPI_Win_flush(target, rma->window);
+			found = (previous == free);
+		}
+		if(!found) {
+			return false;
+		}
+
+		const MPI_Aint displacement = rma->slotDisplacement(slot);
+		MPI_Put(data.data, data.size, MPI_BYTE, target, displacement, data.size, MPI_BYTE, rma->window);
+		MPI_Put(
+			pendingSend->trailer.data(), pendingSend->trailer.size(), MPI_BYTE,
+			target, displacement + data.size, pendingSend->trailer.size(), MPI_BYTE,
+			rma->window
+		);
+		// The frame must be visible at the remote, before it is announced
+		MPI_Win_flush(target, rma->window);
+
+		const RmaNotice rmaNotice { slot, data.size + pendingSend->trailer.size() };
+		const trailer_size_t headerSize = sizeof(rmaNotice) | rmaFlag;
+		sender_tag_t senderTag;
+		std::memcpy(&senderTag, pendingSend->trailer.data() + pendingSend->trailer.size() - sizeof(senderTag), sizeof(senderTag));
+
+		Buffer notice(sizeof(rmaNotice) + sizeof(headerSize) + sizeof(senderTag));
+		std::memcpy(notice.data(), &rmaNotice, sizeof(rmaNotice));
+		std::memcpy(notice.data() + sizeof(rmaNotice), &headerSize, sizeof(headerSize));
+		std::memcpy(notice.data() + sizeof(rmaNotice) + sizeof(headerSize), &senderTag, sizeof(senderTag));
+		pendingSend->trailer = std::move(notice);
+
+		sendTwoSided(ImmutableBuffer(nullptr, 0), remote, std::move(pendingSend), tag);
+		return true;
+	}
+
+	void sendTwoSided(const ImmutableBuffer& data, const Endpoint& remote, std::shared_ptr<PendingSend> pendingSend, int tag) {
+		// Body and trailer are gathered by a datatype with absolute addresses, so the body is not copied
+		int lengths[2] = { static_cast<int>(data.size), static_cast<int>(pendingSend->trailer.size()) };
+		MPI_Aint addresses[2];
+		MPI_Get_address(data.data, &addresses[0]);
+		MPI_Get_address(pendingSend->trailer.data(), &addresses[1]);
+		MPI_Datatype datagramType;
+		MPI_Type_create_hindexed(2, lengths, addresses, MPI_BYTE, &datagramType);
+		MPI_Type_commit(&datagramType);
+
+		MPI_Request request;
+		const int result = MPI_Isend(MPI_BOTTOM, 1, datagramType, remote.first, tag, communicator, &request);
+		// The pending send keeps its own reference to the datatype
+		MPI_Type_free(&datagramType);
+		if(result != MPI_SUCCESS) {
+			pendingSend->promise.set_exception(mpiError(result, "MPI_Isend"));
+			return;
+		}
+
+		track(request, [pendingSend](int error, const MPI_Status&) {
+			if(error != MPI_SUCCESS) {
+				pendingSend->promise.set_exception(mpiError(error, "MPI_Isend"));
+			} else {
+				pendingSend->promise.set_value();
+			}
+		});
+
+		kickProgress();
+	}
+
+	void receive(const Endpoint& local, std::promise<Datagram>&& promise) {
+		auto received = receivedDatagrams.find(local);
+		if(received != receivedDatagrams.end() && !received->second.empty()) {
+			auto& front = received->second.front();
+			if(front.error) {
+				promise.set_exception(front.error);
+			} else {
+				promise.set_value(std::move(front.datagram));
+			}
+			received->second.pop();
+			return;
+		}
+		pendingProbes[local].push(std::move(promise));
+		kickProgress();
+	}
+
+	void close(const Endpoint& local) {
+		pendingProbes.erase(local);
+		receivedDatagrams.erase(local);
+		closeWindow(local);
+	}
+
+}; // End of class MpiEngine::Lane
+
+constexpr std::size_t MpiEngine::Lane::testWindow;
+
+MpiEngine::MpiEngine() :
+	MpiEngine(Configuration())
+{}
+
+MpiEngine::MpiEngine(Configuration configuration) :
+	environment(Environment::instance()),
+	communicator(MPI_COMM_WORLD),
+	duplicated(configuration.duplicateCommunicator),
+	nextLaneIndex(0)
+{
+	if(duplicated) {
+		std::unique_lock<std::mutex> lock(environment->mutex);
+		environment->run([this](){
+			const int result = MPI_Comm_dup(MPI_COMM_WORLD, &communicator);
+			if(result != MPI_SUCCESS) {
+				std::rethrow_exception(mpiError(result, "MPI_Comm_dup"));
+			}
+		});
+	}
+
+	if(configuration.rmaSlots > 0) {
+		rma = std::make_unique<RmaRing>();
+		rma->rank = environment->rank;
+		rma->slots = configuration.rmaSlots;
+		rma->slotSize = configuration.rmaSlotSize;
+		rma->threshold = configuration.rmaThreshold;
+		rma->nextSlot = 0;
+		std::unique_lock<std::mutex> lock(environment->mutex);
+		environment->run([this](){
+			const MPI_Aint size = rma->slotDisplacement(rma->slots);
+			const int result = MPI_Win_allocate(size, 1, MPI_INFO_NULL, communicator, &rma->base, &rma->window);
+			if(result != MPI_SUCCESS) {
+				std::rethrow_exception(mpiError(result, "MPI_Win_allocate"));
+			}
+			std::memset(rma->base, 0, rma->slots * sizeof(std::int64_t));
+			MPI_Win_lock_all(0, rma->window);
+			MPI_Win_sync(rma->window);
+			// No sender may claim a slot, before all flags are cleared
+			MPI_Barrier(communicator);
+		});
+	}
+
+	// Without MPI_THREAD_MULTIPLE, the lane shares the mpi thread
+	const std::size_t laneCount = environment->multiple ? std::max<std::size_t>(1, configuration.progressThreads) : 1;
+	for(std::size_t i = 0; i < laneCount; i++) {
+		lanes.push_back(std::make_unique<Lane>(
+			environment->multiple ? nullptr : &environment->service,
+			communicator,
+			environment->largeTagOffset,
+			rma.get()
+		));
+	}
+}
+
+MpiEngine::~MpiEngine() {
+	for(auto& lane : lanes) {
+		lane->shutdown();
+	}
+	lanes.clear();
+	if(rma) {
+		environment->run([this](){
+			MPI_Win_unlock_all(rma->window);
+			MPI_Win_free(&rma->window);
+		});
+	}
+	if(duplicated) {
+		environment->run([this](){
+			MPI_Comm_free(&communicator);
+		});
 	}
 }
 
+namespace {
+
+MpiEngine::Configuration& defaultConfiguration() {
+	static MpiEngine::Configuration configuration = [](){
+		MpiEngine::Configuration configuration;
+		configuration.duplicateCommunicator = false;
+		return configuration;
+	}();
+	return configuration;
+}
+
+} // End of anonymous namespace
+
+std::shared_ptr<MpiEngine> MpiEngine::defaultEngine() {
+	static std::shared_ptr<MpiEngine> engine = std::make_shared<MpiEngine>(defaultConfiguration());
+	return engine;
+}
+
+void MpiEngine::setDefaultConfiguration(Configuration configuration) {
+	defaultConfiguration() = configuration;
+}
+
+int MpiEngine::rank() const {
+	return environment->rank;
+}
+
+bool MpiEngine::threadMultiple() const {
+	return environment->multiple;
+}
+
+MpiEngine::Lane& MpiEngine::nextLane() {
+	return *lanes[nextLaneIndex++ % lanes.size()];
+}
+
+std::mutex EndpointFactory::mutex;
+std::set<BoostMpiSocket::Endpoint> EndpointFactory::blockedEndpoints;
+
+BoostMpiSocket::BoostMpiSocket() :
+	BoostMpiSocket(Configuration())
+{}
+
+BoostMpiSocket::BoostMpiSocket(Configuration configuration) :
+	configuration(configuration),
+	engine(configuration.engine ? configuration.engine : MpiEngine::defaultEngine()),
+	lane(&engine->nextLane())
+{
+	endpointFactory.rank = engine->rank();
+};
+
+BoostMpiSocket::~BoostMpiSocket() {
+	close();
+}
+
 void BoostMpiSocket::bind(Endpoint endpoint) {
-	if(local != Endpoint(0, 0)) endpointFactory.release(local);
+	if(local != Endpoint(0, 0)) {
+		endpointFactory.release(local);
+		lane->post([lane = this->lane, local = this->local](){
+			lane->closeWindow(local);
+		});
+	}
 
 	if(endpoint.second != 0) {
 		local = endpoint;
@@ -250,13 +900,22 @@ void BoostMpiSocket::bind(Endpoint endpoint) {
 	}
 
 	endpointFactory.block(local);
+
+	if(configuration.persistentReceives > 0) {
+		lane->post([lane = this->lane, local = this->local, configuration = this->configuration](){
+			// Without a second tag range, large messages could not be told apart from the small ones
+			if(lane->largeTagOffset > 0) {
+				lane->openWindow(local, configuration.persistentReceives, configuration.persistentMessageSize);
+			}
+		});
+	}
 }
 
 std::future<void> BoostMpiSocket::asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& headerBuffer) {
 // 	std::cout << "send to " << remote << std::endl;
 
-	auto promise = std::make_shared<std::promise<void>>();
-	auto future = promise->get_future();
+	auto pendingSend = std::make_shared<PendingSend>();
+	auto future = pendingSend->promise.get_future();
 
 	try {
 
@@ -264,34 +923,25 @@ std::future<void> BoostMpiSocket::asyncSendTo(const ImmutableBuffer& data, const
 			bind();
 		}
 
-		const auto headerSize = sizeof(local.second) + headerBuffer.size;
-		auto header = std::make_shared<std::uint8_t>(headerSize);
-		std::memcpy(header.get(), &local.second, sizeof(local.second));
-		std::memcpy(header.get() + sizeof(local.second), headerBuffer.data, headerBuffer.size);
-
-		io_service.post([remote, headerSize, header = std::move(header), promise = std::move(promise), data](){
-// 			std::cout << "send to " << remote << std::endl;
-			auto headerRequest = world->isend(remote.first, remote.second, header.get(), headerSize);
-			auto bodyRequest = world->isend(remote.first, remote.second, data.data, data.size);
-
-			pendingSends.push(
-				std::make_tuple(
-					std::move(headerRequest),
-					std::move(bodyRequest),
-					std::move(*promise),
-					std::move(header)
-				)
-			);
-
-			// Kickstart send tracker
-			if(!pendingSendTrackerRunning) {
-				pendingSendTrackerRunning = true;
-				io_service.post(&trackAsyncSend);
-			}
+		const trailer_size_t headerSize = headerBuffer.size;
+		const sender_tag_t senderTag = local.second;
+		pendingSend->trailer = Buffer(headerSize + sizeof(headerSize) + sizeof(senderTag));
+		std::memcpy(pendingSend->trailer.data(), headerBuffer.data, headerSize);
+		std::memcpy(pendingSend->trailer.data() + headerSize, &headerSize, sizeof(headerSize));
+		std::memcpy(pendingSend->trailer.data() + headerSize + sizeof(headerSize), &senderTag, sizeof(senderTag));
+
+		// Messages, that do not fit into a pre-posted receive of the remote, use the large tag. Without pre-posted
+		// receives all messages use the same tag, which keeps them in order.
+		const std::size_t messageSize = data.size + pendingSend->trailer.size();
+		const bool large = configuration.persistentReceives > 0 && messageSize > configuration.persistentMessageSize;
+		const int tag = large ? remote.second + lane->largeTagOffset : remote.second;
+
+		lane->post([lane = this->lane, remote, pendingSend, data, tag](){
+			lane->send(data, remote, std::move(pendingSend), tag);
 		});
 
 	} catch(...) {
-		promise->set_exception(std::current_exception());
+		pendingSend->promise.set_exception(std::current_exception());
 	}
 
 
@@ -307,15 +957,8 @@ std::future< cracen2::sockets::BoostMpiSocket::Datagram > cracen2::sockets::Boos
 		throw std::runtime_error("Trying to receive on closed socket.");
 	}
 
-	io_service.post([local = this->local, promise = std::move(promise)](){
-		//std::cout << "receive on " << local << std::endl;
-		pendingProbes[local].push(std::move(*promise));
-
-		if(!pendingProbeTrackerRunning) {
-			pendingProbeTrackerRunning = true;
-			io_service.post(&trackAsyncProbe);
-		}
-
+	lane->post([lane = this->lane, local = this->local, promise = std::move(promise)](){
+		lane->receive(local, std::move(*promise));
 	});
 
 	return future;
@@ -330,8 +973,12 @@ BoostMpiSocket::Endpoint BoostMpiSocket::getLocalEndpoint() const {
 }
 
 void BoostMpiSocket::close() {
-	io_service.post([local = this->local](){
-		pendingProbes.erase(local);
+	// A moved from socket has no engine
+	if(!engine) {
+		return;
+	}
+	lane->post([lane = this->lane, local = this->local](){
+		lane->close(local);
 	});
 	if(isOpen()) endpointFactory.release(local);
 	local = Endpoint(0, 0);
@@ -0,0 +1,234 @@
+#include "cracen2/sockets/InProcess.hpp"
+
+#include <map>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+using namespace cracen2;
+using namespace cracen2::sockets;
+
+constexpr std::size_t InProcessSocket::MaxMessageSize::total;
+constexpr std::size_t InProcessSocket::MaxMessageSize::body;
+constexpr std::size_t InProcessSocket::MaxMessageSize::header;
+
+namespace {
+
+struct Registry {
+	std::mutex mutex;
+	std::map<std::uint64_t, std::shared_ptr<InProcessSocket::Inbox>> inboxes;
+	std::uint64_t nextId = 1;
+};
+
+// Never destroyed, sockets may be closed during static destruction
+Registry& registry() {
+	static Registry* instance = new Registry();
+	return *instance;
+}
+
+std::shared_ptr<InProcessSocket::Inbox> find(const InProcessSocket::Endpoint& remote) {
+	auto& r = registry();
+	std::unique_lock<std::mutex> lock(r.mutex);
+	auto it = r.inboxes.find(remote.id);
+	if(it == r.inboxes.end()) {
+		throw std::runtime_error("InProcessSocket: No socket bound to " + std::to_string(remote.id));
+	}
+	return it->second;
+}
+
+network::Buffer copy(const network::ImmutableBuffer& source) {
+	network::Buffer result(source.size);
+	if(source.size > 0) {
+		std::memcpy(result.data(), source.data, source.size);
+	}
+	return result;
+}
+
+} // End of anonymous namespace
+
+bool InProcessSocket::Inbox::deliver(Datagram&& datagram) {
+	std::unique_lock<std::mutex> lock(mutex);
+	if(closed) {
+		return false;
+	}
+	if(!pendingReceives.empty()) {
+		pendingReceives.front().set_value(std::move(datagram));
+		pendingReceives.pop();
+	} else {
+		receivedDatagrams.push(std::move(datagram));
+	}
+	return true;
+}
+
+InProcessSocket::InProcessSocket() :
+	inbox(std::make_shared<Inbox>()),
+	bound(false)
+{}
+
+InProcessSocket::~InProcessSocket() {
+	close();
+}
+
+void InProcessSocket::bind(Endpoint endpoint) {
+	std::unique_lock<std::mutex> lock(bindMutex);
+	if(bound) {
+		throw std::logic_error("InProcessSocket is already bound to " + std::to_string(local.id));
+	}
+	registerEndpoint(endpoint);
+}
+
+void InProcessSocket::registerEndpoint(Endpoint endpoint) {
+	// Called with the bindMutex held
+	auto& r = registry();
+	std::unique_lock<std::mutex> lock(r.mutex);
+	if(endpoint.id == 0) {
+		while(r.inboxes.count(r.nextId) > 0) {
+			r.nextId++;
+		}
+		endpoint.id = r.nextId++;
+	} else if(r.inboxes.count(endpoint.id) > 0) {
+		throw std::runtime_error("InProcessSocket: Endpoint " + std::to_string(endpoint.id) + " is already in use");
+	}
+	if(inbox->closed) {
+		// Bound again after close
+		inbox = std::make_shared<Inbox>();
+	}
+	r.inboxes.insert(std::make_pair(endpoint.id, inbox));
+	local = endpoint;
+	bound.store(true, std::memory_order_release);
+}
+
+void InProcessSocket::bindIfUnbound() {
+	if(bound.load(std::memory_order_acquire)) {
+		return;
+	}
+	// Like an unbound udp socket, the sender gets an endpoint for the replies on the first send
+	std::unique_lock<std::mutex> lock(bindMutex);
+	if(!bound) {
+		registerEndpoint(Endpoint());
+	}
+}
+
+std::shared_ptr<InProcessSocket::Inbox> InProcessSocket::getRemote(const Endpoint& remote) {
+	std::unique_lock<std::mutex> lock(remotesMutex);
+	auto it = remotes.find(remote);
+	if(it != remotes.end()) {
+		return it->second;
+	}
+	auto remoteInbox = find(remote);
+	remotes.insert(std::make_pair(remote, remoteInbox));
+	return remoteInbox;
+}
+
+void InProcessSocket::forgetRemote(const Endpoint& remote, const std::shared_ptr<Inbox>& closed) {
+	std::unique_lock<std::mutex> lock(remotesMutex);
+	auto it = remotes.find(remote);
+	if(it != remotes.end() && it->second == closed) {
+		remotes.erase(it);
+	}
+}
+
+std::future<void> InProcessSocket::asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header) {
+	// The caller owns the memory, so the frame is copied once
+	return asyncSendTo(copy(data), remote, copy(header));
+}
+
+std::future<void> InProcessSocket::asyncSendTo(network::Buffer&& data, const Endpoint remote, network::Buffer&& header) {
+	std::promise<void> promise;
+	auto future = promise.get_future();
+	try {
+		send(std::move(data), remote, std::move(header));
+		promise.set_value();
+	} catch(...) {
+		promise.set_exception(std::current_exception());
+	}
+	return future;
+}
+
+std::future<void> InProcessSocket::asyncSendTo(network::Buffer&& data, const Endpoint remote, const ImmutableBuffer& header) {
+	return asyncSendTo(std::move(data), remote, copy(header));
+}
+
+void InProcessSocket::asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header, network::Completion& completion) {
+	std::exception_ptr error;
+	try {
+		send(copy(data), remote, copy(header));
+	} catch(...) {
+		error = std::current_exception();
+	}
+	completion.complete(std::move(error));
+}
+
+void InProcessSocket::send(network::Buffer&& data, const Endpoint& remote, network::Buffer&& header) {
+	bindIfUnbound();
+	Datagram datagram;
+	datagram.header = std::move(header);
+	datagram.body = std::move(data);
+	datagram.remote = local;
+	auto remoteInbox = getRemote(remote);
+	if(!remoteInbox->deliver(std::move(datagram))) {
+		// The remote has been closed, it may have been bound again
+		forgetRemote(remote, remoteInbox);
+		if(!getRemote(remote)->deliver(std::move(datagram))) {
+			throw std::runtime_error("InProcessSocket: The remote has been closed");
+		}
+	}
+}
+
+std::future<InProcessSocket::Datagram> InProcessSocket::asyncReceiveFrom() {
+	std::shared_ptr<Inbox> current;
+	{
+		std::unique_lock<std::mutex> lock(bindMutex);
+		current = inbox;
+	}
+	std::promise<Datagram> promise;
+	auto future = promise.get_future();
+	std::unique_lock<std::mutex> lock(current->mutex);
+	if(!current->receivedDatagrams.empty()) {
+		promise.set_value(std::move(current->receivedDatagrams.front()));
+		current->receivedDatagrams.pop();
+	} else if(current->closed) {
+		promise.set_exception(std::make_exception_ptr(std::runtime_error("InProcessSocket has been closed")));
+	} else {
+		// Also waits on an unbound socket, it is bound by its first send
+		current->pendingReceives.push(std::move(promise));
+	}
+	return future;
+}
+
+bool InProcessSocket::isOpen() const {
+	return bound;
+}
+
+InProcessSocket::Endpoint InProcessSocket::getLocalEndpoint() const {
+	return local;
+}
+
+void InProcessSocket::close() {
+	std::unique_lock<std::mutex> bindLock(bindMutex);
+	if(!bound) {
+		return;
+	}
+	{
+		auto& r = registry();
+		std::unique_lock<std::mutex> lock(r.mutex);
+		r.inboxes.erase(local.id);
+	}
+	{
+		std::unique_lock<std::mutex> lock(inbox->mutex);
+		inbox->closed = true;
+		while(!inbox->pendingReceives.empty()) {
+			inbox->pendingReceives.front().set_exception(std::make_exception_ptr(std::runtime_error("InProcessSocket has been closed")));
+			inbox->pendingReceives.pop();
+		}
+	}
+	{
+		std::unique_lock<std::mutex> lock(remotesMutex);
+		remotes.clear();
+	}
+	bound = false;
+}
+
+std::ostream& cracen2::sockets::operator<<(std::ostream& lhs, const InProcessSocket::Endpoint& rhs) {
+	return lhs << "inprocess:" << rhs.id;
+}
@@ -0,0 +1,718 @@
+#include "cracen2/sockets/IoUringDatagram.hpp"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+#include <vector>
+
+using namespace cracen2::sockets;
+using namespace cracen2::network;
+using namespace cracen2::util;
+
+constexpr std::size_t IoUringDatagramSocket::MaxMessageSize::total;
+constexpr std::size_t IoUringDatagramSocket::MaxMessageSize::body;
+constexpr std::size_t IoUringDatagramSocket::MaxMessageSize::header;
+
+namespace {
+
+using header_size_t = std::remove_const<decltype(ImmutableBuffer::size)>::type;
+
+constexpr std::size_t maxFrameSize = std::numeric_limits<std::uint16_t>::max();
+
+// User data of the submissions, that are not sends. Sends carry the index of their slot.
+constexpr std::uint64_t receiveData = std::numeric_limits<std::uint64_t>::max();
+constexpr std::uint64_t wakeData = receiveData - 1;
+constexpr std::uint64_t cancelData = receiveData - 2;
+
+constexpr std::uint16_t bufferGroup = 0;
+
+// liburing is not required, the few system calls are made directly
+int io_uring_setup(unsigned entries, io_uring_params* params) {
+	return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void* argument, std::size_t argumentSize) {
+	return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, argument, argumentSize));
+}
+
+int io_uring_register(int fd, unsigned opcode, const void* argument, unsigned count) {
+	return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, argument, count));
+}
+
+void throwErrno(const char* function) {
+	throw std::system_error(errno, std::system_category(), function);
+}
+
+std::size_t roundUpToPowerOfTwo(std::size_t value) {
+	std::size_t result = 1;
+	while(result < value) {
+		result <<= 1;
+	}
+	return result;
+}
+
+void* map(std::size_t size, int fd, off_t offset) {
+	void* result = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+	if(result == MAP_FAILED) {
+		throwErrno("mmap");
+	}
+	return result;
+}
+
+} // End of anonymous namespace
+
+struct IoUringDatagramSocket::Ring {
+
+	/*
+	 * Buffers of the multishot receive: [io_uring_recvmsg_out][address][payload]. The kernel picks one of
+	 * the ring for every received datagram. Bodies are lent out in place and their buffer goes back into
+	 * the ring, when they are released. Lent buffers keep the memory alive beyond the socket.
+	 */
+	class ReceiveBuffers :
+		public network::BufferOwner,
+		public std::enable_shared_from_this<ReceiveBuffers>
+	{
+		// Guards the tail of the ring, buffers are released from any thread
+		std::mutex mutex;
+		std::size_t lent;
+		std::shared_ptr<ReceiveBuffers> self;
+
+		// Puts buffer id at position offset behind the current tail. The tail must be published by the caller.
+		void provide(std::size_t id, std::size_t offset) {
+			const std::uint16_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+			// Not ring->bufs, the empty struct of the flexible array member moves it by 8 bytes in C++
+			io_uring_buf& entry = reinterpret_cast<io_uring_buf*>(ring)[(tail + offset) & (count - 1)];
+			entry.addr = reinterpret_cast<std::uint64_t>(buffer(id));
+			entry.len = size;
+			entry.bid = id;
+		}
+
+		void push(std::size_t id) {
+			provide(id, 0);
+			const std::uint16_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+			__atomic_store_n(&ring->tail, static_cast<std::uint16_t>(tail + 1), __ATOMIC_RELEASE);
+		}
+
+	public:
+
+		io_uring_buf_ring* ring;
+		std::size_t ringSize;
+		std::unique_ptr<std::uint8_t[]> memory;
+		std::size_t count;
+		std::size_t size;
+
+		ReceiveBuffers(std::size_t count, std::size_t size) :
+			lent(0),
+			ringSize(count * sizeof(io_uring_buf)),
+			memory(new std::uint8_t[count * size]),
+			count(count),
+			size(size)
+		{
+			void* ringMemory = ::mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if(ringMemory == MAP_FAILED) {
+				throwErrno("mmap");
+			}
+			ring = static_cast<io_uring_buf_ring*>(ringMemory);
+		}
+
+		// The ring is unregistered by closing the io_uring instance
+		~ReceiveBuffers() {
+			::munmap(ring, ringSize);
+		}
+
+		ReceiveBuffers(const ReceiveBuffers&) = delete;
+		ReceiveBuffers& operator=(const ReceiveBuffers&) = delete;
+
+		std::uint8_t* buffer(std::size_t id) {
+			return memory.get() + id * size;
+		}
+
+		void provideAll() {
+			std::unique_lock<std::mutex> lock(mutex);
+			__atomic_store_n(&ring->tail, 0, __ATOMIC_RELAXED);
+			for(std::size_t i = 0; i < count; i++) {
+				provide(i, i);
+			}
+			__atomic_store_n(&ring->tail, static_cast<std::uint16_t>(count), __ATOMIC_RELEASE);
+		}
+
+		void recycle(std::size_t id) {
+			std::unique_lock<std::mutex> lock(mutex);
+			push(id);
+		}
+
+		// Lends length bytes at data of buffer id, as long as at most half of the buffers are lent, so that
+		// the multishot receive does not run dry. Returns false otherwise.
+		bool lend(std::uint8_t* data, std::size_t length, network::Buffer& destination) {
+			std::unique_lock<std::mutex> lock(mutex);
+			if(2 * (lent + 1) > count) {
+				return false;
+			}
+			if(lent++ == 0) {
+				self = shared_from_this();
+			}
+			lock.unlock();
+			destination = network::Buffer(data, length, *this);
+			return true;
+		}
+
+		void release(std::uint8_t* data) override {
+			std::shared_ptr<ReceiveBuffers> keepAlive;
+			std::unique_lock<std::mutex> lock(mutex);
+			push((data - memory.get()) / size);
+			if(--lent == 0) {
+				keepAlive = std::move(self);
+			}
+			lock.unlock();
+			// May free the buffers, if the socket is gone
+		}
+	};
+
+	// Datagram layout: [body][header][headerSize]
+	struct SendSlot {
+		msghdr message;
+		iovec iovecs[3];
+		header_size_t headerSize;
+		Endpoint remote;
+		network::Completer completion;
+		bool inFlight = false;
+	};
+
+	int fd;
+	io_uring_params params;
+
+	void* sqMemory;
+	std::size_t sqMemorySize;
+	void* cqMemory;
+	std::size_t cqMemorySize;
+	io_uring_sqe* sqes;
+	std::size_t sqesSize;
+
+	unsigned* sqHead;
+	unsigned* sqTail;
+	unsigned sqMask;
+	unsigned* sqArray;
+	// Local copy of the tail, published after each entry
+	unsigned sqLocalTail;
+	unsigned unsubmitted;
+
+	unsigned* cqHead;
+	unsigned* cqTail;
+	unsigned cqMask;
+	io_uring_cqe* cqes;
+
+	std::shared_ptr<ReceiveBuffers> receiveBuffers;
+	msghdr receiveMessage;
+
+	std::vector<SendSlot> sendSlots;
+	std::vector<std::size_t> freeSlots;
+
+	Ring(const Configuration& configuration) :
+		fd(-1),
+		sqMemory(MAP_FAILED),
+		cqMemory(MAP_FAILED),
+		sqes(static_cast<io_uring_sqe*>(MAP_FAILED)),
+		sqLocalTail(0),
+		unsubmitted(0),
+		receiveBuffers(std::make_shared<ReceiveBuffers>(
+			roundUpToPowerOfTwo(std::max<std::size_t>(configuration.receiveBuffers, 1)),
+			sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_storage) + maxFrameSize
+		)),
+		sendSlots(std::max<std::size_t>(configuration.queueDepth, 4) - 2)
+	{
+		try {
+			setup(std::max<std::size_t>(configuration.queueDepth, 4));
+		} catch(...) {
+			release();
+			throw;
+		}
+		for(std::size_t i = sendSlots.size(); i > 0; i--) {
+			freeSlots.push_back(i - 1);
+		}
+	}
+
+	~Ring() {
+		release();
+	}
+
+	void setup(std::size_t entries) {
+		std::memset(&params, 0, sizeof(params));
+		// Completions of the multishot receive may arrive in bursts
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = 4 * entries + receiveBuffers->count;
+		fd = io_uring_setup(entries, &params);
+		if(fd < 0) {
+			throwErrno("io_uring_setup");
+		}
+
+		sqMemorySize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cqMemorySize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		if(params.features & IORING_FEAT_SINGLE_MMAP) {
+			sqMemorySize = cqMemorySize = std::max(sqMemorySize, cqMemorySize);
+		}
+		sqMemory = map(sqMemorySize, fd, IORING_OFF_SQ_RING);
+		if(params.features & IORING_FEAT_SINGLE_MMAP) {
+			cqMemory = sqMemory;
+		} else {
+			cqMemory = map(cqMemorySize, fd, IORING_OFF_CQ_RING);
+		}
+		sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		sqes = static_cast<io_uring_sqe*>(map(sqesSize, fd, IORING_OFF_SQES));
+
+		auto* sq = static_cast<std::uint8_t*>(sqMemory);
+		sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+		sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		sqLocalTail = *sqTail;
+
+		auto* cq = static_cast<std::uint8_t*>(cqMemory);
+		cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+		io_uring_buf_reg registration;
+		std::memset(&registration, 0, sizeof(registration));
+		registration.ring_addr = reinterpret_cast<std::uint64_t>(receiveBuffers->ring);
+		registration.ring_entries = receiveBuffers->count;
+		registration.bgid = bufferGroup;
+		if(io_uring_register(fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+			throwErrno("io_uring_register");
+		}
+		receiveBuffers->provideAll();
+
+		// Only the space reserved for the address is read by the kernel
+		std::memset(&receiveMessage, 0, sizeof(receiveMessage));
+		receiveMessage.msg_namelen = sizeof(sockaddr_storage);
+	}
+
+	void release() {
+		if(sqes != MAP_FAILED) ::munmap(sqes, sqesSize);
+		if(cqMemory != MAP_FAILED && cqMemory != sqMemory) ::munmap(cqMemory, cqMemorySize);
+		if(sqMemory != MAP_FAILED) ::munmap(sqMemory, sqMemorySize);
+		if(fd >= 0) ::close(fd);
+		sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+		cqMemory = sqMemory = MAP_FAILED;
+		fd = -1;
+	}
+
+	// Returns a cleared submission queue entry or nullptr, if the queue is full
+	io_uring_sqe* nextSqe() {
+		const unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+		if(sqLocalTail - head >= params.sq_entries) {
+			return nullptr;
+		}
+		const unsigned index = sqLocalTail & sqMask;
+		io_uring_sqe* sqe = &sqes[index];
+		std::memset(sqe, 0, sizeof(io_uring_sqe));
+		sqArray[index] = index;
+		return sqe;
+	}
+
+	// Like nextSqe, but submits the queued entries to make room and throws, if there still is none
+	io_uring_sqe* acquireSqe() {
+		io_uring_sqe* sqe = nextSqe();
+		if(sqe == nullptr) {
+			submit();
+			sqe = nextSqe();
+		}
+		if(sqe == nullptr) {
+			throw std::runtime_error("io_uring submission queue is full");
+		}
+		return sqe;
+	}
+
+	void publishSqe() {
+		sqLocalTail++;
+		unsubmitted++;
+		__atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+	}
+
+	void submit() {
+		while(unsubmitted > 0) {
+			const int result = io_uring_enter(fd, unsubmitted, 0, 0, nullptr, 0);
+			if(result < 0) {
+				if(errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+					continue;
+				}
+				throwErrno("io_uring_enter");
+			}
+			unsubmitted -= std::min<unsigned>(unsubmitted, result);
+		}
+	}
+};
+
+bool IoUringDatagramSocket::isSupported() {
+	try {
+		Ring ring{Configuration()};
+		return true;
+	} catch(const std::system_error& error) {
+		const int code = error.code().value();
+		if(error.code().category() == std::system_category() && (code == ENOSYS || code == EPERM || code == EINVAL)) {
+			return false;
+		}
+		throw;
+	}
+}
+
+IoUringDatagramSocket::IoUringDatagramSocket() :
+	IoUringDatagramSocket(Configuration())
+{}
+
+IoUringDatagramSocket::IoUringDatagramSocket(Configuration configuration) :
+	configuration(configuration),
+	fd(::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)),
+	reaping(true),
+	receiveArmed(false),
+	stopping(false)
+{
+	if(fd < 0) {
+		throwErrno("socket");
+	}
+	try {
+		ring = std::make_unique<Ring>(configuration);
+	} catch(...) {
+		::close(fd);
+		throw;
+	}
+
+	const int bufferSize = 256*1024*1024;
+	::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+	::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+
+	completionThread = JoiningThread("IoUringDatagramSocket::completions", [this](){ reap(); });
+	if(configuration.sendBatchSize > 1) {
+		batchThread = JoiningThread("IoUringDatagramSocket::batches", [this](){ flushBatches(); });
+	}
+}
+
+IoUringDatagramSocket::~IoUringDatagramSocket() {
+	{
+		std::unique_lock<std::mutex> lock(submitMutex);
+		// Sends in flight reference the memory of their callers, they are completed before the reaper stops
+		try {
+			ring->submit();
+			slotFreed.wait(lock, [this](){ return ring->freeSlots.size() == ring->sendSlots.size() || !reaping; });
+		} catch(const std::exception& e) {
+			std::cerr << "IoUringDatagramSocket: " << e.what() << std::endl;
+		}
+		stopping = true;
+		batchStarted.notify_all();
+		try {
+			io_uring_sqe* sqe = ring->acquireSqe();
+			sqe->opcode = IORING_OP_NOP;
+			sqe->user_data = wakeData;
+			ring->publishSqe();
+			ring->submit();
+		} catch(const std::exception& e) {
+			std::cerr << "IoUringDatagramSocket: " << e.what() << std::endl;
+		}
+	}
+	completionThread = JoiningThread();
+	batchThread = JoiningThread();
+	close();
+
+	// Only left, if the sends could not be submitted or the reaper failed
+	for(auto& slot : ring->sendSlots) {
+		if(slot.inFlight) {
+			slot.inFlight = false;
+			slot.completion.set_exception(std::make_exception_ptr(std::runtime_error("IoUringDatagramSocket has been closed")));
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(receiveMutex);
+	while(!pendingReceives.empty()) {
+		pendingReceives.front().set_exception(std::make_exception_ptr(std::runtime_error("IoUringDatagramSocket has been closed")));
+		pendingReceives.pop();
+	}
+}
+
+void IoUringDatagramSocket::bind(Endpoint endpoint) {
+	if(::bind(fd, endpoint.data(), endpoint.size()) < 0) {
+		throwErrno("bind");
+	}
+}
+
+std::future<void> IoUringDatagramSocket::asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header) {
+	std::promise<void> promise;
+	auto future = promise.get_future();
+	submitSend(data, remote, header, network::Completer(std::move(promise)));
+	return future;
+}
+
+void IoUringDatagramSocket::asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header, network::Completion& completion) {
+	submitSend(data, remote, header, network::Completer(completion));
+}
+
+void IoUringDatagramSocket::submitSend(const ImmutableBuffer& data, const Endpoint& remote, const ImmutableBuffer& header, network::Completer&& completion) {
+	std::unique_lock<std::mutex> lock(submitMutex);
+	if(ring->freeSlots.empty() && std::this_thread::get_id() == completionThreadId) {
+		// Only the completion thread frees slots, so a completion, that sends again, must not wait for one
+		lock.unlock();
+		completion.set_exception(std::make_exception_ptr(std::runtime_error("IoUringDatagramSocket: all send slots are in flight")));
+		return;
+	}
+	// Backpressure: wait for a send to complete, if all slots are in flight
+	slotFreed.wait(lock, [this](){ return !ring->freeSlots.empty(); });
+
+	io_uring_sqe* sqe;
+	try {
+		sqe = ring->acquireSqe();
+	} catch(...) {
+		lock.unlock();
+		completion.set_exception(std::current_exception());
+		return;
+	}
+	const std::size_t index = ring->freeSlots.back();
+	ring->freeSlots.pop_back();
+
+	auto& slot = ring->sendSlots[index];
+	slot.completion = std::move(completion);
+	slot.inFlight = true;
+	slot.remote = remote;
+	slot.headerSize = header.size;
+	slot.iovecs[0].iov_base = const_cast<std::uint8_t*>(data.data);
+	slot.iovecs[0].iov_len = data.size;
+	slot.iovecs[1].iov_base = const_cast<std::uint8_t*>(header.data);
+	slot.iovecs[1].iov_len = header.size;
+	slot.iovecs[2].iov_base = &slot.headerSize;
+	slot.iovecs[2].iov_len = sizeof(slot.headerSize);
+	std::memset(&slot.message, 0, sizeof(slot.message));
+	slot.message.msg_name = slot.remote.data();
+	slot.message.msg_namelen = slot.remote.size();
+	slot.message.msg_iov = slot.iovecs;
+	slot.message.msg_iovlen = 3;
+
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<std::uint64_t>(&slot.message);
+	sqe->len = 1;
+	sqe->user_data = index;
+	ring->publishSqe();
+
+	// Partial batches are submitted by the batch thread after the send window
+	try {
+		if(ring->unsubmitted >= configuration.sendBatchSize) {
+			ring->submit();
+		} else if(ring->unsubmitted == 1) {
+			batchStart = std::chrono::steady_clock::now();
+			batchStarted.notify_one();
+		}
+	} catch(const std::exception& e) {
+		// The send is queued and completes with a later submission, or fails with the destructor
+		std::cerr << "IoUringDatagramSocket: " << e.what() << std::endl;
+	}
+}
+
+std::future<IoUringDatagramSocket::Datagram> IoUringDatagramSocket::asyncReceiveFrom() {
+	std::promise<Datagram> promise;
+	auto future = promise.get_future();
+
+	std::unique_lock<std::mutex> lock(receiveMutex);
+	if(!receivedDatagrams.empty()) {
+		promise.set_value(std::move(receivedDatagrams.front()));
+		receivedDatagrams.pop();
+		return future;
+	}
+
+	pendingReceives.push(std::move(promise));
+	if(!receiveArmed) {
+		armReceive();
+	}
+
+	return future;
+}
+
+void IoUringDatagramSocket::armReceive() {
+	// receiveMutex must be held by the caller
+	std::unique_lock<std::mutex> lock(submitMutex);
+	io_uring_sqe* sqe = ring->acquireSqe();
+	// One submission keeps receiving into the registered buffers, until it runs out of them
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<std::uint64_t>(&ring->receiveMessage);
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = bufferGroup;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->user_data = receiveData;
+	ring->publishSqe();
+	ring->submit();
+	receiveArmed = true;
+}
+
+// Submits a partial batch, once its first send waited for the send window. Sleeps while no batch is queued.
+void IoUringDatagramSocket::flushBatches() {
+	std::unique_lock<std::mutex> lock(submitMutex);
+	while(!stopping) {
+		if(ring->unsubmitted == 0) {
+			batchStarted.wait(lock);
+		} else if(std::chrono::steady_clock::now() < batchStart + configuration.sendWindow) {
+			batchStarted.wait_until(lock, batchStart + configuration.sendWindow);
+		} else {
+			try {
+				ring->submit();
+			} catch(const std::exception& e) {
+				std::cerr << "IoUringDatagramSocket: " << e.what() << std::endl;
+				batchStart = std::chrono::steady_clock::now();
+			}
+		}
+	}
+}
+
+void IoUringDatagramSocket::reap() {
+	{
+		std::unique_lock<std::mutex> lock(submitMutex);
+		completionThreadId = std::this_thread::get_id();
+	}
+	// Waits without a timeout, the destructor wakes it with a nop
+	while(!stopping) {
+		const int result = io_uring_enter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+		if(result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+			std::cerr << "IoUringDatagramSocket: io_uring_enter failed: " << std::strerror(errno) << std::endl;
+			break;
+		}
+
+		unsigned head = *ring->cqHead;
+		const unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+		for(; head != tail; head++) {
+			const io_uring_cqe& cqe = ring->cqes[head & ring->cqMask];
+			if(cqe.user_data == receiveData) {
+				handleReceive(cqe.res, cqe.flags);
+			} else if(cqe.user_data < ring->sendSlots.size()) {
+				handleSend(cqe.user_data, cqe.res);
+			}
+		}
+		__atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+	}
+
+	std::unique_lock<std::mutex> lock(submitMutex);
+	reaping = false;
+	slotFreed.notify_all();
+}
+
+void IoUringDatagramSocket::handleSend(std::uint64_t index, int result) {
+	std::unique_lock<std::mutex> lock(submitMutex);
+	// Completed outside of the lock, so that a completion may send again
+	auto& slot = ring->sendSlots[index];
+	auto completion = std::move(slot.completion);
+	slot.inFlight = false;
+	ring->freeSlots.push_back(index);
+	slotFreed.notify_all();
+	lock.unlock();
+	if(result < 0) {
+		completion.set_exception(std::make_exception_ptr(std::system_error(-result, std::system_category(), "sendmsg")));
+	} else {
+		completion.set_value();
+	}
+}
+
+void IoUringDatagramSocket::deliver(Datagram&& datagram) {
+	if(!pendingReceives.empty()) {
+		pendingReceives.front().set_value(std::move(datagram));
+		pendingReceives.pop();
+	} else {
+		receivedDatagrams.push(std::move(datagram));
+	}
+}
+
+void IoUringDatagramSocket::handleReceive(int result, std::uint32_t flags) {
+	std::unique_lock<std::mutex> lock(receiveMutex);
+
+	if(flags & IORING_CQE_F_BUFFER) {
+		auto& buffers = *ring->receiveBuffers;
+		const std::size_t id = flags >> IORING_CQE_BUFFER_SHIFT;
+		std::uint8_t* buffer = buffers.buffer(id);
+		const auto* out = reinterpret_cast<const io_uring_recvmsg_out*>(buffer);
+		const std::uint8_t* address = buffer + sizeof(io_uring_recvmsg_out);
+		std::uint8_t* frame = buffer + sizeof(io_uring_recvmsg_out) + ring->receiveMessage.msg_namelen + ring->receiveMessage.msg_controllen;
+		const std::size_t frameSize = out->payloadlen;
+
+		header_size_t headerSize = 0;
+		const bool valid =
+			result >= 0 &&
+			!(out->flags & MSG_TRUNC) &&
+			frameSize >= sizeof(headerSize) &&
+			(std::memcpy(&headerSize, frame + frameSize - sizeof(headerSize), sizeof(headerSize)), headerSize <= frameSize - sizeof(headerSize));
+		bool lent = false;
+		if(valid) {
+			// The body stays in the registered buffer, which goes back to the kernel, when the body is
+			// released. Only the small header is copied. Bodies are copied as well, while too many are lent.
+			const std::size_t bodySize = frameSize - headerSize - sizeof(headerSize);
+			Datagram datagram;
+			datagram.remote.resize(std::min<std::size_t>(out->namelen, sizeof(sockaddr_storage)));
+			std::memcpy(datagram.remote.data(), address, datagram.remote.size());
+			datagram.header = Buffer(headerSize);
+			std::memcpy(datagram.header.data(), frame + bodySize, headerSize);
+			lent = buffers.lend(frame, bodySize, datagram.body);
+			if(!lent) {
+				datagram.body = Buffer(bodySize);
+				std::memcpy(datagram.body.data(), frame, bodySize);
+			}
+			deliver(std::move(datagram));
+		}
+		if(!lent) {
+			buffers.recycle(id);
+		}
+	} else if(result < 0 && result != -ENOBUFS && result != -ECANCELED && !pendingReceives.empty()) {
+		pendingReceives.front().set_exception(
+			std::make_exception_ptr(std::system_error(-result, std::system_category(), "recvmsg"))
+		);
+		pendingReceives.pop();
+	}
+
+	if(!(flags & IORING_CQE_F_MORE)) {
+		// The multishot receive ended, for example because all buffers were in use
+		receiveArmed = false;
+		if(!pendingReceives.empty() && !stopping && result != -ECANCELED) {
+			try {
+				armReceive();
+			} catch(...) {
+				pendingReceives.front().set_exception(std::current_exception());
+				pendingReceives.pop();
+			}
+		}
+	}
+}
+
+IoUringDatagramSocket::Endpoint IoUringDatagramSocket::getLocalEndpoint() const {
+	Endpoint endpoint;
+	socklen_t size = endpoint.capacity();
+	if(::getsockname(fd, endpoint.data(), &size) < 0) {
+		throwErrno("getsockname");
+	}
+	endpoint.resize(size);
+	return endpoint;
+}
+
+bool IoUringDatagramSocket::isOpen() const {
+	return fd >= 0;
+}
+
+void IoUringDatagramSocket::close() {
+	std::unique_lock<std::mutex> receiveLock(receiveMutex);
+	if(fd < 0) {
+		return;
+	}
+	if(receiveArmed && !stopping) {
+		// A closed descriptor does not end the operations of the ring, that still reference it
+		std::unique_lock<std::mutex> lock(submitMutex);
+		io_uring_sqe* sqe = ring->acquireSqe();
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->addr = receiveData;
+		sqe->user_data = cancelData;
+		ring->publishSqe();
+		ring->submit();
+	}
+	::close(fd);
+	fd = -1;
+}
@@ -0,0 +1,52 @@
+#include "cracen2/sockets/RateController.hpp"
+
+#include <algorithm>
+
+using namespace cracen2::sockets;
+
+RateController::RateController() :
+	RateController(Configuration())
+{}
+
+RateController::RateController(Configuration configuration) :
+	configuration(configuration),
+	currentRate(configuration.initialRate),
+	baseDelay(0),
+	lastUpdate(Clock::now()),
+	lastDecrease()
+{}
+
+void RateController::update(const RateSample& sample, Clock::time_point now) {
+	using seconds = std::chrono::duration<double>;
+
+	// The base delay is forgotten after a while, so that route changes are picked up
+	if(sample.rtt.count() > 0 && (baseDelay.count() == 0 || sample.rtt < baseDelay || now - baseDelayMeasured > configuration.baseDelayWindow)) {
+		baseDelay = sample.rtt;
+		baseDelayMeasured = now;
+	}
+	const double rtt = std::max(seconds(baseDelay).count(), 100e-6);
+
+	if(sample.rtt.count() > 0) {
+		const double rtts = std::min(1.0, seconds(now - lastUpdate).count() / rtt);
+		const double queuing = seconds(sample.rtt - baseDelay).count();
+		const double target = seconds(configuration.targetDelay).count();
+		const double offTarget = std::max(-1.0, std::min(1.0, (target - queuing) / target));
+		currentRate *= 1 + configuration.gain * offTarget * rtts;
+		lastUpdate = now;
+	}
+
+	if(sample.lost > 0 && seconds(now - lastDecrease).count() > rtt) {
+		currentRate *= configuration.lossDecrease;
+		lastDecrease = now;
+	}
+
+	currentRate = std::max(configuration.minRate, std::min(configuration.maxRate, currentRate));
+}
+
+double RateController::rate() const {
+	return currentRate;
+}
+
+std::chrono::microseconds RateController::getBaseDelay() const {
+	return baseDelay;
+}
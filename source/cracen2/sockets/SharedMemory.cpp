@@ -0,0 +1,651 @@
+#include "cracen2/sockets/SharedMemory.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <numeric>
+#include <stdexcept>
+#include <system_error>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+using namespace cracen2;
+using namespace cracen2::sockets;
+
+constexpr std::size_t SharedMemorySocket::MaxMessageSize::total;
+constexpr std::size_t SharedMemorySocket::MaxMessageSize::body;
+constexpr std::size_t SharedMemorySocket::MaxMessageSize::header;
+
+namespace {
+
+constexpr std::uint64_t ringMagic = 0x63726163656e3201; // "cracen2" + layout version
+
+// Shared futexes, the segment is mapped by several processes
+int futexWait(std::atomic<std::uint32_t>& word, std::uint32_t expected, const timespec* timeout) {
+	return syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+
+void futexWake(std::atomic<std::uint32_t>& word) {
+	syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+std::string segmentName(const SharedMemorySocket::Endpoint& endpoint) {
+	return "/cracen2." + std::to_string(endpoint.process) + "." + std::to_string(endpoint.id);
+}
+
+std::system_error systemError(const std::string& what) {
+	return std::system_error(errno, std::system_category(), what);
+}
+
+/*
+ * Layout at the start of the shared segment. The producer side and the consumer side live on
+ * different cache lines. Sequence numbers are the futex words, the waiting counters let the other
+ * side skip the wake syscall, if nobody sleeps.
+ */
+struct RingHeader {
+	std::atomic<std::uint64_t> magic;
+	std::uint64_t capacity;
+	std::int32_t owner;
+	std::atomic<std::uint32_t> closed;
+	// Producers hold the mutex for a whole frame, so frames of different senders do not interleave
+	pthread_mutex_t producerMutex;
+
+	alignas(64) std::atomic<std::uint64_t> head;
+	std::atomic<std::uint32_t> dataSequence;
+	std::atomic<std::uint32_t> consumerWaiting;
+
+	alignas(64) std::atomic<std::uint64_t> tail;
+	std::atomic<std::uint32_t> spaceSequence;
+	std::atomic<std::uint32_t> producersWaiting;
+};
+
+constexpr std::size_t dataOffset = (sizeof(RingHeader) + 63) / 64 * 64;
+
+// Precedes every frame in the ring
+struct FrameHeader {
+	SharedMemorySocket::Endpoint sender;
+	std::uint64_t headerSize;
+	std::uint64_t bodySize;
+};
+
+} // End of anonymous namespace
+
+/*
+ * Single consumer, multi producer byte ring in a shared memory segment. Frames are copied in and out
+ * in pieces, so a frame may be bigger than the ring. The consumer may also borrow a contiguous range of
+ * the ring. The tail only passes it, once it has been released.
+ */
+class SharedMemorySocket::Ring :
+	public network::BufferOwner,
+	public std::enable_shared_from_this<Ring>
+{
+	struct Loan {
+		std::uint64_t begin;
+		std::uint64_t end;
+		bool released;
+	};
+
+	std::string name;
+	bool owner;
+	bool unlinked;
+	std::size_t size;
+	void* memory;
+	RingHeader* header;
+	std::uint8_t* data;
+
+	// Consumer side. The tail lags behind the read position, while ranges are borrowed.
+	std::mutex loanMutex;
+	std::uint64_t readPosition;
+	std::deque<Loan> loans;
+	// Keeps the mapping alive, while ranges are borrowed
+	std::shared_ptr<Ring> self;
+
+	void map(int fd);
+	void waitForSpace();
+	bool lockProducers(bool wait);
+	void write(const std::uint8_t* source, std::size_t length);
+	void advanceTail();
+
+public:
+
+	// Creates the segment
+	Ring(std::string name, std::size_t capacity);
+	// Maps an existing segment
+	Ring(std::string name);
+	~Ring();
+
+	Ring(const Ring&) = delete;
+	Ring& operator=(const Ring&) = delete;
+
+	// Writes all pieces as one frame. Throws, if the ring is closed or its owner died.
+	void write(std::initializer_list<ImmutableBuffer> pieces);
+	// Writes the frame only, if it fits without waiting. Throws like write.
+	bool tryWrite(std::initializer_list<ImmutableBuffer> pieces);
+	// Blocks until length bytes are read. Returns false, if the ring has been closed and is drained.
+	bool read(std::uint8_t* destination, std::size_t length);
+	// Hands out the next length bytes in place, if they are contiguous and at most half of the ring is
+	// borrowed with them. Waits until they are written. Returns false otherwise, without consuming anything.
+	bool borrow(std::size_t length, network::Buffer& destination);
+	void release(std::uint8_t* data) override;
+	bool isClosed() const;
+	void close();
+};
+
+void SharedMemorySocket::Ring::map(int fd) {
+	memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(memory == MAP_FAILED) {
+		throw systemError("SharedMemorySocket: mmap of " + name + " failed");
+	}
+	header = static_cast<RingHeader*>(memory);
+	data = static_cast<std::uint8_t*>(memory) + dataOffset;
+}
+
+SharedMemorySocket::Ring::Ring(std::string name, std::size_t capacity) :
+	name(std::move(name)),
+	owner(true),
+	unlinked(false),
+	size(dataOffset + capacity),
+	readPosition(0)
+{
+	int fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if(fd < 0 && errno == EEXIST) {
+		// Left over by a dead process, that had the same pid. Ids are unique inside this process.
+		shm_unlink(this->name.c_str());
+		fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	}
+	if(fd < 0) {
+		throw systemError("SharedMemorySocket: shm_open of " + this->name + " failed");
+	}
+	if(ftruncate(fd, size) != 0) {
+		const auto error = systemError("SharedMemorySocket: ftruncate of " + this->name + " failed");
+		::close(fd);
+		shm_unlink(this->name.c_str());
+		throw error;
+	}
+	map(fd);
+
+	new(header) RingHeader();
+	header->capacity = capacity;
+	header->owner = getpid();
+	header->closed = 0;
+	header->head = 0;
+	header->tail = 0;
+	header->dataSequence = 0;
+	header->consumerWaiting = 0;
+	header->spaceSequence = 0;
+	header->producersWaiting = 0;
+
+	pthread_mutexattr_t attributes;
+	pthread_mutexattr_init(&attributes);
+	pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&header->producerMutex, &attributes);
+	pthread_mutexattr_destroy(&attributes);
+
+	// Producers check the magic, so it is written last
+	header->magic.store(ringMagic);
+}
+
+SharedMemorySocket::Ring::Ring(std::string name) :
+	name(std::move(name)),
+	owner(false),
+	unlinked(false),
+	readPosition(0)
+{
+	const int fd = shm_open(this->name.c_str(), O_RDWR, 0);
+	if(fd < 0) {
+		throw systemError("SharedMemorySocket: No socket bound to " + this->name);
+	}
+	struct stat status;
+	if(fstat(fd, &status) != 0 || static_cast<std::size_t>(status.st_size) < dataOffset) {
+		::close(fd);
+		throw std::runtime_error("SharedMemorySocket: " + this->name + " is not a cracen2 socket");
+	}
+	size = status.st_size;
+	map(fd);
+	if(header->magic.load() != ringMagic || header->capacity != size - dataOffset) {
+		munmap(memory, size);
+		throw std::runtime_error("SharedMemorySocket: " + this->name + " is not a cracen2 socket");
+	}
+}
+
+SharedMemorySocket::Ring::~Ring() {
+	if(owner) {
+		close();
+	}
+	munmap(memory, size);
+}
+
+bool SharedMemorySocket::Ring::isClosed() const {
+	return header->closed.load() != 0;
+}
+
+void SharedMemorySocket::Ring::close() {
+	header->closed.store(1);
+	header->dataSequence++;
+	header->spaceSequence++;
+	futexWake(header->dataSequence);
+	futexWake(header->spaceSequence);
+	// Unlinked right away, the mapping may outlive the socket, while ranges are borrowed
+	if(owner && !unlinked) {
+		shm_unlink(name.c_str());
+		unlinked = true;
+	}
+}
+
+void SharedMemorySocket::Ring::waitForSpace() {
+	const std::uint32_t sequence = header->spaceSequence.load();
+	header->producersWaiting++;
+	if(header->head.load() - header->tail.load() == header->capacity && !isClosed()) {
+		// Wake up from time to time, to notice a receiver, that died without closing its inbox
+		const timespec timeout { 0, 100*1000*1000 };
+		if(futexWait(header->spaceSequence, sequence, &timeout) != 0 && errno == ETIMEDOUT) {
+			if(kill(header->owner, 0) != 0 && errno == ESRCH) {
+				header->closed.store(1);
+			}
+		}
+	}
+	header->producersWaiting--;
+}
+
+void SharedMemorySocket::Ring::write(const std::uint8_t* source, std::size_t length) {
+	const std::uint64_t capacity = header->capacity;
+	while(length > 0) {
+		if(isClosed()) {
+			throw std::runtime_error("SharedMemorySocket: " + name + " has been closed");
+		}
+		const std::uint64_t head = header->head.load(std::memory_order_relaxed);
+		const std::uint64_t free = capacity - (head - header->tail.load());
+		if(free == 0) {
+			waitForSpace();
+			continue;
+		}
+		const std::uint64_t offset = head % capacity;
+		const std::size_t chunk = std::min<std::uint64_t>({ length, free, capacity - offset });
+		std::memcpy(data + offset, source, chunk);
+		header->head.store(head + chunk);
+		header->dataSequence++;
+		if(header->consumerWaiting.load()) {
+			futexWake(header->dataSequence);
+		}
+		source += chunk;
+		length -= chunk;
+	}
+}
+
+bool SharedMemorySocket::Ring::lockProducers(bool wait) {
+	const int result = wait ? pthread_mutex_lock(&header->producerMutex) : pthread_mutex_trylock(&header->producerMutex);
+	if(result == EOWNERDEAD) {
+		// A sender died in the middle of a frame, the stream can not be parsed any more
+		header->closed.store(1);
+		pthread_mutex_consistent(&header->producerMutex);
+		pthread_mutex_unlock(&header->producerMutex);
+		throw std::runtime_error("SharedMemorySocket: A sender of " + name + " died while sending");
+	} else if(result == EBUSY && !wait) {
+		return false;
+	} else if(result != 0) {
+		errno = result;
+		throw systemError("SharedMemorySocket: Could not lock " + name);
+	}
+	return true;
+}
+
+bool SharedMemorySocket::Ring::tryWrite(std::initializer_list<ImmutableBuffer> pieces) {
+	if(isClosed()) {
+		throw std::runtime_error("SharedMemorySocket: " + name + " has been closed");
+	}
+	const std::uint64_t length = std::accumulate(pieces.begin(), pieces.end(), std::uint64_t(0), [](std::uint64_t sum, const ImmutableBuffer& piece) { return sum + piece.size; });
+	auto fits = [this, length](){ return header->capacity - (header->head.load() - header->tail.load()) >= length; };
+	if(!fits() || !lockProducers(false)) {
+		return false;
+	}
+	if(!fits()) {
+		pthread_mutex_unlock(&header->producerMutex);
+		return false;
+	}
+	try {
+		for(const auto& piece : pieces) {
+			write(piece.data, piece.size);
+		}
+	} catch(...) {
+		pthread_mutex_unlock(&header->producerMutex);
+		throw;
+	}
+	pthread_mutex_unlock(&header->producerMutex);
+	return true;
+}
+
+void SharedMemorySocket::Ring::write(std::initializer_list<ImmutableBuffer> pieces) {
+	lockProducers(true);
+
+	try {
+		for(const auto& piece : pieces) {
+			write(piece.data, piece.size);
+		}
+	} catch(...) {
+		pthread_mutex_unlock(&header->producerMutex);
+		throw;
+	}
+	pthread_mutex_unlock(&header->producerMutex);
+}
+
+// Called with the loanMutex held
+void SharedMemorySocket::Ring::advanceTail() {
+	while(!loans.empty() && loans.front().released) {
+		loans.pop_front();
+	}
+	const std::uint64_t tail = loans.empty() ? readPosition : loans.front().begin;
+	if(tail == header->tail.load(std::memory_order_relaxed)) {
+		return;
+	}
+	header->tail.store(tail);
+	header->spaceSequence++;
+	if(header->producersWaiting.load()) {
+		futexWake(header->spaceSequence);
+	}
+}
+
+bool SharedMemorySocket::Ring::read(std::uint8_t* destination, std::size_t length) {
+	const std::uint64_t capacity = header->capacity;
+	while(length > 0) {
+		const std::uint64_t position = readPosition;
+		const std::uint64_t available = header->head.load() - position;
+		if(available == 0) {
+			// Frames, that were written before the ring has been closed, are still read
+			if(isClosed()) {
+				return false;
+			}
+			const std::uint32_t sequence = header->dataSequence.load();
+			header->consumerWaiting.store(1);
+			if(header->head.load() == position && !isClosed()) {
+				futexWait(header->dataSequence, sequence, nullptr);
+			}
+			header->consumerWaiting.store(0);
+			continue;
+		}
+		const std::uint64_t offset = position % capacity;
+		const std::size_t chunk = std::min<std::uint64_t>({ length, available, capacity - offset });
+		std::memcpy(destination, data + offset, chunk);
+		{
+			std::unique_lock<std::mutex> lock(loanMutex);
+			readPosition = position + chunk;
+			advanceTail();
+		}
+		destination += chunk;
+		length -= chunk;
+	}
+	return true;
+}
+
+bool SharedMemorySocket::Ring::borrow(std::size_t length, network::Buffer& destination) {
+	const std::uint64_t capacity = header->capacity;
+	const std::uint64_t offset = readPosition % capacity;
+	if(offset + length > capacity) {
+		return false;
+	}
+	std::unique_lock<std::mutex> lock(loanMutex);
+	if(readPosition - header->tail.load(std::memory_order_relaxed) + length > capacity / 2) {
+		return false;
+	}
+	lock.unlock();
+	// The rest of the frame fits into the free half of the ring, so the producer does not wait for us
+	while(header->head.load() - readPosition < length) {
+		if(isClosed()) {
+			return false;
+		}
+		const std::uint32_t sequence = header->dataSequence.load();
+		header->consumerWaiting.store(1);
+		if(header->head.load() - readPosition < length && !isClosed()) {
+			futexWait(header->dataSequence, sequence, nullptr);
+		}
+		header->consumerWaiting.store(0);
+	}
+	lock.lock();
+	if(loans.empty()) {
+		self = shared_from_this();
+	}
+	loans.push_back(Loan { readPosition, readPosition + length, false });
+	readPosition += length;
+	destination = network::Buffer(data + offset, length, *this);
+	return true;
+}
+
+void SharedMemorySocket::Ring::release(std::uint8_t* borrowed) {
+	std::shared_ptr<Ring> keepAlive;
+	{
+		std::unique_lock<std::mutex> lock(loanMutex);
+		const std::uint64_t offset = borrowed - data;
+		for(auto& loan : loans) {
+			if(!loan.released && loan.begin % header->capacity == offset) {
+				loan.released = true;
+				break;
+			}
+		}
+		advanceTail();
+		if(loans.empty()) {
+			keepAlive = std::move(self);
+		}
+	}
+	// May unmap the ring, if the socket is gone
+}
+
+SharedMemorySocket::SharedMemorySocket() :
+	SharedMemorySocket(Configuration())
+{}
+
+SharedMemorySocket::SharedMemorySocket(Configuration configuration) :
+	configuration(configuration),
+	closed(false)
+{
+	if(configuration.ringSize == 0) {
+		throw std::invalid_argument("SharedMemorySocket needs a ring size greater than 0.");
+	}
+}
+
+SharedMemorySocket::~SharedMemorySocket() {
+	close();
+}
+
+void SharedMemorySocket::bind(Endpoint endpoint) {
+	static std::atomic<std::uint32_t> nextId(1);
+
+	if(inbox) {
+		throw std::logic_error("SharedMemorySocket is already bound to " + segmentName(local));
+	}
+	if(endpoint.process == 0) {
+		endpoint.process = getpid();
+	}
+	if(endpoint.id == 0) {
+		endpoint.id = nextId++;
+	}
+	inbox = std::make_shared<Ring>(segmentName(endpoint), configuration.ringSize);
+	local = endpoint;
+	{
+		std::unique_lock<std::mutex> lock(receiveMutex);
+		closed = false;
+	}
+	receiver = util::JoiningThread("SharedMemorySocket::receiver", &SharedMemorySocket::receive, this);
+}
+
+void SharedMemorySocket::receive() {
+	while(true) {
+		FrameHeader frame;
+		if(!inbox->read(reinterpret_cast<std::uint8_t*>(&frame), sizeof(frame))) {
+			break;
+		}
+		Datagram datagram;
+		datagram.header = network::Buffer(frame.headerSize);
+		datagram.remote = frame.sender;
+		if(!inbox->read(datagram.header.data(), frame.headerSize)) {
+			break;
+		}
+		if(frame.bodySize < configuration.borrowThreshold || !inbox->borrow(frame.bodySize, datagram.body)) {
+			datagram.body = network::Buffer(frame.bodySize);
+			if(!inbox->read(datagram.body.data(), frame.bodySize)) {
+				break;
+			}
+		}
+		handle_datagram(std::move(datagram));
+	}
+
+	// Nothing will arrive any more
+	std::unique_lock<std::mutex> lock(receiveMutex);
+	closed = true;
+	while(!pendingReceives.empty()) {
+		pendingReceives.front().set_exception(std::make_exception_ptr(std::runtime_error("SharedMemorySocket has been closed")));
+		pendingReceives.pop();
+	}
+}
+
+void SharedMemorySocket::handle_datagram(Datagram&& datagram) {
+	std::unique_lock<std::mutex> lock(receiveMutex);
+	if(!pendingReceives.empty()) {
+		pendingReceives.front().set_value(std::move(datagram));
+		pendingReceives.pop();
+	} else {
+		receivedDatagrams.push(std::move(datagram));
+	}
+}
+
+std::shared_ptr<SharedMemorySocket::Ring> SharedMemorySocket::getRemote(const Endpoint& remote) {
+	std::unique_lock<std::mutex> lock(remotesMutex);
+	auto it = remotes.find(remote);
+	if(it != remotes.end()) {
+		if(!it->second->isClosed()) {
+			return it->second;
+		}
+		// The remote has been closed, it may have been bound again
+		remotes.erase(it);
+	}
+	auto ring = std::make_shared<Ring>(segmentName(remote));
+	remotes.insert(std::make_pair(remote, ring));
+	return ring;
+}
+
+std::future<void> SharedMemorySocket::asyncSendTo(const ImmutableBuffer& data, const Endpoint remote, const ImmutableBuffer& header) {
+	std::promise<void> promise;
+	auto future = promise.get_future();
+	try {
+		{
+			// Like an unbound udp socket, the sender gets an endpoint for the replies on the first send
+			std::unique_lock<std::mutex> lock(remotesMutex);
+			if(!inbox) {
+				bind();
+			}
+		}
+		const FrameHeader frame { local, header.size, data.size };
+		auto ring = getRemote(remote);
+		std::unique_lock<std::mutex> lock(sendMutex);
+		auto& queue = remoteSends[remote];
+		if(
+			queue.pending.empty() && !queue.sending &&
+			ring->tryWrite({
+				ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&frame), sizeof(frame)),
+				header,
+				data
+			})
+		) {
+			promise.set_value();
+			return future;
+		}
+		// The inbox is full, the sender thread of the remote waits for space instead of the caller
+		queue.pending.push(PendingSend { data, header, remote, std::move(promise) });
+		if(!queue.sending) {
+			queue.sending = true;
+			// Joins the last sender of the remote, which has left the queue already
+			queue.sender = util::JoiningThread("SharedMemorySocket::sender", &SharedMemorySocket::send, this, remote);
+		}
+	} catch(...) {
+		promise.set_exception(std::current_exception());
+	}
+	return future;
+}
+
+void SharedMemorySocket::send(Endpoint remote) {
+	std::unique_lock<std::mutex> lock(sendMutex);
+	auto& queue = remoteSends[remote];
+	while(!queue.pending.empty()) {
+		PendingSend pending = std::move(queue.pending.front());
+		queue.pending.pop();
+		lock.unlock();
+		try {
+			const FrameHeader frame { local, pending.header.size, pending.data.size };
+			getRemote(remote)->write({
+				ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&frame), sizeof(frame)),
+				pending.header,
+				pending.data
+			});
+			pending.promise.set_value();
+		} catch(...) {
+			pending.promise.set_exception(std::current_exception());
+		}
+		lock.lock();
+	}
+	queue.sending = false;
+}
+
+std::future<SharedMemorySocket::Datagram> SharedMemorySocket::asyncReceiveFrom() {
+	std::promise<Datagram> promise;
+	auto future = promise.get_future();
+	std::unique_lock<std::mutex> lock(receiveMutex);
+	if(!receivedDatagrams.empty()) {
+		promise.set_value(std::move(receivedDatagrams.front()));
+		receivedDatagrams.pop();
+	} else if(closed) {
+		promise.set_exception(std::make_exception_ptr(std::runtime_error("SharedMemorySocket has been closed")));
+	} else {
+		pendingReceives.push(std::move(promise));
+	}
+	return future;
+}
+
+bool SharedMemorySocket::isOpen() const {
+	return inbox != nullptr;
+}
+
+SharedMemorySocket::Endpoint SharedMemorySocket::getLocalEndpoint() const {
+	return local;
+}
+
+void SharedMemorySocket::close() {
+	std::vector<util::JoiningThread> senders;
+	{
+		// Sends, that wait for a full inbox, fail. Only the frames, that are written right now, are finished.
+		std::unique_lock<std::mutex> lock(sendMutex);
+		for(auto& endpointSends : remoteSends) {
+			auto& queue = endpointSends.second;
+			while(!queue.pending.empty()) {
+				queue.pending.front().promise.set_exception(std::make_exception_ptr(std::runtime_error("SharedMemorySocket has been closed")));
+				queue.pending.pop();
+			}
+			if(queue.sender.joinable()) {
+				senders.push_back(std::move(queue.sender));
+			}
+		}
+	}
+	senders.clear();
+	if(inbox) {
+		inbox->close();
+		receiver = util::JoiningThread();
+		inbox.reset();
+	}
+	std::unique_lock<std::mutex> lock(remotesMutex);
+	remotes.clear();
+}
+
+std::ostream& cracen2::sockets::operator<<(std::ostream& lhs, const SharedMemorySocket::Endpoint& rhs) {
+	return lhs << "shm:" << rhs.process << "." << rhs.id;
+}
@@ -11,6 +11,7 @@
 #include <vector>
 #include <sstream>
 #include <memory>
+#include <array>
 
 std::ostream& cracen2::util::stacktrace(std::ostream& os) {
 	std::vector<void*> buffer(1);
@@ -1,6 +1,8 @@
 #include "cracen2/sockets/BoostMpi.hpp"
 #include "cracen2/sockets/AsioDatagram.hpp"
 #include "cracen2/sockets/AsioStreaming.hpp"
+#include "cracen2/sockets/SharedMemory.hpp"
+#include "cracen2/sockets/InProcess.hpp"
 
 #include "cracen2/Cracen2.hpp"
 #include "cracen2/CracenServer.hpp"
@@ -8,12 +10,38 @@
 #include "cracen2/send_policies/broadcast.hpp"
 #include "cracen2/util/Test.hpp"
 
+#include <deque>
+#include <future>
+#include <memory>
+#include <vector>
+
 
 using namespace cracen2;
 using namespace cracen2::util;
 using namespace cracen2::sockets;
 
-using Messages = std::tuple<int>;
+// Composite message of metadata and a payload
+struct Frame {
+	int id;
+	std::vector<float> samples;
+};
+
+namespace cracen2 {
+namespace network {
+
+template <>
+struct Members<Frame> {
+	template <class Self>
+	static auto tie(Self& frame) -> decltype(std::tie(frame.id, frame.samples)) {
+		return std::tie(frame.id, frame.samples);
+	}
+};
+
+} // End of namespace network
+} // End of namespace cracen2
+
+// std::deque and Frame have no view, so they are queued decoded
+using Messages = std::tuple<int, std::deque<int>, Frame>;
 
 struct Role {
 	template <class T>
@@ -37,13 +65,13 @@ template <class T>
 constexpr size_t Role::InputQueueSize<T>::value;
 
 template <class SocketImplementation>
-void cracenTest() {
+void cracenTest(std::uint32_t features = backend::Features::none) {
 	TestSuite testSuite("Cracen2 Testsuite");
 	CracenServer<SocketImplementation> server;
 
 	std::array<Cracen2<SocketImplementation, Role, Messages>, 2> cracen {{
-		{ server.getEndpoint(), Role(0) },
-		{ server.getEndpoint(), Role(1) }
+		{ server.getEndpoint(), Role(0), features },
+		{ server.getEndpoint(), Role(1), features }
 	}};
 
 	// Using udp, there is a chance of package loss due to collision with the older packages
@@ -56,19 +84,74 @@ void cracenTest() {
 		"Cracen2Test::SendAction",
 		[&](){
 			cracen[0].send(5, send_policies::broadcast_any());
+			cracen[0].send(6, send_policies::broadcast_any());
+			cracen[0].send(std::deque<int>{ 1, 2, 3 }, send_policies::broadcast_any());
+			cracen[0].send(Frame { 7, std::vector<float>(1024, 1.5f) }, send_policies::broadcast_any());
 		}
 	);
 	auto received = cracen[1].template receive<int>();
 	std::cout << "received int = " << received << std::endl;
 	testSuite.equal(received, 5, "Cracen receive test");
+	testSuite.equal(*cracen[1].template receive<network::View<int>>(), 6, "Cracen view receive test");
+	testSuite.test(cracen[1].template receive<std::deque<int>>() == std::deque<int>{ 1, 2, 3 }, "Cracen receive test without view");
+	const auto frame = cracen[1].template receive<Frame>();
+	testSuite.test(frame.id == 7 && frame.samples == std::vector<float>(1024, 1.5f), "Cracen composite receive test");
+
+	if(features & backend::Features::extendedHeader) {
+		const auto map = cracen[1].getRoleEndpointMapReadOnlyView();
+		const auto& endpoints = map->get().at(0);
+		testSuite.equal(cracen[1].getEdgeStatistics(endpoints.front()).received, std::uint64_t(4), "Cracen extended header test");
+	}
 
 	cracen[0].release();
 	cracen[1].release();
 	server.stop();
 }
 
+// Two contexts, each with its own mpi engine, run side by side without seeing the messages of the other
+void separateEngineTest() {
+	TestSuite testSuite("Cracen2 separate engine Testsuite");
+	using Cracen = Cracen2<BoostMpiSocket, Role, Messages>;
+
+	BoostMpiSocket::Configuration first;
+	first.engine = std::make_shared<sockets::detail::MpiEngine>();
+	BoostMpiSocket::Configuration second;
+	second.engine = std::make_shared<sockets::detail::MpiEngine>();
+
+	CracenServer<BoostMpiSocket> firstServer(BoostMpiSocket::Endpoint(), first);
+	CracenServer<BoostMpiSocket> secondServer(BoostMpiSocket::Endpoint(), second);
+
+	auto secondSender = std::async(std::launch::async, [&]() {
+		return std::unique_ptr<Cracen>(new Cracen(secondServer.getEndpoint(), Role(0), backend::Features::none, second));
+	});
+	auto secondReceiver = std::async(std::launch::async, [&]() {
+		return std::unique_ptr<Cracen>(new Cracen(secondServer.getEndpoint(), Role(1), backend::Features::none, second));
+	});
+	std::array<Cracen, 2> cracen {{
+		{ firstServer.getEndpoint(), Role(0), backend::Features::none, first },
+		{ firstServer.getEndpoint(), Role(1), backend::Features::none, first }
+	}};
+	std::array<std::unique_ptr<Cracen>, 2> other {{ secondSender.get(), secondReceiver.get() }};
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+	cracen[0].send(1, send_policies::broadcast_any());
+	other[0]->send(2, send_policies::broadcast_any());
+	testSuite.equal(cracen[1].template receive<int>(), 1, "First engine receive test");
+	testSuite.equal(other[1]->template receive<int>(), 2, "Second engine receive test");
+
+	for(auto* instance : { &cracen[0], &cracen[1], other[0].get(), other[1].get() }) {
+		instance->release();
+	}
+	firstServer.stop();
+	secondServer.stop();
+}
+
 int main(int, char**) {
 //  	cracenTest<AsioDatagramSocket>();
   	cracenTest<AsioStreamingSocket>();
 	cracenTest<BoostMpiSocket>();
+	cracenTest<SharedMemorySocket>();
+	cracenTest<InProcessSocket>();
+	cracenTest<InProcessSocket>(backend::Features::extendedHeader);
+	separateEngineTest();
 }
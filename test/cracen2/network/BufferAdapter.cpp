@@ -62,6 +62,14 @@ int main() {
 		testSuite.equalRange(result, { {1, 2, 3, 4, 5, 6, 7, 8, 9, 10} }, "Buffer Adaptor for std::array");
 	}
 
+	{
+		std::deque<int> value = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+		ImmutableBuffer buffer = make_buffer_adaptor(value);
+
+		std::deque<int> result = BufferAdapter<std::deque<int>>(buffer).cast();
+		testSuite.equalRange(result, std::deque<int>{1, 2, 3, 4, 5, 6, 7, 8, 9, 10}, "Buffer Adaptor for std::deque");
+	}
+
 
 
 }
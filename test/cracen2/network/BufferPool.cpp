@@ -0,0 +1,101 @@
+#include "cracen2/network/ImmutableBuffer.hpp"
+#include "cracen2/util/Test.hpp"
+#include "cracen2/util/Thread.hpp"
+
+#include <vector>
+#include <cstring>
+
+using namespace cracen2::network;
+using namespace cracen2::util;
+
+int main() {
+	TestSuite testSuite("BufferPool");
+
+	testSuite.equal(BufferPool::sizeClass(1), 0, "Smallest size class");
+	testSuite.equal(BufferPool::sizeClass(256), 0, "Exact size class");
+	testSuite.equal(BufferPool::sizeClass(257), 1, "Rounded up size class");
+	testSuite.equal(BufferPool::sizeClassCapacity(BufferPool::sizeClass(510*1024)), std::size_t(512*1024), "Frame size class");
+	testSuite.equal(BufferPool::sizeClass(std::size_t(1) << 30), -1, "Unpooled size");
+
+	BufferPool::resetStatistics();
+	{
+		// Fresh memory for every block of the second size class
+		std::vector<Buffer> buffers;
+		for(int i = 0; i < 4; i++) {
+			buffers.emplace_back(300);
+			std::memset(buffers.back().data(), i, buffers.back().size());
+		}
+	}
+	testSuite.equal(BufferPool::statistics().misses, std::uint64_t(4), "Miss counter");
+	testSuite.equal(BufferPool::statistics().hits, std::uint64_t(0), "Hit counter before recycling");
+
+	{
+		// The same blocks come back from the thread local cache
+		std::vector<Buffer> buffers;
+		for(int i = 0; i < 4; i++) {
+			buffers.emplace_back(400);
+			testSuite.equal(buffers.back().size(), std::size_t(400), "Recycled buffer size");
+		}
+	}
+	testSuite.equal(BufferPool::statistics().hits, std::uint64_t(4), "Hit counter after recycling");
+	testSuite.equal(BufferPool::statistics().misses, std::uint64_t(4), "Miss counter after recycling");
+
+	{
+		// Buffers released on another thread go back into the shared free list on thread exit
+		std::vector<Buffer> buffers;
+		for(int i = 0; i < 4; i++) {
+			buffers.emplace_back(64*1024);
+		}
+		JoiningThread releaser("BufferPoolTest::releaser", [&buffers](){
+			buffers.clear();
+		});
+	}
+	BufferPool::resetStatistics();
+	{
+		Buffer buffer(64*1024);
+	}
+	testSuite.equal(BufferPool::statistics().hits, std::uint64_t(1), "Hit counter for cross thread release");
+
+	{
+		Buffer buffer(std::size_t(32) << 20);
+	}
+	testSuite.equal(BufferPool::statistics().unpooled, std::uint64_t(1), "Unpooled counter");
+
+	{
+		// Counters of exited threads are kept
+		BufferPool::resetStatistics();
+		JoiningThread allocator("BufferPoolTest::allocator", [](){
+			Buffer first(1024);
+			Buffer second(1024);
+		});
+	}
+	testSuite.equal(BufferPool::statistics().misses + BufferPool::statistics().hits, std::uint64_t(2), "Counters of an exited thread");
+
+	{
+		// Blocks above the high-water mark are freed instead of kept
+		BufferPool::trim();
+		testSuite.equal(BufferPool::statistics().idleBytes, std::uint64_t(0), "Idle bytes after trim");
+		BufferPool::setIdleLimit(2*1024*1024);
+		{
+			std::vector<Buffer> buffers;
+			for(int i = 0; i < 4; i++) {
+				buffers.emplace_back(1024*1024);
+			}
+			JoiningThread releaser("BufferPoolTest::releaser", [&buffers](){
+				buffers.clear();
+			});
+		}
+		testSuite.equal(BufferPool::statistics().idleBytes, std::uint64_t(2*1024*1024), "Idle bytes at the high-water mark");
+		BufferPool::trim();
+		testSuite.equal(BufferPool::statistics().idleBytes, std::uint64_t(0), "Idle bytes after second trim");
+		BufferPool::setIdleLimit(BufferPool::defaultIdleLimit);
+	}
+
+	{
+		std::unique_ptr<std::uint8_t[]> memory(new std::uint8_t[16]);
+		Buffer buffer(std::move(memory), 16);
+		testSuite.equal(buffer.size(), std::size_t(16), "Adopted memory");
+	}
+
+	return 0;
+}
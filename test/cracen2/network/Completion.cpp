@@ -0,0 +1,289 @@
+#include "cracen2/util/Test.hpp"
+#include "cracen2/network/Completion.hpp"
+#include "cracen2/network/Communicator.hpp"
+#include "cracen2/sockets/InProcess.hpp"
+#include "cracen2/sockets/AsioDatagram.hpp"
+#include "cracen2/sockets/AsioStreaming.hpp"
+#ifdef CRACEN2_ENABLE_IO_URING
+#include "cracen2/sockets/IoUringDatagram.hpp"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <set>
+#include <thread>
+#include <vector>
+
+// Counts the allocations of the thread, that sets countAllocations
+thread_local bool countAllocations = false;
+std::atomic<std::size_t> allocations(0);
+
+void* operator new(std::size_t size) {
+	if(countAllocations) {
+		allocations++;
+	}
+	if(void* result = std::malloc(size == 0 ? 1 : size)) {
+		return result;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+	std::free(pointer);
+}
+
+using namespace cracen2::util;
+using namespace cracen2::sockets;
+using namespace cracen2::network;
+
+constexpr int runs = 1000;
+
+struct Counter {
+	std::atomic<int>* completed;
+	std::atomic<int>* failed;
+
+	void operator()(std::exception_ptr error) {
+		(error ? *failed : *completed)++;
+	}
+};
+
+void poolTest(TestSuite& testSuite) {
+	std::atomic<int> completed(0);
+	std::atomic<int> failed(0);
+	CompletionPool<Completion, Counter> pool(Counter { &completed, &failed }, 4);
+
+	// Sequential completions recycle the same objects
+	std::set<Completion*> used;
+	for(int i = 0; i < runs; i++) {
+		auto& completion = pool.acquire();
+		used.insert(&completion);
+		completion.complete(i % 10 == 0 ? std::make_exception_ptr(std::runtime_error("failed")) : nullptr);
+	}
+	testSuite.equal(used.size(), std::size_t(1), "Recycled completion test");
+	testSuite.equal(completed.load(), runs - runs / 10, "Completed count test");
+	testSuite.equal(failed.load(), runs / 10, "Failed count test");
+
+	// The pool grows, if all objects are in flight
+	std::vector<Completion*> inFlight;
+	for(int i = 0; i < 8; i++) {
+		inFlight.push_back(&pool.acquire());
+	}
+	testSuite.equal(std::set<Completion*>(inFlight.begin(), inFlight.end()).size(), std::size_t(8), "Grown pool test");
+	for(auto completion : inFlight) {
+		completion->complete(nullptr);
+	}
+}
+
+void completerTest(TestSuite& testSuite) {
+	std::promise<void> promise;
+	auto future = promise.get_future();
+	Completer completer(std::move(promise));
+	Completer moved(std::move(completer));
+	moved.set_exception(std::make_exception_ptr(std::runtime_error("failed")));
+	bool thrown = false;
+	try {
+		future.get();
+	} catch(const std::runtime_error&) {
+		thrown = true;
+	}
+	testSuite.test(thrown, "Completer promise test");
+}
+
+template <class Socket, class Value>
+void sendTest(TestSuite& testSuite, Communicator<Socket, std::tuple<Value>>& source, Communicator<Socket, std::tuple<Value>>& sink, const std::vector<Value>& values, const std::string& name) {
+	std::atomic<int> completed(0);
+	std::atomic<int> failed(0);
+	CompletionPool<SendCompletion, Counter> pool(Counter { &completed, &failed }, 64);
+
+	for(auto& value : values) {
+		source.asyncSendTo(value, sink.getLocalEndpoint(), pool.acquire());
+	}
+	std::vector<Value> received;
+	for(std::size_t i = 0; i < values.size(); i++) {
+		received.push_back(sink.template receive<Value>());
+	}
+	std::vector<Value> expected(values);
+	std::sort(received.begin(), received.end());
+	std::sort(expected.begin(), expected.end());
+	while(completed + failed < static_cast<int>(values.size())) {
+		std::this_thread::yield();
+	}
+	testSuite.test(received == expected, name + " completion send test");
+	testSuite.equal(failed.load(), 0, name + " completion error test");
+}
+
+template <class Socket>
+void allocationTest(TestSuite& testSuite, const std::string& name) {
+	const typename Socket::Endpoint loopback(boost::asio::ip::address::from_string("127.0.0.1"), 0);
+	Communicator<Socket, std::tuple<int>> sink;
+	sink.bind(loopback);
+	Communicator<Socket, std::tuple<int>> source;
+	source.bind(loopback);
+
+	constexpr int burst = 16;
+	std::atomic<int> completed(0);
+	std::atomic<int> failed(0);
+	CompletionPool<SendCompletion, Counter> pool(Counter { &completed, &failed }, burst);
+	const int value = 17;
+	int sent = 0;
+	auto sendBurst = [&](bool counted) {
+		countAllocations = counted;
+		for(int i = 0; i < burst; i++) {
+			source.asyncSendTo(value, sink.getLocalEndpoint(), pool.acquire());
+		}
+		countAllocations = false;
+		sent += burst;
+		while(completed + failed < sent) {
+			std::this_thread::yield();
+		}
+		for(int i = 0; i < burst; i++) {
+			sink.template receive<int>();
+		}
+	};
+
+	// The first sends set up the state per remote
+	sendBurst(false);
+	allocations = 0;
+	sendBurst(true);
+	testSuite.equal(allocations.load(), std::size_t(0), name + " allocation-free send test");
+	testSuite.equal(failed.load(), 0, name + " allocation-free send error test");
+}
+
+#ifdef CRACEN2_ENABLE_IO_URING
+void completionThreadTest(TestSuite& testSuite) {
+	// A completion, that sends again while all slots are in flight, fails instead of waiting for itself
+	IoUringDatagramSocket::Configuration configuration;
+	configuration.queueDepth = 4;
+	const IoUringDatagramSocket::Endpoint loopback(boost::asio::ip::address::from_string("127.0.0.1"), 0);
+	IoUringDatagramSocket sink;
+	sink.bind(loopback);
+	IoUringDatagramSocket source(configuration);
+	source.bind(loopback);
+
+	const int value = 17;
+	const ImmutableBuffer body(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value));
+	std::atomic<int> completed(0);
+	std::atomic<int> failed(0);
+	CompletionPool<Completion, Counter> pool(Counter { &completed, &failed });
+
+	struct Resend : Completion {
+		IoUringDatagramSocket* socket;
+		IoUringDatagramSocket::Endpoint remote;
+		const ImmutableBuffer* body;
+		CompletionPool<Completion, Counter>* pool;
+		std::promise<void> done;
+
+		void complete(std::exception_ptr) override {
+			for(int i = 0; i < 4; i++) {
+				socket->asyncSendTo(*body, remote, ImmutableBuffer(nullptr, 0), pool->acquire());
+			}
+			done.set_value();
+		}
+	} resend;
+	resend.socket = &source;
+	resend.remote = sink.getLocalEndpoint();
+	resend.body = &body;
+	resend.pool = &pool;
+	auto done = resend.done.get_future();
+
+	source.asyncSendTo(body, sink.getLocalEndpoint(), ImmutableBuffer(nullptr, 0), resend);
+	testSuite.test(done.wait_for(std::chrono::seconds(10)) == std::future_status::ready, "Send from completion test");
+	while(completed + failed < 4) {
+		std::this_thread::yield();
+	}
+	testSuite.test(failed > 0, "Full send slots from completion test");
+}
+#endif
+
+int main() {
+	TestSuite testSuite("Completion");
+
+	poolTest(testSuite);
+	completerTest(testSuite);
+	allocationTest<AsioDatagramSocket>(testSuite, "AsioDatagram");
+	allocationTest<AsioStreamingSocket>(testSuite, "AsioStreaming");
+#ifdef CRACEN2_ENABLE_IO_URING
+	// io_uring may be missing or forbidden, e.g. in a container
+	const bool ioUring = IoUringDatagramSocket::isSupported();
+	if(ioUring) {
+		allocationTest<IoUringDatagramSocket>(testSuite, "IoUringDatagram");
+		completionThreadTest(testSuite);
+	}
+#endif
+
+	const boost::asio::ip::address loopback = boost::asio::ip::address::from_string("127.0.0.1");
+	std::vector<int> values(runs);
+	for(int i = 0; i < runs; i++) {
+		values[i] = i;
+	}
+
+	{
+		Communicator<InProcessSocket, std::tuple<int>> sink;
+		sink.bind();
+		Communicator<InProcessSocket, std::tuple<int>> source;
+		sendTest(testSuite, source, sink, values, "InProcess");
+	}
+	{
+		Communicator<AsioStreamingSocket, std::tuple<int>> sink;
+		sink.bind(AsioStreamingSocket::Endpoint(loopback, 0));
+		Communicator<AsioStreamingSocket, std::tuple<int>> source;
+		source.bind(AsioStreamingSocket::Endpoint(loopback, 0));
+		sendTest(testSuite, source, sink, values, "AsioStreaming");
+	}
+	{
+		// Few enough datagrams to not overflow the receive buffer of the sink
+		const std::vector<int> datagramValues(values.begin(), values.begin() + 100);
+		Communicator<AsioDatagramSocket, std::tuple<int>> sink;
+		sink.bind(AsioDatagramSocket::Endpoint(loopback, 0));
+		Communicator<AsioDatagramSocket, std::tuple<int>> source;
+		source.bind(AsioDatagramSocket::Endpoint(loopback, 0));
+		sendTest(testSuite, source, sink, datagramValues, "AsioDatagram");
+
+#ifdef CRACEN2_ENABLE_IO_URING
+		if(ioUring) {
+			Communicator<IoUringDatagramSocket, std::tuple<int>> uringSink;
+			uringSink.bind(IoUringDatagramSocket::Endpoint(loopback, 0));
+			Communicator<IoUringDatagramSocket, std::tuple<int>> uringSource;
+			uringSource.bind(IoUringDatagramSocket::Endpoint(loopback, 0));
+			sendTest(testSuite, uringSource, uringSink, datagramValues, "IoUringDatagram");
+		}
+#endif
+	}
+	{
+		// Striped bodies complete, when the last stripe is written
+		AsioStreamingSocket::Configuration configuration;
+		configuration.streams = 4;
+		configuration.stripeThreshold = 4096;
+		AsioStreamingSocket sink(configuration);
+		sink.bind(AsioStreamingSocket::Endpoint(loopback, 0));
+		AsioStreamingSocket source(configuration);
+		source.bind(AsioStreamingSocket::Endpoint(loopback, 0));
+
+		std::atomic<int> completed(0);
+		std::atomic<int> failed(0);
+		CompletionPool<Completion, Counter> pool(Counter { &completed, &failed });
+		const std::vector<std::uint8_t> body(64*1024, 0x17);
+		constexpr int bodies = 16;
+		for(int i = 0; i < bodies; i++) {
+			source.asyncSendTo(ImmutableBuffer(body.data(), body.size()), sink.getLocalEndpoint(), ImmutableBuffer(nullptr, 0), pool.acquire());
+		}
+		int received = 0;
+		for(int i = 0; i < bodies; i++) {
+			auto datagram = sink.asyncReceiveFrom().get();
+			received += (datagram.body.size() == body.size() && std::equal(body.begin(), body.end(), datagram.body.data()));
+		}
+		while(completed + failed < bodies) {
+			std::this_thread::yield();
+		}
+		testSuite.equal(received, bodies, "Striped completion send test");
+		testSuite.equal(failed.load(), 0, "Striped completion error test");
+	}
+
+	return 0;
+}
@@ -0,0 +1,181 @@
+#include "cracen2/util/Test.hpp"
+#include "cracen2/network/Communicator.hpp"
+#include "cracen2/sockets/InProcess.hpp"
+#include "cracen2/sockets/AsioStreaming.hpp"
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+
+using namespace cracen2::util;
+using namespace cracen2::sockets;
+using namespace cracen2::network;
+
+struct Metadata {
+	int id;
+	double timestamp;
+};
+
+struct Source {
+	std::string name;
+	Metadata metadata;
+};
+
+struct Frame {
+	Metadata metadata;
+	std::vector<float> samples;
+	std::string label;
+	Source source;
+	std::deque<int> counters;
+
+	bool operator==(const Frame& other) const {
+		return
+			metadata.id == other.metadata.id &&
+			metadata.timestamp == other.metadata.timestamp &&
+			samples == other.samples &&
+			label == other.label &&
+			source.name == other.source.name &&
+			source.metadata.id == other.source.metadata.id &&
+			counters == other.counters;
+	}
+};
+
+namespace cracen2 {
+namespace network {
+
+template <>
+struct Members<Source> {
+	template <class Self>
+	static auto tie(Self& source) -> decltype(std::tie(source.name, source.metadata)) {
+		return std::tie(source.name, source.metadata);
+	}
+};
+
+template <>
+struct Members<Frame> {
+	template <class Self>
+	static auto tie(Self& frame) -> decltype(std::tie(frame.metadata, frame.samples, frame.label, frame.source, frame.counters)) {
+		return std::tie(frame.metadata, frame.samples, frame.label, frame.source, frame.counters);
+	}
+};
+
+} // End of namespace network
+} // End of namespace cracen2
+
+using TagList = std::tuple<int, Frame>;
+
+Frame makeFrame(std::size_t samples) {
+	Frame frame;
+	frame.metadata = Metadata { 42, 1.5 };
+	for(std::size_t i = 0; i < samples; i++) {
+		frame.samples.push_back(i * 0.5f);
+	}
+	frame.label = "Hello World!";
+	frame.source = Source { "sensor", Metadata { 7, 2.5 } };
+	for(int i = 0; i < 1000; i++) {
+		frame.counters.push_back(i);
+	}
+	return frame;
+}
+
+void serializeTest(TestSuite& testSuite) {
+	static_assert(is_composite<Frame>::value, "Frame is composite");
+	static_assert(!is_composite<Metadata>::value, "Trivial types are not composite");
+	static_assert(!is_composite<std::vector<float>>::value, "Unregistered types are not composite");
+
+	const Frame frame = makeFrame(100);
+	Serialized<Frame> serialized(frame);
+
+	// The pieces point into the frame, nothing is copied
+	const auto& pieces = serialized.pieces();
+	bool samplesPiece = false;
+	for(const auto& piece : pieces) {
+		samplesPiece |= piece.data == reinterpret_cast<const std::uint8_t*>(frame.samples.data());
+	}
+	testSuite.test(samplesPiece, "Zero copy piece test");
+	testSuite.test(pieces.size() >= 8, "Piece count test");
+
+	auto packed = serialized.pack();
+	testSuite.equal(packed.size(), serialized.size(), "Packed size test");
+	testSuite.test(BufferAdapter<Frame>(ImmutableBuffer(packed.data(), packed.size())).cast() == frame, "Round trip test");
+
+	const Frame empty {};
+	Serialized<Frame> emptySerialized(empty);
+	auto emptyPacked = emptySerialized.pack();
+	testSuite.test(deserialize<Frame>(ImmutableBuffer(emptyPacked.data(), emptyPacked.size())) == empty, "Empty members test");
+
+	bool thrown = false;
+	try {
+		deserialize<Frame>(ImmutableBuffer(packed.data(), packed.size() - 1));
+	} catch(const std::runtime_error&) {
+		thrown = true;
+	}
+	testSuite.test(thrown, "Truncated body test");
+}
+
+template <class Socket>
+void communicatorTest(TestSuite& testSuite, Communicator<Socket, TagList>& source, Communicator<Socket, TagList>& sink, const std::string& name) {
+	const Frame frame = makeFrame(64*1024);
+	source.sendTo(frame, sink.getLocalEndpoint());
+	source.sendTo(17, sink.getLocalEndpoint());
+	source.sendTo(frame, sink.getLocalEndpoint());
+
+	testSuite.test(sink.template receive<Frame>() == frame, name + " receive test");
+	testSuite.equal(sink.template receive<int>(), 17, name + " interleaved test");
+
+	auto visitor = Communicator<Socket, TagList>::make_visitor(
+		[](int, typename Socket::Endpoint) -> std::size_t { return 0; },
+		[](Frame frame, typename Socket::Endpoint) -> std::size_t { return frame.samples.size(); }
+	);
+	testSuite.equal(sink.receive(visitor), frame.samples.size(), name + " visitor test");
+}
+
+// Counts the sends, that hand their buffers over to the socket
+std::atomic<int> movedSends(0);
+
+struct MovingSocket : InProcessSocket {
+	using InProcessSocket::asyncSendTo;
+
+	std::future<void> asyncSendTo(Buffer&& data, const Endpoint remote, const cracen2::network::ImmutableBuffer& header) {
+		movedSends++;
+		return InProcessSocket::asyncSendTo(std::move(data), remote, header);
+	}
+};
+
+int main() {
+	TestSuite testSuite("Composite");
+
+	serializeTest(testSuite);
+
+	{
+		// Packed into one buffer
+		Communicator<InProcessSocket, TagList> sink;
+		sink.bind();
+		Communicator<InProcessSocket, TagList> source;
+		source.bind();
+		source.enableExtendedHeader();
+		communicatorTest(testSuite, source, sink, "InProcess");
+		testSuite.equal(sink.getEdgeStatistics(source.getLocalEndpoint()).truncated, std::uint64_t(0), "Extended header length test");
+	}
+	{
+		// The packed buffer is moved into sockets, that take over buffers
+		Communicator<MovingSocket, TagList> sink;
+		sink.bind();
+		Communicator<MovingSocket, TagList> source;
+		source.bind();
+		communicatorTest(testSuite, source, sink, "Moved");
+		testSuite.equal(movedSends.load(), 2, "Moved packed buffer test");
+	}
+	{
+		// One gather write
+		const boost::asio::ip::address loopback = boost::asio::ip::address::from_string("127.0.0.1");
+		Communicator<AsioStreamingSocket, TagList> sink;
+		sink.bind(AsioStreamingSocket::Endpoint(loopback, 0));
+		Communicator<AsioStreamingSocket, TagList> source;
+		source.bind(AsioStreamingSocket::Endpoint(loopback, 0));
+		communicatorTest(testSuite, source, sink, "AsioStreaming");
+	}
+
+	return 0;
+}
@@ -0,0 +1,203 @@
+#include "cracen2/util/Test.hpp"
+#include "cracen2/network/Communicator.hpp"
+#include "cracen2/sockets/InProcess.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+using namespace cracen2::util;
+using namespace cracen2::sockets;
+using namespace cracen2::network;
+
+using TagList = std::tuple<int, float>;
+
+Buffer copy(const cracen2::network::ImmutableBuffer& buffer) {
+	Buffer result(buffer.size);
+	std::memcpy(result.data(), buffer.data, buffer.size);
+	return result;
+}
+
+std::future<void> dropped() {
+	std::promise<void> done;
+	done.set_value();
+	return done.get_future();
+}
+
+// Drops the third message and delivers the fifth after the seventh
+class ShufflingSocket : public InProcessSocket {
+	int sent = 0;
+	Buffer heldData;
+	Buffer heldHeader;
+	Endpoint heldRemote;
+
+public:
+	std::future<void> asyncSendTo(const cracen2::network::ImmutableBuffer& data, const Endpoint remote, const cracen2::network::ImmutableBuffer& header = cracen2::network::ImmutableBuffer(nullptr, 0)) {
+		sent++;
+		if(sent == 3 || sent == 5) {
+			if(sent == 5) {
+				heldData = copy(data);
+				heldHeader = copy(header);
+				heldRemote = remote;
+			}
+			return dropped();
+		}
+		auto result = InProcessSocket::asyncSendTo(data, remote, header);
+		if(sent == 7) {
+			result.get();
+			return InProcessSocket::asyncSendTo(std::move(heldData), heldRemote, std::move(heldHeader));
+		}
+		return result;
+	}
+};
+
+// Drops the fourth message and delivers the third again after the fifth
+class DuplicatingSocket : public InProcessSocket {
+	int sent = 0;
+	Buffer heldData;
+	Buffer heldHeader;
+
+public:
+	std::future<void> asyncSendTo(const cracen2::network::ImmutableBuffer& data, const Endpoint remote, const cracen2::network::ImmutableBuffer& header = cracen2::network::ImmutableBuffer(nullptr, 0)) {
+		sent++;
+		if(sent == 3) {
+			heldData = copy(data);
+			heldHeader = copy(header);
+		}
+		if(sent == 4) {
+			return dropped();
+		}
+		auto result = InProcessSocket::asyncSendTo(data, remote, header);
+		if(sent == 5) {
+			result.get();
+			return InProcessSocket::asyncSendTo(std::move(heldData), remote, std::move(heldHeader));
+		}
+		return result;
+	}
+};
+
+void minimalTest(TestSuite& testSuite) {
+	InProcessSocket sink;
+	sink.bind();
+	Communicator<InProcessSocket, TagList> source;
+	source.bind();
+	testSuite.test(!source.hasExtendedHeader(), "Minimal header default test");
+
+	source.sendTo(42, sink.getLocalEndpoint());
+	auto datagram = sink.asyncReceiveFrom().get();
+	testSuite.equal(datagram.header.size(), sizeof(Header), "Minimal header size test");
+}
+
+void extendedTest(TestSuite& testSuite) {
+	Communicator<InProcessSocket, TagList> sink;
+	sink.bind();
+	Communicator<ShufflingSocket, TagList> source;
+	source.bind();
+	source.enableExtendedHeader();
+
+	for(int i = 0; i < 10; i++) {
+		source.sendTo(i, sink.getLocalEndpoint());
+	}
+	std::vector<int> received;
+	for(int i = 0; i < 9; i++) {
+		received.push_back(sink.receive<int>());
+	}
+	testSuite.equal(received[3], 5, "Shuffled order test");
+	testSuite.equal(received[5], 4, "Late delivery test");
+
+	const auto statistics = sink.getEdgeStatistics(source.getLocalEndpoint());
+	testSuite.equal(statistics.received, std::uint64_t(9), "Received statistics test");
+	testSuite.equal(statistics.lost, std::uint64_t(1), "Lost statistics test");
+	testSuite.equal(statistics.reordered, std::uint64_t(1), "Reordered statistics test");
+	testSuite.equal(statistics.truncated, std::uint64_t(0), "Truncated statistics test");
+	testSuite.test(statistics.latency >= std::chrono::nanoseconds(0) && statistics.latency < std::chrono::seconds(1), "Latency test");
+}
+
+void duplicateTest(TestSuite& testSuite) {
+	Communicator<InProcessSocket, TagList> sink;
+	sink.bind();
+	Communicator<DuplicatingSocket, TagList> source;
+	source.bind();
+	source.enableExtendedHeader();
+
+	for(int i = 0; i < 5; i++) {
+		source.sendTo(i, sink.getLocalEndpoint());
+	}
+	for(int i = 0; i < 5; i++) {
+		sink.receive<int>();
+	}
+
+	// The duplicate does not cancel the loss
+	const auto statistics = sink.getEdgeStatistics(source.getLocalEndpoint());
+	testSuite.equal(statistics.received, std::uint64_t(5), "Duplicate received statistics test");
+	testSuite.equal(statistics.lost, std::uint64_t(1), "Duplicate lost statistics test");
+	testSuite.equal(statistics.reordered, std::uint64_t(0), "Duplicate reordered statistics test");
+	testSuite.equal(statistics.duplicated, std::uint64_t(1), "Duplicated statistics test");
+}
+
+void headerTest(TestSuite& testSuite) {
+	InProcessSocket sink;
+	sink.bind();
+	Communicator<InProcessSocket, TagList> source;
+	source.bind();
+	source.enableExtendedHeader();
+
+	const float value = 1.5f;
+	source.sendTo(value, sink.getLocalEndpoint());
+	source.sendTo(value, sink.getLocalEndpoint());
+	sink.asyncReceiveFrom().get();
+	auto datagram = sink.asyncReceiveFrom().get();
+	testSuite.equal(datagram.header.size(), sizeof(ExtendedHeader), "Extended header size test");
+	ExtendedHeader header;
+	std::memcpy(&header, datagram.header.data(), sizeof(header));
+	testSuite.equal(header.header.typeId, std::uint16_t(1), "Extended type id test");
+	testSuite.equal(header.sequence, std::uint32_t(1), "Sequence test");
+	testSuite.equal(header.length, std::uint64_t(sizeof(value)), "Length test");
+	testSuite.equal(header.flags, std::uint16_t(0), "Flags test");
+}
+
+struct Counter {
+	std::atomic<int>* completed;
+
+	void operator()(std::exception_ptr) {
+		(*completed)++;
+	}
+};
+
+void completionTest(TestSuite& testSuite) {
+	Communicator<InProcessSocket, TagList> sink;
+	sink.bind();
+	Communicator<InProcessSocket, TagList> source;
+	source.bind();
+	source.enableExtendedHeader();
+
+	std::atomic<int> completed(0);
+	CompletionPool<SendCompletion, Counter> pool(Counter { &completed });
+	const std::vector<int> values { 1, 2, 3 };
+	for(auto& value : values) {
+		source.asyncSendTo(value, sink.getLocalEndpoint(), pool.acquire());
+	}
+	auto visitor = Communicator<InProcessSocket, TagList>::make_visitor(
+		[](int value, InProcessSocket::Endpoint) -> int { return value; },
+		[](float, InProcessSocket::Endpoint) -> int { return -1; }
+	);
+	int sum = 0;
+	for(std::size_t i = 0; i < values.size(); i++) {
+		sum += sink.receive(visitor);
+	}
+	testSuite.equal(sum, 6, "Completion send test");
+	testSuite.equal(completed.load(), 3, "Completion count test");
+	testSuite.equal(sink.getEdgeStatistics(source.getLocalEndpoint()).received, std::uint64_t(3), "Visitor statistics test");
+}
+
+int main() {
+	TestSuite testSuite("ExtendedHeader");
+
+	minimalTest(testSuite);
+	extendedTest(testSuite);
+	duplicateTest(testSuite);
+	headerTest(testSuite);
+	completionTest(testSuite);
+
+	return 0;
+}
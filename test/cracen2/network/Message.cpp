@@ -2,6 +2,7 @@
 #include "cracen2/network/Message.hpp"
 
 #include <boost/optional/optional_io.hpp>
+#include <string>
 
 using namespace cracen2::util;
 using namespace cracen2::network;
@@ -47,4 +48,32 @@ int main() {
 	testSuite.test(!MyMessage(f).cast<int>(), "Cast test for float, with wrong type");
 	testSuite.test(!MyMessage(f).cast<char>(), "Cast test for float, with wrong type");
 
+	// Message types without a functor throw
+	auto partial = MyMessage::make_visitor_helper<>::make_visitor(
+		[](int value) -> int { return value; }
+	);
+	bool thrown = false;
+	try {
+		MyMessage(c).visit(partial);
+	} catch(const std::runtime_error&) {
+		thrown = true;
+	}
+	testSuite.test(thrown, "Missing visitor function test");
+
+	// The runtime composed visitor dispatches the same
+	MyMessage::Visitor<int> dynamicVisitor;
+	dynamicVisitor.add([](int) -> int { return 0; });
+	dynamicVisitor.add([](char) -> int { return 1; });
+	dynamicVisitor.add([](float) -> int { return 2; });
+	testSuite.equal(MyMessage(c).visit(dynamicVisitor), 1, "Dynamic visitor test.");
+
+	// Unknown type ids name the received id
+	std::string error;
+	try {
+		MyMessage(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&i), sizeof(i)), Header { 7 }).visit(visitor);
+	} catch(const std::runtime_error& e) {
+		error = e.what();
+	}
+	testSuite.test(error.find("\"7\"") != std::string::npos, "Invalid type id error test");
+
 }
@@ -0,0 +1,82 @@
+#include "cracen2/util/Test.hpp"
+#include "cracen2/network/Message.hpp"
+#include "cracen2/network/Communicator.hpp"
+#include "cracen2/sockets/InProcess.hpp"
+
+#include <deque>
+#include <numeric>
+
+using namespace cracen2::util;
+using namespace cracen2::sockets;
+using namespace cracen2::network;
+
+using Frame = std::vector<float>;
+using TL = std::tuple<int, Frame, std::string>;
+using MyMessage = Message<TL>;
+
+void messageTest(TestSuite& testSuite) {
+	Frame frame(1024);
+	std::iota(frame.begin(), frame.end(), 0.0f);
+	MyMessage message(frame);
+
+	// Without an owner, the view copies the body
+	auto copied = message.cast<View<Frame>>();
+	testSuite.test(copied && copied->size() == frame.size(), "Copied view size test");
+	testSuite.test(copied && std::equal(frame.begin(), frame.end(), copied->begin()), "Copied view content test");
+	testSuite.test(!message.cast<View<std::string>>(), "View cast test, with wrong type");
+
+	// With an owner, the view takes over the buffer
+	Buffer owner(frame.size() * sizeof(float));
+	std::memcpy(owner.data(), frame.data(), owner.size());
+	const auto address = owner.data();
+	MyMessage received(ImmutableBuffer(owner.data(), owner.size()), message.getHeader());
+	auto view = received.cast<View<Frame>>(&owner);
+	testSuite.test(view && reinterpret_cast<const std::uint8_t*>(view->data()) == address, "Aliasing view test");
+	testSuite.test(view && view->copy() == frame, "View copy test");
+
+	auto visitor = MyMessage::make_visitor_helper<>::make_visitor(
+		[](int value) -> float { return value; },
+		[](View<Frame> value) -> float { return value[10]; },
+		[](View<std::string> value) -> float { return value.copy().size(); }
+	);
+	testSuite.equal(MyMessage(frame).visit(visitor), 10.0f, "View visitor test");
+	testSuite.equal(MyMessage(std::string("hello")).visit(visitor), 5.0f, "String view visitor test");
+	testSuite.equal(MyMessage(7).visit(visitor), 7.0f, "Value visitor test");
+}
+
+void communicatorTest(TestSuite& testSuite) {
+	Communicator<InProcessSocket, TL> sink;
+	sink.bind();
+	Communicator<InProcessSocket, TL> source;
+
+	Frame frame(4096, 1.5f);
+	source.sendTo(frame, sink.getLocalEndpoint());
+	source.sendTo(42, sink.getLocalEndpoint());
+
+	auto view = sink.receive<View<Frame>>();
+	testSuite.equal(view.size(), frame.size(), "Communicator view size test");
+	testSuite.test(std::equal(frame.begin(), frame.end(), view.begin()), "Communicator view content test");
+	testSuite.equal(*sink.receive<View<int>>(), 42, "Communicator value view test");
+}
+
+void decodedTest(TestSuite& testSuite) {
+	// A deque has no linear body, so its view owns the decoded value
+	using Queue = std::deque<int>;
+	static_assert(!cracen2::network::detail::has_view<Queue>::value, "std::deque has no view");
+	const Queue queue { 1, 2, 3 };
+	Message<std::tuple<Queue>> message(queue);
+
+	auto view = message.cast<View<Queue>>();
+	testSuite.test(view && view->size() == 1 && **view == queue, "Decoded view test");
+	testSuite.test(view && MessageArgument<Queue>::from(std::move(*view)) == queue, "Decoded view move test");
+}
+
+int main() {
+	TestSuite testSuite("View");
+
+	messageTest(testSuite);
+	communicatorTest(testSuite);
+	decodedTest(testSuite);
+
+	return 0;
+}
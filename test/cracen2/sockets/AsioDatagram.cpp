@@ -0,0 +1,408 @@
+#include "cracen2/util/Test.hpp"
+#include "cracen2/sockets/AsioDatagram.hpp"
+#include "TestFrame.hpp"
+
+#include <memory>
+#include <vector>
+#include <cstring>
+#include <thread>
+
+using namespace cracen2::util;
+using namespace cracen2::sockets;
+using namespace cracen2::network;
+
+constexpr int runs = 200;
+
+void batchedReceiveTest(TestSuite& testSuite, std::size_t batchSize, std::shared_ptr<AsioExecutor> executor = std::make_shared<AsioExecutor>()) {
+	AsioDatagramSocket::Configuration configuration;
+	configuration.receiveBatchSize = batchSize;
+
+	AsioDatagramSocket sink(configuration, executor);
+	sink.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	AsioDatagramSocket source(AsioDatagramSocket::Configuration(), executor);
+	source.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+
+	const auto sinkEndpoint = sink.getLocalEndpoint();
+	const std::uint16_t header = 0x4242;
+
+	// Fill the socket buffer first, so that a single wakeup finds many datagrams
+	for(int i = 0; i < runs; i++) {
+		source.asyncSendTo(
+			ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&i), sizeof(i)),
+			sinkEndpoint,
+			ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&header), sizeof(header))
+		).get();
+	}
+
+	std::vector<std::future<AsioDatagramSocket::Datagram>> futures;
+	for(int i = 0; i < runs; i++) {
+		futures.push_back(sink.asyncReceiveFrom());
+	}
+
+	const std::string name = "batchSize = " + std::to_string(batchSize);
+	for(int i = 0; i < runs; i++) {
+		auto datagram = futures[i].get();
+		int value;
+		std::memcpy(&value, datagram.body.data(), sizeof(value));
+		testSuite.equal(datagram.body.size(), sizeof(int), "Body size test for " + name);
+		testSuite.equal(value, i, "Ordered receive test for " + name);
+		testSuite.equal(datagram.header.size(), sizeof(header), "Header size test for " + name);
+		testSuite.equal(*reinterpret_cast<const std::uint16_t*>(datagram.header.data()), header, "Header test for " + name);
+		testSuite.equal(datagram.remote, source.getLocalEndpoint(), "Remote endpoint test for " + name);
+	}
+}
+
+void coalescedSendTest(TestSuite& testSuite, std::size_t batchSize, std::chrono::microseconds window) {
+	AsioDatagramSocket::Configuration configuration;
+	configuration.sendBatchSize = batchSize;
+	configuration.sendWindow = window;
+
+	AsioDatagramSocket sink;
+	sink.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	AsioDatagramSocket source(configuration);
+	source.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+
+	const auto sinkEndpoint = sink.getLocalEndpoint();
+	// Fewer datagrams than the batch size, so the last batch has to be flushed by the window
+	const int count = runs + batchSize / 2;
+	std::vector<int> values(count);
+	std::vector<std::future<void>> sends;
+	for(int i = 0; i < count; i++) {
+		values[i] = i;
+		sends.push_back(
+			source.asyncSendTo(
+				ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&values[i]), sizeof(int)),
+				sinkEndpoint
+			)
+		);
+	}
+	for(auto& send : sends) {
+		send.get();
+	}
+
+	const std::string name = "sendBatchSize = " + std::to_string(batchSize);
+	for(int i = 0; i < count; i++) {
+		auto datagram = sink.asyncReceiveFrom().get();
+		int value;
+		std::memcpy(&value, datagram.body.data(), sizeof(value));
+		testSuite.equal(value, i, "Ordered coalesced send test for " + name);
+		testSuite.equal(datagram.header.size(), std::size_t(0), "Empty header test for " + name);
+	}
+}
+
+// Waits for a datagram, but reports a failure instead of hanging, if it never arrives
+bool arrived(TestSuite& testSuite, std::future<AsioDatagramSocket::Datagram>& receive, AsioDatagramSocket::Datagram& datagram, const std::string& name) {
+	if(receive.wait_for(std::chrono::seconds(10)) != std::future_status::ready) {
+		testSuite.fail(name + " timed out");
+		return false;
+	}
+	datagram = receive.get();
+	return true;
+}
+
+// Fragment with a four byte piece, that holds its index, and no header: [piece][FragmentInfo][headerSize | flag]
+void sendRawFragment(
+	boost::asio::ip::udp::socket& raw,
+	const AsioDatagramSocket::Endpoint& remote,
+	std::uint32_t message,
+	std::uint32_t index,
+	std::uint32_t count,
+	std::uint32_t total
+) {
+	const std::uint32_t info[5] = { message, index, count, index * 4, total };
+	const std::uint32_t piece = index;
+	const std::size_t headerSize = std::size_t(1) << (8 * sizeof(std::size_t) - 1);
+	std::vector<std::uint8_t> datagram(sizeof(piece) + sizeof(info) + sizeof(headerSize));
+	std::memcpy(datagram.data(), &piece, sizeof(piece));
+	std::memcpy(datagram.data() + sizeof(piece), info, sizeof(info));
+	std::memcpy(datagram.data() + sizeof(piece) + sizeof(info), &headerSize, sizeof(headerSize));
+	raw.send_to(boost::asio::buffer(datagram), remote);
+}
+
+void fragmentationTest(TestSuite& testSuite, std::size_t fragmentSize, bool segmentationOffload) {
+	AsioDatagramSocket::Configuration configuration;
+	configuration.fragmentSize = fragmentSize;
+	configuration.segmentationOffload = segmentationOffload;
+
+	AsioDatagramSocket sink;
+	sink.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	AsioDatagramSocket source(configuration);
+	source.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	const auto sinkEndpoint = sink.getLocalEndpoint();
+
+	// Small frames fit into one datagram, the others are fragmented. The last fragment is shorter.
+	const std::vector<std::size_t> sizes { 510*1024, 13, 100*1024 + 1, 0, 4*1024*1024 + 17 };
+	constexpr int fragmentedRuns = 20;
+	const Frames frames(sizes, fragmentedRuns);
+
+	const std::string name = "fragmentSize = " + std::to_string(fragmentSize) + (segmentationOffload ? " with GSO" : "");
+	for(int i = 0; i < fragmentedRuns; i++) {
+		auto receive = sink.asyncReceiveFrom();
+		source.asyncSendTo(frames.body(i), sinkEndpoint, frames.header(i)).get();
+
+		AsioDatagramSocket::Datagram datagram;
+		if(!arrived(testSuite, receive, datagram, "Fragmented receive for " + name)) return;
+		verifyFrame(testSuite, datagram, sizes, i, "Fragmented frame for " + name);
+		testSuite.equal(datagram.remote, source.getLocalEndpoint(), "Fragmented remote endpoint test for " + name);
+	}
+}
+
+void largeDatagramTest(TestSuite& testSuite) {
+	AsioDatagramSocket::Configuration configuration;
+	configuration.receiveBatchSize = 2;
+
+	AsioDatagramSocket sink(configuration);
+	sink.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	AsioDatagramSocket source;
+	source.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	const auto sinkEndpoint = sink.getLocalEndpoint();
+
+	// Nearly full datagrams keep the buffer they were received into. The slots are reused, while the bodies are held.
+	constexpr int count = 8;
+	std::vector<std::size_t> sizes;
+	for(int i = 0; i < count; i++) {
+		sizes.push_back(50*1024 + i);
+	}
+	const Frames frames(sizes, count);
+	for(int i = 0; i < count; i++) {
+		source.asyncSendTo(frames.body(i), sinkEndpoint, frames.header(i)).get();
+	}
+	std::vector<AsioDatagramSocket::Datagram> datagrams;
+	for(int i = 0; i < count; i++) {
+		datagrams.push_back(sink.asyncReceiveFrom().get());
+	}
+	for(int i = 0; i < count; i++) {
+		verifyFrame(testSuite, datagrams[i], sizes, i, "Large datagram");
+	}
+}
+
+void reassemblyTimeoutTest(TestSuite& testSuite) {
+	AsioDatagramSocket::Configuration configuration;
+	configuration.reassemblyTimeout = std::chrono::milliseconds(50);
+
+	AsioDatagramSocket sink(configuration);
+	sink.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	AsioDatagramSocket source;
+	source.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	const auto sinkEndpoint = sink.getLocalEndpoint();
+
+	// Fragments of one message with two pieces: [piece][FragmentInfo][headerSize | flag], no header
+	boost::asio::io_service io_service;
+	boost::asio::ip::udp::socket raw(io_service, source.getLocalEndpoint().protocol());
+	const auto sendFragment = [&](std::uint32_t index) {
+		sendRawFragment(raw, sinkEndpoint, 0x1234, index, 2, 8);
+	};
+
+	// The second fragment arrives too late and starts a new message, that is never completed
+	auto receive = sink.asyncReceiveFrom();
+	sendFragment(0);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	const int value = 42;
+	source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), sinkEndpoint).get();
+	sendFragment(1);
+
+	AsioDatagramSocket::Datagram datagram;
+	if(!arrived(testSuite, receive, datagram, "Discarded reassembly")) return;
+	testSuite.equal(datagram.body.size(), sizeof(value), "Discarded reassembly size test");
+	testSuite.equal(*reinterpret_cast<const int*>(datagram.body.data()), value, "Discarded reassembly test");
+
+	// A complete message with the same id is still delivered
+	receive = sink.asyncReceiveFrom();
+	sendFragment(0);
+	if(!arrived(testSuite, receive, datagram, "Reassembly after timeout")) return;
+	std::uint32_t pieces[3];
+	std::memcpy(pieces, datagram.body.data(), 2 * sizeof(std::uint32_t));
+	testSuite.equal(datagram.body.size(), std::size_t(8), "Reassembly after timeout size test");
+	testSuite.test(pieces[0] == 0 && pieces[1] == 1, "Reassembly after timeout content test");
+
+	// The timeout counts from the last fragment, so a message, that takes longer than the timeout, but keeps
+	// arriving, is completed
+	receive = sink.asyncReceiveFrom();
+	for(std::uint32_t i = 0; i < 3; i++) {
+		if(i > 0) std::this_thread::sleep_for(std::chrono::milliseconds(30));
+		sendRawFragment(raw, sinkEndpoint, 0x5678, i, 3, 12);
+	}
+	if(!arrived(testSuite, receive, datagram, "Slow reassembly")) return;
+	std::memcpy(pieces, datagram.body.data(), sizeof(pieces));
+	testSuite.equal(datagram.body.size(), std::size_t(12), "Slow reassembly size test");
+	testSuite.test(pieces[0] == 0 && pieces[1] == 1 && pieces[2] == 2, "Slow reassembly content test");
+}
+
+void invalidFragmentTest(TestSuite& testSuite) {
+	AsioDatagramSocket::Configuration configuration;
+	configuration.maxReassembledSize = 1024;
+
+	AsioDatagramSocket sink(configuration);
+	sink.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	AsioDatagramSocket::Configuration sourceConfiguration;
+	sourceConfiguration.fragmentSize = 512;
+	AsioDatagramSocket source(sourceConfiguration);
+	source.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	const auto sinkEndpoint = sink.getLocalEndpoint();
+
+	// Fragments with four byte pieces and no header: [piece][FragmentInfo][headerSize | flag]
+	boost::asio::io_service io_service;
+	boost::asio::ip::udp::socket raw(io_service, source.getLocalEndpoint().protocol());
+	const auto sendFragment = [&](std::uint32_t message, std::uint32_t index, std::uint32_t count, std::uint32_t total) {
+		sendRawFragment(raw, sinkEndpoint, message, index, count, total);
+	};
+
+	auto receive = sink.asyncReceiveFrom();
+	// Claims 4 GiB, but may only hold maxReassembledSize bytes
+	sendFragment(1, 0, 2, 0xFFFFFFFF);
+	// Two pieces can not make up a body of 100 bytes
+	sendFragment(2, 0, 2, 100);
+	sendFragment(2, 1, 2, 100);
+	// Properly fragmented, but too big
+	const auto body = frame(2048, 3);
+	source.asyncSendTo(ImmutableBuffer(body.data(), body.size()), sinkEndpoint).get();
+	const int value = 42;
+	source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), sinkEndpoint).get();
+
+	AsioDatagramSocket::Datagram datagram;
+	if(!arrived(testSuite, receive, datagram, "Invalid fragments dropped")) return;
+	testSuite.equal(datagram.body.size(), sizeof(value), "Invalid fragments dropped size test");
+	testSuite.equal(*reinterpret_cast<const int*>(datagram.body.data()), value, "Invalid fragments dropped test");
+
+	// A consistent message within the limit is reassembled
+	receive = sink.asyncReceiveFrom();
+	sendFragment(4, 0, 2, 8);
+	sendFragment(4, 1, 2, 8);
+	if(!arrived(testSuite, receive, datagram, "Valid fragments")) return;
+	testSuite.equal(datagram.body.size(), std::size_t(8), "Valid fragments size test");
+}
+
+void pacingTest(TestSuite& testSuite) {
+	AsioDatagramSocket::Configuration configuration;
+	configuration.pacing = true;
+	configuration.pacingBurst = 64*1024;
+	configuration.rateControl.initialRate = 10e6;
+
+	AsioDatagramSocket sink;
+	sink.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	AsioDatagramSocket source(configuration);
+	source.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	const auto sinkEndpoint = sink.getLocalEndpoint();
+	testSuite.equal(source.getRate(sinkEndpoint), 10e6, "Initial pacing rate test");
+
+	// 2 MB at 10 MB/s take at least 190 ms, after the first burst
+	constexpr int pacedRuns = 20;
+	const std::vector<std::size_t> sizes { 100*1024 };
+	const Frames frames(sizes, pacedRuns);
+	std::vector<std::future<AsioDatagramSocket::Datagram>> receives;
+	std::vector<std::future<void>> sends;
+	const auto begin = std::chrono::steady_clock::now();
+	for(int i = 0; i < pacedRuns; i++) {
+		receives.push_back(sink.asyncReceiveFrom());
+		sends.push_back(source.asyncSendTo(frames.body(i), sinkEndpoint, frames.header(i)));
+	}
+	for(auto& send : sends) {
+		send.get();
+	}
+	const auto elapsed = std::chrono::steady_clock::now() - begin;
+	testSuite.test(elapsed >= std::chrono::milliseconds(150), "Pacing delay test");
+
+	for(int i = 0; i < pacedRuns; i++) {
+		verifyFrame(testSuite, receives[i].get(), sizes, i, "Paced");
+	}
+
+	// Feedback of an empty path increases the rate
+	source.feedback(sinkEndpoint, RateSample { std::chrono::microseconds(100), 1000, 0 });
+	testSuite.test(source.getRate(sinkEndpoint) > 10e6, "Pacing feedback test");
+	testSuite.equal(source.getRates().size(), std::size_t(1), "Pacing rates test");
+}
+
+void pacingBoundTest(TestSuite& testSuite) {
+	AsioDatagramSocket::Configuration configuration;
+	configuration.pacing = true;
+	configuration.pacingBurst = 64*1024;
+	configuration.rateControl.initialRate = 10e6;
+	configuration.maxPacedSends = 8;
+
+	AsioDatagramSocket sink;
+	sink.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	AsioDatagramSocket idle;
+	idle.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	AsioDatagramSocket source(configuration);
+	source.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+
+	// A send takes 10 ms at 10 MB/s, so most of the sends find the deferred queue of the sink full
+	constexpr int overloadRuns = 100;
+	const std::vector<std::size_t> sizes { 100*1024 };
+	const Frames frames(sizes, overloadRuns);
+	std::vector<std::future<void>> sends;
+	for(int i = 0; i < overloadRuns; i++) {
+		sends.push_back(source.asyncSendTo(frames.body(i), sink.getLocalEndpoint(), frames.header(i)));
+	}
+	// Another destination is not held back by the backlog of the sink
+	const int value = 42;
+	const auto begin = std::chrono::steady_clock::now();
+	source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), idle.getLocalEndpoint()).get();
+	testSuite.test(std::chrono::steady_clock::now() - begin < std::chrono::milliseconds(50), "Paced destinations independence test");
+
+	std::vector<int> delivered;
+	int failed = 0;
+	for(int i = 0; i < overloadRuns; i++) {
+		try {
+			sends[i].get();
+			delivered.push_back(i);
+		} catch(const std::exception&) {
+			failed++;
+		}
+	}
+	testSuite.test(failed > 0, "Bounded pacing queue test");
+	testSuite.test(delivered.size() >= configuration.maxPacedSends, "Deferred sends delivery test");
+	for(int i : delivered) {
+		verifyFrame(testSuite, sink.asyncReceiveFrom().get(), sizes, i, "Deferred");
+	}
+}
+
+void destructionTest(TestSuite& testSuite) {
+	AsioExecutor::Configuration executorConfiguration;
+	executorConfiguration.threads = 4;
+	auto executor = std::make_shared<AsioExecutor>(executorConfiguration);
+
+	AsioDatagramSocket sink;
+	sink.bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+	const auto sinkEndpoint = sink.getLocalEndpoint();
+
+	// The sockets are destroyed, while the executor threads still complete their handlers
+	constexpr int sockets = 200;
+	const int value = 42;
+	int destroyed = 0;
+	for(int i = 0; i < sockets; i++) {
+		auto source = std::make_unique<AsioDatagramSocket>(AsioDatagramSocket::Configuration(), executor);
+		source->bind(AsioDatagramSocket::Endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0));
+		for(int j = 0; j < 8; j++) {
+			source->asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), sinkEndpoint);
+		}
+		source.reset();
+		destroyed++;
+	}
+	testSuite.equal(destroyed, sockets, "Destroyed sockets with completing handlers test");
+}
+
+int main() {
+	TestSuite testSuite("AsioDatagram");
+
+	batchedReceiveTest(testSuite, 1);
+	batchedReceiveTest(testSuite, 32);
+	coalescedSendTest(testSuite, 1, std::chrono::microseconds(0));
+	coalescedSendTest(testSuite, 16, std::chrono::microseconds(500));
+
+	AsioExecutor::Configuration executorConfiguration;
+	executorConfiguration.threads = 4;
+	batchedReceiveTest(testSuite, 8, std::make_shared<AsioExecutor>(executorConfiguration));
+
+	fragmentationTest(testSuite, 65507, true);
+	fragmentationTest(testSuite, 1472, true);
+	fragmentationTest(testSuite, 1472, false);
+	largeDatagramTest(testSuite);
+	reassemblyTimeoutTest(testSuite);
+	invalidFragmentTest(testSuite);
+	pacingTest(testSuite);
+	pacingBoundTest(testSuite);
+	destructionTest(testSuite);
+
+	return 0;
+}
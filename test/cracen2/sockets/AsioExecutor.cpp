@@ -0,0 +1,52 @@
+#include "cracen2/util/Test.hpp"
+#include "cracen2/sockets/AsioExecutor.hpp"
+
+#include <future>
+
+using namespace cracen2::util;
+using namespace cracen2::sockets;
+
+int main() {
+	TestSuite testSuite("AsioExecutor");
+
+	HandlerTracker tracker;
+
+	// A handler, that runs, is released once, although asio copies it
+	{
+		boost::asio::io_service io_service;
+		int runs = 0;
+		io_service.post(tracker.wrap([&runs](){ runs++; }));
+		io_service.run();
+		testSuite.equal(runs, 1, "Handler run test");
+	}
+	tracker.wait();
+
+	// A handler, that is destroyed by its io_service without running, is released as well
+	{
+		boost::asio::io_service io_service;
+		bool ran = false;
+		io_service.post(tracker.wrap([&ran](){ ran = true; }));
+		auto copy = tracker.wrap([](){});
+		testSuite.test(!ran, "Handler not run test");
+	}
+	auto waited = std::async(std::launch::async, [&tracker](){ tracker.wait(); });
+	testSuite.test(waited.wait_for(std::chrono::seconds(5)) == std::future_status::ready, "Destroyed handler release test");
+
+	// Copies of a handler count on their own, moved from handlers do not count
+	{
+		auto original = tracker.wrap([](){});
+		auto copy = original;
+		auto moved = std::move(original);
+		{
+			auto discarded = std::move(moved);
+		}
+		auto pending = std::async(std::launch::async, [&tracker](){ tracker.wait(); });
+		testSuite.test(pending.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout, "Copied handler pending test");
+		{
+			auto last = std::move(copy);
+		}
+		testSuite.test(pending.wait_for(std::chrono::seconds(5)) == std::future_status::ready, "Copied handler release test");
+	}
+
+	return 0;
+}
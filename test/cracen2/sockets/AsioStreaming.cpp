@@ -0,0 +1,358 @@
+#include "cracen2/util/Test.hpp"
+#include "cracen2/util/Thread.hpp"
+#include "cracen2/sockets/AsioStreaming.hpp"
+#include "TestFrame.hpp"
+
+#include <vector>
+#include <cstring>
+#include <thread>
+
+using namespace cracen2::util;
+using namespace cracen2::sockets;
+using namespace cracen2::network;
+
+using Endpoint = AsioStreamingSocket::Endpoint;
+
+constexpr int runs = 500;
+
+const Endpoint loopback(boost::asio::ip::address::from_string("127.0.0.1"), 0);
+
+// Small frames are parsed from the staging buffer, big frames are read directly into their body.
+const std::vector<std::size_t> frameSizes { 0, 1, 13, 4096, 40*1024, 100*1024, 1024*1024 };
+
+void framingTest(TestSuite& testSuite) {
+	AsioStreamingSocket sink;
+	sink.bind(loopback);
+	const Endpoint sinkEndpoint = sink.getLocalEndpoint();
+
+	JoiningThread sourceThread("AsioStreamingTest::source", [sinkEndpoint](){
+		AsioStreamingSocket source;
+		sendFrames(source, sinkEndpoint, frameSizes, runs);
+	});
+	receiveFrames(testSuite, sink, frameSizes, runs, "Frame");
+}
+
+void concurrentPeersTest(TestSuite& testSuite, std::shared_ptr<AsioExecutor> executor) {
+	constexpr int peers = 4;
+
+	AsioStreamingSocket sink(executor);
+	sink.bind(loopback);
+	const Endpoint sinkEndpoint = sink.getLocalEndpoint();
+
+	std::vector<JoiningThread> sources;
+	for(int p = 0; p < peers; p++) {
+		sources.emplace_back("AsioStreamingTest::sources", [sinkEndpoint, p, executor](){
+			AsioStreamingSocket source(executor);
+			const auto body = frame(256*1024, p);
+			std::vector<std::future<void>> sends;
+			for(int i = 0; i < runs / peers; i++) {
+				sends.push_back(source.asyncSendTo(ImmutableBuffer(body.data(), body.size()), sinkEndpoint));
+			}
+			for(auto& send : sends) {
+				send.get();
+			}
+		});
+	}
+
+	for(int i = 0; i < peers * (runs / peers); i++) {
+		auto datagram = sink.asyncReceiveFrom().get();
+		testSuite.equal(datagram.body.size(), std::size_t(256*1024), "Concurrent peers frame size test");
+		const int p = datagram.body.data()[0];
+		testSuite.test(p >= 0 && p < peers, "Concurrent peers frame content test");
+		testSuite.test(
+			std::memcmp(datagram.body.data(), frame(256*1024, p).data(), datagram.body.size()) == 0,
+			"Concurrent peers frame integrity test"
+		);
+	}
+}
+
+void stripingTest(TestSuite& testSuite) {
+	AsioStreamingSocket::Configuration configuration;
+	configuration.streams = 4;
+	configuration.stripeThreshold = 64*1024;
+
+	AsioStreamingSocket sink(configuration);
+	sink.bind(loopback);
+	const Endpoint sinkEndpoint = sink.getLocalEndpoint();
+
+	// Big frames are split over all streams, small frames stay on the first one
+	const std::vector<std::size_t> sizes { 13, 64*1024, 510*1024 + 3, 4096, 1024*1024 };
+	constexpr int stripedRuns = 100;
+
+	AsioStreamingSocket source(configuration);
+	source.connect(sinkEndpoint);
+	const Frames frames(sizes, stripedRuns);
+	std::vector<std::future<void>> sends;
+	for(int i = 0; i < stripedRuns; i++) {
+		sends.push_back(source.asyncSendTo(frames.body(i), sinkEndpoint, frames.header(i)));
+	}
+
+	std::vector<bool> seen(stripedRuns, false);
+	Endpoint remote;
+	for(int i = 0; i < stripedRuns; i++) {
+		auto datagram = sink.asyncReceiveFrom().get();
+		remote = datagram.remote;
+		std::uint32_t header = stripedRuns;
+		if(datagram.header.size() == sizeof(header)) {
+			std::memcpy(&header, datagram.header.data(), sizeof(header));
+		}
+		testSuite.test(header < std::uint32_t(stripedRuns) && !seen[header], "Striped frame header test");
+		if(header >= std::uint32_t(stripedRuns)) continue;
+		seen[header] = true;
+		// Stripes of different frames may overtake each other, so the frame is identified by its header
+		verifyFrame(testSuite, datagram, sizes, header, "Striped frame");
+	}
+	for(auto& send : sends) {
+		send.get();
+	}
+
+	// The remote of a striped frame is the primary connection, so replies reach the source
+	const int value = 7;
+	sink.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), remote).get();
+	auto reply = source.asyncReceiveFrom().get();
+	testSuite.equal(*reinterpret_cast<const int*>(reply.body.data()), value, "Reply to striped sender test");
+}
+
+void zeroCopyTest(TestSuite& testSuite) {
+	AsioStreamingSocket::Configuration configuration;
+	configuration.zeroCopyThreshold = 256*1024;
+
+	AsioStreamingSocket sink;
+	sink.bind(loopback);
+	const Endpoint sinkEndpoint = sink.getLocalEndpoint();
+
+	// Pinned bodies and copied frames share the connection and keep their order
+	const std::vector<std::size_t> sizes { 510*1024, 13, 510*1024, 4096, 1024*1024 + 7, 0 };
+	constexpr int zeroCopyRuns = 100;
+
+	AsioStreamingSocket source(configuration);
+	const Frames frames(sizes, zeroCopyRuns);
+	std::vector<std::future<void>> sends;
+	for(int i = 0; i < zeroCopyRuns; i++) {
+		sends.push_back(source.asyncSendTo(frames.body(i), sinkEndpoint, frames.header(i)));
+	}
+	// A gather send without pieces adds no body buffer to its batch
+	const std::vector<ImmutableBuffer> noPieces;
+	const std::uint32_t lastHeader = zeroCopyRuns;
+	sends.push_back(source.asyncSendTo(
+		noPieces,
+		sinkEndpoint,
+		ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&lastHeader), sizeof(std::uint32_t))
+	));
+
+	for(int i = 0; i < zeroCopyRuns; i++) {
+		verifyFrame(testSuite, sink.asyncReceiveFrom().get(), sizes, i, "Zero copy");
+	}
+	auto empty = sink.asyncReceiveFrom().get();
+	testSuite.equal(empty.body.size(), std::size_t(0), "Zero copy empty gather send test");
+	// Every send completes, also the ones, that wait for the kernel to release their body
+	for(auto& send : sends) {
+		testSuite.test(send.wait_for(std::chrono::seconds(10)) == std::future_status::ready, "Zero copy completion test");
+		send.get();
+	}
+}
+
+void connectTest(TestSuite& testSuite) {
+	AsioStreamingSocket sink;
+	sink.bind(loopback);
+	const Endpoint sinkEndpoint = sink.getLocalEndpoint();
+
+	// Frames sent right after the pre-connect are queued until the handshake is done
+	AsioStreamingSocket source;
+	source.connect(sinkEndpoint);
+	source.connect(sinkEndpoint);
+	const int value = 42;
+	std::vector<std::future<void>> sends;
+	for(int i = 0; i < 10; i++) {
+		sends.push_back(source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), sinkEndpoint));
+	}
+	for(auto& send : sends) {
+		send.get();
+	}
+	for(int i = 0; i < 10; i++) {
+		auto datagram = sink.asyncReceiveFrom().get();
+		testSuite.equal(*reinterpret_cast<const int*>(datagram.body.data()), value, "Send after pre-connect test");
+	}
+
+	// A refused connection fails the queued frames, but not the caller
+	Endpoint closedEndpoint;
+	{
+		boost::asio::io_service io_service;
+		boost::asio::ip::tcp::acceptor acceptor(io_service, loopback);
+		closedEndpoint = acceptor.local_endpoint();
+	}
+	bool failed = false;
+	try {
+		source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), closedEndpoint).get();
+	} catch(const std::exception&) {
+		failed = true;
+	}
+	testSuite.test(failed, "Send to refused endpoint test");
+}
+
+// True, if acceptor gets a connection within a few seconds
+bool accepted(boost::asio::ip::tcp::acceptor& acceptor, boost::asio::ip::tcp::socket& socket) {
+	acceptor.non_blocking(true);
+	for(int i = 0; i < 5000; i++) {
+		boost::system::error_code error;
+		acceptor.accept(socket, error);
+		if(!error) return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+void reconnectTest(TestSuite& testSuite) {
+	boost::asio::io_service io_service;
+	boost::asio::ip::tcp::acceptor acceptor(io_service, loopback);
+	const Endpoint sinkEndpoint = acceptor.local_endpoint();
+
+	AsioStreamingSocket source;
+	source.bind(loopback);
+	const int value = 42;
+	const ImmutableBuffer body(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value));
+	source.asyncSendTo(body, sinkEndpoint).get();
+
+	// The peer closes the connection. The source forgets it, when its read fails.
+	{
+		boost::asio::ip::tcp::socket first(io_service);
+		testSuite.test(accepted(acceptor, first), "First connection test");
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	// The next send connects again instead of writing into the closed connection
+	bool sent = true;
+	try {
+		source.asyncSendTo(body, sinkEndpoint).get();
+	} catch(const std::exception&) {
+		sent = false;
+	}
+	testSuite.test(sent, "Send after closed connection test");
+	boost::asio::ip::tcp::socket second(io_service);
+	testSuite.test(accepted(acceptor, second), "Reconnect after closed connection test");
+}
+
+// Raw stripe frame: [headerSize | stripeFlag][StripeInfo][header][bodySize][body]
+std::vector<std::uint8_t> stripeFrame(std::uint64_t message, std::uint64_t offset, std::uint64_t total, std::size_t bodySize) {
+	const std::size_t headerSize = std::size_t(1) << (8 * sizeof(std::size_t) - 1);
+	const std::uint64_t info[4] = { 0x5eed, message, offset, total };
+	std::vector<std::uint8_t> result(sizeof(headerSize) + sizeof(info) + sizeof(bodySize) + bodySize);
+	std::memcpy(result.data(), &headerSize, sizeof(headerSize));
+	std::memcpy(result.data() + sizeof(headerSize), info, sizeof(info));
+	std::memcpy(result.data() + sizeof(headerSize) + sizeof(info), &bodySize, sizeof(bodySize));
+	return result;
+}
+
+void reassemblyDropTest(TestSuite& testSuite) {
+	AsioStreamingSocket::Configuration configuration;
+	configuration.reassemblyTimeout = std::chrono::milliseconds(50);
+	AsioStreamingSocket sink(configuration);
+	sink.bind(loopback);
+
+	const auto waitFor = [&sink](std::size_t count) {
+		for(int i = 0; i < 5000 && sink.getPendingReassemblies() != count; i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return sink.getPendingReassemblies() == count;
+	};
+
+	boost::asio::io_service io_service;
+	{
+		// The connection dies in the middle of a stripe
+		boost::asio::ip::tcp::socket raw(io_service);
+		raw.connect(sink.getLocalEndpoint());
+		const auto stripe = stripeFrame(1, 0, 2*1024*1024, 1024*1024);
+		boost::asio::write(raw, boost::asio::buffer(stripe.data(), stripe.size() / 2));
+		testSuite.test(waitFor(1), "Partial stripe reassembly test");
+	}
+	testSuite.test(waitFor(0), "Failed connection drops reassembly test");
+
+	// The other stripes of a message never arrive
+	boost::asio::ip::tcp::socket raw(io_service);
+	raw.connect(sink.getLocalEndpoint());
+	boost::asio::write(raw, boost::asio::buffer(stripeFrame(2, 1024, 2048, 1024)));
+	testSuite.test(waitFor(1), "Stale reassembly test");
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	boost::asio::write(raw, boost::asio::buffer(stripeFrame(3, 1024, 2048, 1024)));
+	testSuite.test(waitFor(1), "Stale reassembly expires test");
+}
+
+// True, if the sink closes the raw connection within a few seconds
+bool closedByPeer(boost::asio::ip::tcp::socket& raw) {
+	const timeval timeout { 5, 0 };
+	::setsockopt(raw.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	std::uint8_t byte;
+	boost::system::error_code error;
+	raw.read_some(boost::asio::buffer(&byte, 1), error);
+	return error == boost::asio::error::eof || error == boost::asio::error::connection_reset;
+}
+
+void stripeValidationTest(TestSuite& testSuite) {
+	AsioStreamingSocket::Configuration configuration;
+	configuration.maxStripedSize = 1024*1024;
+	AsioStreamingSocket sink(configuration);
+	sink.bind(loopback);
+
+	boost::asio::io_service io_service;
+	{
+		// Bigger than maxStripedSize
+		boost::asio::ip::tcp::socket raw(io_service);
+		raw.connect(sink.getLocalEndpoint());
+		boost::asio::write(raw, boost::asio::buffer(stripeFrame(1, 0, 2*1024*1024, 1024)));
+		testSuite.test(closedByPeer(raw), "Oversized striped message test");
+	}
+
+	boost::asio::ip::tcp::socket first(io_service);
+	first.connect(sink.getLocalEndpoint());
+	boost::asio::write(first, boost::asio::buffer(stripeFrame(2, 0, 2048, 1024)));
+	{
+		// Claims a bigger message than the stripes before
+		boost::asio::ip::tcp::socket raw(io_service);
+		raw.connect(sink.getLocalEndpoint());
+		boost::asio::write(raw, boost::asio::buffer(stripeFrame(2, 1024, 4096, 1024)));
+		testSuite.test(closedByPeer(raw), "Inconsistent stripe total test");
+	}
+	{
+		// Repeats a stripe, which must not complete the message
+		boost::asio::ip::tcp::socket raw(io_service);
+		raw.connect(sink.getLocalEndpoint());
+		boost::asio::write(raw, boost::asio::buffer(stripeFrame(2, 512, 2048, 1024)));
+		testSuite.test(closedByPeer(raw), "Overlapping stripe test");
+	}
+	auto receive = sink.asyncReceiveFrom();
+	testSuite.test(receive.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout, "Incomplete message test");
+
+	boost::asio::ip::tcp::socket second(io_service);
+	second.connect(sink.getLocalEndpoint());
+	boost::asio::write(second, boost::asio::buffer(stripeFrame(2, 1024, 2048, 1024)));
+	const bool complete = receive.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+	testSuite.test(complete, "Complete striped message test");
+	if(complete) {
+		testSuite.equal(receive.get().body.size(), std::size_t(2048), "Complete striped message size test");
+	}
+}
+
+int main() {
+	TestSuite testSuite("AsioStreaming");
+
+	framingTest(testSuite);
+	connectTest(testSuite);
+	reconnectTest(testSuite);
+	stripingTest(testSuite);
+	reassemblyDropTest(testSuite);
+	stripeValidationTest(testSuite);
+	zeroCopyTest(testSuite);
+	concurrentPeersTest(testSuite, std::make_shared<AsioExecutor>());
+
+	AsioExecutor::Configuration shared;
+	shared.policy = AsioExecutor::Policy::shared;
+	shared.threads = 4;
+	concurrentPeersTest(testSuite, std::make_shared<AsioExecutor>(shared));
+
+	AsioExecutor::Configuration sharded;
+	sharded.policy = AsioExecutor::Policy::sharded;
+	sharded.threads = 4;
+	concurrentPeersTest(testSuite, std::make_shared<AsioExecutor>(sharded));
+
+	return 0;
+}
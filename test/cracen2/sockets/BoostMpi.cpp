@@ -0,0 +1,288 @@
+#include "cracen2/util/Test.hpp"
+#include "cracen2/util/Thread.hpp"
+#include "cracen2/sockets/BoostMpi.hpp"
+#include "TestFrame.hpp"
+
+#include <vector>
+#include <cstring>
+#include <thread>
+
+using namespace cracen2::util;
+using namespace cracen2::sockets;
+using namespace cracen2::network;
+
+using Endpoint = BoostMpiSocket::Endpoint;
+using MpiEngine = cracen2::sockets::detail::MpiEngine;
+
+constexpr int runs = 200;
+
+// Big frames use the rendezvous protocol and complete later than the small frames behind them
+const std::vector<std::size_t> frameSizes { 0, 1, 13, 4096, 100*1024, 4*1024*1024 };
+
+void frameTest(TestSuite& testSuite) {
+	BoostMpiSocket sink;
+	sink.bind();
+	BoostMpiSocket source;
+	source.bind();
+
+	const Frames frames(frameSizes, runs);
+
+	// All sends and receives are outstanding at the same time
+	std::vector<std::future<BoostMpiSocket::Datagram>> receives;
+	for(int i = 0; i < runs; i++) {
+		receives.push_back(sink.asyncReceiveFrom());
+	}
+	std::vector<std::future<void>> sends;
+	for(int i = 0; i < runs; i++) {
+		sends.push_back(source.asyncSendTo(frames.body(i), sink.getLocalEndpoint(), frames.header(i)));
+	}
+
+	for(int i = 0; i < runs; i++) {
+		auto datagram = receives[i].get();
+		verifyFrame(testSuite, datagram, frameSizes, i, "Frame");
+		testSuite.test(datagram.remote == source.getLocalEndpoint(), "Remote endpoint test");
+	}
+	for(auto& send : sends) {
+		send.get();
+	}
+}
+
+void concurrentSendersTest(TestSuite& testSuite) {
+	constexpr int senders = 4;
+
+	BoostMpiSocket sink;
+	sink.bind();
+	const Endpoint sinkEndpoint = sink.getLocalEndpoint();
+
+	std::vector<JoiningThread> sources;
+	for(int s = 0; s < senders; s++) {
+		sources.emplace_back("BoostMpiTest::sources", [sinkEndpoint, s](){
+			BoostMpiSocket source;
+			source.bind();
+			for(int i = 0; i < runs / senders; i++) {
+				const auto body = frame(frameSizes[i % frameSizes.size()], s);
+				const std::uint32_t header[2] = { std::uint32_t(s), std::uint32_t(i) };
+				source.asyncSendTo(
+					ImmutableBuffer(body.data(), body.size()),
+					sinkEndpoint,
+					ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(header), sizeof(header))
+				).get();
+			}
+		});
+	}
+
+	// Frames of different senders on the same tag must not be mixed up
+	std::vector<std::uint32_t> next(senders, 0);
+	for(int i = 0; i < senders * (runs / senders); i++) {
+		auto datagram = sink.asyncReceiveFrom().get();
+		std::uint32_t header[2];
+		std::memcpy(header, datagram.header.data(), sizeof(header));
+		testSuite.test(header[0] < senders, "Concurrent sender header test");
+		if(header[0] >= senders) continue;
+		testSuite.equal(header[1], next[header[0]]++, "Concurrent sender order test");
+		const auto expected = frame(frameSizes[header[1] % frameSizes.size()], header[0]);
+		testSuite.equal(datagram.body.size(), expected.size(), "Concurrent sender size test");
+		testSuite.test(
+			std::memcmp(datagram.body.data(), expected.data(), expected.size()) == 0,
+			"Concurrent sender content test"
+		);
+	}
+}
+
+void persistentTest(TestSuite& testSuite) {
+	BoostMpiSocket::Configuration configuration;
+	configuration.persistentReceives = 16;
+	BoostMpiSocket sink(configuration);
+	sink.bind();
+	BoostMpiSocket source(configuration);
+	source.bind();
+
+	// Small frames arrive in the pre-posted receives, big ones are probed. Only frames of the same kind keep their order.
+	const Frames frames(frameSizes, runs);
+	std::vector<std::future<void>> sends;
+	for(int i = 0; i < runs; i++) {
+		sends.push_back(source.asyncSendTo(frames.body(i), sink.getLocalEndpoint(), frames.header(i)));
+	}
+
+	std::vector<std::uint32_t> last(2, 0);
+	std::vector<bool> seen(2, false);
+	for(int i = 0; i < runs; i++) {
+		auto datagram = sink.asyncReceiveFrom().get();
+		std::uint32_t header = runs;
+		if(datagram.header.size() == sizeof(header)) {
+			std::memcpy(&header, datagram.header.data(), sizeof(header));
+		}
+		testSuite.test(header < std::uint32_t(runs), "Persistent receive header test");
+		if(header >= std::uint32_t(runs)) continue;
+		const bool probed = frames.bodies[header].size() > 4096;
+		testSuite.test(!seen[probed] || last[probed] < header, "Persistent receive order test");
+		seen[probed] = true;
+		last[probed] = header;
+		verifyFrame(testSuite, datagram, frameSizes, header, "Persistent receive");
+	}
+	for(auto& send : sends) {
+		send.get();
+	}
+
+	// Frames, that nearly fill a pre-posted receive, take over its buffer and the receive gets a new one
+	sends.clear();
+	const std::vector<std::size_t> fillingSizes { 60*1024 };
+	const int filling = 3 * configuration.persistentReceives;
+	const Frames fillingFrames(fillingSizes, filling);
+	for(int i = 0; i < filling; i++) {
+		sends.push_back(source.asyncSendTo(fillingFrames.body(i), sink.getLocalEndpoint(), fillingFrames.header(i)));
+	}
+	for(int i = 0; i < filling; i++) {
+		verifyFrame(testSuite, sink.asyncReceiveFrom().get(), fillingSizes, i, "Persistent hand over");
+	}
+	for(auto& send : sends) {
+		send.get();
+	}
+}
+
+void engineTest(TestSuite& testSuite) {
+	MpiEngine::Configuration engineConfiguration;
+	engineConfiguration.progressThreads = 2;
+	auto data = std::make_shared<MpiEngine>(engineConfiguration);
+	auto management = std::make_shared<MpiEngine>(engineConfiguration);
+
+	BoostMpiSocket::Configuration dataConfiguration;
+	dataConfiguration.engine = data;
+	BoostMpiSocket::Configuration managementConfiguration;
+	managementConfiguration.engine = management;
+
+	// The same endpoint on two engines does not share messages, because the communicators are duplicated
+	BoostMpiSocket dataSink(dataConfiguration);
+	dataSink.bind(Endpoint(0, 100));
+	BoostMpiSocket managementSink(managementConfiguration);
+	managementSink.bind(Endpoint(0, 100));
+
+	std::vector<JoiningThread> sources;
+	for(auto configuration : { dataConfiguration, managementConfiguration }) {
+		const Endpoint sinkEndpoint = dataSink.getLocalEndpoint();
+		sources.emplace_back("BoostMpiTest::sources", [configuration, sinkEndpoint, data](){
+			BoostMpiSocket source(configuration);
+			source.bind();
+			const std::uint32_t engine = (configuration.engine == data) ? 0 : 1;
+			for(int i = 0; i < runs; i++) {
+				const auto body = frame(frameSizes[i % 4], i);
+				source.asyncSendTo(
+					ImmutableBuffer(body.data(), body.size()),
+					sinkEndpoint,
+					ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&engine), sizeof(engine))
+				).get();
+			}
+		});
+	}
+
+	std::uint32_t engine;
+	for(int i = 0; i < runs; i++) {
+		auto datagram = dataSink.asyncReceiveFrom().get();
+		std::memcpy(&engine, datagram.header.data(), sizeof(engine));
+		testSuite.equal(engine, std::uint32_t(0), "Data engine test");
+		testSuite.equal(datagram.body.size(), frameSizes[i % 4], "Data engine size test");
+
+		datagram = managementSink.asyncReceiveFrom().get();
+		std::memcpy(&engine, datagram.header.data(), sizeof(engine));
+		testSuite.equal(engine, std::uint32_t(1), "Management engine test");
+		testSuite.equal(datagram.body.size(), frameSizes[i % 4], "Management engine size test");
+	}
+}
+
+void rmaTest(TestSuite& testSuite) {
+	MpiEngine::Configuration engineConfiguration;
+	engineConfiguration.rmaSlots = 4;
+	engineConfiguration.rmaSlotSize = 1024*1024;
+	engineConfiguration.rmaThreshold = 64*1024;
+	BoostMpiSocket::Configuration configuration;
+	configuration.engine = std::make_shared<MpiEngine>(engineConfiguration);
+
+	BoostMpiSocket sink(configuration);
+	sink.bind();
+	BoostMpiSocket source(configuration);
+	source.bind();
+
+	// Frames, that find no free slot, fall back to two sided sends. The biggest frames do not fit into a slot.
+	const Frames frames(frameSizes, runs);
+	std::vector<std::future<void>> sends;
+	std::vector<std::future<BoostMpiSocket::Datagram>> receives;
+	for(int i = 0; i < runs; i++) {
+		receives.push_back(sink.asyncReceiveFrom());
+	}
+	// The first half is sent at once and fills the ring, the second half one by one
+	for(int i = 0; i < runs; i++) {
+		sends.push_back(source.asyncSendTo(frames.body(i), sink.getLocalEndpoint(), frames.header(i)));
+		if(i >= runs / 2) {
+			sends.back().wait();
+		}
+	}
+
+	for(int i = 0; i < runs; i++) {
+		auto datagram = receives[i].get();
+		verifyFrame(testSuite, datagram, frameSizes, i, "Rma");
+		testSuite.test(datagram.remote == source.getLocalEndpoint(), "Rma remote endpoint test");
+	}
+	for(auto& send : sends) {
+		send.get();
+	}
+}
+
+void prePostedErrorTest(TestSuite& testSuite) {
+	// Both engines use MPI_COMM_WORLD, so the sink receives the rma notices of the source without a ring of its own
+	MpiEngine::Configuration sourceEngine;
+	sourceEngine.duplicateCommunicator = false;
+	sourceEngine.rmaSlots = 4;
+	sourceEngine.rmaThreshold = 64*1024;
+	MpiEngine::Configuration sinkEngine;
+	sinkEngine.duplicateCommunicator = false;
+
+	BoostMpiSocket::Configuration sinkConfiguration;
+	sinkConfiguration.persistentReceives = 4;
+	sinkConfiguration.engine = std::make_shared<MpiEngine>(sinkEngine);
+	BoostMpiSocket sink(sinkConfiguration);
+	sink.bind();
+	BoostMpiSocket::Configuration sourceConfiguration;
+	sourceConfiguration.engine = std::make_shared<MpiEngine>(sourceEngine);
+	BoostMpiSocket source(sourceConfiguration);
+	source.bind();
+
+	// The notice lands in a pre-posted receive before a receive is requested, its error is kept for the next one
+	const std::vector<std::size_t> sizes { 100*1024, 13 };
+	const Frames frames(sizes, 2);
+	source.asyncSendTo(frames.body(0), sink.getLocalEndpoint(), frames.header(0)).get();
+	source.asyncSendTo(frames.body(1), sink.getLocalEndpoint(), frames.header(1)).get();
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	bool failed = false;
+	try {
+		sink.asyncReceiveFrom().get();
+	} catch(const std::exception&) {
+		failed = true;
+	}
+	testSuite.test(failed, "Queued pre-posted receive error test");
+	verifyFrame(testSuite, sink.asyncReceiveFrom().get(), sizes, 1, "Receive after error");
+
+	// A receive, that is already waiting, fails right away
+	auto pending = sink.asyncReceiveFrom();
+	source.asyncSendTo(frames.body(0), sink.getLocalEndpoint(), frames.header(0)).get();
+	failed = false;
+	try {
+		pending.get();
+	} catch(const std::exception&) {
+		failed = true;
+	}
+	testSuite.test(failed, "Pending pre-posted receive error test");
+}
+
+int main() {
+	TestSuite testSuite("BoostMpi");
+
+	frameTest(testSuite);
+	concurrentSendersTest(testSuite);
+	persistentTest(testSuite);
+	engineTest(testSuite);
+	rmaTest(testSuite);
+	prePostedErrorTest(testSuite);
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+#include "cracen2/util/Test.hpp"
+#include "cracen2/util/Thread.hpp"
+#include "cracen2/sockets/InProcess.hpp"
+#include "cracen2/network/Communicator.hpp"
+
+#include <vector>
+#include <cstring>
+
+using namespace cracen2::util;
+using namespace cracen2::sockets;
+using namespace cracen2::network;
+
+using Endpoint = InProcessSocket::Endpoint;
+
+constexpr int runs = 1000;
+
+void orderTest(TestSuite& testSuite) {
+	InProcessSocket sink;
+	sink.bind();
+	const Endpoint sinkEndpoint = sink.getLocalEndpoint();
+
+	JoiningThread sourceThread("InProcessTest::source", [sinkEndpoint](){
+		InProcessSocket source;
+		for(int i = 0; i < runs; i++) {
+			source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&i), sizeof(i)), sinkEndpoint).get();
+		}
+	});
+
+	Endpoint sourceEndpoint;
+	for(int i = 0; i < runs; i++) {
+		auto datagram = sink.asyncReceiveFrom().get();
+		int value;
+		std::memcpy(&value, datagram.body.data(), sizeof(value));
+		testSuite.equal(value, i, "Ordered receive test");
+		testSuite.equal(datagram.header.size(), std::size_t(0), "Empty header test");
+		if(i > 0) {
+			testSuite.equal(datagram.remote, sourceEndpoint, "Stable remote endpoint test");
+		}
+		sourceEndpoint = datagram.remote;
+	}
+}
+
+void ownershipTest(TestSuite& testSuite) {
+	InProcessSocket sink;
+	sink.bind();
+	InProcessSocket source;
+	source.bind();
+
+	Buffer body(4096);
+	Buffer header(16);
+	std::memset(body.data(), 0x42, body.size());
+	const std::uint8_t* const bodyMemory = body.data();
+	source.asyncSendTo(std::move(body), sink.getLocalEndpoint(), std::move(header)).get();
+
+	auto datagram = sink.asyncReceiveFrom().get();
+	testSuite.test(datagram.body.data() == bodyMemory, "Buffer is moved without a copy test");
+	testSuite.equal(datagram.body.size(), std::size_t(4096), "Moved body size test");
+	testSuite.equal(datagram.header.size(), std::size_t(16), "Moved header size test");
+	testSuite.equal(datagram.remote, source.getLocalEndpoint(), "Remote endpoint test");
+
+	// Reply over the endpoint of the datagram
+	const int value = 7;
+	sink.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), datagram.remote).get();
+	testSuite.equal(*reinterpret_cast<const int*>(source.asyncReceiveFrom().get().body.data()), value, "Reply test");
+}
+
+void closedTest(TestSuite& testSuite) {
+	InProcessSocket source;
+	Endpoint closedEndpoint;
+	std::future<InProcessSocket::Datagram> pending;
+	const int value = 0;
+	{
+		InProcessSocket sink;
+		sink.bind();
+		closedEndpoint = sink.getLocalEndpoint();
+		// The source keeps the inbox of the sink after the first send
+		source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), closedEndpoint).get();
+		sink.asyncReceiveFrom().get();
+		pending = sink.asyncReceiveFrom();
+	}
+
+	bool failed = false;
+	try {
+		pending.get();
+	} catch(const std::exception&) {
+		failed = true;
+	}
+	testSuite.test(failed, "Pending receive on closed socket test");
+
+	failed = false;
+	try {
+		source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), closedEndpoint).get();
+	} catch(const std::exception&) {
+		failed = true;
+	}
+	testSuite.test(failed, "Send to closed endpoint test");
+
+	// The kept inbox is replaced, once the endpoint is bound again
+	InProcessSocket rebound;
+	rebound.bind(closedEndpoint);
+	source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), closedEndpoint).get();
+	testSuite.equal(rebound.asyncReceiveFrom().get().remote, source.getLocalEndpoint(), "Send to rebound endpoint test");
+}
+
+struct Value {
+	int value;
+};
+
+void communicatorTest(TestSuite& testSuite) {
+	Communicator<InProcessSocket, std::tuple<Value>> sink;
+	sink.bind();
+	Communicator<InProcessSocket, std::tuple<Value>> source;
+	source.sendTo(Value { 7 }, sink.getLocalEndpoint());
+	testSuite.equal(sink.receive<Value>().value, 7, "Communicator test");
+}
+
+int main() {
+	TestSuite testSuite("InProcess");
+
+	orderTest(testSuite);
+	ownershipTest(testSuite);
+	closedTest(testSuite);
+	communicatorTest(testSuite);
+
+	return 0;
+}
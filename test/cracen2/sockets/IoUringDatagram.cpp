@@ -0,0 +1,178 @@
+#include "cracen2/util/Test.hpp"
+#include "cracen2/sockets/IoUringDatagram.hpp"
+#include "cracen2/sockets/AsioDatagram.hpp"
+#include "cracen2/network/Communicator.hpp"
+
+#include <vector>
+#include <cstring>
+
+using namespace cracen2::util;
+using namespace cracen2::sockets;
+using namespace cracen2::network;
+
+using Endpoint = IoUringDatagramSocket::Endpoint;
+
+constexpr int runs = 200;
+
+const Endpoint loopback(boost::asio::ip::address::from_string("127.0.0.1"), 0);
+
+void orderTest(TestSuite& testSuite, std::size_t sendBatchSize) {
+	IoUringDatagramSocket::Configuration configuration;
+	configuration.sendBatchSize = sendBatchSize;
+	// Few buffers, so the multishot receive runs out of them and is armed again
+	configuration.receiveBuffers = 4;
+
+	IoUringDatagramSocket sink(configuration);
+	sink.bind(loopback);
+	IoUringDatagramSocket source(configuration);
+	source.bind(loopback);
+
+	const std::string name = "sendBatchSize = " + std::to_string(sendBatchSize);
+	const std::uint16_t header = 0x4242;
+	std::vector<int> values(runs);
+	std::vector<std::future<void>> sends;
+	for(int i = 0; i < runs; i++) {
+		values[i] = i;
+		sends.push_back(source.asyncSendTo(
+			ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&values[i]), sizeof(int)),
+			sink.getLocalEndpoint(),
+			ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&header), sizeof(header))
+		));
+		// Paced, so the datagrams fit into the socket buffer of the sink
+		if(i % 16 == 15) {
+			sends.back().wait();
+		}
+	}
+
+	for(int i = 0; i < runs; i++) {
+		auto datagram = sink.asyncReceiveFrom().get();
+		int value;
+		std::memcpy(&value, datagram.body.data(), sizeof(value));
+		testSuite.equal(datagram.body.size(), sizeof(int), "Body size test for " + name);
+		testSuite.equal(value, i, "Ordered receive test for " + name);
+		testSuite.equal(datagram.header.size(), sizeof(header), "Header size test for " + name);
+		testSuite.equal(*reinterpret_cast<const std::uint16_t*>(datagram.header.data()), header, "Header test for " + name);
+		testSuite.equal(datagram.remote, source.getLocalEndpoint(), "Remote endpoint test for " + name);
+	}
+	for(auto& send : sends) {
+		send.get();
+	}
+}
+
+void batchTest(TestSuite& testSuite) {
+	IoUringDatagramSocket::Configuration configuration;
+	configuration.sendBatchSize = 64;
+	configuration.sendWindow = std::chrono::microseconds(1000);
+
+	IoUringDatagramSocket sink;
+	sink.bind(loopback);
+	const int value = 42;
+	const ImmutableBuffer body(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value));
+
+	// A partial batch is submitted after the send window
+	IoUringDatagramSocket source(configuration);
+	source.bind(loopback);
+	for(int i = 0; i < 3; i++) {
+		source.asyncSendTo(body, sink.getLocalEndpoint()).get();
+		testSuite.equal(sink.asyncReceiveFrom().get().body.size(), sizeof(value), "Partial batch test");
+	}
+
+	// The destructor drains a batch, that is still queued
+	configuration.sendWindow = std::chrono::microseconds(60*1000*1000);
+	std::vector<std::future<void>> sends;
+	{
+		IoUringDatagramSocket closing(configuration);
+		closing.bind(loopback);
+		for(int i = 0; i < 3; i++) {
+			sends.push_back(closing.asyncSendTo(body, sink.getLocalEndpoint()));
+		}
+	}
+	int completed = 0;
+	for(auto& send : sends) {
+		completed += send.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+	testSuite.equal(completed, 3, "Destructor drain test");
+}
+
+void asioInteroperabilityTest(TestSuite& testSuite) {
+	IoUringDatagramSocket uring;
+	uring.bind(loopback);
+	AsioDatagramSocket asio;
+	asio.bind(loopback);
+
+	// Maximum sized frames in both directions
+	std::vector<std::uint8_t> body(IoUringDatagramSocket::MaxMessageSize::body - 8, 0x17);
+	std::vector<std::uint8_t> header(8, 0x71);
+	auto received = asio.asyncReceiveFrom();
+	uring.asyncSendTo(ImmutableBuffer(body.data(), body.size()), asio.getLocalEndpoint(), ImmutableBuffer(header.data(), header.size())).get();
+	auto datagram = received.get();
+	testSuite.equal(datagram.body.size(), body.size(), "io_uring to asio size test");
+	testSuite.test(std::memcmp(datagram.body.data(), body.data(), body.size()) == 0, "io_uring to asio content test");
+	testSuite.equal(datagram.remote, uring.getLocalEndpoint(), "io_uring to asio remote test");
+
+	asio.asyncSendTo(ImmutableBuffer(body.data(), body.size()), datagram.remote, ImmutableBuffer(header.data(), header.size())).get();
+	auto reply = uring.asyncReceiveFrom().get();
+	testSuite.equal(reply.body.size(), body.size(), "asio to io_uring size test");
+	testSuite.test(std::memcmp(reply.header.data(), header.data(), header.size()) == 0, "asio to io_uring header test");
+}
+
+void lendTest(TestSuite& testSuite) {
+	IoUringDatagramSocket::Configuration configuration;
+	configuration.receiveBuffers = 4;
+
+	std::vector<Buffer> bodies;
+	{
+		IoUringDatagramSocket sink(configuration);
+		sink.bind(loopback);
+		IoUringDatagramSocket source;
+		source.bind(loopback);
+
+		// Bodies, that are kept, hold their receive buffer. The ones above half of the ring are copied.
+		for(int i = 0; i < 12; i++) {
+			source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&i), sizeof(i)), sink.getLocalEndpoint()).get();
+			bodies.push_back(std::move(sink.asyncReceiveFrom().get().body));
+			if(i >= 6) {
+				// Released bodies go back into the ring
+				bodies.pop_back();
+			}
+		}
+	}
+	// The lent bodies outlive the socket
+	testSuite.equal(bodies.size(), std::size_t(6), "Kept bodies test");
+	for(int i = 0; i < 6; i++) {
+		int value;
+		std::memcpy(&value, bodies[i].data(), sizeof(value));
+		testSuite.equal(value, i, "Lent body test");
+	}
+}
+
+struct Value {
+	int value;
+};
+
+void communicatorTest(TestSuite& testSuite) {
+	Communicator<IoUringDatagramSocket, std::tuple<Value>> sink;
+	sink.bind(loopback);
+	Communicator<IoUringDatagramSocket, std::tuple<Value>> source;
+	source.bind(loopback);
+	source.sendTo(Value { 7 }, sink.getLocalEndpoint());
+	testSuite.equal(sink.receive<Value>().value, 7, "Communicator test");
+}
+
+int main() {
+	if(!IoUringDatagramSocket::isSupported()) {
+		std::cerr << "io_uring is not available, IoUringDatagram is skipped." << std::endl;
+		return 0;
+	}
+
+	TestSuite testSuite("IoUringDatagram");
+
+	orderTest(testSuite, 1);
+	orderTest(testSuite, 16);
+	batchTest(testSuite);
+	asioInteroperabilityTest(testSuite);
+	communicatorTest(testSuite);
+	lendTest(testSuite);
+
+	return 0;
+}
@@ -0,0 +1,60 @@
+#include "cracen2/util/Test.hpp"
+#include "cracen2/sockets/RateController.hpp"
+
+using namespace cracen2::util;
+using namespace cracen2::sockets;
+
+using Clock = RateController::Clock;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+int main() {
+	TestSuite testSuite("RateController");
+
+	RateController::Configuration configuration;
+	configuration.initialRate = 100e6;
+	configuration.minRate = 1e6;
+	configuration.maxRate = 1e9;
+	configuration.targetDelay = microseconds(1000);
+	configuration.gain = 0.25;
+	configuration.lossDecrease = 0.5;
+
+	RateController controller(configuration);
+	auto now = Clock::now();
+	testSuite.equal(controller.rate(), 100e6, "Initial rate test");
+
+	// Empty path: one step of gain per rtt
+	now += milliseconds(1);
+	controller.update(RateSample { microseconds(1000), 1000, 0 }, now);
+	testSuite.equal(controller.getBaseDelay().count(), 1000l, "Base delay test");
+	double previous = controller.rate();
+	testSuite.test(previous > 100e6, "Increase test");
+
+	// Queuing delay above the target
+	now += milliseconds(1);
+	controller.update(RateSample { microseconds(3000), 1000, 0 }, now);
+	testSuite.test(controller.rate() < previous, "Delay decrease test");
+	testSuite.equal(controller.getBaseDelay().count(), 1000l, "Base delay is the minimum test");
+
+	// At most one decrease per rtt on loss
+	now += milliseconds(1);
+	previous = controller.rate();
+	controller.update(RateSample { microseconds(0), 0, 1 }, now);
+	testSuite.equal(controller.rate(), previous * 0.5, "Loss decrease test");
+	controller.update(RateSample { microseconds(0), 0, 1 }, now + microseconds(10));
+	testSuite.equal(controller.rate(), previous * 0.5, "One loss decrease per rtt test");
+
+	// Bounds
+	for(int i = 0; i < 100; i++) {
+		now += milliseconds(2);
+		controller.update(RateSample { microseconds(0), 0, 1 }, now);
+	}
+	testSuite.equal(controller.rate(), 1e6, "Min rate test");
+	for(int i = 0; i < 1000; i++) {
+		now += milliseconds(1);
+		controller.update(RateSample { microseconds(1000), 1000, 0 }, now);
+	}
+	testSuite.equal(controller.rate(), 1e9, "Max rate test");
+
+	return 0;
+}
@@ -0,0 +1,218 @@
+#include "cracen2/util/Test.hpp"
+#include "cracen2/sockets/Reliable.hpp"
+#include "cracen2/sockets/AsioDatagram.hpp"
+#include "cracen2/network/Communicator.hpp"
+
+#include <atomic>
+#include <vector>
+#include <cstring>
+
+using namespace cracen2::util;
+using namespace cracen2::sockets;
+using namespace cracen2::network;
+
+constexpr int runs = 500;
+
+const AsioDatagramSocket::Endpoint loopback(boost::asio::ip::address::from_string("127.0.0.1"), 0);
+
+// Drops every dropInterval-th datagram, acks included
+std::atomic<unsigned> dropInterval(5);
+
+class LossySocket : public AsioDatagramSocket {
+	std::atomic<unsigned> sent;
+public:
+	LossySocket() : sent(0) {}
+
+	std::future<void> asyncSendTo(const cracen2::network::ImmutableBuffer& data, const Endpoint remote, const cracen2::network::ImmutableBuffer& header = cracen2::network::ImmutableBuffer(nullptr, 0)) {
+		const unsigned interval = dropInterval;
+		if(interval > 0 && ++sent % interval == 0) {
+			std::promise<void> dropped;
+			dropped.set_value();
+			return dropped.get_future();
+		}
+		return AsioDatagramSocket::asyncSendTo(data, remote, header);
+	}
+};
+
+using Socket = ReliableSocket<LossySocket>;
+
+void lossTest(TestSuite& testSuite) {
+	Socket sink;
+	sink.bind(loopback);
+	Socket source;
+	source.bind(loopback);
+
+	std::vector<int> values(runs);
+	std::vector<std::future<void>> sends;
+	for(int i = 0; i < runs; i++) {
+		values[i] = i;
+		sends.push_back(source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&values[i]), sizeof(int)), sink.getLocalEndpoint()));
+	}
+
+	std::vector<bool> seen(runs, false);
+	for(int i = 0; i < runs; i++) {
+		auto datagram = sink.asyncReceiveFrom().get();
+		int value;
+		std::memcpy(&value, datagram.body.data(), sizeof(value));
+		testSuite.test(value >= 0 && value < runs && !seen[value], "Lossy delivery test");
+		if(value >= 0 && value < runs) seen[value] = true;
+		testSuite.equal(datagram.header.size(), std::size_t(0), "Stripped header test");
+		testSuite.equal(datagram.remote, source.getLocalEndpoint(), "Lossy remote endpoint test");
+	}
+	for(auto& send : sends) {
+		send.get();
+	}
+	if(dropInterval > 0) {
+		testSuite.test(source.getStatistics().retransmissions > 0, "Retransmission test");
+	}
+	testSuite.equal(source.getStatistics().failed, std::size_t(0), "No failed message test");
+
+	// Nothing is delivered twice
+	auto extra = sink.asyncReceiveFrom();
+	testSuite.test(extra.wait_for(std::chrono::milliseconds(100)) == std::future_status::timeout, "Duplicate suppression test");
+}
+
+void perTypeTest(TestSuite& testSuite) {
+	using TagList = std::tuple<int, float>;
+	Socket::Configuration configuration;
+	configuration.reliable = reliableTypes<TagList, int>();
+
+	Socket sink(configuration);
+	sink.bind(loopback);
+	Socket source(configuration);
+	source.bind(loopback);
+
+	// Only the status messages (int) are retransmitted, the bulk messages (float) stay best-effort
+	const Header status { 0 };
+	const Header bulk { 1 };
+	constexpr int perType = 100;
+	std::vector<std::future<void>> sends;
+	for(int i = 0; i < perType; i++) {
+		for(auto& header : { status, bulk }) {
+			sends.push_back(source.asyncSendTo(
+				ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&i), sizeof(i)),
+				sink.getLocalEndpoint(),
+				ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&header), sizeof(header))
+			));
+			sends.back().wait();
+		}
+	}
+
+	int statusCount = 0;
+	int bulkCount = 0;
+	while(statusCount < perType) {
+		auto datagram = sink.asyncReceiveFrom().get();
+		Header header;
+		std::memcpy(&header, datagram.header.data(), sizeof(header));
+		(header.typeId == 0 ? statusCount : bulkCount)++;
+	}
+	while(true) {
+		auto receive = sink.asyncReceiveFrom();
+		if(receive.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) break;
+		auto datagram = receive.get();
+		Header header;
+		std::memcpy(&header, datagram.header.data(), sizeof(header));
+		(header.typeId == 0 ? statusCount : bulkCount)++;
+	}
+	testSuite.equal(statusCount, perType, "Reliable type test");
+	testSuite.test(bulkCount > 0 && bulkCount < perType, "Best-effort type test");
+}
+
+void giveUpTest(TestSuite& testSuite) {
+	Socket::Configuration configuration;
+	configuration.retransmissionTimeout = std::chrono::milliseconds(5);
+	configuration.maxRetransmissions = 3;
+	Socket source(configuration);
+	source.bind(loopback);
+
+	// Nobody acknowledges
+	AsioDatagramSocket sink;
+	sink.bind(loopback);
+
+	const int value = 42;
+	bool failed = false;
+	try {
+		source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), sink.getLocalEndpoint()).get();
+	} catch(const std::exception&) {
+		failed = true;
+	}
+	testSuite.test(failed, "Unacknowledged message test");
+	testSuite.equal(source.getStatistics().failed, std::size_t(1), "Failed statistics test");
+}
+
+void closeTest(TestSuite& testSuite) {
+	Socket sink;
+	sink.bind(loopback);
+
+	auto pending = sink.asyncReceiveFrom();
+	sink.close();
+	auto later = sink.asyncReceiveFrom();
+
+	bool failed = false;
+	try {
+		pending.get();
+	} catch(const std::exception&) {
+		failed = true;
+	}
+	testSuite.test(failed, "Pending receive on close test");
+	failed = false;
+	try {
+		later.get();
+	} catch(const std::exception&) {
+		failed = true;
+	}
+	testSuite.test(failed, "Receive after close test");
+}
+
+void communicatorTest(TestSuite& testSuite) {
+	using TagList = std::tuple<int>;
+	Communicator<Socket, TagList> sink;
+	sink.bind(loopback);
+	Communicator<Socket, TagList> source;
+	source.bind(loopback);
+
+	for(int i = 0; i < 100; i++) {
+		source.asyncSendTo(i, sink.getLocalEndpoint()).get();
+	}
+	int sum = 0;
+	for(int i = 0; i < 100; i++) {
+		sum += sink.receive<int>();
+	}
+	testSuite.equal(sum, 99 * 100 / 2, "Communicator test");
+}
+
+void pacingTest(TestSuite& testSuite) {
+	AsioDatagramSocket::Configuration socketConfiguration;
+	socketConfiguration.pacing = true;
+	socketConfiguration.rateControl.initialRate = 10e6;
+
+	ReliableSocket<AsioDatagramSocket> sink(ReliableSocket<AsioDatagramSocket>::Configuration(), socketConfiguration);
+	sink.bind(loopback);
+	ReliableSocket<AsioDatagramSocket> source(ReliableSocket<AsioDatagramSocket>::Configuration(), socketConfiguration);
+	source.bind(loopback);
+
+	// The acks of the sink drive the pacing rate of the source
+	const std::vector<std::uint8_t> body(4096, 0x17);
+	for(int i = 0; i < 100; i++) {
+		auto send = source.asyncSendTo(ImmutableBuffer(body.data(), body.size()), sink.getLocalEndpoint());
+		sink.asyncReceiveFrom().get();
+		send.get();
+	}
+	testSuite.test(source.getRate(sink.getLocalEndpoint()) != 10e6, "Adapted pacing rate test");
+}
+
+int main() {
+	TestSuite testSuite("Reliable");
+
+	lossTest(testSuite);
+	perTypeTest(testSuite);
+	giveUpTest(testSuite);
+	closeTest(testSuite);
+	communicatorTest(testSuite);
+	pacingTest(testSuite);
+
+	dropInterval = 0;
+	lossTest(testSuite);
+
+	return 0;
+}
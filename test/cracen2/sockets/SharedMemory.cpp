@@ -0,0 +1,262 @@
+#include "cracen2/util/Test.hpp"
+#include "cracen2/util/Thread.hpp"
+#include "cracen2/sockets/SharedMemory.hpp"
+#include "cracen2/network/Communicator.hpp"
+#include "TestFrame.hpp"
+
+#include <vector>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace cracen2::util;
+using namespace cracen2::sockets;
+using namespace cracen2::network;
+
+using Endpoint = SharedMemorySocket::Endpoint;
+
+constexpr int runs = 200;
+
+// The smaller ring forces frames to be streamed through it in pieces
+const std::vector<std::size_t> frameSizes { 0, 1, 13, 4096, 100*1024, 3*1024*1024 + 7 };
+
+// Also runs in the forked child, which reports failures by its exit status
+bool trySendFrames(SharedMemorySocket& source, const Endpoint& sinkEndpoint) {
+	try {
+		sendFrames(source, sinkEndpoint, frameSizes, runs);
+	} catch(const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+SharedMemorySocket::Configuration smallRing() {
+	SharedMemorySocket::Configuration configuration;
+	configuration.ringSize = 1024*1024;
+	return configuration;
+}
+
+void threadTest(TestSuite& testSuite) {
+	SharedMemorySocket sink(smallRing());
+	sink.bind();
+	const Endpoint sinkEndpoint = sink.getLocalEndpoint();
+
+	bool sent = false;
+	JoiningThread sourceThread("SharedMemoryTest::source", [sinkEndpoint, &sent](){
+		SharedMemorySocket source;
+		sent = trySendFrames(source, sinkEndpoint);
+	});
+	receiveFrames(testSuite, sink, frameSizes, runs, "Thread frame");
+	sourceThread = JoiningThread();
+	testSuite.test(sent, "Thread send test");
+}
+
+// Source in a child process. It is forked before any socket or thread exists and gets the sink endpoint through a pipe.
+struct SourceProcess {
+	pid_t pid;
+	int endpointPipe;
+};
+
+SourceProcess forkSourceProcess() {
+	int fds[2];
+	if(pipe(fds) != 0) {
+		return SourceProcess { -1, -1 };
+	}
+	const pid_t child = fork();
+	if(child == 0) {
+		// The child must not run the destructors of the parent state
+		close(fds[1]);
+		Endpoint sinkEndpoint;
+		const bool received = read(fds[0], &sinkEndpoint, sizeof(sinkEndpoint)) == sizeof(sinkEndpoint);
+		close(fds[0]);
+		int status = 1;
+		if(received) {
+			SharedMemorySocket source;
+			if(trySendFrames(source, sinkEndpoint)) {
+				// Wait for the reply of the parent
+				auto reply = source.asyncReceiveFrom().get();
+				status = (reply.remote == sinkEndpoint && reply.body.size() == sizeof(int)) ? 0 : 2;
+			}
+			source.close();
+		}
+		_exit(status);
+	}
+	close(fds[0]);
+	if(child < 0) {
+		close(fds[1]);
+		return SourceProcess { -1, -1 };
+	}
+	return SourceProcess { child, fds[1] };
+}
+
+void processTest(TestSuite& testSuite, SourceProcess source) {
+	testSuite.test(source.pid > 0, "Fork test");
+	if(source.pid < 0) return;
+
+	SharedMemorySocket sink(smallRing());
+	sink.bind();
+	const Endpoint sinkEndpoint = sink.getLocalEndpoint();
+	const bool written = write(source.endpointPipe, &sinkEndpoint, sizeof(sinkEndpoint)) == sizeof(sinkEndpoint);
+	close(source.endpointPipe);
+	testSuite.test(written, "Endpoint pipe test");
+
+	if(written) {
+		const Endpoint childEndpoint = receiveFrames(testSuite, sink, frameSizes, runs, "Process frame");
+		testSuite.equal(childEndpoint.process, std::int32_t(source.pid), "Remote process test");
+
+		// Reply to the endpoint, that the child got on its first send
+		const int value = 42;
+		sink.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), childEndpoint).get();
+	}
+	int status = -1;
+	waitpid(source.pid, &status, 0);
+	testSuite.test(WIFEXITED(status) && WEXITSTATUS(status) == 0, "Process send and reply test");
+}
+
+void asyncTest(TestSuite& testSuite) {
+	// All sends are issued up front. Frames, that do not fit into the inbox, are queued behind each other.
+	SharedMemorySocket sink(smallRing());
+	sink.bind();
+	SharedMemorySocket source;
+
+	constexpr int count = 24;
+	const Frames frames(frameSizes, count);
+	std::vector<std::future<void>> sends;
+	for(int i = 0; i < count; i++) {
+		sends.push_back(source.asyncSendTo(frames.body(i), sink.getLocalEndpoint(), frames.header(i)));
+	}
+	receiveFrames(testSuite, sink, frameSizes, count, "Async frame");
+	bool sent = true;
+	for(auto& send : sends) {
+		try {
+			send.get();
+		} catch(const std::exception&) {
+			sent = false;
+		}
+	}
+	testSuite.test(sent, "Async send test");
+}
+
+void slowConsumerTest(TestSuite& testSuite) {
+	SharedMemorySocket::Configuration configuration;
+	configuration.ringSize = 256*1024;
+	SharedMemorySocket slow(configuration);
+	slow.bind();
+	SharedMemorySocket fast;
+	fast.bind();
+	SharedMemorySocket source;
+
+	// The inbox of slow is full, until it receives
+	constexpr int count = 8;
+	const std::vector<std::size_t> sizes { 100*1024 };
+	const Frames frames(sizes, count);
+	std::vector<std::future<void>> sends;
+	for(int i = 0; i < count; i++) {
+		sends.push_back(source.asyncSendTo(frames.body(i), slow.getLocalEndpoint(), frames.header(i)));
+	}
+	testSuite.test(sends.back().wait_for(std::chrono::milliseconds(0)) == std::future_status::timeout, "Full inbox test");
+
+	// Sends to another remote do not wait behind the full inbox
+	const int value = 42;
+	auto idle = source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), fast.getLocalEndpoint());
+	testSuite.test(idle.wait_for(std::chrono::seconds(1)) == std::future_status::ready, "Independent remote test");
+	testSuite.equal(fast.asyncReceiveFrom().get().body.size(), sizeof(value), "Independent remote receive test");
+
+	receiveFrames(testSuite, slow, sizes, count, "Slow consumer frame");
+	for(auto& send : sends) {
+		send.get();
+	}
+}
+
+std::uint64_t poolAllocations() {
+	const auto statistics = BufferPool::statistics();
+	return statistics.hits + statistics.misses + statistics.unpooled;
+}
+
+void borrowTest(TestSuite& testSuite) {
+	SharedMemorySocket::Configuration configuration;
+	configuration.ringSize = 256*1024;
+	SharedMemorySocket sink(configuration);
+	sink.bind();
+	SharedMemorySocket source;
+
+	// Large bodies are borrowed from the inbox, until half of it is borrowed. Only the header is allocated then.
+	std::vector<SharedMemorySocket::Datagram> held;
+	std::vector<std::uint64_t> allocations;
+	for(int i = 0; i < 16; i++) {
+		const auto body = frame(48*1024, i);
+		const std::uint32_t header = i;
+		const auto before = poolAllocations();
+		source.asyncSendTo(
+			ImmutableBuffer(body.data(), body.size()),
+			sink.getLocalEndpoint(),
+			ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&header), sizeof(header))
+		).get();
+		held.push_back(sink.asyncReceiveFrom().get());
+		allocations.push_back(poolAllocations() - before);
+		const auto expected = frame(48*1024, i);
+		testSuite.test(std::memcmp(held.back().body.data(), expected.data(), expected.size()) == 0, "Body content test");
+		// A borrowed body holds back the inbox behind it, so the bodies are released again
+		if(i == 2) {
+			held.clear();
+		} else if(i > 2) {
+			held.erase(held.begin(), held.end() - 1);
+		}
+	}
+	testSuite.equal(allocations[0], std::uint64_t(1), "Borrowed body test");
+	testSuite.equal(allocations[1], std::uint64_t(1), "Second borrowed body test");
+	testSuite.equal(allocations[2], std::uint64_t(2), "Copied body test, when half of the inbox is borrowed");
+	testSuite.equal(allocations[3], std::uint64_t(1), "Borrowed body after release test");
+
+	// Borrowed bodies keep the inbox mapped after the socket is closed
+	sink.close();
+	testSuite.equal(held.back().body.data()[0], frame(1, 15)[0], "Borrowed body after close test");
+}
+
+void closedTest(TestSuite& testSuite) {
+	SharedMemorySocket source;
+	Endpoint closedEndpoint;
+	{
+		SharedMemorySocket sink;
+		sink.bind();
+		closedEndpoint = sink.getLocalEndpoint();
+	}
+	bool failed = false;
+	try {
+		const int value = 0;
+		source.asyncSendTo(ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&value), sizeof(value)), closedEndpoint).get();
+	} catch(const std::exception&) {
+		failed = true;
+	}
+	testSuite.test(failed, "Send to closed endpoint test");
+}
+
+struct Value {
+	int value;
+};
+
+void communicatorTest(TestSuite& testSuite) {
+	Communicator<SharedMemorySocket, std::tuple<Value>> sink;
+	sink.bind();
+	Communicator<SharedMemorySocket, std::tuple<Value>> source;
+	source.sendTo(Value { 7 }, sink.getLocalEndpoint());
+	testSuite.equal(sink.receive<Value>().value, 7, "Communicator test");
+}
+
+int main() {
+	// Forking later would copy the threads and locks of the sockets in an unknown state
+	const SourceProcess sourceProcess = forkSourceProcess();
+
+	TestSuite testSuite("SharedMemory");
+
+	threadTest(testSuite);
+	processTest(testSuite, sourceProcess);
+	asyncTest(testSuite);
+	slowConsumerTest(testSuite);
+	borrowTest(testSuite);
+	closedTest(testSuite);
+	communicatorTest(testSuite);
+
+	return 0;
+}
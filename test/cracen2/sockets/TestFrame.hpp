@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "cracen2/network/ImmutableBuffer.hpp"
+#include "cracen2/util/Test.hpp"
+
+/*
+ * Frames of the socket tests. Frame i of a run over frameSizes has a body of frameSizes[i % frameSizes.size()]
+ * bytes seeded with i and its index as an uint32_t header.
+ */
+
+namespace cracen2 {
+
+namespace util {
+
+// Test payload of size bytes, whose content depends on seed and on the position of every byte
+inline std::vector<std::uint8_t> frame(std::size_t size, int seed) {
+	std::vector<std::uint8_t> result(size);
+	for(std::size_t i = 0; i < size; i++) {
+		result[i] = static_cast<std::uint8_t>(seed + i);
+	}
+	return result;
+}
+
+inline std::vector<std::uint8_t> frame(const std::vector<std::size_t>& frameSizes, int i) {
+	return frame(frameSizes[i % frameSizes.size()], i);
+}
+
+// Bodies and headers of count frames, for sends, that are outstanding at the same time
+struct Frames {
+	std::vector<std::vector<std::uint8_t>> bodies;
+	std::vector<std::uint32_t> headers;
+
+	Frames(const std::vector<std::size_t>& frameSizes, int count) {
+		for(int i = 0; i < count; i++) {
+			bodies.push_back(frame(frameSizes, i));
+			headers.push_back(i);
+		}
+	}
+
+	network::ImmutableBuffer body(int i) const {
+		return network::ImmutableBuffer(bodies[i].data(), bodies[i].size());
+	}
+
+	network::ImmutableBuffer header(int i) const {
+		return network::ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&headers[i]), sizeof(std::uint32_t));
+	}
+};
+
+// Checks the header, the size and the content of datagram against frame i
+template <class Datagram>
+void verifyFrame(TestSuite& testSuite, const Datagram& datagram, const std::vector<std::size_t>& frameSizes, int i, const std::string& name) {
+	std::uint32_t header;
+	testSuite.equal(datagram.header.size(), sizeof(header), name + " header size test");
+	if(datagram.header.size() != sizeof(header)) return;
+	std::memcpy(&header, datagram.header.data(), sizeof(header));
+	testSuite.equal(header, std::uint32_t(i), name + " order test");
+
+	const auto expected = frame(frameSizes, i);
+	testSuite.equal(datagram.body.size(), expected.size(), name + " size test");
+	testSuite.test(
+		datagram.body.size() == expected.size() && std::memcmp(datagram.body.data(), expected.data(), expected.size()) == 0,
+		name + " content test for frame " + std::to_string(i)
+	);
+}
+
+// Sends count frames one after the other
+template <class Socket>
+void sendFrames(Socket& source, const typename Socket::Endpoint& sink, const std::vector<std::size_t>& frameSizes, int count) {
+	for(int i = 0; i < count; i++) {
+		const auto body = frame(frameSizes, i);
+		const std::uint32_t header = i;
+		source.asyncSendTo(
+			network::ImmutableBuffer(body.data(), body.size()),
+			sink,
+			network::ImmutableBuffer(reinterpret_cast<const std::uint8_t*>(&header), sizeof(header))
+		).get();
+	}
+}
+
+// Receives count frames, that must arrive in order. Returns the remote of the last one.
+template <class Socket>
+typename Socket::Endpoint receiveFrames(TestSuite& testSuite, Socket& sink, const std::vector<std::size_t>& frameSizes, int count, const std::string& name) {
+	typename Socket::Endpoint remote;
+	for(int i = 0; i < count; i++) {
+		auto datagram = sink.asyncReceiveFrom().get();
+		remote = datagram.remote;
+		verifyFrame(testSuite, datagram, frameSizes, i, name);
+	}
+	return remote;
+}
+
+} // End of namespace util
+
+} // End of namespace cracen2